@@ -1,7 +1,136 @@
 #version 450
 
+// Must match clustered_lighting.h
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_MAX_LIGHTS 127
+#define CLUSTER_STRIDE (CLUSTER_MAX_LIGHTS + 1)
+#define LIGHT_TYPE_SPOT 1.0
+// Must match shadow_atlas.h
+#define SHADOW_MAX_TILES 64
+#define SHADOW_ATLAS_SIZE 4096.0
+// Must match MaterialFeature in main.c
+#define MATERIAL_DIRECTIONAL 1u
+#define MATERIAL_CLUSTERED_LIGHTS 2u
+#define MATERIAL_SHADOWS 4u
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+  mat4 view_proj;
+  mat4 view;
+  vec4 time;
+  vec4 screen;
+  vec4 cluster_depth;
+  uvec4 light_count;
+} frame;
+
+layout(set = 0, binding = 1) uniform DrawUniforms {
+  vec4 color;
+  vec4 mesh_center;
+  vec4 mesh_extent;
+} draw;
+
+struct Light {
+  vec4 position_radius;
+  vec4 color_type;
+  vec4 direction_cone;
+  vec4 shadow;
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer Lights {
+  Light lights[];
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer Clusters {
+  uint clusters[];
+};
+
+layout(set = 0, binding = 5) uniform ShadowUniforms {
+  mat4 view_proj[SHADOW_MAX_TILES];
+  vec4 rect[SHADOW_MAX_TILES]; // Offset and scale of the tile in atlas coordinates
+} shadows;
+
+layout(set = 0, binding = 6) uniform sampler2DShadow shadow_atlas;
+
+// Specialization constants, see MaterialConstant in main.c
+layout(constant_id = 1) const uint SHADOW_FILTER_TAPS = 2u; // Per axis
+
+#ifdef UBERSHADER
+// Generic variant drawn while the specialized pipeline compiles, the features are pushed per draw
+layout(push_constant) uniform Material {
+  layout(offset = 64) uvec4 features;
+} material;
+#define FEATURES material.features.x
+#else
+layout(constant_id = 0) const uint MATERIAL_FEATURES = MATERIAL_DIRECTIONAL | MATERIAL_CLUSTERED_LIGHTS | MATERIAL_SHADOWS;
+#define FEATURES MATERIAL_FEATURES
+#endif
+
+layout(location = 0) in vec3 inNormal;
+layout(location = 1) in vec2 inUV;
+layout(location = 2) in vec3 inWorldPosition;
+
 layout(location = 0) out vec4 outColor;
 
+// NxN comparisons, each filtered by the sampler where supported, kept inside the tile
+float sample_shadow(uint tile, vec3 position) {
+  vec4 clip = shadows.view_proj[tile] * vec4(position, 1.0);
+  vec3 ndc = clip.xyz / clip.w;
+  vec4 rect = shadows.rect[tile];
+  vec2 texel = vec2(1.0 / SHADOW_ATLAS_SIZE);
+  vec2 lo = rect.xy + texel;
+  vec2 hi = rect.xy + rect.zw - texel;
+  vec2 uv = rect.xy + (ndc.xy * 0.5 + 0.5) * rect.zw;
+
+  float lit = 0.0;
+  float center = 0.5 * float(SHADOW_FILTER_TAPS - 1);
+  for (uint y = 0; y < SHADOW_FILTER_TAPS; y++) {
+    for (uint x = 0; x < SHADOW_FILTER_TAPS; x++) {
+      vec2 offset = vec2(float(x) - center, float(y) - center) * texel;
+      lit += texture(shadow_atlas, vec3(clamp(uv + offset, lo, hi), ndc.z));
+    }
+  }
+  return lit / float(SHADOW_FILTER_TAPS * SHADOW_FILTER_TAPS);
+}
+
 void main() {
-  outColor = vec4(1.0, 0.0, 0.0, 1.0);
-}
\ No newline at end of file
+  vec3 normal = normalize(inNormal);
+  vec3 light_direction = normalize(vec3(0.4, 0.6, 0.7));
+  vec3 lighting = vec3(0.1);
+  if ((FEATURES & MATERIAL_DIRECTIONAL) != 0u) {
+    lighting += 0.2 * max(dot(normal, light_direction), 0.0);
+  }
+
+  float depth = -(frame.view * vec4(inWorldPosition, 1.0)).z;
+  // HDR target: alpha carries the linear view depth for the post-processing, see post_process.h
+  if ((FEATURES & MATERIAL_CLUSTERED_LIGHTS) == 0u) {
+    outColor = vec4(draw.color.rgb * lighting, depth);
+    return;
+  }
+
+  uvec2 tile = uvec2(gl_FragCoord.xy / frame.screen.xy * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y));
+  uint slice = uint(clamp(log(depth) * frame.cluster_depth.z + frame.cluster_depth.w, 0.0, float(CLUSTER_GRID_Z - 1)));
+  uint cluster = (slice * CLUSTER_GRID_Y + min(tile.y, uint(CLUSTER_GRID_Y - 1))) * CLUSTER_GRID_X + min(tile.x, uint(CLUSTER_GRID_X - 1));
+
+  uint base = cluster * CLUSTER_STRIDE;
+  uint count = clusters[base];
+  for (uint i = 0; i < count; i++) {
+    Light light = lights[clusters[base + 1 + i]];
+    vec3 to_light = light.position_radius.xyz - inWorldPosition;
+    float dist = length(to_light);
+    vec3 l = to_light / dist;
+
+    float falloff = clamp(1.0 - (dist * dist) / (light.position_radius.w * light.position_radius.w), 0.0, 1.0);
+    float attenuation = falloff * falloff;
+    if (light.color_type.w == LIGHT_TYPE_SPOT) {
+      float cos_angle = dot(-l, light.direction_cone.xyz);
+      attenuation *= smoothstep(light.direction_cone.w, light.direction_cone.w + 0.05, cos_angle);
+      if ((FEATURES & MATERIAL_SHADOWS) != 0u && light.shadow.x >= 0.0 && attenuation > 0.0) {
+        attenuation *= sample_shadow(uint(light.shadow.x), inWorldPosition);
+      }
+    }
+    lighting += light.color_type.rgb * attenuation * max(dot(normal, l), 0.0);
+  }
+
+  outColor = vec4(draw.color.rgb * lighting, depth);
+}
@@ -1,11 +1,43 @@
 #version 450
 
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec4 inNormal;
+layout(location = 2) in vec2 inUV;
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+  mat4 view_proj;
+  mat4 view;
+  vec4 time;
+  vec4 screen;
+  vec4 cluster_depth;
+  uvec4 light_count;
+} frame;
+
+layout(set = 0, binding = 1) uniform DrawUniforms {
+  vec4 color;
+  vec4 mesh_center;
+  vec4 mesh_extent;
+} draw;
+
+layout(std430, set = 0, binding = 2) readonly buffer Instances {
+  mat4 world[];
+} instances;
+
+layout(location = 0) out vec3 outNormal;
+layout(location = 1) out vec2 outUV;
+layout(location = 2) out vec3 outWorldPosition;
+
+// The depth pre-pass and the color pass must produce the exact same depth for the EQUAL test
+invariant gl_Position;
+
 void main() {
-  vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-  );
-
-  gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-}
\ No newline at end of file
+  mat4 world = instances.world[gl_InstanceIndex];
+  vec3 position = inPosition.xyz * draw.mesh_extent.xyz + draw.mesh_center.xyz;
+
+  vec4 world_position = world * vec4(position, 1.0);
+
+  outNormal = mat3(world) * inNormal.xyz;
+  outUV = inUV;
+  outWorldPosition = world_position.xyz;
+  gl_Position = frame.view_proj * world_position;
+}
@@ -0,0 +1,23 @@
+#version 450
+
+// Depth only rendering of the instances into a shadow atlas tile
+layout(location = 0) in vec4 inPosition;
+
+layout(set = 0, binding = 1) uniform DrawUniforms {
+  vec4 color;
+  vec4 mesh_center;
+  vec4 mesh_extent;
+} draw;
+
+layout(std430, set = 0, binding = 2) readonly buffer Instances {
+  mat4 world[];
+} instances;
+
+layout(push_constant) uniform ShadowConstants {
+  mat4 view_proj;
+} shadow;
+
+void main() {
+  vec3 position = inPosition.xyz * draw.mesh_extent.xyz + draw.mesh_center.xyz;
+  gl_Position = shadow.view_proj * instances.world[gl_InstanceIndex] * vec4(position, 1.0);
+}
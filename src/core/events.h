@@ -57,6 +57,8 @@ b8 event_fire(u16 code, void* sender, EventContext data);
 typedef enum SystemEventCode {
     EVENT_CODE_APPLICATION_QUIT = 0x01,
     EVENT_CODE_RESIZED = 0x02,
+    // u8[0]: TRUE while the compositor suspended repaints, u8[1]: TRUE while the window is activated
+    EVENT_CODE_WINDOW_STATE = 0x03,
 
     MAX_EVENT_CODE = 0xFF
 } SystemEventCode;
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "jobs.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define MAX_WORKERS 64
+
+typedef struct parallel_job {
+  PFN_job_range callback;
+  void* user_data;
+  u32 count;
+  u32 batch_size;
+  u32 batch_count;
+  atomic_uint next_batch;
+  atomic_uint finished_batches;
+} parallel_job;
+
+typedef struct jobs_state {
+  b8 initialized;
+  b8 quit;
+  u32 worker_count;
+  pthread_t workers[MAX_WORKERS];
+
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  // Bumped for every published job so sleeping workers can tell a new one arrived.
+  u64 generation;
+  parallel_job* current;
+  // Workers still holding a pointer to current, the job lives on the caller's stack.
+  u32 active;
+} jobs_state;
+
+static jobs_state state;
+
+static void run_batches(parallel_job* job) {
+  for (;;)
+  {
+    u32 batch = atomic_fetch_add(&job->next_batch, 1);
+    if (batch >= job->batch_count) return;
+
+    u32 begin = batch * job->batch_size;
+    u32 end = begin + job->batch_size;
+    if (end > job->count) end = job->count;
+    TraceZone zone = trace_begin("job", TRACE_COLOR_DEFAULT);
+    job->callback(job->user_data, begin, end);
+    trace_end(zone);
+
+    atomic_fetch_add(&job->finished_batches, 1);
+  }
+}
+
+static void* worker_main(void* arg) {
+  u64 seen_generation = 0;
+  trace_set_thread_name("job worker");
+
+  pthread_mutex_lock(&state.mutex);
+  for (;;)
+  {
+    while (!state.quit && state.generation == seen_generation) {
+      pthread_cond_wait(&state.wake, &state.mutex);
+    }
+    if (state.quit) break;
+
+    seen_generation = state.generation;
+    parallel_job* job = state.current;
+    if (!job) continue;
+    state.active++;
+    pthread_mutex_unlock(&state.mutex);
+
+    run_batches(job);
+
+    pthread_mutex_lock(&state.mutex);
+    state.active--;
+    pthread_cond_signal(&state.done);
+  }
+  pthread_mutex_unlock(&state.mutex);
+
+  return 0;
+}
+
+b8 jobs_initialize(u32 worker_count) {
+  if (state.initialized) return true;
+
+  if (worker_count == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    worker_count = cpus > 1 ? (u32)cpus - 1 : 0;
+  }
+  if (worker_count > MAX_WORKERS) worker_count = MAX_WORKERS;
+
+  pthread_mutex_init(&state.mutex, 0);
+  pthread_cond_init(&state.wake, 0);
+  pthread_cond_init(&state.done, 0);
+  state.quit = false;
+  state.generation = 0;
+  state.current = 0;
+  state.active = 0;
+
+  for (u32 i = 0; i < worker_count; i++)
+  {
+    if (pthread_create(&state.workers[i], 0, worker_main, 0) != 0) {
+      printf("Failed to create worker thread %u\n", i);
+      break;
+    }
+    state.worker_count++;
+  }
+
+  state.initialized = true;
+  printf("Job system initialized with %u workers!\n", state.worker_count);
+  return true;
+}
+
+void jobs_shutdown() {
+  if (!state.initialized) return;
+
+  pthread_mutex_lock(&state.mutex);
+  state.quit = true;
+  pthread_cond_broadcast(&state.wake);
+  pthread_mutex_unlock(&state.mutex);
+
+  for (u32 i = 0; i < state.worker_count; i++)
+  {
+    pthread_join(state.workers[i], 0);
+  }
+
+  pthread_cond_destroy(&state.done);
+  pthread_cond_destroy(&state.wake);
+  pthread_mutex_destroy(&state.mutex);
+  state.worker_count = 0;
+  state.initialized = false;
+}
+
+u32 jobs_thread_count() {
+  return state.worker_count + 1;
+}
+
+void jobs_parallel_for(u32 count, u32 min_batch, PFN_job_range job, void* user_data) {
+  if (count == 0) return;
+  if (min_batch == 0) min_batch = 1;
+
+  // Aim for a few batches per thread so uneven batches balance out
+  u32 batch_size = count / (jobs_thread_count() * 4);
+  if (batch_size < min_batch) batch_size = min_batch;
+
+  if (!state.initialized || state.worker_count == 0 || batch_size >= count) {
+    job(user_data, 0, count);
+    return;
+  }
+
+  parallel_job parallel = {0};
+  parallel.callback = job;
+  parallel.user_data = user_data;
+  parallel.count = count;
+  parallel.batch_size = batch_size;
+  parallel.batch_count = (count + batch_size - 1) / batch_size;
+  atomic_init(&parallel.next_batch, 0);
+  atomic_init(&parallel.finished_batches, 0);
+
+  pthread_mutex_lock(&state.mutex);
+  state.current = &parallel;
+  state.generation++;
+  pthread_cond_broadcast(&state.wake);
+  pthread_mutex_unlock(&state.mutex);
+
+  run_batches(&parallel);
+
+  pthread_mutex_lock(&state.mutex);
+  while (atomic_load(&parallel.finished_batches) < parallel.batch_count || state.active > 0) {
+    pthread_cond_wait(&state.done, &state.mutex);
+  }
+  state.current = 0;
+  pthread_mutex_unlock(&state.mutex);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "defines.h"
+
+/**
+ * Callback invoked by a worker for the half open index range [begin, end).
+ */
+typedef void (*PFN_job_range)(void* user_data, u32 begin, u32 end);
+
+/**
+ * Starts the worker threads.
+ * @param worker_count The number of worker threads. 0 picks one less than the number of online CPUs.
+ * @returns TRUE on success.
+ */
+b8 jobs_initialize(u32 worker_count);
+void jobs_shutdown();
+
+/**
+ * @returns The number of threads that take part in a parallel for, including the caller.
+ */
+u32 jobs_thread_count();
+
+/**
+ * Splits [0, count) into batches of at least min_batch indices and runs them on the workers.
+ * The calling thread takes batches as well and the call returns once every batch finished.
+ * Runs inline when the job system is not initialized or the range fits in a single batch.
+ * @param count The number of indices.
+ * @param min_batch The smallest batch worth handing to another thread.
+ * @param job The callback to run for each batch.
+ * @param user_data Passed through to the callback.
+ */
+void jobs_parallel_for(u32 count, u32 min_batch, PFN_job_range job, void* user_data);
@@ -0,0 +1,37 @@
+#pragma once
+#include "defines.h"
+
+typedef union Vec2 {
+  f32 elements[2];
+  struct { f32 x, y; };
+} Vec2;
+
+typedef union Vec3 {
+  f32 elements[3];
+  struct { f32 x, y, z; };
+} Vec3;
+
+typedef union Vec4 {
+  f32 elements[4];
+  struct { f32 x, y, z, w; };
+} __attribute__((aligned(16))) Vec4;
+
+// Rotation quaternion, xyz is the vector part and w the scalar part.
+typedef Vec4 Quat;
+
+// Column major, data[column * 4 + row], matching GLSL mat4.
+typedef union Mat4 {
+  f32 data[16];
+  Vec4 columns[4];
+} __attribute__((aligned(16))) Mat4;
+
+typedef struct Aabb {
+  Vec3 min;
+  Vec3 max;
+} Aabb;
+
+// Planes point inwards: xyz is the normal and w the distance, a point p is inside a plane
+// when dot(xyz, p) + w >= 0.
+typedef struct Frustum {
+  Vec4 planes[6];
+} Frustum;
@@ -0,0 +1,195 @@
+#include "startup.h"
+#include "trace.h"
+#include "platform/platform.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct startup_state {
+  Startup* startup;
+  pthread_mutex_t mutex;
+  pthread_cond_t changed;
+  u32 started_count;
+  u32 finished;  // Bits of the finished steps
+  u32 locks;     // Locks held by running steps
+  b8 failed;
+  f64 begin;
+} startup_state;
+
+typedef struct startup_thread {
+  startup_state* state;
+  u32 index;
+} startup_thread;
+
+// The first step in order whose dependencies finished and whose locks are free, -1 if none
+static i32 next_step(startup_state* state) {
+  Startup* startup = state->startup;
+  for (u32 i = 0; i < startup->step_count; i++)
+  {
+    StartupStep* step = &startup->steps[i];
+    if (!step->started && (step->dependencies & ~state->finished) == 0 && (step->locks & state->locks) == 0) {
+      return (i32)i;
+    }
+  }
+  return -1;
+}
+
+// Dependencies always come earlier, so when no step is ready another one is running and the
+// wait ends when it finishes
+static void run_steps(startup_state* state, u32 thread) {
+  Startup* startup = state->startup;
+
+  pthread_mutex_lock(&state->mutex);
+  while (!state->failed && state->started_count < startup->step_count)
+  {
+    i32 index = next_step(state);
+    if (index < 0) {
+      pthread_cond_wait(&state->changed, &state->mutex);
+      continue;
+    }
+
+    StartupStep* step = &startup->steps[index];
+    step->started = true;
+    step->thread = thread;
+    state->started_count++;
+    state->locks |= step->locks;
+    pthread_mutex_unlock(&state->mutex);
+
+    TraceZone zone = trace_begin(step->name, TRACE_COLOR_DEFAULT);
+    step->start = platform_get_absolute_time() - state->begin;
+    b8 result = step->run();
+    step->end = platform_get_absolute_time() - state->begin;
+    trace_end(zone);
+
+    pthread_mutex_lock(&state->mutex);
+    step->finished = true;
+    step->failed = !result;
+    state->finished |= 1u << index;
+    state->locks &= ~step->locks;
+    state->failed |= !result;
+    pthread_cond_broadcast(&state->changed);
+  }
+  pthread_mutex_unlock(&state->mutex);
+}
+
+static void* thread_main(void* arg) {
+  startup_thread* thread = arg;
+  char name[32];
+  snprintf(name, sizeof(name), "startup %u", thread->index);
+  trace_set_thread_name(name);
+  run_steps(thread->state, thread->index);
+  return 0;
+}
+
+void startup_create(Startup* startup) {
+  memset(startup, 0, sizeof(Startup));
+}
+
+u32 startup_add(Startup* startup, const char* name, PFN_startup_step run, u32 dependencies, u32 locks) {
+  if (startup->step_count >= STARTUP_MAX_STEPS) {
+    printf("Startup: more than %d steps, %s is dropped\n", STARTUP_MAX_STEPS, name);
+    return 0;
+  }
+
+  u32 index = startup->step_count++;
+  StartupStep* step = &startup->steps[index];
+  memset(step, 0, sizeof(StartupStep));
+  step->name = name;
+  step->run = run;
+  step->dependencies = dependencies;
+  step->locks = locks;
+  return 1u << index;
+}
+
+b8 startup_run(Startup* startup, u32 thread_count) {
+  startup_state state = {0};
+  state.startup = startup;
+  pthread_mutex_init(&state.mutex, 0);
+  pthread_cond_init(&state.changed, 0);
+  state.begin = platform_get_absolute_time();
+
+  if (thread_count < 1) thread_count = 1;
+  if (thread_count > STARTUP_MAX_THREADS) thread_count = STARTUP_MAX_THREADS;
+  if (thread_count > startup->step_count) thread_count = startup->step_count;
+
+  // A thread that could not be started leaves its steps to the others
+  pthread_t threads[STARTUP_MAX_THREADS];
+  startup_thread thread_args[STARTUP_MAX_THREADS];
+  u32 started_threads = 0;
+  for (u32 i = 1; i < thread_count; i++)
+  {
+    thread_args[started_threads] = (startup_thread){&state, i};
+    if (pthread_create(&threads[started_threads], 0, thread_main, &thread_args[started_threads]) == 0) {
+      started_threads++;
+    }
+  }
+  startup->thread_count = started_threads + 1;
+
+  run_steps(&state, 0);
+  for (u32 i = 0; i < started_threads; i++)
+  {
+    pthread_join(threads[i], 0);
+  }
+
+  startup->seconds = platform_get_absolute_time() - state.begin;
+  pthread_cond_destroy(&state.changed);
+  pthread_mutex_destroy(&state.mutex);
+  return !state.failed;
+}
+
+void startup_report(Startup* startup) {
+  // Longest chain of finished steps ending in each step, dependencies come first
+  f64 path[STARTUP_MAX_STEPS];
+  i32 previous[STARTUP_MAX_STEPS];
+  f64 total = 0.0;
+  i32 last = -1;
+  for (u32 i = 0; i < startup->step_count; i++)
+  {
+    StartupStep* step = &startup->steps[i];
+    path[i] = 0.0;
+    previous[i] = -1;
+    if (!step->finished) continue;
+
+    for (u32 d = 0; d < i; d++)
+    {
+      if ((step->dependencies & (1u << d)) && startup->steps[d].finished && path[d] > path[i]) {
+        path[i] = path[d];
+        previous[i] = (i32)d;
+      }
+    }
+    f64 duration = step->end - step->start;
+    path[i] += duration;
+    total += duration;
+    if (last < 0 || path[i] > path[last]) last = (i32)i;
+  }
+
+  printf("Startup: %.2f ms on %u threads, the steps took %.2f ms\n", startup->seconds * 1000.0,
+    startup->thread_count, total * 1000.0);
+  for (u32 i = 0; i < startup->step_count; i++)
+  {
+    StartupStep* step = &startup->steps[i];
+    if (!step->started) {
+      printf("  %-20s not started\n", step->name);
+      continue;
+    }
+    printf("  %-20s %8.2f ms at %8.2f ms on thread %u%s\n", step->name, (step->end - step->start) * 1000.0,
+      step->start * 1000.0, step->thread, step->failed ? " FAILED" : "");
+  }
+
+  if (last < 0) {
+    return;
+  }
+  // The chain is collected backwards from its last step
+  i32 chain[STARTUP_MAX_STEPS];
+  u32 chain_length = 0;
+  for (i32 i = last; i >= 0; i = previous[i])
+  {
+    chain[chain_length++] = i;
+  }
+  printf("  critical path %.2f ms:", path[last] * 1000.0);
+  while (chain_length > 0)
+  {
+    printf(" %s", startup->steps[chain[--chain_length]].name);
+  }
+  printf("\n");
+}
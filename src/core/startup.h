@@ -0,0 +1,61 @@
+#pragma once
+#include "defines.h"
+
+#define STARTUP_MAX_STEPS 32
+#define STARTUP_MAX_THREADS 8
+
+/**
+ * A step of the startup, FALSE stops the startup: steps already running finish, no other starts.
+ */
+typedef b8 (*PFN_startup_step)();
+
+typedef struct StartupStep {
+  const char* name;
+  PFN_startup_step run;
+  u32 dependencies; // Steps that must have finished, as returned by startup_add
+  u32 locks;        // Steps sharing a bit never run at the same time
+
+  // Filled in by startup_run, in seconds since it began
+  f64 start;
+  f64 end;
+  u32 thread;       // 0 is the thread that called startup_run
+  b8 started;
+  b8 finished;
+  b8 failed;
+} StartupStep;
+
+/**
+ * The steps of the startup and what they wait for. Independent steps run on their own threads,
+ * so that waiting on the driver or the compositor in one step overlaps with the work of another.
+ */
+typedef struct Startup {
+  StartupStep steps[STARTUP_MAX_STEPS];
+  u32 step_count;
+  u32 thread_count;
+  f64 seconds; // Wall time of startup_run
+} Startup;
+
+void startup_create(Startup* startup);
+
+/**
+ * Adds a step. Dependencies are steps added before, so the steps can never wait on each other.
+ * @param dependencies The bits of the steps to wait for, 0 for none.
+ * @param locks Bits of the resources the step uses without synchronization of its own.
+ * @returns The bit of the step to pass as a dependency of later ones.
+ */
+u32 startup_add(Startup* startup, const char* name, PFN_startup_step run, u32 dependencies, u32 locks);
+
+/**
+ * Runs every step once its dependencies finished and its locks are free. The calling thread
+ * runs steps as well and the call returns once no step is running anymore.
+ * @param thread_count Threads running steps, including the caller. 1 runs the steps one after
+ * the other in the order they were added.
+ * @returns TRUE if every step succeeded.
+ */
+b8 startup_run(Startup* startup, u32 thread_count);
+
+/**
+ * Prints when every step ran, how long the steps took in total and the longest chain of
+ * dependent steps, the lower bound of the startup however many threads it gets.
+ */
+void startup_report(Startup* startup);
@@ -0,0 +1,212 @@
+#include "trace.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Tracks show up as threads with ids no real thread has
+#define TRACK_THREAD_ID 0x7fff0000u
+
+typedef struct trace_event {
+  const char* name;
+  f64 start;
+  f64 end;    // The value of counters
+  u32 track;
+  TraceColor color;
+  b8 counter;
+} trace_event;
+
+typedef struct trace_buffer {
+  u32 thread_id;
+  char thread_name[32];
+  // Events ever recorded by the thread, the last TRACE_EVENTS_PER_THREAD of them are kept. Only
+  // the thread writes, each event is complete before the count that covers it is published.
+  atomic_ullong written;
+  trace_event events[TRACE_EVENTS_PER_THREAD];
+} trace_buffer;
+
+typedef struct trace_state {
+  b8 enabled;
+  f64 begin;
+  atomic_uint buffer_count;
+  _Atomic(trace_buffer*) buffers[TRACE_MAX_THREADS];
+  atomic_uint track_count;
+  const char* tracks[TRACE_MAX_TRACKS]; // Track 0 is the recording thread itself
+} trace_state;
+
+static trace_state state;
+static _Thread_local trace_buffer* local_buffer;
+static _Thread_local b8 local_failed; // No buffer could be registered for the thread
+
+// The clock of platform_get_absolute_time, read here so that tools linking the core without the
+// platform layer can record zones too
+static f64 now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 0.000000001;
+}
+
+static const char* color_names[TRACE_COLOR_COUNT] = {"", "good", "bad", "terrible", "yellow", "olive", "grey"};
+
+static trace_buffer* thread_buffer() {
+  if (local_buffer || local_failed) return local_buffer;
+
+  u32 index = atomic_fetch_add(&state.buffer_count, 1);
+  trace_buffer* buffer = index < TRACE_MAX_THREADS ? calloc(1, sizeof(trace_buffer)) : NULL;
+  if (!buffer) {
+    local_failed = true;
+    return NULL;
+  }
+  buffer->thread_id = (u32)syscall(SYS_gettid);
+  snprintf(buffer->thread_name, sizeof(buffer->thread_name), "thread %u", buffer->thread_id);
+  atomic_store_explicit(&state.buffers[index], buffer, memory_order_release);
+  local_buffer = buffer;
+  return buffer;
+}
+
+static void push(const char* name, TraceColor color, f64 start, f64 end, u32 track, b8 counter) {
+  trace_buffer* buffer = thread_buffer();
+  if (!buffer) return;
+
+  u64 index = atomic_load_explicit(&buffer->written, memory_order_relaxed);
+  buffer->events[index % TRACE_EVENTS_PER_THREAD] = (trace_event){name, start, end, track, color, counter};
+  atomic_store_explicit(&buffer->written, index + 1, memory_order_release);
+}
+
+void trace_initialize() {
+  state.begin = now();
+  state.enabled = true;
+}
+
+void trace_shutdown() {
+  state.enabled = false;
+  u32 buffer_count = atomic_load(&state.buffer_count);
+  for (u32 i = 0; i < buffer_count && i < TRACE_MAX_THREADS; i++)
+  {
+    free(atomic_load(&state.buffers[i]));
+    atomic_store(&state.buffers[i], NULL);
+  }
+  atomic_store(&state.buffer_count, 0);
+  local_buffer = NULL;
+}
+
+b8 trace_enabled() {
+  return state.enabled;
+}
+
+void trace_set_thread_name(const char* name) {
+  if (!state.enabled) return;
+  trace_buffer* buffer = thread_buffer();
+  if (buffer) strncpy(buffer->thread_name, name, sizeof(buffer->thread_name) - 1);
+}
+
+TraceZone trace_begin(const char* name, TraceColor color) {
+  TraceZone zone = {0};
+  if (!state.enabled) return zone;
+  zone.name = name;
+  zone.color = color;
+  zone.start = now();
+  return zone;
+}
+
+void trace_end(TraceZone zone) {
+  if (!zone.name || !state.enabled) return;
+  push(zone.name, zone.color, zone.start, now(), 0, false);
+}
+
+void trace_end_scope(TraceZone* zone) {
+  trace_end(*zone);
+}
+
+u32 trace_track(const char* name) {
+  if (!state.enabled) return 0;
+  u32 track = atomic_fetch_add(&state.track_count, 1) + 1;
+  if (track >= TRACE_MAX_TRACKS) return 0;
+  state.tracks[track] = name;
+  return track;
+}
+
+void trace_record(u32 track, const char* name, TraceColor color, f64 start, f64 end) {
+  if (!state.enabled) return;
+  push(name, color, start, end, track < TRACE_MAX_TRACKS ? track : 0, false);
+}
+
+void trace_counter(const char* name, f64 value) {
+  if (!state.enabled) return;
+  push(name, TRACE_COLOR_DEFAULT, now(), value, 0, true);
+}
+
+static void write_string(FILE* file, const char* string) {
+  for (const char* c = string; *c; c++)
+  {
+    if (*c == '"' || *c == '\\') fputc('\\', file);
+    if ((u8)*c < 0x20) continue;
+    fputc(*c, file);
+  }
+}
+
+static void write_thread_name(FILE* file, b8* first, u32 pid, u32 thread_id, const char* name) {
+  fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %u, \"tid\": %u, \"args\": {\"name\": \"",
+    *first ? "" : ",\n", pid, thread_id);
+  write_string(file, name);
+  fprintf(file, "\"}}");
+  *first = false;
+}
+
+b8 trace_write(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    printf("Failed to open %s for writing\n", path);
+    return false;
+  }
+
+  u32 pid = (u32)getpid();
+  b8 first = true;
+  u64 zone_count = 0;
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+  u32 track_count = atomic_load(&state.track_count) + 1;
+  for (u32 t = 1; t < track_count && t < TRACE_MAX_TRACKS; t++)
+  {
+    write_thread_name(file, &first, pid, TRACK_THREAD_ID + t, state.tracks[t]);
+  }
+
+  u32 buffer_count = atomic_load(&state.buffer_count);
+  for (u32 b = 0; b < buffer_count && b < TRACE_MAX_THREADS; b++)
+  {
+    trace_buffer* buffer = atomic_load_explicit(&state.buffers[b], memory_order_acquire);
+    if (!buffer) continue;
+    write_thread_name(file, &first, pid, buffer->thread_id, buffer->thread_name);
+
+    u64 written = atomic_load_explicit(&buffer->written, memory_order_acquire);
+    u64 oldest = written > TRACE_EVENTS_PER_THREAD ? written - TRACE_EVENTS_PER_THREAD : 0;
+    for (u64 i = oldest; i < written; i++)
+    {
+      trace_event* event = &buffer->events[i % TRACE_EVENTS_PER_THREAD];
+      if (event->counter) {
+        fprintf(file, ",\n{\"name\": \"");
+        write_string(file, event->name);
+        fprintf(file, "\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": %u, \"args\": {\"value\": %.3f}}",
+          (event->start - state.begin) * 1e6, pid, event->end);
+        continue;
+      }
+      u32 thread_id = event->track ? TRACK_THREAD_ID + event->track : buffer->thread_id;
+      fprintf(file, ",\n{\"name\": \"");
+      write_string(file, event->name);
+      fprintf(file, "\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %u, \"tid\": %u",
+        (event->start - state.begin) * 1e6, (event->end - event->start) * 1e6, pid, thread_id);
+      if (event->color != TRACE_COLOR_DEFAULT) fprintf(file, ", \"cname\": \"%s\"", color_names[event->color]);
+      fprintf(file, "}");
+      zone_count++;
+    }
+  }
+  fprintf(file, "\n]}\n");
+  b8 result = !ferror(file);
+  fclose(file);
+
+  printf("Trace: %llu zones written to %s\n", (unsigned long long)zone_count, path);
+  return result;
+}
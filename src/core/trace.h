@@ -0,0 +1,84 @@
+#pragma once
+#include "defines.h"
+
+#define TRACE_MAX_THREADS 64
+#define TRACE_MAX_TRACKS 8
+#define TRACE_EVENTS_PER_THREAD (64 * 1024) // The most recent ones are kept
+
+// Reserved colors of the Chrome trace viewer, Perfetto picks its own
+typedef enum TraceColor {
+  TRACE_COLOR_DEFAULT,
+  TRACE_COLOR_GOOD,     // Green
+  TRACE_COLOR_BAD,      // Orange, waits that may stall
+  TRACE_COLOR_TERRIBLE, // Red
+  TRACE_COLOR_YELLOW,
+  TRACE_COLOR_OLIVE,
+  TRACE_COLOR_GREY,
+  TRACE_COLOR_COUNT
+} TraceColor;
+
+typedef struct TraceZone {
+  const char* name; // NULL when tracing is off
+  TraceColor color;
+  f64 start;
+} TraceZone;
+
+/**
+ * Starts recording. Without it every call is a cheap no-op. Zones are recorded into a buffer per
+ * thread that only the thread writes to, no locks are taken.
+ */
+void trace_initialize();
+
+/**
+ * Frees the buffers, no thread may record anymore.
+ */
+void trace_shutdown();
+
+b8 trace_enabled();
+
+/**
+ * Names the calling thread in the trace, threads are named by their id otherwise.
+ */
+void trace_set_thread_name(const char* name);
+
+/**
+ * Opens a zone on the calling thread, closed by trace_end on the same thread.
+ * @param name Must stay valid until the trace is written, e.g. a string literal.
+ */
+TraceZone trace_begin(const char* name, TraceColor color);
+void trace_end(TraceZone zone);
+
+void trace_end_scope(TraceZone* zone);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// A zone closed when the enclosing scope is left, returns included
+#define TRACE_SCOPE(name, color) \
+  TraceZone TRACE_CONCAT(trace_zone_, __LINE__) __attribute__((cleanup(trace_end_scope))) = trace_begin(name, color)
+
+/**
+ * Registers a track for zones that do not run on a CPU thread, e.g. a GPU queue.
+ * @returns The track to pass to trace_record, 0 if there is no room or tracing is off.
+ */
+u32 trace_track(const char* name);
+
+/**
+ * Records a zone that already ended on a track, from the calling thread.
+ * @param track As returned by trace_track, 0 records on the calling thread.
+ * @param start In seconds of platform_get_absolute_time.
+ */
+void trace_record(u32 track, const char* name, TraceColor color, f64 start, f64 end);
+
+/**
+ * Records the value of a counter at the current time, shown as a graph over the timeline.
+ * @param name Must stay valid until the trace is written, e.g. a string literal.
+ */
+void trace_counter(const char* name, f64 value);
+
+/**
+ * Writes every recorded zone as Chrome trace JSON, for chrome://tracing or ui.perfetto.dev.
+ * Threads recording at the same time can tear the oldest zones of their buffer, so call it while
+ * the others are idle, e.g. between frames.
+ * @returns TRUE on success.
+ */
+b8 trace_write(const char* path);
@@ -0,0 +1,492 @@
+#include "vmath.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+  #define VMATH_X86
+  #include <immintrin.h>
+  #define AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+static i32 simd_level = -1;
+
+static SimdLevel detect_simd_level() {
+#ifdef VMATH_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return SIMD_LEVEL_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SIMD_LEVEL_SSE;
+  }
+#endif
+  return SIMD_LEVEL_SCALAR;
+}
+
+SimdLevel vmath_simd_level() {
+  if (simd_level < 0) {
+    simd_level = detect_simd_level();
+  }
+  return (SimdLevel)simd_level;
+}
+
+void vmath_set_simd_level(SimdLevel level) {
+  SimdLevel supported = detect_simd_level();
+  simd_level = level > supported ? supported : level;
+}
+
+const char* vmath_simd_level_name(SimdLevel level) {
+  switch (level) {
+    case SIMD_LEVEL_AVX2: return "avx2";
+    case SIMD_LEVEL_SSE: return "sse";
+    default: return "scalar";
+  }
+}
+
+Frustum frustum_from_mat4(const Mat4* m) {
+  // Rows of the matrix, column major storage
+  Vec4 row[4];
+  for (u32 r = 0; r < 4; r++)
+  {
+    row[r] = vec4_create(m->data[r], m->data[4 + r], m->data[8 + r], m->data[12 + r]);
+  }
+
+  Frustum f;
+  f.planes[0] = vec4_add(row[3], row[0]);
+  f.planes[1] = vec4_add(row[3], vec4_mul_scalar(row[0], -1.0f));
+  f.planes[2] = vec4_add(row[3], row[1]);
+  f.planes[3] = vec4_add(row[3], vec4_mul_scalar(row[1], -1.0f));
+  f.planes[4] = row[2];
+  f.planes[5] = vec4_add(row[3], vec4_mul_scalar(row[2], -1.0f));
+
+  for (u32 i = 0; i < 6; i++)
+  {
+    f32 length = sqrtf(f.planes[i].x * f.planes[i].x + f.planes[i].y * f.planes[i].y + f.planes[i].z * f.planes[i].z);
+    if (length > 0.0f) {
+      f.planes[i] = vec4_mul_scalar(f.planes[i], 1.0f / length);
+    }
+  }
+  return f;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Scalar reference
+// ---------------------------------------------------------------------------------------------
+
+void mat4_mul_batch_scalar(const Mat4* a, const Mat4* b, Mat4* out, u32 count) {
+  for (u32 i = 0; i < count; i++)
+  {
+    out[i] = mat4_mul(&a[i], &b[i]);
+  }
+}
+
+void mat4_mul_batch_left_scalar(const Mat4* m, const Mat4* b, Mat4* out, u32 count) {
+  for (u32 i = 0; i < count; i++)
+  {
+    out[i] = mat4_mul(m, &b[i]);
+  }
+}
+
+void mat4_transform_points_scalar(const Mat4* m, const Vec3* points, Vec4* out, u32 count) {
+  const f32* d = m->data;
+  for (u32 i = 0; i < count; i++)
+  {
+    f32 x = points[i].x, y = points[i].y, z = points[i].z;
+    out[i].x = d[0] * x + d[4] * y + d[8] * z + d[12];
+    out[i].y = d[1] * x + d[5] * y + d[9] * z + d[13];
+    out[i].z = d[2] * x + d[6] * y + d[10] * z + d[14];
+    out[i].w = d[3] * x + d[7] * y + d[11] * z + d[15];
+  }
+}
+
+u32 frustum_cull_spheres_scalar(const Frustum* frustum, const Vec4* spheres, u8* visible, u32 count) {
+  u32 visible_count = 0;
+  for (u32 i = 0; i < count; i++)
+  {
+    u8 inside = 1;
+    for (u32 p = 0; p < 6; p++)
+    {
+      const Vec4* plane = &frustum->planes[p];
+      f32 distance = plane->x * spheres[i].x + plane->y * spheres[i].y + plane->z * spheres[i].z + plane->w;
+      inside &= distance >= -spheres[i].w;
+    }
+    visible[i] = inside;
+    visible_count += inside;
+  }
+  return visible_count;
+}
+
+u32 frustum_cull_aabbs_scalar(const Frustum* frustum, const Aabb* boxes, u8* visible, u32 count) {
+  u32 visible_count = 0;
+  for (u32 i = 0; i < count; i++)
+  {
+    Vec3 center = vec3_mul_scalar(vec3_add(boxes[i].min, boxes[i].max), 0.5f);
+    Vec3 extents = vec3_mul_scalar(vec3_sub(boxes[i].max, boxes[i].min), 0.5f);
+
+    u8 inside = 1;
+    for (u32 p = 0; p < 6; p++)
+    {
+      const Vec4* plane = &frustum->planes[p];
+      f32 distance = plane->x * center.x + plane->y * center.y + plane->z * center.z + plane->w;
+      f32 radius = fabsf(plane->x) * extents.x + fabsf(plane->y) * extents.y + fabsf(plane->z) * extents.z;
+      inside &= distance >= -radius;
+    }
+    visible[i] = inside;
+    visible_count += inside;
+  }
+  return visible_count;
+}
+
+#ifdef VMATH_X86
+
+// ---------------------------------------------------------------------------------------------
+// SSE, 4 wide. Only SSE2 instructions so every x86_64 CPU can run it.
+// ---------------------------------------------------------------------------------------------
+
+static inline __m128 sse_mat4_mul_column(const __m128 a[4], const f32* column) {
+  __m128 r = _mm_mul_ps(a[0], _mm_set1_ps(column[0]));
+  r = _mm_add_ps(r, _mm_mul_ps(a[1], _mm_set1_ps(column[1])));
+  r = _mm_add_ps(r, _mm_mul_ps(a[2], _mm_set1_ps(column[2])));
+  return _mm_add_ps(r, _mm_mul_ps(a[3], _mm_set1_ps(column[3])));
+}
+
+static void mat4_mul_batch_sse(const Mat4* a, const Mat4* b, Mat4* out, u32 count) {
+  for (u32 i = 0; i < count; i++)
+  {
+    __m128 columns[4] = {
+      _mm_load_ps(&a[i].data[0]), _mm_load_ps(&a[i].data[4]),
+      _mm_load_ps(&a[i].data[8]), _mm_load_ps(&a[i].data[12]),
+    };
+    for (u32 c = 0; c < 4; c++)
+    {
+      _mm_store_ps(&out[i].data[c * 4], sse_mat4_mul_column(columns, &b[i].data[c * 4]));
+    }
+  }
+}
+
+static void mat4_mul_batch_left_sse(const Mat4* m, const Mat4* b, Mat4* out, u32 count) {
+  __m128 columns[4] = {
+    _mm_load_ps(&m->data[0]), _mm_load_ps(&m->data[4]),
+    _mm_load_ps(&m->data[8]), _mm_load_ps(&m->data[12]),
+  };
+  for (u32 i = 0; i < count; i++)
+  {
+    for (u32 c = 0; c < 4; c++)
+    {
+      _mm_store_ps(&out[i].data[c * 4], sse_mat4_mul_column(columns, &b[i].data[c * 4]));
+    }
+  }
+}
+
+static void mat4_transform_points_sse(const Mat4* m, const Vec3* points, Vec4* out, u32 count) {
+  __m128 c0 = _mm_load_ps(&m->data[0]);
+  __m128 c1 = _mm_load_ps(&m->data[4]);
+  __m128 c2 = _mm_load_ps(&m->data[8]);
+  __m128 c3 = _mm_load_ps(&m->data[12]);
+  for (u32 i = 0; i < count; i++)
+  {
+    __m128 r = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(points[i].x)), c3);
+    r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(points[i].y)));
+    r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(points[i].z)));
+    _mm_store_ps(out[i].elements, r);
+  }
+}
+
+static inline void store_mask4(u8* visible, i32 mask) {
+  visible[0] = mask & 1;
+  visible[1] = (mask >> 1) & 1;
+  visible[2] = (mask >> 2) & 1;
+  visible[3] = (mask >> 3) & 1;
+}
+
+static u32 frustum_cull_spheres_sse(const Frustum* frustum, const Vec4* spheres, u8* visible, u32 count) {
+  u32 visible_count = 0;
+  u32 i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    // Four spheres transposed into x, y, z and radius lanes
+    __m128 x = _mm_load_ps(spheres[i].elements);
+    __m128 y = _mm_load_ps(spheres[i + 1].elements);
+    __m128 z = _mm_load_ps(spheres[i + 2].elements);
+    __m128 r = _mm_load_ps(spheres[i + 3].elements);
+    _MM_TRANSPOSE4_PS(x, y, z, r);
+    __m128 negative_radius = _mm_sub_ps(_mm_setzero_ps(), r);
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (u32 p = 0; p < 6; p++)
+    {
+      const Vec4* plane = &frustum->planes[p];
+      __m128 d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane->x)), _mm_set1_ps(plane->w));
+      d = _mm_add_ps(d, _mm_mul_ps(y, _mm_set1_ps(plane->y)));
+      d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(plane->z)));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negative_radius));
+    }
+
+    i32 mask = _mm_movemask_ps(inside);
+    store_mask4(&visible[i], mask);
+    visible_count += __builtin_popcount(mask);
+  }
+  return visible_count + frustum_cull_spheres_scalar(frustum, spheres + i, visible + i, count - i);
+}
+
+// Loads the min and max corners of a box without reading past the end of the struct.
+static inline void sse_load_aabb(const Aabb* box, __m128* center, __m128* extents) {
+  __m128 lo = _mm_loadu_ps(&box->min.x);   // min.x min.y min.z max.x
+  __m128 hi = _mm_loadu_ps(&box->min.z);   // min.z max.x max.y max.z
+  __m128 max = _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(3, 3, 2, 1));
+  __m128 half = _mm_set1_ps(0.5f);
+  *center = _mm_mul_ps(_mm_add_ps(lo, max), half);
+  *extents = _mm_mul_ps(_mm_sub_ps(max, lo), half);
+}
+
+static u32 frustum_cull_aabbs_sse(const Frustum* frustum, const Aabb* boxes, u8* visible, u32 count) {
+  __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  u32 visible_count = 0;
+  u32 i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 cx, cy, cz, cw, ex, ey, ez, ew;
+    sse_load_aabb(&boxes[i], &cx, &ex);
+    sse_load_aabb(&boxes[i + 1], &cy, &ey);
+    sse_load_aabb(&boxes[i + 2], &cz, &ez);
+    sse_load_aabb(&boxes[i + 3], &cw, &ew);
+    _MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+    _MM_TRANSPOSE4_PS(ex, ey, ez, ew);
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (u32 p = 0; p < 6; p++)
+    {
+      const Vec4* plane = &frustum->planes[p];
+      __m128 nx = _mm_set1_ps(plane->x), ny = _mm_set1_ps(plane->y), nz = _mm_set1_ps(plane->z);
+      __m128 d = _mm_add_ps(_mm_mul_ps(cx, nx), _mm_set1_ps(plane->w));
+      d = _mm_add_ps(d, _mm_mul_ps(cy, ny));
+      d = _mm_add_ps(d, _mm_mul_ps(cz, nz));
+      __m128 radius = _mm_mul_ps(ex, _mm_and_ps(nx, abs_mask));
+      radius = _mm_add_ps(radius, _mm_mul_ps(ey, _mm_and_ps(ny, abs_mask)));
+      radius = _mm_add_ps(radius, _mm_mul_ps(ez, _mm_and_ps(nz, abs_mask)));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_sub_ps(_mm_setzero_ps(), radius)));
+    }
+
+    i32 mask = _mm_movemask_ps(inside);
+    store_mask4(&visible[i], mask);
+    visible_count += __builtin_popcount(mask);
+  }
+  return visible_count + frustum_cull_aabbs_scalar(frustum, boxes + i, visible + i, count - i);
+}
+
+// ---------------------------------------------------------------------------------------------
+// AVX2 + FMA, 8 wide. Compiled for the target through attributes and only called after the
+// CPU reported support, so the rest of the program keeps the baseline instruction set.
+// ---------------------------------------------------------------------------------------------
+
+// Above this many products the three matrix arrays outgrow a typical L2 cache
+#define MAT4_STREAM_THRESHOLD 8192
+
+static inline AVX2_TARGET __m256 avx_pair(__m128 lo, __m128 hi) {
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+// Mat4 is only 16 byte aligned, so the 256 bit loads and stores are the unaligned ones. They
+// cost nothing extra on aligned addresses.
+static inline AVX2_TARGET void avx_mat4_mul_columns(const __m256 a[4], const Mat4* b, __m256 out[2]) {
+  // Two result columns per iteration, one per 128 bit lane
+  for (u32 c = 0; c < 2; c++)
+  {
+    __m256 bc = _mm256_loadu_ps(&b->data[c * 8]);
+    __m256 r = _mm256_mul_ps(a[0], _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(0, 0, 0, 0)));
+    r = _mm256_fmadd_ps(a[1], _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(1, 1, 1, 1)), r);
+    r = _mm256_fmadd_ps(a[2], _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(2, 2, 2, 2)), r);
+    out[c] = _mm256_fmadd_ps(a[3], _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(3, 3, 3, 3)), r);
+  }
+}
+
+static inline AVX2_TARGET void avx_mat4_mul(const __m256 a[4], const Mat4* b, Mat4* out) {
+  __m256 r[2];
+  avx_mat4_mul_columns(a, b, r);
+  _mm256_storeu_ps(&out->data[0], r[0]);
+  _mm256_storeu_ps(&out->data[8], r[1]);
+}
+
+static AVX2_TARGET void mat4_mul_batch_avx2(const Mat4* a, const Mat4* b, Mat4* out, u32 count) {
+  // Three matrices per product make large batches memory bound. Streaming stores skip reading the
+  // output lines before writing them, a quarter of the traffic, and keep the inputs in the cache.
+  b8 stream = count >= MAT4_STREAM_THRESHOLD;
+  for (u32 i = 0; i < count; i++)
+  {
+    __m256 columns[4] = {
+      _mm256_broadcast_ps((const __m128*)&a[i].data[0]), _mm256_broadcast_ps((const __m128*)&a[i].data[4]),
+      _mm256_broadcast_ps((const __m128*)&a[i].data[8]), _mm256_broadcast_ps((const __m128*)&a[i].data[12]),
+    };
+    __m256 r[2];
+    avx_mat4_mul_columns(columns, &b[i], r);
+    if (stream) {
+      _mm_stream_ps(&out[i].data[0], _mm256_castps256_ps128(r[0]));
+      _mm_stream_ps(&out[i].data[4], _mm256_extractf128_ps(r[0], 1));
+      _mm_stream_ps(&out[i].data[8], _mm256_castps256_ps128(r[1]));
+      _mm_stream_ps(&out[i].data[12], _mm256_extractf128_ps(r[1], 1));
+    } else {
+      _mm256_storeu_ps(&out[i].data[0], r[0]);
+      _mm256_storeu_ps(&out[i].data[8], r[1]);
+    }
+  }
+  if (stream) _mm_sfence();
+}
+
+static AVX2_TARGET void mat4_mul_batch_left_avx2(const Mat4* m, const Mat4* b, Mat4* out, u32 count) {
+  __m256 columns[4] = {
+    _mm256_broadcast_ps((const __m128*)&m->data[0]), _mm256_broadcast_ps((const __m128*)&m->data[4]),
+    _mm256_broadcast_ps((const __m128*)&m->data[8]), _mm256_broadcast_ps((const __m128*)&m->data[12]),
+  };
+  for (u32 i = 0; i < count; i++)
+  {
+    avx_mat4_mul(columns, &b[i], &out[i]);
+  }
+}
+
+static AVX2_TARGET void mat4_transform_points_avx2(const Mat4* m, const Vec3* points, Vec4* out, u32 count) {
+  __m256 c0 = _mm256_broadcast_ps((const __m128*)&m->data[0]);
+  __m256 c1 = _mm256_broadcast_ps((const __m128*)&m->data[4]);
+  __m256 c2 = _mm256_broadcast_ps((const __m128*)&m->data[8]);
+  __m256 c3 = _mm256_broadcast_ps((const __m128*)&m->data[12]);
+  u32 i = 0;
+  for (; i + 2 <= count; i += 2)
+  {
+    __m256 x = avx_pair(_mm_set1_ps(points[i].x), _mm_set1_ps(points[i + 1].x));
+    __m256 y = avx_pair(_mm_set1_ps(points[i].y), _mm_set1_ps(points[i + 1].y));
+    __m256 z = avx_pair(_mm_set1_ps(points[i].z), _mm_set1_ps(points[i + 1].z));
+    __m256 r = _mm256_fmadd_ps(c0, x, c3);
+    r = _mm256_fmadd_ps(c1, y, r);
+    r = _mm256_fmadd_ps(c2, z, r);
+    _mm256_storeu_ps(out[i].elements, r);
+  }
+  mat4_transform_points_scalar(m, points + i, out + i, count - i);
+}
+
+static inline void store_mask8(u8* visible, i32 mask) {
+  store_mask4(visible, mask);
+  store_mask4(visible + 4, mask >> 4);
+}
+
+static AVX2_TARGET u32 frustum_cull_spheres_avx2(const Frustum* frustum, const Vec4* spheres, u8* visible, u32 count) {
+  u32 visible_count = 0;
+  u32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128 x0 = _mm_load_ps(spheres[i].elements), y0 = _mm_load_ps(spheres[i + 1].elements);
+    __m128 z0 = _mm_load_ps(spheres[i + 2].elements), r0 = _mm_load_ps(spheres[i + 3].elements);
+    __m128 x1 = _mm_load_ps(spheres[i + 4].elements), y1 = _mm_load_ps(spheres[i + 5].elements);
+    __m128 z1 = _mm_load_ps(spheres[i + 6].elements), r1 = _mm_load_ps(spheres[i + 7].elements);
+    _MM_TRANSPOSE4_PS(x0, y0, z0, r0);
+    _MM_TRANSPOSE4_PS(x1, y1, z1, r1);
+    __m256 x = avx_pair(x0, x1), y = avx_pair(y0, y1), z = avx_pair(z0, z1);
+    __m256 negative_radius = _mm256_sub_ps(_mm256_setzero_ps(), avx_pair(r0, r1));
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (u32 p = 0; p < 6; p++)
+    {
+      const Vec4* plane = &frustum->planes[p];
+      __m256 d = _mm256_fmadd_ps(x, _mm256_set1_ps(plane->x), _mm256_set1_ps(plane->w));
+      d = _mm256_fmadd_ps(y, _mm256_set1_ps(plane->y), d);
+      d = _mm256_fmadd_ps(z, _mm256_set1_ps(plane->z), d);
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negative_radius, _CMP_GE_OQ));
+    }
+
+    i32 mask = _mm256_movemask_ps(inside);
+    store_mask8(&visible[i], mask);
+    visible_count += __builtin_popcount(mask);
+  }
+  return visible_count + frustum_cull_spheres_sse(frustum, spheres + i, visible + i, count - i);
+}
+
+static AVX2_TARGET u32 frustum_cull_aabbs_avx2(const Frustum* frustum, const Aabb* boxes, u8* visible, u32 count) {
+  __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  u32 visible_count = 0;
+  u32 i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128 c[8], e[8];
+    for (u32 b = 0; b < 8; b++)
+    {
+      sse_load_aabb(&boxes[i + b], &c[b], &e[b]);
+    }
+    _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+    _MM_TRANSPOSE4_PS(c[4], c[5], c[6], c[7]);
+    _MM_TRANSPOSE4_PS(e[0], e[1], e[2], e[3]);
+    _MM_TRANSPOSE4_PS(e[4], e[5], e[6], e[7]);
+    __m256 cx = avx_pair(c[0], c[4]), cy = avx_pair(c[1], c[5]), cz = avx_pair(c[2], c[6]);
+    __m256 ex = avx_pair(e[0], e[4]), ey = avx_pair(e[1], e[5]), ez = avx_pair(e[2], e[6]);
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (u32 p = 0; p < 6; p++)
+    {
+      const Vec4* plane = &frustum->planes[p];
+      __m256 nx = _mm256_set1_ps(plane->x), ny = _mm256_set1_ps(plane->y), nz = _mm256_set1_ps(plane->z);
+      __m256 d = _mm256_fmadd_ps(cx, nx, _mm256_set1_ps(plane->w));
+      d = _mm256_fmadd_ps(cy, ny, d);
+      d = _mm256_fmadd_ps(cz, nz, d);
+      __m256 radius = _mm256_mul_ps(ex, _mm256_and_ps(nx, abs_mask));
+      radius = _mm256_fmadd_ps(ey, _mm256_and_ps(ny, abs_mask), radius);
+      radius = _mm256_fmadd_ps(ez, _mm256_and_ps(nz, abs_mask), radius);
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_sub_ps(_mm256_setzero_ps(), radius), _CMP_GE_OQ));
+    }
+
+    i32 mask = _mm256_movemask_ps(inside);
+    store_mask8(&visible[i], mask);
+    visible_count += __builtin_popcount(mask);
+  }
+  return visible_count + frustum_cull_aabbs_sse(frustum, boxes + i, visible + i, count - i);
+}
+
+#endif
+
+// ---------------------------------------------------------------------------------------------
+// Dispatch
+// ---------------------------------------------------------------------------------------------
+
+void mat4_mul_batch(const Mat4* a, const Mat4* b, Mat4* out, u32 count) {
+  switch (vmath_simd_level()) {
+#ifdef VMATH_X86
+    case SIMD_LEVEL_AVX2: mat4_mul_batch_avx2(a, b, out, count); return;
+    case SIMD_LEVEL_SSE: mat4_mul_batch_sse(a, b, out, count); return;
+#endif
+    default: mat4_mul_batch_scalar(a, b, out, count); return;
+  }
+}
+
+void mat4_mul_batch_left(const Mat4* m, const Mat4* b, Mat4* out, u32 count) {
+  switch (vmath_simd_level()) {
+#ifdef VMATH_X86
+    case SIMD_LEVEL_AVX2: mat4_mul_batch_left_avx2(m, b, out, count); return;
+    case SIMD_LEVEL_SSE: mat4_mul_batch_left_sse(m, b, out, count); return;
+#endif
+    default: mat4_mul_batch_left_scalar(m, b, out, count); return;
+  }
+}
+
+void mat4_transform_points(const Mat4* m, const Vec3* points, Vec4* out, u32 count) {
+  switch (vmath_simd_level()) {
+#ifdef VMATH_X86
+    case SIMD_LEVEL_AVX2: mat4_transform_points_avx2(m, points, out, count); return;
+    case SIMD_LEVEL_SSE: mat4_transform_points_sse(m, points, out, count); return;
+#endif
+    default: mat4_transform_points_scalar(m, points, out, count); return;
+  }
+}
+
+u32 frustum_cull_spheres(const Frustum* frustum, const Vec4* spheres, u8* visible, u32 count) {
+  switch (vmath_simd_level()) {
+#ifdef VMATH_X86
+    case SIMD_LEVEL_AVX2: return frustum_cull_spheres_avx2(frustum, spheres, visible, count);
+    case SIMD_LEVEL_SSE: return frustum_cull_spheres_sse(frustum, spheres, visible, count);
+#endif
+    default: return frustum_cull_spheres_scalar(frustum, spheres, visible, count);
+  }
+}
+
+u32 frustum_cull_aabbs(const Frustum* frustum, const Aabb* boxes, u8* visible, u32 count) {
+  switch (vmath_simd_level()) {
+#ifdef VMATH_X86
+    case SIMD_LEVEL_AVX2: return frustum_cull_aabbs_avx2(frustum, boxes, visible, count);
+    case SIMD_LEVEL_SSE: return frustum_cull_aabbs_sse(frustum, boxes, visible, count);
+#endif
+    default: return frustum_cull_aabbs_scalar(frustum, boxes, visible, count);
+  }
+}
@@ -0,0 +1,194 @@
+#pragma once
+#include "core/math_types.h"
+#include <math.h>
+
+#define V_PI 3.14159265358979323846f
+
+typedef enum SimdLevel {
+  SIMD_LEVEL_SCALAR = 0,
+  SIMD_LEVEL_SSE = 1,
+  SIMD_LEVEL_AVX2 = 2,
+} SimdLevel;
+
+// ---------------------------------------------------------------------------------------------
+// Single value helpers. Small enough to be inlined, the batch kernels below do the heavy work.
+// ---------------------------------------------------------------------------------------------
+
+static inline Vec3 vec3_create(f32 x, f32 y, f32 z) { return (Vec3){{x, y, z}}; }
+static inline Vec3 vec3_add(Vec3 a, Vec3 b) { return (Vec3){{a.x + b.x, a.y + b.y, a.z + b.z}}; }
+static inline Vec3 vec3_sub(Vec3 a, Vec3 b) { return (Vec3){{a.x - b.x, a.y - b.y, a.z - b.z}}; }
+static inline Vec3 vec3_mul_scalar(Vec3 v, f32 s) { return (Vec3){{v.x * s, v.y * s, v.z * s}}; }
+static inline f32 vec3_dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static inline f32 vec3_length(Vec3 v) { return sqrtf(vec3_dot(v, v)); }
+
+static inline Vec3 vec3_cross(Vec3 a, Vec3 b) {
+  return (Vec3){{a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x}};
+}
+
+static inline Vec3 vec3_normalize(Vec3 v) {
+  f32 length = vec3_length(v);
+  return length > 0.0f ? vec3_mul_scalar(v, 1.0f / length) : v;
+}
+
+static inline Vec4 vec4_create(f32 x, f32 y, f32 z, f32 w) { return (Vec4){{x, y, z, w}}; }
+static inline Vec4 vec4_add(Vec4 a, Vec4 b) { return (Vec4){{a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w}}; }
+static inline Vec4 vec4_mul_scalar(Vec4 v, f32 s) { return (Vec4){{v.x * s, v.y * s, v.z * s, v.w * s}}; }
+static inline f32 vec4_dot(Vec4 a, Vec4 b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+static inline Quat quat_identity() { return (Quat){{0.0f, 0.0f, 0.0f, 1.0f}}; }
+
+static inline Quat quat_from_axis_angle(Vec3 axis, f32 angle) {
+  Vec3 n = vec3_normalize(axis);
+  f32 s = sinf(angle * 0.5f);
+  return (Quat){{n.x * s, n.y * s, n.z * s, cosf(angle * 0.5f)}};
+}
+
+static inline Quat quat_mul(Quat a, Quat b) {
+  return (Quat){{
+    a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+    a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+    a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+    a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+  }};
+}
+
+static inline Quat quat_normalize(Quat q) {
+  f32 length = sqrtf(vec4_dot(q, q));
+  return length > 0.0f ? vec4_mul_scalar(q, 1.0f / length) : quat_identity();
+}
+
+static inline Mat4 mat4_identity() {
+  Mat4 m = {0};
+  m.data[0] = m.data[5] = m.data[10] = m.data[15] = 1.0f;
+  return m;
+}
+
+static inline Mat4 mat4_mul(const Mat4* a, const Mat4* b) {
+  Mat4 out;
+  for (u32 c = 0; c < 4; c++)
+  {
+    for (u32 r = 0; r < 4; r++)
+    {
+      out.data[c * 4 + r] = a->data[r] * b->data[c * 4] + a->data[4 + r] * b->data[c * 4 + 1] +
+        a->data[8 + r] * b->data[c * 4 + 2] + a->data[12 + r] * b->data[c * 4 + 3];
+    }
+  }
+  return out;
+}
+
+// Translation * rotation * scale.
+static inline Mat4 mat4_from_trs(Vec3 t, Quat r, Vec3 s) {
+  f32 xx = r.x * r.x, yy = r.y * r.y, zz = r.z * r.z;
+  f32 xy = r.x * r.y, xz = r.x * r.z, yz = r.y * r.z;
+  f32 wx = r.w * r.x, wy = r.w * r.y, wz = r.w * r.z;
+
+  Mat4 m;
+  m.data[0] = (1.0f - 2.0f * (yy + zz)) * s.x;
+  m.data[1] = 2.0f * (xy + wz) * s.x;
+  m.data[2] = 2.0f * (xz - wy) * s.x;
+  m.data[3] = 0.0f;
+  m.data[4] = 2.0f * (xy - wz) * s.y;
+  m.data[5] = (1.0f - 2.0f * (xx + zz)) * s.y;
+  m.data[6] = 2.0f * (yz + wx) * s.y;
+  m.data[7] = 0.0f;
+  m.data[8] = 2.0f * (xz + wy) * s.z;
+  m.data[9] = 2.0f * (yz - wx) * s.z;
+  m.data[10] = (1.0f - 2.0f * (xx + yy)) * s.z;
+  m.data[11] = 0.0f;
+  m.data[12] = t.x;
+  m.data[13] = t.y;
+  m.data[14] = t.z;
+  m.data[15] = 1.0f;
+  return m;
+}
+
+// Right handed, Vulkan clip space: y down, depth in [0, 1].
+static inline Mat4 mat4_perspective(f32 fov_y, f32 aspect, f32 near, f32 far) {
+  f32 f = 1.0f / tanf(fov_y * 0.5f);
+  Mat4 m = {0};
+  m.data[0] = f / aspect;
+  m.data[5] = -f;
+  m.data[10] = far / (near - far);
+  m.data[11] = -1.0f;
+  m.data[14] = near * far / (near - far);
+  return m;
+}
+
+static inline Mat4 mat4_look_at(Vec3 eye, Vec3 target, Vec3 up) {
+  Vec3 f = vec3_normalize(vec3_sub(target, eye));
+  Vec3 s = vec3_normalize(vec3_cross(f, up));
+  Vec3 u = vec3_cross(s, f);
+
+  Mat4 m = mat4_identity();
+  m.data[0] = s.x;
+  m.data[4] = s.y;
+  m.data[8] = s.z;
+  m.data[1] = u.x;
+  m.data[5] = u.y;
+  m.data[9] = u.z;
+  m.data[2] = -f.x;
+  m.data[6] = -f.y;
+  m.data[10] = -f.z;
+  m.data[12] = -vec3_dot(s, eye);
+  m.data[13] = -vec3_dot(u, eye);
+  m.data[14] = vec3_dot(f, eye);
+  return m;
+}
+
+/**
+ * Extracts normalized, inward facing planes from a view projection matrix with a [0, 1] depth range.
+ * Plane order is left, right, bottom, top, near, far.
+ */
+Frustum frustum_from_mat4(const Mat4* view_proj);
+
+// ---------------------------------------------------------------------------------------------
+// Batch kernels. They run the best instruction set the CPU supports (AVX2, SSE or scalar),
+// the _scalar variants are the portable reference and are kept simple so compilers can
+// auto-vectorize them on targets like NEON.
+// ---------------------------------------------------------------------------------------------
+
+/**
+ * @returns The instruction set the batch kernels currently use.
+ */
+SimdLevel vmath_simd_level();
+
+/**
+ * Forces the batch kernels to a lower instruction set, used to compare implementations.
+ * Requests above what the CPU supports are clamped.
+ */
+void vmath_set_simd_level(SimdLevel level);
+const char* vmath_simd_level_name(SimdLevel level);
+
+/**
+ * out[i] = a[i] * b[i]. The output may not alias the inputs. Large batches are written around
+ * the cache, so their results are not cached afterwards.
+ */
+void mat4_mul_batch(const Mat4* a, const Mat4* b, Mat4* out, u32 count);
+void mat4_mul_batch_scalar(const Mat4* a, const Mat4* b, Mat4* out, u32 count);
+
+/**
+ * out[i] = m * b[i], e.g. a view projection applied to every world matrix.
+ */
+void mat4_mul_batch_left(const Mat4* m, const Mat4* b, Mat4* out, u32 count);
+void mat4_mul_batch_left_scalar(const Mat4* m, const Mat4* b, Mat4* out, u32 count);
+
+/**
+ * out[i] = m * vec4(points[i], 1).
+ */
+void mat4_transform_points(const Mat4* m, const Vec3* points, Vec4* out, u32 count);
+void mat4_transform_points_scalar(const Mat4* m, const Vec3* points, Vec4* out, u32 count);
+
+/**
+ * Tests spheres, xyz center and w radius, against a frustum. visible[i] is 1 when the sphere
+ * intersects or is inside the frustum and 0 otherwise.
+ * @returns The number of visible spheres.
+ */
+u32 frustum_cull_spheres(const Frustum* frustum, const Vec4* spheres, u8* visible, u32 count);
+u32 frustum_cull_spheres_scalar(const Frustum* frustum, const Vec4* spheres, u8* visible, u32 count);
+
+/**
+ * Same as frustum_cull_spheres for axis aligned boxes. Conservative: boxes crossing the
+ * corner of two planes outside of the frustum may be reported visible.
+ */
+u32 frustum_cull_aabbs(const Frustum* frustum, const Aabb* boxes, u8* visible, u32 count);
+u32 frustum_cull_aabbs_scalar(const Frustum* frustum, const Aabb* boxes, u8* visible, u32 count);
@@ -1,5 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/resource.h>
 
 #ifdef PLATFORM_WAYLAND
   #define VK_USE_PLATFORM_WAYLAND_KHR
@@ -9,56 +12,224 @@
 #include "defines.h"
 #include "platform/platform.h"
 #include "core/events.h"
-
-typedef struct QueueIndex {
-  u32 familyIndex;
-  u32 index;
-} QueueIndex;
-
-const u32 MAX_FRAMES = 3;
-
-typedef struct VkContext {
-  VkInstance instance;
-  VkDebugUtilsMessengerEXT debug_messenger;
-
-  VkPhysicalDevice physicalDevice;
-  VkDevice device;
-
-  QueueIndex graphics_queue_index;
-  VkQueue graphics_queue;
-
-  VkCommandPool command_pool;
-  VkCommandBuffer *command_buffers; // MAX FRAMES
-
-  VkSurfaceKHR surface;
-  VkSwapchainKHR swapchain;
-  u32 swapchain_image_count;
-  VkImage *swapchain_images;
-  VkImageView *swapchain_image_views;
-  u32 image_index;
-
-  VkRenderPass render_pass;
-  VkPipelineLayout pipeline_layout;
-  VkPipeline graphics_pipeline;
-  VkFramebuffer *framebuffers; //IMAGE COUNT
-
-  VkSemaphore *image_available_semaphores; // MAX FRAMES
-  VkSemaphore *render_finished_semaphores; // MAX FRAMES
-  VkFence *in_flight_fences; // MAX FRAMES
-  VkFence *images_in_flight; //IMAGE_COUNT
-  u32 current_frame;
-
-  u32 image_width;
-  u32 image_height;
-
-  u32 next_width;
-  u32 next_height;
-} VkContext;
+#include "core/jobs.h"
+#include "core/startup.h"
+#include "core/trace.h"
+#include "core/vmath.h"
+#include "scene/scene.h"
+#include "renderer/vulkan_types.h"
+#include "renderer/uniform_ring.h"
+#include "renderer/vulkan_buffer.h"
+#include "renderer/mesh.h"
+#include "renderer/vulkan_shader.h"
+#include "renderer/render_graph.h"
+#include "renderer/gpu_timer.h"
+#include "renderer/clustered_lighting.h"
+#include "renderer/shadow_atlas.h"
+#include "renderer/post_process.h"
+#include "renderer/pipeline_cache.h"
+#include "renderer/layout_cache.h"
+#include "renderer/descriptor_allocator.h"
+#include "renderer/readback.h"
+#include "renderer/golden_image.h"
+#include "renderer/residency.h"
+
+#define SWAPCHAIN_FORMAT VK_FORMAT_B8G8R8A8_SRGB
+#define UNIFORM_RING_FRAME_SIZE (64 * 1024)
+#define MAX_INSTANCES 1024
+#define INSTANCE_PARTITION_SIZE (MAX_INSTANCES * sizeof(Mat4))
+#define CAMERA_NEAR 0.1f
+#define CAMERA_FAR 100.0f
+#define LIGHT_SWEEP_FRAMES 300
+#define HEADLESS_FRAMES 120 // Frames rendered without a window when no capture is requested
+#define STATS_MAX_FRAMES 4096
+#define BENCH_MAX_PIPELINES 8
+
+// Must match the blocks declared in basic.vert and basic.frag
+typedef struct FrameUniforms {
+  Mat4 view_proj;
+  Mat4 view;
+  f32 time[4];
+  f32 screen[4];        // Width, height, 1 / projection[0][0], 1 / projection[1][1]
+  f32 cluster_depth[4]; // See clustered_lighting_depth_params
+  u32 light_count[4];
+} FrameUniforms;
+
+typedef struct DrawUniforms {
+  f32 color[4];
+  f32 mesh_center[4];
+  f32 mesh_extent[4];
+} DrawUniforms;
+
+typedef struct ShadowUniforms {
+  Mat4 view_proj[SHADOW_MAX_TILES];
+  f32 rect[SHADOW_MAX_TILES][4]; // See shadow_atlas_tile_uv
+} ShadowUniforms;
 
 VkContext ctx = {0};
 Window window;
 b8 running = true;
 
+Scene scene;
+u32 scene_root;
+// Nodes below static_first form the spinning hierarchy, the static_count nodes that follow never
+// move after the first update so the shadow atlas caches them
+u32 static_first;
+u32 static_count;
+
+typedef struct RenderSettings {
+  b8 depth_prepass;
+  VkSampleCountFlagBits msaa_samples;
+  u32 light_count;
+  b8 light_sweep; // Benchmark: doubles the light count every LIGHT_SWEEP_FRAMES frames, then quits
+  b8 ssao;
+  b8 async_compute; // Post-processing on a compute only queue when the device has one
+  b8 pipeline_library;  // Fast linked pipelines when the device supports graphics pipeline libraries
+  b8 pipeline_optimize; // Link time optimized replacements compiled in the background
+  b8 pipeline_async;    // Specialized pipelines compiled in the background, the ubershader draws meanwhile
+  u32 material_features;  // MaterialFeature bits
+  u32 shadow_filter_taps; // Per axis
+  b8 descriptor_buffer;   // Descriptors bound from a buffer with VK_EXT_descriptor_buffer when supported
+  b8 reuse_commands;      // Submit the previous command buffers of a frame slot again when nothing changed
+  b8 static_scene;        // Benchmark: animation stopped, every frame draws the same content
+  b8 headless;            // Offscreen images instead of a window and swapchain, any GPU including lavapipe
+  b8 readback;            // Copy every frame back to the host, to measure what it costs
+  u32 capture_frame;      // Read back the first frame from this one on with every shadow tile up to date, then quit
+  const char *golden_path;  // Reference image the capture is compared against, PPM
+  b8 golden_update;         // Write the capture as the new reference instead
+  u32 golden_tolerance;     // Channel difference still counted as equal
+  f32 golden_max_differing; // Fraction of pixels allowed to differ by more than the tolerance
+  u32 width;              // Of the window or the offscreen images
+  u32 height;
+  u32 frames_in_flight;   // At most MAX_FRAMES
+  u32 frame_limit;        // Quit after this many frames, 0 never
+  u32 warmup_frames;      // Not counted in the frame statistics
+  u32 draw_count;         // Benchmark: the main pass draws one instance per draw call, this many draws
+  u32 pipeline_count;     // Benchmark: the split draws alternate between this many pipeline variants
+  const char *stats_path; // Frame statistics written as JSON at exit
+  u32 startup_threads;    // Threads running independent startup steps, 1 runs them in order with readable logs
+  const char *shader_dir; // Development: SPIR-V loaded from here before the shaders embedded in the executable
+  const char *trace_path; // CPU and GPU zones written as Chrome trace JSON at exit and on SIGUSR1
+  u32 memory_budget_mb;   // Caps the budget of every memory heap, to try eviction as on a GPU shared with other apps
+} RenderSettings;
+
+RenderSettings settings = {.depth_prepass = true, .msaa_samples = VK_SAMPLE_COUNT_4_BIT, .light_count = 256, .ssao = true,
+  .pipeline_library = true, .pipeline_optimize = true, .pipeline_async = true, .material_features = 0x7,
+  .shadow_filter_taps = 2, .reuse_commands = true, .golden_tolerance = 2, .golden_max_differing = 0.001f,
+  .width = 800, .height = 600, .frames_in_flight = MAX_FRAMES, .pipeline_count = 1,
+  .startup_threads = 4};
+
+ClusteredLighting lighting;
+GpuLight scene_lights[MAX_LIGHTS];
+GpuTimer gpu_timer;
+u64 frame_count;
+ShadowAtlas shadow_atlas;
+PostProcess post;
+
+// Features of basic.frag, pushed to the ubershader and baked into the specialized shader
+typedef enum MaterialFeature {
+  MATERIAL_DIRECTIONAL = 1 << 0,
+  MATERIAL_CLUSTERED_LIGHTS = 1 << 1,
+  MATERIAL_SHADOWS = 1 << 2,
+} MaterialFeature;
+
+// Specialization constant ids of basic.frag
+typedef enum MaterialConstant {
+  MATERIAL_CONSTANT_FEATURES,
+  MATERIAL_CONSTANT_SHADOW_FILTER_TAPS,
+} MaterialConstant;
+
+#define MATERIAL_PUSH_OFFSET 64 // After the vertex stage matrix
+
+// Graphics pipelines are looked up by key when the passes are recorded, their layouts come from
+// the reflection of the shaders
+PipelineCache pipelines;
+LayoutCache layouts;
+VkShaderModule cluster_shader;
+DescriptorAllocator descriptors;
+PipelineKey main_pipeline_key;
+PipelineKey uber_pipeline_key; // Fallback of main_pipeline_key
+PipelineKey prepass_pipeline_key;
+PipelineKey shadow_pipeline_key;
+PipelineKey bench_pipeline_keys[BENCH_MAX_PIPELINES]; // Variants of main_pipeline_key
+
+RenderGraph render_graph;
+u32 rg_swapchain;
+u32 rg_clusters;
+u32 rg_light_binning;
+u32 rg_shadow_static_atlas;
+u32 rg_shadow_atlas;
+u32 rg_shadow_static;
+u32 rg_shadow_composite;
+u32 rg_shadow_dynamic;
+u32 rg_color_msaa;
+u32 rg_hdr;
+u32 rg_depth;
+u32 rg_depth_prepass;
+u32 rg_main_pass;
+u32 rg_readback;
+u32 draw_offsets[5];
+// Set 0 of every scene pipeline and the light binning. Written once, only the offsets of the
+// dynamic bindings change per frame.
+DescriptorBinding scene_bindings[7];
+
+// Segments after the first one of the render graph, only with async compute. The first segment
+// records into ctx.command_buffers, each segment signals a semaphore the next one waits for.
+VkCommandBuffer segment_command_buffers[MAX_FRAMES][RG_MAX_SEGMENTS];
+VkSemaphore segment_semaphores[MAX_FRAMES][RG_MAX_SEGMENTS];
+
+// Fragment shader invocations of the color pass, read back a few frames late
+b8 statistics_pending[MAX_FRAMES];
+
+// Key of the state the command buffers of each frame slot were recorded from, valid until the
+// slot records again. Frames with the same key record identical commands: only buffer contents
+// differ, and those are written every frame.
+u64 command_keys[MAX_FRAMES];
+b8 command_valid[MAX_FRAMES];
+u64 command_version;   // Bumped by changes the key does not see, e.g. a recreated swapchain
+u64 commands_recorded;
+u64 commands_reused;
+f64 recorded_frame_seconds; // CPU time from acquire to submit
+f64 reused_frame_seconds;
+
+// Damage tracking: the loop only renders while the view is dirty, otherwise it sleeps in the
+// window event dispatch until the compositor sends something
+b8 view_dirty = true;
+b8 window_suspended; // The compositor does not repaint the window, e.g. occluded or screen locked
+u64 active_frames;
+u64 idle_wakeups;    // Loop iterations without a frame
+u64 suspended_wakeups;
+f64 idle_seconds;
+
+u64 statistics_fragments;
+u64 statistics_frames;
+
+// Resources startup steps use without synchronization of their own
+typedef enum StartupLock {
+  STARTUP_LOCK_COMMAND_POOL = 1 << 0, // ctx.command_pool and the graphics queue
+  STARTUP_LOCK_BUFFERS = 1 << 1,      // The buffer statistics of ctx
+} StartupLock;
+
+Startup startup;
+volatile sig_atomic_t trace_requested; // Set by SIGUSR1, the trace is written after the frame
+f64 process_start;
+f64 first_frame_seconds; // From the start of main until the first frame was submitted
+
+// Without a window the frames render into images of our own, one per frame in flight
+VkDeviceMemory offscreen_memory[MAX_FRAMES];
+
+// Frame statistics after the warm-up frames, for the benchmark runner
+f32 frame_ms_samples[STATS_MAX_FRAMES]; // From the fence wait to the present
+f32 cpu_ms_samples[STATS_MAX_FRAMES];   // From the acquire to the submit
+u32 stats_sample_count;
+
+Readback readback;
+Residency residency;
+u32 mesh_resource = RESIDENCY_MAX_RESOURCES;
+b8 capture_requested;
+u64 capture_frame_number;
+int exit_code;
+
 b8 create_instance() {
   printf("Creating instance ... ");
 
@@ -73,14 +244,17 @@ b8 create_instance() {
   VkInstanceCreateInfo instance_info = {0};
   instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 
-  u32 instance_ext_count = 3;
+  // Headless needs neither a surface nor the window system
+  u32 instance_ext_count = settings.headless ? 1 : 3;
   const char **instance_extensions = malloc(sizeof(const char *) * instance_ext_count);
   const char *surface_ext = VK_KHR_SURFACE_EXTENSION_NAME;
   const char *debug_ext = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
   const char *platform_ext = "VK_KHR_wayland_surface";
-  instance_extensions[0] = surface_ext;
-  instance_extensions[1] = debug_ext;
-  instance_extensions[2] = platform_ext;
+  instance_extensions[0] = debug_ext;
+  if (!settings.headless) {
+    instance_extensions[1] = surface_ext;
+    instance_extensions[2] = platform_ext;
+  }
 
   instance_info.enabledExtensionCount = instance_ext_count;
   instance_info.ppEnabledExtensionNames = instance_extensions;
@@ -145,26 +319,40 @@ b8 choose_physical_device() {
     return false;
   };
 
+  // A discrete GPU when there is one, otherwise integrated, virtual and finally CPU devices like
+  // lavapipe, which the headless regression tests run on
   b8 found = false;
+  u32 best_rank = 0;
   for (u32 i = 0; i < device_count; i++)
   {
     VkPhysicalDeviceProperties properties;
     vkGetPhysicalDeviceProperties(devices[i], &properties);
     printf("Checking device %s ... ", properties.deviceName);
 
-    if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+    u32 rank = 0;
+    switch (properties.deviceType) {
+      case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: rank = 4; break;
+      case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: rank = 3; break;
+      case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: rank = 2; break;
+      case VK_PHYSICAL_DEVICE_TYPE_CPU: rank = 1; break;
+      default: break;
+    }
+    if (properties.apiVersion < VK_API_VERSION_1_3 || rank <= best_rank) {
       continue;
     }
 
     ctx.physicalDevice = devices[i];
+    ctx.device_properties = properties;
+    best_rank = rank;
     found = true;
-    break;
   }
 
   if(!found) {
     printf("FAIL 3\n");
     return false;
   }
+  vkGetPhysicalDeviceMemoryProperties(ctx.physicalDevice, &ctx.memory_properties);
+  printf("Using %s ... ", ctx.device_properties.deviceName);
 
   u32 queueFamilyPropertiesCount = 0;
   vkGetPhysicalDeviceQueueFamilyProperties(ctx.physicalDevice, &queueFamilyPropertiesCount, NULL);
@@ -181,10 +369,38 @@ b8 choose_physical_device() {
     }
   }
 
+  // Async compute needs a family of its own, with timestamps so its passes are timed as well
+  ctx.compute_queue_index = ctx.graphics_queue_index;
+  for (u32 i = 0; i < queueFamilyPropertiesCount; i++)
+  {
+    VkQueueFlags flags = queue_properties[i].queueFlags;
+    if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && queue_properties[i].timestampValidBits > 0) {
+      ctx.compute_queue_index.familyIndex = i;
+      ctx.compute_queue_index.index = 0;
+      printf("Compute Queue Family Index: %u ", i);
+      break;
+    }
+  }
+
   printf("SUCCESS\n");
   return true;
 }
 
+b8 device_extension_supported(const char *name) {
+  u32 count = 0;
+  vkEnumerateDeviceExtensionProperties(ctx.physicalDevice, NULL, &count, NULL);
+  VkExtensionProperties *extensions = malloc(sizeof(VkExtensionProperties) * count);
+  vkEnumerateDeviceExtensionProperties(ctx.physicalDevice, NULL, &count, extensions);
+
+  b8 found = false;
+  for (u32 i = 0; i < count && !found; i++)
+  {
+    found = strcmp(extensions[i].extensionName, name) == 0;
+  }
+  free(extensions);
+  return found;
+}
+
 b8 create_logical_device() {
   printf("Creating logical device ... ");
 
@@ -198,25 +414,95 @@ b8 create_logical_device() {
   f32 queue_priority[] = {1.f};
   graphics_queue_info.pQueuePriorities = queue_priority;
 
-  device_info.queueCreateInfoCount = 1;
-  device_info.pQueueCreateInfos = &graphics_queue_info;
+  VkDeviceQueueCreateInfo queue_infos[2] = {graphics_queue_info, graphics_queue_info};
+  queue_infos[1].queueFamilyIndex = ctx.compute_queue_index.familyIndex;
+
+  device_info.queueCreateInfoCount = ctx.compute_queue_index.familyIndex != ctx.graphics_queue_index.familyIndex ? 2 : 1;
+  device_info.pQueueCreateInfos = queue_infos;
+
+  const char *device_extensions[8];
+  u32 device_extension_count = 0;
+  if (!settings.headless) {
+    device_extensions[device_extension_count++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+  }
 
-  const char *swapchain_ext = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
-  device_info.enabledExtensionCount = 1;
-  device_info.ppEnabledExtensionNames = &swapchain_ext;
+  VkPhysicalDeviceFeatures supported_features;
+  vkGetPhysicalDeviceFeatures(ctx.physicalDevice, &supported_features);
 
   VkPhysicalDeviceFeatures features = {0};
   features.samplerAnisotropy = VK_TRUE;
+  features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
   device_info.pEnabledFeatures = &features;
 
+  // The render graph records its barriers with vkCmdPipelineBarrier2
+  VkPhysicalDeviceVulkan13Features features13 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+  features13.synchronization2 = VK_TRUE;
+  device_info.pNext = &features13;
+
+  // Pipeline libraries let the pipeline cache link pipelines from precompiled parts
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT library_features = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT};
+  if (device_extension_supported(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+    device_extension_supported(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    features2.pNext = &library_features;
+    vkGetPhysicalDeviceFeatures2(ctx.physicalDevice, &features2);
+    if (library_features.graphicsPipelineLibrary) {
+      device_extensions[device_extension_count++] = VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME;
+      device_extensions[device_extension_count++] = VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME;
+      library_features.pNext = device_info.pNext;
+      device_info.pNext = &library_features;
+      ctx.graphics_pipeline_library = true;
+    }
+  }
+
+  // Descriptor buffers are opt in, so the two binding paths can be compared
+  VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT};
+  VkPhysicalDeviceVulkan12Features features12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+  if (settings.descriptor_buffer && device_extension_supported(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    features2.pNext = &descriptor_buffer_features;
+    descriptor_buffer_features.pNext = &features12;
+    vkGetPhysicalDeviceFeatures2(ctx.physicalDevice, &features2);
+    if (descriptor_buffer_features.descriptorBuffer && features12.bufferDeviceAddress) {
+      device_extensions[device_extension_count++] = VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME;
+      memset(&features12, 0, sizeof(features12));
+      features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+      features12.bufferDeviceAddress = VK_TRUE;
+      memset(&descriptor_buffer_features, 0, sizeof(descriptor_buffer_features));
+      descriptor_buffer_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+      descriptor_buffer_features.descriptorBuffer = VK_TRUE;
+      descriptor_buffer_features.pNext = &features12;
+      features12.pNext = (void *)device_info.pNext;
+      device_info.pNext = &descriptor_buffer_features;
+      ctx.descriptor_buffer = true;
+    }
+  }
+
+  // Puts the GPU zones of the trace on the CPU clock
+  if (trace_enabled() && device_extension_supported(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+    device_extensions[device_extension_count++] = VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
+    ctx.calibrated_timestamps = true;
+  }
+
+  // Budgets of the heaps shared with other processes, otherwise residency estimates them
+  if (device_extension_supported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+    device_extensions[device_extension_count++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+    ctx.memory_budget = true;
+  }
+
+  device_info.enabledExtensionCount = device_extension_count;
+  device_info.ppEnabledExtensionNames = device_extensions;
+
   if(vkCreateDevice(ctx.physicalDevice, &device_info, NULL, &ctx.device) != VK_SUCCESS) {
     printf("FAIL 1 \n");
     return false;
   }
 
   vkGetDeviceQueue(ctx.device, ctx.graphics_queue_index.familyIndex, ctx.graphics_queue_index.index, &ctx.graphics_queue);
+  vkGetDeviceQueue(ctx.device, ctx.compute_queue_index.familyIndex, ctx.compute_queue_index.index, &ctx.compute_queue);
 
-  printf("SUCCESS\n");
+  printf("SUCCESS%s%s\n", ctx.graphics_pipeline_library ? " (graphics pipeline library)" : "",
+    ctx.descriptor_buffer ? " (descriptor buffer)" : "");
   return true;
 }
 
@@ -252,6 +538,13 @@ b8 allocate_command_buffers() {
   return true;
 }
 
+b8 create_window() {
+  if (!platform_create_window("My app", 0, 0, settings.width, settings.height, &window)) {
+    return false;
+  }
+  return platform_show_window(&window);
+}
+
 b8 create_surface() {
 #ifdef PLATFORM_WAYLAND
   printf("Creating Linux Wayland Surface ... ");
@@ -279,12 +572,14 @@ b8 create_swapchain() {
   swapchain_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
   swapchain_info.surface = ctx.surface;
   swapchain_info.minImageCount = MAX_FRAMES;
-  swapchain_info.imageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+  swapchain_info.imageFormat = SWAPCHAIN_FORMAT;
   swapchain_info.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
   swapchain_info.imageExtent.width = ctx.next_width;
   swapchain_info.imageExtent.height = ctx.next_height;
   swapchain_info.imageArrayLayers = 1;
-  swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  // The post-processing copies its result into the swapchain, the readback copies it out again
+  swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  if (settings.readback || settings.capture_frame) swapchain_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
   swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
   swapchain_info.queueFamilyIndexCount = 1;
   swapchain_info.pQueueFamilyIndices = &ctx.graphics_queue_index.familyIndex;
@@ -319,7 +614,7 @@ b8 create_swapchain() {
     view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     view_info.image = ctx.swapchain_images[i];
     view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    view_info.format = VK_FORMAT_B8G8R8A8_SRGB;
+    view_info.format = SWAPCHAIN_FORMAT;
     view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
     view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
     view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -341,216 +636,596 @@ b8 create_swapchain() {
   return true;
 }
 
-b8 create_render_pass() {
-  printf("Creating Render Pass ... ");
+// Stands in for the swapchain without a window: the frame slot renders into the image of the
+// same index, which is never presented
+b8 create_offscreen_images() {
+  printf("Creating offscreen images ... ");
+
+  ctx.image_width = ctx.next_width;
+  ctx.image_height = ctx.next_height;
+  ctx.swapchain_image_count = MAX_FRAMES;
+  ctx.swapchain_images = malloc(sizeof(VkImage) * MAX_FRAMES);
+  ctx.swapchain_image_views = malloc(sizeof(VkImageView) * MAX_FRAMES);
+  for (u32 i = 0; i < MAX_FRAMES; i++)
+  {
+    VkImageCreateInfo image_info = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = SWAPCHAIN_FORMAT;
+    image_info.extent = (VkExtent3D){ctx.image_width, ctx.image_height, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(ctx.device, &image_info, NULL, &ctx.swapchain_images[i]) != VK_SUCCESS) {
+      printf("vkCreateImage FAIL %u\n", i);
+      return false;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(ctx.device, ctx.swapchain_images[i], &requirements);
+    VkMemoryAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+    alloc_info.allocationSize = requirements.size;
+    i32 memory_type = vulkan_find_memory_type(&ctx, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (memory_type < 0) {
+      printf("no device local memory\n");
+      return false;
+    }
+    alloc_info.memoryTypeIndex = memory_type;
+    if (vkAllocateMemory(ctx.device, &alloc_info, NULL, &offscreen_memory[i]) != VK_SUCCESS) {
+      printf("vkAllocateMemory FAIL %u\n", i);
+      return false;
+    }
+    vkBindImageMemory(ctx.device, ctx.swapchain_images[i], offscreen_memory[i], 0);
+
+    VkImageViewCreateInfo view_info = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+    view_info.image = ctx.swapchain_images[i];
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = SWAPCHAIN_FORMAT;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(ctx.device, &view_info, NULL, &ctx.swapchain_image_views[i]) != VK_SUCCESS) {
+      printf("vkCreateImageView FAIL %u\n", i);
+      return false;
+    }
+  }
+
+  printf("SUCCESS\n");
+  return true;
+}
+
+void load_render_settings() {
+  const char *prepass = getenv("VKG_DEPTH_PREPASS");
+  if (prepass) settings.depth_prepass = atoi(prepass) != 0;
+  const char *msaa = getenv("VKG_MSAA");
+  if (msaa) settings.msaa_samples = (VkSampleCountFlagBits)atoi(msaa);
+  const char *lights = getenv("VKG_LIGHTS");
+  if (lights) settings.light_count = atoi(lights);
+  const char *sweep = getenv("VKG_LIGHT_SWEEP");
+  if (sweep) settings.light_sweep = atoi(sweep) != 0;
+  const char *ssao = getenv("VKG_SSAO");
+  if (ssao) settings.ssao = atoi(ssao) != 0;
+  const char *async_compute = getenv("VKG_ASYNC_COMPUTE");
+  if (async_compute) settings.async_compute = atoi(async_compute) != 0;
+  const char *pipeline_library = getenv("VKG_PIPELINE_LIBRARY");
+  if (pipeline_library) settings.pipeline_library = atoi(pipeline_library) != 0;
+  const char *pipeline_optimize = getenv("VKG_PIPELINE_OPTIMIZE");
+  if (pipeline_optimize) settings.pipeline_optimize = atoi(pipeline_optimize) != 0;
+  const char *pipeline_async = getenv("VKG_PIPELINE_ASYNC");
+  if (pipeline_async) settings.pipeline_async = atoi(pipeline_async) != 0;
+  const char *material_features = getenv("VKG_MATERIAL_FEATURES");
+  if (material_features) settings.material_features = (u32)strtoul(material_features, 0, 0);
+  const char *shadow_filter = getenv("VKG_SHADOW_FILTER");
+  if (shadow_filter) settings.shadow_filter_taps = atoi(shadow_filter);
+  const char *descriptor_buffer = getenv("VKG_DESCRIPTOR_BUFFER");
+  if (descriptor_buffer) settings.descriptor_buffer = atoi(descriptor_buffer) != 0;
+  const char *reuse_commands = getenv("VKG_REUSE_COMMANDS");
+  if (reuse_commands) settings.reuse_commands = atoi(reuse_commands) != 0;
+  const char *static_scene = getenv("VKG_STATIC_SCENE");
+  if (static_scene) settings.static_scene = atoi(static_scene) != 0;
+  const char *headless = getenv("VKG_HEADLESS");
+  if (headless) settings.headless = atoi(headless) != 0;
+  const char *readback_every_frame = getenv("VKG_READBACK");
+  if (readback_every_frame) settings.readback = atoi(readback_every_frame) != 0;
+  const char *capture_frame = getenv("VKG_CAPTURE_FRAME");
+  if (capture_frame) settings.capture_frame = atoi(capture_frame);
+  settings.golden_path = getenv("VKG_GOLDEN");
+  const char *golden_update = getenv("VKG_GOLDEN_UPDATE");
+  if (golden_update) settings.golden_update = atoi(golden_update) != 0;
+  const char *golden_tolerance = getenv("VKG_GOLDEN_TOLERANCE");
+  if (golden_tolerance) settings.golden_tolerance = atoi(golden_tolerance);
+  const char *golden_max_differing = getenv("VKG_GOLDEN_MAX_DIFFERING");
+  if (golden_max_differing) settings.golden_max_differing = (f32)atof(golden_max_differing);
+  const char *width = getenv("VKG_WIDTH");
+  if (width) settings.width = atoi(width);
+  const char *height = getenv("VKG_HEIGHT");
+  if (height) settings.height = atoi(height);
+  const char *frames_in_flight = getenv("VKG_FRAMES_IN_FLIGHT");
+  if (frames_in_flight) settings.frames_in_flight = atoi(frames_in_flight);
+  const char *frame_limit = getenv("VKG_FRAMES");
+  if (frame_limit) settings.frame_limit = atoi(frame_limit);
+  const char *warmup_frames = getenv("VKG_WARMUP_FRAMES");
+  if (warmup_frames) settings.warmup_frames = atoi(warmup_frames);
+  const char *draw_count = getenv("VKG_DRAWS");
+  if (draw_count) settings.draw_count = atoi(draw_count);
+  const char *pipeline_count = getenv("VKG_PIPELINES");
+  if (pipeline_count) settings.pipeline_count = atoi(pipeline_count);
+  settings.stats_path = getenv("VKG_STATS_JSON");
+  const char *startup_threads = getenv("VKG_STARTUP_THREADS");
+  if (startup_threads) settings.startup_threads = atoi(startup_threads);
+  settings.shader_dir = getenv("VKG_SHADER_DIR");
+  settings.trace_path = getenv("VKG_TRACE");
+  const char *memory_budget_mb = getenv("VKG_MEMORY_BUDGET_MB");
+  if (memory_budget_mb) settings.memory_budget_mb = atoi(memory_budget_mb);
+
+  if (settings.shadow_filter_taps < 1) settings.shadow_filter_taps = 1;
+  if (settings.light_sweep) settings.light_count = 64;
+  if (settings.light_count > MAX_LIGHTS) settings.light_count = MAX_LIGHTS;
+  if (settings.width == 0 || settings.height == 0) {
+    settings.width = 800;
+    settings.height = 600;
+  }
+  if (settings.frames_in_flight < 1) settings.frames_in_flight = 1;
+  if (settings.frames_in_flight > MAX_FRAMES) settings.frames_in_flight = MAX_FRAMES;
+  if (settings.pipeline_count < 1) settings.pipeline_count = 1;
+  if (settings.startup_threads < 1) settings.startup_threads = 1;
+  if (settings.pipeline_count > BENCH_MAX_PIPELINES) settings.pipeline_count = BENCH_MAX_PIPELINES;
+  if (settings.pipeline_count > 1 && settings.draw_count < settings.pipeline_count) settings.draw_count = settings.pipeline_count;
+  if (settings.headless && !settings.frame_limit && !settings.capture_frame) settings.frame_limit = HEADLESS_FRAMES;
+}
 
-  VkAttachmentDescription color_attachment = {0};
-  color_attachment.format = VK_FORMAT_B8G8R8A8_SRGB;
-  color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-  color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-  color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+// Clamps the requested sample count to what both color and depth attachments support
+void choose_msaa_samples() {
+  VkSampleCountFlags supported = ctx.device_properties.limits.framebufferColorSampleCounts &
+    ctx.device_properties.limits.framebufferDepthSampleCounts;
 
-  VkAttachmentReference color_attachment_ref = {0};
-  color_attachment_ref.attachment = 0;
-  color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+  VkSampleCountFlagBits candidates[] = {VK_SAMPLE_COUNT_8_BIT, VK_SAMPLE_COUNT_4_BIT, VK_SAMPLE_COUNT_2_BIT};
+  for (u32 i = 0; i < sizeof(candidates) / sizeof(VkSampleCountFlagBits); i++)
+  {
+    if (candidates[i] <= settings.msaa_samples && (supported & candidates[i])) {
+      samples = candidates[i];
+      break;
+    }
+  }
+  settings.msaa_samples = samples;
+
+  printf("Render settings: depth pre-pass %s, MSAA %ux\n", settings.depth_prepass ? "on" : "off", settings.msaa_samples);
+}
 
-  VkSubpassDescription subpass = {0};
-  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-  subpass.colorAttachmentCount = 1;
-  subpass.pColorAttachments = &color_attachment_ref;
+b8 choose_depth_format() {
+  VkFormat candidates[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM};
+  for (u32 i = 0; i < sizeof(candidates) / sizeof(VkFormat); i++)
+  {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(ctx.physicalDevice, candidates[i], &properties);
+    if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+      ctx.depth_format = candidates[i];
+      return true;
+    }
+  }
+  return false;
+}
 
-  VkSubpassDependency dependency = {0};
-  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.dstSubpass = 0;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.srcAccessMask = 0;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+void bin_lights(VkCommandBuffer command_buffer, void *user_data);
+void draw_shadow_static(VkCommandBuffer command_buffer, void *user_data);
+void composite_shadows(VkCommandBuffer command_buffer, void *user_data);
+void draw_shadow_dynamic(VkCommandBuffer command_buffer, void *user_data);
+void draw_depth_prepass(VkCommandBuffer command_buffer, void *user_data);
+void draw_main_pass(VkCommandBuffer command_buffer, void *user_data);
+void read_back_frame(VkCommandBuffer command_buffer, void *user_data);
 
-  VkRenderPassCreateInfo render_pass_info = {0};
-  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-  render_pass_info.attachmentCount = 1;
-  render_pass_info.pAttachments = &color_attachment;
-  render_pass_info.subpassCount = 1;
-  render_pass_info.pSubpasses = &subpass;
-  render_pass_info.dependencyCount = 1;
-  render_pass_info.pDependencies = &dependency;
+b8 create_render_graph() {
+  printf("Creating render graph ... ");
 
-  if (vkCreateRenderPass(ctx.device, &render_pass_info, NULL, &ctx.render_pass) != VK_SUCCESS) {
-    printf("vkCreateRenderPass FAIL\n");
+  if (!choose_depth_format()) {
+    printf("FAIL 1\n");
     return false;
   }
+  choose_msaa_samples();
+
+  render_graph_create(&render_graph);
+  // The offscreen images of headless rendering are never presented, they end up ready to copy
+  rg_swapchain = render_graph_import_image(&render_graph, "swapchain", SWAPCHAIN_FORMAT, VK_SAMPLE_COUNT_1_BIT,
+    RG_ACCESS_ACQUIRE, settings.headless ? RG_ACCESS_TRANSFER_SRC : RG_ACCESS_PRESENT);
+  // Without a pre-pass the depth buffer lives and dies in the main pass, so the graph makes it a
+  // transient attachment that never leaves tile memory
+  rg_depth = render_graph_create_image(&render_graph, "depth", (RgImageDesc){ctx.depth_format, settings.msaa_samples});
+  // The scene is lit into an HDR image the post-processing turns into the swapchain image.
+  // Multisampled color is resolved into it at the end of the main pass, it is transient as well
+  // and its samples never reach memory on tilers.
+  rg_hdr = render_graph_create_image(&render_graph, "hdr", (RgImageDesc){POST_HDR_FORMAT, VK_SAMPLE_COUNT_1_BIT});
+  b8 msaa = settings.msaa_samples != VK_SAMPLE_COUNT_1_BIT;
+  if (msaa) {
+    rg_color_msaa = render_graph_create_image(&render_graph, "color_msaa", (RgImageDesc){POST_HDR_FORMAT, settings.msaa_samples});
+  }
+
+  // The clusters are rebuilt every frame, the previous frame only read them in its main pass
+  rg_clusters = render_graph_import_buffer(&render_graph, "clusters", RG_ACCESS_STORAGE_READ_FRAGMENT,
+    RG_ACCESS_STORAGE_READ_FRAGMENT);
+  render_graph_set_buffer(&render_graph, rg_clusters, lighting.cluster_buffer.handle);
+  rg_light_binning = render_graph_add_pass(&render_graph, "light_binning", RG_PASS_COMPUTE, bin_lights, NULL);
+  render_graph_use(&render_graph, rg_light_binning, rg_clusters, RG_ACCESS_STORAGE_WRITE_COMPUTE);
+
+  // Shadows: the static casters of the tiles that changed are rendered into the static atlas,
+  // copied into the sampled atlas and the dynamic casters drawn on top. The passes have nothing
+  // to record on frames where every tile is cached.
+  VkExtent2D atlas_extent = {SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE};
+  rg_shadow_static_atlas = render_graph_import_image(&render_graph, "shadow_static_atlas", shadow_atlas.format,
+    VK_SAMPLE_COUNT_1_BIT, RG_ACCESS_TRANSFER_SRC, RG_ACCESS_TRANSFER_SRC);
+  render_graph_set_image(&render_graph, rg_shadow_static_atlas, shadow_atlas.static_image, shadow_atlas.static_view,
+    atlas_extent);
+  rg_shadow_atlas = render_graph_import_image(&render_graph, "shadow_atlas", shadow_atlas.format,
+    VK_SAMPLE_COUNT_1_BIT, RG_ACCESS_SAMPLED_FRAGMENT, RG_ACCESS_SAMPLED_FRAGMENT);
+  render_graph_set_image(&render_graph, rg_shadow_atlas, shadow_atlas.image, shadow_atlas.view, atlas_extent);
+
+  rg_shadow_static = render_graph_add_pass(&render_graph, "shadow_static", RG_PASS_RASTER, draw_shadow_static, NULL);
+  render_graph_use(&render_graph, rg_shadow_static, rg_shadow_static_atlas, RG_ACCESS_DEPTH_ATTACHMENT);
+  rg_shadow_composite = render_graph_add_pass(&render_graph, "shadow_composite", RG_PASS_TRANSFER, composite_shadows, NULL);
+  render_graph_use(&render_graph, rg_shadow_composite, rg_shadow_static_atlas, RG_ACCESS_TRANSFER_SRC);
+  render_graph_use(&render_graph, rg_shadow_composite, rg_shadow_atlas, RG_ACCESS_TRANSFER_DST);
+  rg_shadow_dynamic = render_graph_add_pass(&render_graph, "shadow_dynamic", RG_PASS_RASTER, draw_shadow_dynamic, NULL);
+  render_graph_use(&render_graph, rg_shadow_dynamic, rg_shadow_atlas, RG_ACCESS_DEPTH_ATTACHMENT);
+
+  VkClearValue clear_depth = {.depthStencil = {1.0f, 0}};
+  if (settings.depth_prepass) {
+    rg_depth_prepass = render_graph_add_pass(&render_graph, "depth_prepass", RG_PASS_RASTER, draw_depth_prepass, NULL);
+    render_graph_use_clear(&render_graph, rg_depth_prepass, rg_depth, RG_ACCESS_DEPTH_ATTACHMENT, clear_depth);
+  }
+
+  rg_main_pass = render_graph_add_pass(&render_graph, "main", RG_PASS_RASTER, draw_main_pass, NULL);
+  // Alpha is the view depth of the background
+  VkClearValue clear_color = {{{0.0f, 0.0f, 0.1f, CAMERA_FAR}}};
+  if (msaa) {
+    render_graph_use_clear(&render_graph, rg_main_pass, rg_color_msaa, RG_ACCESS_COLOR_ATTACHMENT, clear_color);
+    render_graph_resolve(&render_graph, rg_main_pass, rg_color_msaa, rg_hdr);
+  } else {
+    render_graph_use_clear(&render_graph, rg_main_pass, rg_hdr, RG_ACCESS_COLOR_ATTACHMENT, clear_color);
+  }
+  if (settings.depth_prepass) {
+    render_graph_use(&render_graph, rg_main_pass, rg_depth, RG_ACCESS_DEPTH_ATTACHMENT_READ_ONLY);
+  } else {
+    render_graph_use_clear(&render_graph, rg_main_pass, rg_depth, RG_ACCESS_DEPTH_ATTACHMENT, clear_depth);
+  }
+  render_graph_use(&render_graph, rg_main_pass, rg_clusters, RG_ACCESS_STORAGE_READ_FRAGMENT);
+  render_graph_use(&render_graph, rg_main_pass, rg_shadow_atlas, RG_ACCESS_SAMPLED_FRAGMENT);
+
+  if (!post_process_add_passes(&ctx, &post, &render_graph, rg_hdr, rg_swapchain, SWAPCHAIN_FORMAT)) {
+    printf("FAIL 2\n");
+    return false;
+  }
+  // Copies the final image to the host on the frames that ask for it, see request_readback
+  if (settings.readback || settings.capture_frame) {
+    rg_readback = render_graph_add_pass(&render_graph, "readback", RG_PASS_TRANSFER, read_back_frame, NULL);
+    render_graph_use(&render_graph, rg_readback, rg_swapchain, RG_ACCESS_TRANSFER_SRC);
+    render_graph_set_side_effects(&render_graph, rg_readback);
+  }
+  if (settings.async_compute) {
+    if (ctx.compute_queue_index.familyIndex != ctx.graphics_queue_index.familyIndex) {
+      render_graph_enable_async_compute(&render_graph, ctx.graphics_queue_index.familyIndex,
+        ctx.compute_queue_index.familyIndex);
+    } else {
+      printf("no compute only queue family, async compute disabled ... ");
+    }
+  }
+  render_graph_set_output(&render_graph, rg_swapchain);
+
+  // The swapchain is created at the requested size, possibly at the same time as the graph
+  if (!render_graph_compile(&ctx, &render_graph, (VkExtent2D){ctx.next_width, ctx.next_height})) {
+    printf("FAIL 3\n");
+    return false;
+  }
+  ctx.render_pass = render_graph_get_render_pass(&render_graph, rg_main_pass);
 
   printf("SUCCESS\n");
+  render_graph_dump(&render_graph);
   return true;
 }
 
-b8 read_file(const char* filename, char** buffer, u32* length) {
-  FILE* file = fopen(filename, "rb");
-  if (!file) return false;
+b8 create_post_process() {
+  printf("Creating post-processing ... ");
 
-  fseek(file, 0, SEEK_END);
-  *length = ftell(file);
-  rewind(file);
+  PostProcessSettings post_settings = {0};
+  post_settings.ssao = settings.ssao;
+  post_settings.async_compute = settings.async_compute;
+  post_settings.exposure = 1.0f;
+  post_settings.bloom_intensity = 0.05f;
+  post_settings.bloom_threshold = 1.0f;
+  post_settings.ssao_radius = 0.3f;
+  post_settings.ssao_intensity = 1.0f;
 
-  *buffer = malloc(*length);
-  size_t read_size = fread(*buffer, 1, *length, file);
-  fclose(file);
+  if (!post_process_create(&ctx, post_settings, &descriptors, &layouts, &post)) {
+    printf("FAIL\n");
+    return false;
+  }
 
-  return (read_size == *length);
+  printf("SUCCESS\n");
+  return true;
 }
 
-VkShaderModule create_shader_module(const char* filename) {
-  char* code = NULL;
-  u32 length = 0;
-
-  if (!read_file(filename, &code, &length)) {
-    printf("Falha ao ler shader: %s\n", filename);
-    return VK_NULL_HANDLE;
+// Command buffers and semaphores of the render graph segments after the first one
+b8 create_segment_resources() {
+  if (render_graph.segment_count < 2) {
+    return true;
   }
+  printf("Creating async compute segments ... ");
 
-  VkShaderModuleCreateInfo create_info = {0};
-  create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  create_info.codeSize = length;
-  create_info.pCode = (u32*)code;
+  VkCommandPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = ctx.compute_queue_index.familyIndex;
+  if (vkCreateCommandPool(ctx.device, &pool_info, NULL, &ctx.compute_command_pool) != VK_SUCCESS) {
+    printf("FAIL 1\n");
+    return false;
+  }
 
-  VkShaderModule module;
-  if (vkCreateShaderModule(ctx.device, &create_info, NULL, &module) != VK_SUCCESS) {
-    printf("Falha ao criar modulo de shader\n");
-    return VK_NULL_HANDLE;
+  VkSemaphoreCreateInfo semaphore_info = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+  for (u32 f = 0; f < MAX_FRAMES; f++)
+  {
+    for (u32 s = 0; s < render_graph.segment_count; s++)
+    {
+      // The last segment signals the render finished semaphore instead
+      if (s + 1 < render_graph.segment_count &&
+        vkCreateSemaphore(ctx.device, &semaphore_info, NULL, &segment_semaphores[f][s]) != VK_SUCCESS) {
+        printf("FAIL 2\n");
+        return false;
+      }
+      if (s == 0) {
+        segment_command_buffers[f][s] = ctx.command_buffers[f];
+        continue;
+      }
+
+      VkCommandBufferAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+      alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      alloc_info.commandPool = render_graph.segments[s].queue == RG_QUEUE_ASYNC_COMPUTE ? ctx.compute_command_pool : ctx.command_pool;
+      alloc_info.commandBufferCount = 1;
+      if (vkAllocateCommandBuffers(ctx.device, &alloc_info, &segment_command_buffers[f][s]) != VK_SUCCESS) {
+        printf("FAIL 3\n");
+        return false;
+      }
+    }
   }
 
-  free(code);
-  return module;
+  printf("SUCCESS\n");
+  return true;
 }
 
-b8 create_graphics_pipeline() {
-  printf("Creating graphics pipeline ... ");
+b8 create_shadow_atlas() {
+  printf("Creating shadow atlas ... ");
 
-  VkShaderModule fragment_shader = create_shader_module("shaders/basic.frag.spv");
-  VkShaderModule vertex_shader = create_shader_module("shaders/basic.vert.spv");
+  if (!shadow_atlas_create(&ctx, &shadow_atlas)) {
+    printf("FAIL\n");
+    return false;
+  }
 
-  if(fragment_shader == VK_NULL_HANDLE || vertex_shader == VK_NULL_HANDLE) {
-    printf("Creating shader module FAIL\n");
+  printf("SUCCESS\n");
+  return true;
+}
+
+b8 create_descriptor_allocator() {
+  printf("Creating descriptor allocator ... ");
+
+  if (!descriptor_allocator_create(&ctx, &descriptors)) {
+    printf("FAIL\n");
     return false;
   }
 
-  VkGraphicsPipelineCreateInfo pipeline_info = {0};
-  pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-  pipeline_info.stageCount = 2;
+  printf("SUCCESS%s\n", ctx.descriptor_buffer ? " (descriptor buffer)" : "");
+  return true;
+}
 
-  VkPipelineShaderStageCreateInfo vertex_info = {0};
-  vertex_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  vertex_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-  vertex_info.module = vertex_shader;
-  vertex_info.pName = "main";
-  VkPipelineShaderStageCreateInfo fragment_info = {0};
-  fragment_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  fragment_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  fragment_info.module = fragment_shader;
-  fragment_info.pName = "main";
+// Loads the shaders and builds the layout they share from their reflection. Per frame data is
+// bound at a dynamic offset, the set is written once and never touched again. The light binning
+// compute pass shares it.
+b8 create_layouts() {
+  printf("Creating layouts ... ");
 
-  VkPipelineShaderStageCreateInfo stages[] = {fragment_info, vertex_info};
+  PipelineCacheSettings cache_settings = {settings.pipeline_library, settings.pipeline_optimize, settings.pipeline_async};
+  if (!pipeline_cache_create(&ctx, cache_settings, ctx.graphics_pipeline_library, &pipelines)) {
+    printf("FAIL\n");
+    return false;
+  }
 
-  pipeline_info.pStages = stages;
+  const char *names[] = {"basic.vert.spv", "basic.frag.spv", "basic_uber.frag.spv",
+    "shadow.vert.spv", "cluster_lights.comp.spv"};
+  const ShaderReflection *reflections[sizeof(names) / sizeof(names[0])];
+  for (u32 i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+  {
+    VkShaderModule module = pipeline_cache_shader(&ctx, &pipelines, names[i]);
+    if (module == VK_NULL_HANDLE) {
+      printf("Creating shader module FAIL\n");
+      return false;
+    }
+    reflections[i] = pipeline_cache_shader_reflection(&pipelines, module);
+  }
+  cluster_shader = pipeline_cache_shader(&ctx, &pipelines, "cluster_lights.comp.spv");
+
+  // The mesh vertex layout must feed every input of both vertex shaders
+  VkVertexInputBindingDescription vertex_binding;
+  VkVertexInputAttributeDescription vertex_attributes[3];
+  u32 attribute_count = mesh_vertex_input_description(&vertex_binding, vertex_attributes);
+  if (!shader_reflect_check_vertex_inputs(reflections[0], vertex_attributes, attribute_count) ||
+    !shader_reflect_check_vertex_inputs(reflections[3], vertex_attributes, attribute_count)) {
+    printf("FAIL\n");
+    return false;
+  }
 
-  VkPipelineVertexInputStateCreateInfo vertex_input = {0};
-  vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  // Frame, draw, instance, light and shadow data live in the uniform ring and instance buffer
+  u32 dynamic_masks[REFLECT_MAX_SETS] = {(1 << 0) | (1 << 1) | (1 << 2) | (1 << 3) | (1 << 5)};
+  VkDescriptorSetLayout set_layouts[REFLECT_MAX_SETS];
+  ctx.pipeline_layout = layout_cache_pipeline_layout(&ctx, &layouts, reflections, sizeof(names) / sizeof(names[0]),
+    dynamic_masks, set_layouts);
+  if (ctx.pipeline_layout == VK_NULL_HANDLE || set_layouts[0] == VK_NULL_HANDLE) {
+    printf("FAIL\n");
+    return false;
+  }
+  ctx.descriptor_set_layout = set_layouts[0];
 
-  VkPipelineInputAssemblyStateCreateInfo input_assembly = {0};
-  input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-  input_assembly.primitiveRestartEnable = VK_FALSE;
+  printf("SUCCESS\n");
+  return true;
+}
 
-  VkPipelineViewportStateCreateInfo viewport_state = {0};
-  viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-  viewport_state.viewportCount = 1;
-  viewport_state.scissorCount = 1;
+b8 create_uniform_buffers() {
+  printf("Creating uniform ring ... ");
 
-  VkPipelineRasterizationStateCreateInfo rasterization_state = {0};
-  rasterization_state.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-  rasterization_state.depthClampEnable = VK_FALSE;
-  rasterization_state.rasterizerDiscardEnable = VK_FALSE;
-  rasterization_state.polygonMode = VK_POLYGON_MODE_FILL;
-  rasterization_state.lineWidth = 1.f;
-  rasterization_state.cullMode = VK_CULL_MODE_BACK_BIT;
-  rasterization_state.frontFace = VK_FRONT_FACE_CLOCKWISE;
+  if (!uniform_ring_create(&ctx, UNIFORM_RING_FRAME_SIZE, MAX_FRAMES, &ctx.uniform_ring)) {
+    printf("FAIL 1\n");
+    return false;
+  }
 
-  VkPipelineMultisampleStateCreateInfo multisample_info = {0};
-  multisample_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-  multisample_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-  multisample_info.sampleShadingEnable = VK_FALSE;
+  printf("Creating instance buffer ... ");
 
-  VkPipelineColorBlendStateCreateInfo color_blend = {0};
-  color_blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-  color_blend.logicOpEnable = VK_FALSE;
-  color_blend.attachmentCount = 1;
+  if (!vulkan_buffer_create(&ctx, INSTANCE_PARTITION_SIZE * MAX_FRAMES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &ctx.instance_buffer)) {
+    printf("FAIL 5\n");
+    return false;
+  }
 
-  VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
-  color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-  color_blend_attachment.blendEnable = VK_TRUE;
-  color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-  color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-  color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
-  color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-  color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-  color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
-  color_blend.pAttachments = &color_blend_attachment;
+  printf("Creating light buffers ... ");
 
-  VkPipelineDynamicStateCreateInfo dynamic_state = {0};
-  dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-  dynamic_state.dynamicStateCount = 2;
-  VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-  dynamic_state.pDynamicStates = dynamic_states;
+  if (!clustered_lighting_create(&ctx, &lighting)) {
+    printf("FAIL 6\n");
+    return false;
+  }
 
-  VkPipelineLayoutCreateInfo pipeline_layout_info = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-  if (vkCreatePipelineLayout(ctx.device, &pipeline_layout_info, 0, &ctx.pipeline_layout) != VK_SUCCESS)
+  // Must match the layout reflected in create_layouts
+  memset(scene_bindings, 0, sizeof(scene_bindings));
+  VkDescriptorType types[7] = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER};
+  for (u32 i = 0; i < 7; i++)
   {
-    printf("vkCreatePipelineLayout FAIL\n");
+    scene_bindings[i].binding = i;
+    scene_bindings[i].type = types[i];
+  }
+  scene_bindings[0].buffer = (VkDescriptorBufferInfo){ctx.uniform_ring.buffer.handle, 0, sizeof(FrameUniforms)};
+  scene_bindings[1].buffer = (VkDescriptorBufferInfo){ctx.uniform_ring.buffer.handle, 0, sizeof(DrawUniforms)};
+  scene_bindings[2].buffer = (VkDescriptorBufferInfo){ctx.instance_buffer.handle, 0, INSTANCE_PARTITION_SIZE};
+  scene_bindings[3].buffer = (VkDescriptorBufferInfo){lighting.light_buffer.handle, 0, LIGHT_PARTITION_SIZE};
+  scene_bindings[4].buffer = (VkDescriptorBufferInfo){lighting.cluster_buffer.handle, 0, lighting.cluster_buffer.size};
+  scene_bindings[5].buffer = (VkDescriptorBufferInfo){ctx.uniform_ring.buffer.handle, 0, sizeof(ShadowUniforms)};
+  // The sampled atlas only leaves the shader read layout inside the shadow passes
+  scene_bindings[6].image.sampler = shadow_atlas.sampler;
+  scene_bindings[6].image.imageView = shadow_atlas.view;
+  scene_bindings[6].image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  // With sets the scene set is written once here and every bind finds it in the immutable cache
+  if (!ctx.descriptor_buffer &&
+    !descriptor_allocator_get_immutable(&ctx, &descriptors, ctx.descriptor_set_layout, scene_bindings, 7)) {
+    printf("FAIL 4\n");
     return false;
   }
 
-  pipeline_info.pVertexInputState = &vertex_input;
-  pipeline_info.pInputAssemblyState = &input_assembly;
-  pipeline_info.pViewportState = &viewport_state;
-  pipeline_info.pRasterizationState = &rasterization_state;
-  pipeline_info.pMultisampleState = &multisample_info;
-  pipeline_info.pColorBlendState = &color_blend;
-  pipeline_info.pDynamicState = &dynamic_state;
-  pipeline_info.layout = ctx.pipeline_layout;
-  pipeline_info.renderPass = ctx.render_pass;
+  printf("SUCCESS\n");
+  return true;
+}
+
+b8 reload_mesh(VkContext *context, void *user_data) {
+  return mesh_load(context, "assets/meshes/torus.mesh", user_data);
+}
+
+// The bounds stay, the draw uniforms are written from them while the mesh is out
+void evict_mesh(VkContext *context, void *user_data) {
+  mesh_destroy(context, user_data);
+}
+
+b8 load_meshes() {
+  printf("Loading meshes ... ");
 
-  if(vkCreateGraphicsPipelines(ctx.device, NULL, 1, &pipeline_info, NULL, &ctx.graphics_pipeline) != VK_SUCCESS) {
-    printf("vkCreateGraphicsPipelines FAIL\n");
+  if (!mesh_load(&ctx, "assets/meshes/torus.mesh", &ctx.mesh)) {
+    printf("FAIL\n");
     return false;
   }
 
+  residency_create(&ctx, (u64)settings.memory_budget_mb * 1024 * 1024, &residency);
+  u32 heap = ctx.memory_properties.memoryTypes[ctx.mesh.vertex_buffer.memory_type].heapIndex;
+  mesh_resource = residency_register(&residency, "torus", ctx.mesh.vertex_buffer.size + ctx.mesh.index_buffer.size, heap,
+    reload_mesh, evict_mesh, &ctx.mesh);
+
   printf("SUCCESS\n");
   return true;
 }
 
-b8 create_framebuffers() {
-  printf("Creating Framebuffers... ");
-  ctx.framebuffers = malloc(sizeof(VkFramebuffer) * ctx.swapchain_image_count);
+b8 create_graphics_pipeline() {
+  printf("Creating graphics pipeline ... ");
 
-  for (u32 i = 0; i < ctx.swapchain_image_count; i++) {
-    VkImageView attachments[] = { ctx.swapchain_image_views[i] };
+  // Already loaded by create_layouts
+  VkShaderModule fragment_shader = pipeline_cache_shader(&ctx, &pipelines, "basic.frag.spv");
+  VkShaderModule vertex_shader = pipeline_cache_shader(&ctx, &pipelines, "basic.vert.spv");
+  VkShaderModule shadow_shader = pipeline_cache_shader(&ctx, &pipelines, "shadow.vert.spv");
+  VkShaderModule uber_shader = pipeline_cache_shader(&ctx, &pipelines, "basic_uber.frag.spv");
 
-    VkFramebufferCreateInfo framebuffer_info = {0};
-    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    framebuffer_info.renderPass = ctx.render_pass;
-    framebuffer_info.attachmentCount = 1;
-    framebuffer_info.pAttachments = attachments;
-    framebuffer_info.width = ctx.next_width;
-    framebuffer_info.height = ctx.next_height;
-    framebuffer_info.layers = 1;
+  if(fragment_shader == VK_NULL_HANDLE || vertex_shader == VK_NULL_HANDLE || shadow_shader == VK_NULL_HANDLE ||
+    uber_shader == VK_NULL_HANDLE) {
+    printf("Creating shader module FAIL\n");
+    return false;
+  }
 
-    if (vkCreateFramebuffer(ctx.device, &framebuffer_info, NULL, &ctx.framebuffers[i]) != VK_SUCCESS) {
-      printf("vkCreateFramebuffer FAIL\n");
+  if (!clustered_lighting_create_pipeline(&ctx, &lighting, cluster_shader, ctx.pipeline_layout)) {
+    return false;
+  }
+
+  // Meshes are counter clockwise, the projection flips y so the winding is preserved on screen,
+  // which is the default of the keys. Opaque geometry only: the alpha channel of the HDR target
+  // holds the view depth. With the pre-pass the depth buffer is final, the color pass only
+  // shades the visible fragment.
+  pipeline_key_init(&main_pipeline_key);
+  main_pipeline_key.vertex_shader = vertex_shader;
+  main_pipeline_key.fragment_shader = fragment_shader;
+  main_pipeline_key.layout = ctx.pipeline_layout;
+  main_pipeline_key.render_pass = ctx.render_pass;
+  main_pipeline_key.samples = settings.msaa_samples;
+  main_pipeline_key.depth_write = !settings.depth_prepass;
+  main_pipeline_key.depth_compare = settings.depth_prepass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
+  pipeline_key_specialize(&main_pipeline_key, PIPELINE_STAGE_FRAGMENT, MATERIAL_CONSTANT_FEATURES,
+    settings.material_features);
+  pipeline_key_specialize(&main_pipeline_key, PIPELINE_STAGE_FRAGMENT, MATERIAL_CONSTANT_SHADOW_FILTER_TAPS,
+    settings.shadow_filter_taps);
+
+  // Same state, the features are branched on at runtime
+  uber_pipeline_key = main_pipeline_key;
+  uber_pipeline_key.fragment_shader = uber_shader;
+
+  // Same vertex shader, no fragment shader and no color attachment
+  prepass_pipeline_key = main_pipeline_key;
+  prepass_pipeline_key.fragment_shader = VK_NULL_HANDLE;
+  memset(prepass_pipeline_key.constants[PIPELINE_STAGE_FRAGMENT], 0, sizeof(main_pipeline_key.constants[PIPELINE_STAGE_FRAGMENT]));
+  prepass_pipeline_key.constant_masks[PIPELINE_STAGE_FRAGMENT] = 0;
+  prepass_pipeline_key.color_attachment_count = 0;
+  prepass_pipeline_key.depth_write = true;
+  prepass_pipeline_key.depth_compare = VK_COMPARE_OP_LESS;
+  prepass_pipeline_key.render_pass = settings.depth_prepass ? render_graph_get_render_pass(&render_graph, rg_depth_prepass) : VK_NULL_HANDLE;
+
+  // Shadow tiles: depth only, single sampled, slope scaled bias against acne. The static and
+  // dynamic shadow passes have compatible render passes.
+  pipeline_key_init(&shadow_pipeline_key);
+  shadow_pipeline_key.vertex_shader = shadow_shader;
+  shadow_pipeline_key.layout = ctx.pipeline_layout;
+  shadow_pipeline_key.render_pass = render_graph_get_render_pass(&render_graph, rg_shadow_static);
+  shadow_pipeline_key.color_attachment_count = 0;
+  shadow_pipeline_key.depth_bias = true;
+
+  // Every pipeline of the frame is known up front, the passes only ever hit the cache. With async
+  // pipelines only the ubershader is ready, the specialized one compiles during the first frames.
+  PipelineKey keys[] = {settings.pipeline_async ? uber_pipeline_key : main_pipeline_key, shadow_pipeline_key,
+    prepass_pipeline_key};
+  if (!pipeline_cache_prewarm(&ctx, &pipelines, keys, settings.depth_prepass ? 3 : 2)) {
+    printf("pipeline_cache_prewarm FAIL\n");
+    return false;
+  }
+
+  // Benchmark variants: the same pipeline with another filter size is a distinct pipeline to bind
+  if (settings.pipeline_count > 1) {
+    for (u32 i = 0; i < settings.pipeline_count; i++)
+    {
+      bench_pipeline_keys[i] = main_pipeline_key;
+      pipeline_key_specialize(&bench_pipeline_keys[i], PIPELINE_STAGE_FRAGMENT, MATERIAL_CONSTANT_SHADOW_FILTER_TAPS,
+        settings.shadow_filter_taps + i);
+    }
+    if (!pipeline_cache_prewarm(&ctx, &pipelines, bench_pipeline_keys, settings.pipeline_count)) {
+      printf("pipeline_cache_prewarm FAIL 2\n");
       return false;
     }
   }
@@ -559,6 +1234,155 @@ b8 create_framebuffers() {
   return true;
 }
 
+b8 create_statistics_queries() {
+  printf("Creating pipeline statistics queries ... ");
+
+  VkPhysicalDeviceFeatures features;
+  vkGetPhysicalDeviceFeatures(ctx.physicalDevice, &features);
+  if (!features.pipelineStatisticsQuery) {
+    printf("UNSUPPORTED\n");
+    return true;
+  }
+
+  VkQueryPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+  pool_info.queryCount = MAX_FRAMES;
+  pool_info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+  if (vkCreateQueryPool(ctx.device, &pool_info, NULL, &ctx.statistics_pool) != VK_SUCCESS) {
+    printf("FAIL 1\n");
+    return false;
+  }
+
+  printf("SUCCESS\n");
+  return true;
+}
+
+void read_statistics_queries() {
+  if (!ctx.statistics_pool || !statistics_pending[ctx.current_frame]) {
+    return;
+  }
+
+  // The frame fence was waited, the result is available
+  u64 fragments = 0;
+  if (vkGetQueryPoolResults(ctx.device, ctx.statistics_pool, ctx.current_frame, 1, sizeof(u64), &fragments,
+    sizeof(u64), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+    statistics_fragments += fragments;
+    statistics_frames++;
+  }
+  statistics_pending[ctx.current_frame] = false;
+}
+
+void report_command_reuse() {
+  u64 frames = commands_recorded + commands_reused;
+  if (frames == 0) {
+    return;
+  }
+  printf("Command buffers: %llu frames recorded, %llu reused (%.1f%%)%s\n", (unsigned long long)commands_recorded,
+    (unsigned long long)commands_reused, 100.0 * (f64)commands_reused / (f64)frames,
+    settings.reuse_commands ? "" : ", reuse disabled");
+  printf("  CPU %.3f ms per recorded frame, %.3f ms per reused frame%s\n",
+    commands_recorded ? recorded_frame_seconds * 1e3 / (f64)commands_recorded : 0.0,
+    commands_reused ? reused_frame_seconds * 1e3 / (f64)commands_reused : 0.0,
+    settings.static_scene ? " (static scene)" : "");
+}
+
+void report_idle() {
+  printf("Frames: %llu rendered, %llu idle wake-ups (%llu while suspended), %.1f s idle\n",
+    (unsigned long long)active_frames, (unsigned long long)idle_wakeups, (unsigned long long)suspended_wakeups,
+    idle_seconds);
+}
+
+int compare_f32(const void *a, const void *b) {
+  f32 x = *(const f32 *)a;
+  f32 y = *(const f32 *)b;
+  return (x > y) - (x < y);
+}
+
+// Sorts the samples in place
+f32 percentile(f32 *samples, u32 count, f32 fraction) {
+  if (count == 0) return 0.0f;
+  qsort(samples, count, sizeof(f32), compare_f32);
+  u32 index = (u32)(fraction * (f32)(count - 1) + 0.5f);
+  return samples[index];
+}
+
+f64 average(const f32 *samples, u32 count) {
+  f64 sum = 0.0;
+  for (u32 i = 0; i < count; i++)
+  {
+    sum += samples[i];
+  }
+  return count ? sum / count : 0.0;
+}
+
+// One line of JSON the benchmark runner reads back, see tools/render_bench.c. Must be called
+// before the GPU timer and the render graph are destroyed.
+void write_stats_json(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    printf("Failed to open %s for writing\n", path);
+    return;
+  }
+
+  f64 frame_ms = average(frame_ms_samples, stats_sample_count);
+  f64 cpu_ms = average(cpu_ms_samples, stats_sample_count);
+  f32 frame_p50 = percentile(frame_ms_samples, stats_sample_count, 0.5f);
+  f32 frame_p99 = percentile(frame_ms_samples, stats_sample_count, 0.99f);
+  f32 cpu_p50 = percentile(cpu_ms_samples, stats_sample_count, 0.5f);
+  f32 cpu_p99 = percentile(cpu_ms_samples, stats_sample_count, 0.99f);
+
+  f64 gpu_ms = 0.0;
+  for (u32 i = 0; i < gpu_timer.zone_count; i++)
+  {
+    GpuTimerZone *zone = &gpu_timer.zones[i];
+    if (zone->samples) gpu_ms += zone->total_ms / zone->samples;
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  u64 memory_usage = 0, memory_budget = 0;
+  for (u32 h = 0; h < residency.heap_count; h++)
+  {
+    if (!(ctx.memory_properties.memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) continue;
+    memory_usage += residency.heap_usage[h];
+    memory_budget += residency.heap_budget[h];
+  }
+
+  fprintf(file, "{\"device\": \"%s\", \"width\": %u, \"height\": %u, \"frames_in_flight\": %u, \"draws\": %u, "
+    "\"pipelines\": %u, \"frames\": %u, \"frame_ms\": %.4f, \"frame_ms_p50\": %.4f, \"frame_ms_p99\": %.4f, "
+    "\"cpu_ms\": %.4f, \"cpu_ms_p50\": %.4f, \"cpu_ms_p99\": %.4f, \"gpu_ms\": %.4f, \"gpu_zones\": {",
+    ctx.device_properties.deviceName, ctx.image_width, ctx.image_height, settings.frames_in_flight,
+    settings.draw_count, settings.pipeline_count, stats_sample_count, frame_ms, frame_p50, frame_p99, cpu_ms, cpu_p50,
+    cpu_p99, gpu_ms);
+  b8 first = true;
+  for (u32 i = 0; i < gpu_timer.zone_count; i++)
+  {
+    GpuTimerZone *zone = &gpu_timer.zones[i];
+    if (zone->samples == 0) continue;
+    fprintf(file, "%s\"%s\": %.4f", first ? "" : ", ", zone->name, zone->total_ms / zone->samples);
+    first = false;
+  }
+  fprintf(file, "}, \"buffer_bytes\": %llu, \"buffer_peak_bytes\": %llu, \"buffer_count\": %u, "
+    "\"render_graph_bytes\": %llu, \"peak_rss_kb\": %ld, \"startup_ms\": %.4f, \"first_frame_ms\": %.4f, "
+    "\"memory_usage_bytes\": %llu, \"memory_budget_bytes\": %llu, \"evictions\": %llu, \"reloads\": %llu}\n",
+    (unsigned long long)ctx.buffer_bytes, (unsigned long long)ctx.buffer_peak_bytes, ctx.buffer_count,
+    (unsigned long long)render_graph.allocated_bytes, usage.ru_maxrss, startup.seconds * 1000.0,
+    first_frame_seconds * 1000.0, (unsigned long long)memory_usage, (unsigned long long)memory_budget,
+    (unsigned long long)residency.evictions, (unsigned long long)residency.reloads);
+  fclose(file);
+}
+
+void report_statistics_queries() {
+  if (statistics_frames == 0) {
+    return;
+  }
+  printf("Color pass fragment shader invocations: %llu per frame over %llu frames (depth pre-pass %s, MSAA %ux)\n",
+    (unsigned long long)(statistics_fragments / statistics_frames), (unsigned long long)statistics_frames,
+    settings.depth_prepass ? "on" : "off", settings.msaa_samples);
+}
+
 b8 create_sync_objects() {
   printf("Creating sync objects ... ");
 
@@ -593,26 +1417,7 @@ b8 create_sync_objects() {
   return true;
 }
 
-b8 record_command_buffer() {
-  VkCommandBufferBeginInfo command_begin_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-
-  vkBeginCommandBuffer(ctx.command_buffers[ctx.current_frame], &command_begin_info);
-
-  VkRenderPassBeginInfo renderpass_info = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
-  renderpass_info.renderPass = ctx.render_pass;
-  renderpass_info.framebuffer = ctx.framebuffers[ctx.image_index];
-  renderpass_info.renderArea.offset = (VkOffset2D){0, 0};
-  renderpass_info.renderArea.extent.width = ctx.image_width;
-  renderpass_info.renderArea.extent.height = ctx.image_height;
-
-  VkClearValue clear_color = {{{0.0f, 0.0f, 0.1f, 1.0f}}};
-  renderpass_info.clearValueCount = 1;
-  renderpass_info.pClearValues = &clear_color;
-
-  vkCmdBeginRenderPass(ctx.command_buffers[ctx.current_frame], &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
-
-  vkCmdBindPipeline(ctx.command_buffers[ctx.current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, ctx.graphics_pipeline);
-
+void set_viewport(VkCommandBuffer command_buffer) {
   VkViewport viewport = {0};
   viewport.x = 0.0f;
   viewport.y = 0.0f;
@@ -620,21 +1425,305 @@ b8 record_command_buffer() {
   viewport.height = (f32)ctx.image_height;
   viewport.minDepth = 0.0f;
   viewport.maxDepth = 1.0f;
-  vkCmdSetViewport(ctx.command_buffers[ctx.current_frame], 0, 1, &viewport);
+  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
 
   VkRect2D scissor = {0};
   scissor.offset = (VkOffset2D){0, 0};
   scissor.extent = (VkExtent2D){ctx.image_width, ctx.image_height};
-  vkCmdSetScissor(ctx.command_buffers[ctx.current_frame], 0, 1, &scissor);
-  vkCmdDraw(ctx.command_buffers[ctx.current_frame], 3, 1, 0, 0);
+  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+}
+
+// The frame's offsets go into the dynamic bindings, in binding order
+void bind_scene_set(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point) {
+  const u32 dynamic_bindings[5] = {0, 1, 2, 3, 5};
+  for (u32 i = 0; i < 5; i++)
+  {
+    scene_bindings[dynamic_bindings[i]].buffer.offset = draw_offsets[i];
+  }
+  descriptor_allocator_bind(&ctx, &descriptors, command_buffer, bind_point, ctx.pipeline_layout, 0,
+    ctx.descriptor_set_layout, scene_bindings, 7, true);
+}
+
+void bin_lights(VkCommandBuffer command_buffer, void *user_data) {
+  bind_scene_set(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+  clustered_lighting_dispatch(&lighting, command_buffer);
+}
+
+void bind_scene(VkCommandBuffer command_buffer) {
+  bind_scene_set(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+
+  VkDeviceSize vertex_offset = 0;
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &ctx.mesh.vertex_buffer.handle, &vertex_offset);
+  vkCmdBindIndexBuffer(command_buffer, ctx.mesh.index_buffer.handle, 0, ctx.mesh.index_type);
+}
 
-  vkCmdEndRenderPass(ctx.command_buffers[ctx.current_frame]);
-  vkEndCommandBuffer(ctx.command_buffers[ctx.current_frame]);
+void draw_scene(VkCommandBuffer command_buffer) {
+  bind_scene(command_buffer);
+  vkCmdDrawIndexed(command_buffer, ctx.mesh.index_count, scene.count, 0, 0, 0);
+}
+
+// Benchmark: one instance per draw call, cycling through them, and alternating between the
+// pipeline variants. Instances drawn again fail the depth test or shade the same fragments, the
+// image is the same as with one instanced draw as long as there is one pipeline.
+void draw_scene_split(VkCommandBuffer command_buffer) {
+  bind_scene(command_buffer);
+  for (u32 d = 0; d < settings.draw_count; d++)
+  {
+    if (settings.pipeline_count > 1) {
+      VkPipeline pipeline = pipeline_cache_get(&ctx, &pipelines, &bench_pipeline_keys[d % settings.pipeline_count]);
+      vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    }
+    vkCmdDrawIndexed(command_buffer, ctx.mesh.index_count, 1, 0, 0, d % scene.count);
+  }
+}
+
+// Draws the static or the dynamic casters of a list of tiles, each into its own viewport
+void draw_shadow_tiles(VkCommandBuffer command_buffer, const u32 *tiles, u32 tile_count, b8 static_casters) {
+  if (tile_count == 0) return;
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_cache_get(&ctx, &pipelines, &shadow_pipeline_key));
+  bind_scene(command_buffer);
+  vkCmdSetDepthBias(command_buffer, 1.25f, 0.0f, 1.75f);
+
+  u32 first_instance = static_casters ? static_first : 0;
+  u32 instance_count = static_casters ? static_count : static_first;
+  for (u32 i = 0; i < tile_count; i++)
+  {
+    ShadowTile *tile = &shadow_atlas.tiles[tiles[i]];
+    if (!static_casters && !tile->has_dynamic) continue;
+
+    VkRect2D rect = shadow_atlas_tile_rect(tiles[i]);
+    VkViewport viewport = {(f32)rect.offset.x, (f32)rect.offset.y, (f32)rect.extent.width, (f32)rect.extent.height, 0.0f, 1.0f};
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    vkCmdSetScissor(command_buffer, 0, 1, &rect);
+
+    // The rest of the atlas is loaded, only the tiles being rendered start from the far plane
+    if (static_casters) {
+      VkClearAttachment clear = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, {.depthStencil = {1.0f, 0}}};
+      VkClearRect clear_rect = {rect, 0, 1};
+      vkCmdClearAttachments(command_buffer, 1, &clear, 1, &clear_rect);
+    }
+
+    vkCmdPushConstants(command_buffer, ctx.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Mat4), &tile->view_proj);
+    vkCmdDrawIndexed(command_buffer, ctx.mesh.index_count, instance_count, 0, 0, first_instance);
+  }
+}
 
+void draw_shadow_static(VkCommandBuffer command_buffer, void *user_data) {
+  draw_shadow_tiles(command_buffer, shadow_atlas.static_updates, shadow_atlas.static_update_count, true);
+}
+
+void composite_shadows(VkCommandBuffer command_buffer, void *user_data) {
+  shadow_atlas_record_copies(&shadow_atlas, command_buffer);
+}
+
+void draw_shadow_dynamic(VkCommandBuffer command_buffer, void *user_data) {
+  draw_shadow_tiles(command_buffer, shadow_atlas.composite_updates, shadow_atlas.composite_update_count, false);
+}
+
+void draw_depth_prepass(VkCommandBuffer command_buffer, void *user_data) {
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_cache_get(&ctx, &pipelines, &prepass_pipeline_key));
+  set_viewport(command_buffer);
+  draw_scene(command_buffer);
+}
+
+void draw_main_pass(VkCommandBuffer command_buffer, void *user_data) {
+  if (ctx.statistics_pool) {
+    vkCmdBeginQuery(command_buffer, ctx.statistics_pool, ctx.current_frame, 0);
+  }
+
+  b8 fallback;
+  VkPipeline pipeline = pipeline_cache_get_async(&ctx, &pipelines, &main_pipeline_key, &uber_pipeline_key, &fallback);
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  if (fallback) {
+    u32 features[4] = {settings.material_features};
+    vkCmdPushConstants(command_buffer, ctx.pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, MATERIAL_PUSH_OFFSET,
+      sizeof(features), features);
+  }
+  set_viewport(command_buffer);
+  if (settings.draw_count) {
+    draw_scene_split(command_buffer);
+  } else {
+    draw_scene(command_buffer);
+  }
+
+  if (ctx.statistics_pool) {
+    vkCmdEndQuery(command_buffer, ctx.statistics_pool, ctx.current_frame);
+    statistics_pending[ctx.current_frame] = true;
+  }
+}
+
+// Writes the uniforms of the frame, whether its commands are recorded again or not
+b8 write_frame_uniforms(f32 time, Mat4 *out_projection) {
+  FrameUniforms *frame_uniforms = uniform_ring_alloc(&ctx.uniform_ring, sizeof(FrameUniforms), &draw_offsets[0]);
+  DrawUniforms *draw_uniforms = uniform_ring_alloc(&ctx.uniform_ring, sizeof(DrawUniforms), &draw_offsets[1]);
+  ShadowUniforms *shadow_uniforms = uniform_ring_alloc(&ctx.uniform_ring, sizeof(ShadowUniforms), &draw_offsets[4]);
+  if (!frame_uniforms || !draw_uniforms || !shadow_uniforms) {
+    printf("Uniform ring out of space\n");
+    return false;
+  }
+
+  Mat4 view = mat4_look_at(vec3_create(0.0f, 0.0f, 3.0f), vec3_create(0.0f, 0.0f, 0.0f), vec3_create(0.0f, 1.0f, 0.0f));
+  Mat4 projection = mat4_perspective(V_PI / 3.0f, (f32)ctx.image_width / (f32)ctx.image_height, CAMERA_NEAR, CAMERA_FAR);
+  frame_uniforms->view_proj = mat4_mul(&projection, &view);
+  frame_uniforms->view = view;
+  frame_uniforms->time[0] = time;
+  frame_uniforms->screen[0] = (f32)ctx.image_width;
+  frame_uniforms->screen[1] = (f32)ctx.image_height;
+  frame_uniforms->screen[2] = 1.0f / projection.data[0];
+  frame_uniforms->screen[3] = 1.0f / projection.data[5];
+  clustered_lighting_depth_params(CAMERA_NEAR, CAMERA_FAR, frame_uniforms->cluster_depth);
+  frame_uniforms->light_count[0] = settings.light_count;
+
+  *draw_uniforms = (DrawUniforms){
+    {0.8f, 0.8f, 0.8f, 1.0f},
+    {ctx.mesh.center[0], ctx.mesh.center[1], ctx.mesh.center[2], 0.0f},
+    {ctx.mesh.extent[0], ctx.mesh.extent[1], ctx.mesh.extent[2], 0.0f},
+  };
+
+  // Only the tiles referenced by the lights are read
+  for (u32 i = 0; i < SHADOW_MAX_TILES; i++)
+  {
+    if (shadow_atlas_tile_ready(&shadow_atlas, i)) {
+      shadow_uniforms->view_proj[i] = shadow_atlas.tiles[i].view_proj;
+      shadow_atlas_tile_uv(i, shadow_uniforms->rect[i]);
+    }
+  }
+
+  draw_offsets[2] = ctx.current_frame * INSTANCE_PARTITION_SIZE;
+  draw_offsets[3] = ctx.current_frame * LIGHT_PARTITION_SIZE;
+  *out_projection = projection;
   return true;
 }
 
-void handle_resize() {
+// FNV-1a
+u64 hash_bytes(const void *data, u64 size, u64 hash) {
+  const u8 *bytes = (const u8 *)data;
+  for (u64 i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+void read_back_frame(VkCommandBuffer command_buffer, void *user_data) {
+  readback_record(&readback, command_buffer, ctx.current_frame, ctx.swapchain_images[ctx.image_index]);
+}
+
+// Hashes what the recorded commands depend on and may change from one frame to the next. The
+// pipeline cache version covers pipelines swapped in by the compile thread, the residency version
+// buffers evicted and loaded again, the shadow updates are draws and copies with the tile matrices
+// as push constants.
+u64 frame_command_key() {
+  u64 key = hash_bytes(&command_version, sizeof(command_version), 14695981039346656037ull);
+  key = hash_bytes(&ctx.image_index, sizeof(ctx.image_index), key);
+  key = hash_bytes(&ctx.image_width, sizeof(ctx.image_width), key);
+  key = hash_bytes(&ctx.image_height, sizeof(ctx.image_height), key);
+  key = hash_bytes(draw_offsets, sizeof(draw_offsets), key);
+  key = hash_bytes(&pipelines.version, sizeof(pipelines.version), key);
+  key = hash_bytes(&residency.version, sizeof(residency.version), key);
+  key = hash_bytes(&settings.light_count, sizeof(settings.light_count), key);
+  b8 copy = readback_requested(&readback, ctx.current_frame);
+  key = hash_bytes(&copy, sizeof(copy), key);
+
+  key = hash_bytes(&shadow_atlas.static_update_count, sizeof(u32), key);
+  key = hash_bytes(shadow_atlas.static_updates, sizeof(u32) * shadow_atlas.static_update_count, key);
+  key = hash_bytes(&shadow_atlas.composite_update_count, sizeof(u32), key);
+  key = hash_bytes(shadow_atlas.composite_updates, sizeof(u32) * shadow_atlas.composite_update_count, key);
+  for (u32 i = 0; i < shadow_atlas.composite_update_count; i++)
+  {
+    ShadowTile *tile = &shadow_atlas.tiles[shadow_atlas.composite_updates[i]];
+    key = hash_bytes(&tile->view_proj, sizeof(Mat4), key);
+    key = hash_bytes(&tile->has_dynamic, sizeof(tile->has_dynamic), key);
+  }
+  for (u32 i = 0; i < shadow_atlas.static_update_count; i++)
+  {
+    key = hash_bytes(&shadow_atlas.tiles[shadow_atlas.static_updates[i]].view_proj, sizeof(Mat4), key);
+  }
+  return key;
+}
+
+b8 record_command_buffer(const Mat4 *projection) {
+  post_process_begin_frame(&post, projection);
+  render_graph_set_image(&render_graph, rg_swapchain, ctx.swapchain_images[ctx.image_index],
+    ctx.swapchain_image_views[ctx.image_index], (VkExtent2D){ctx.image_width, ctx.image_height});
+
+  // One command buffer per segment, a single one without async compute
+  b8 result = true;
+  for (u32 s = 0; s < render_graph.segment_count && result; s++)
+  {
+    VkCommandBuffer command_buffer = s == 0 ? ctx.command_buffers[ctx.current_frame] : segment_command_buffers[ctx.current_frame][s];
+    if (s > 0) vkResetCommandBuffer(command_buffer, 0);
+
+    VkCommandBufferBeginInfo command_begin_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    vkBeginCommandBuffer(command_buffer, &command_begin_info);
+
+    if (s == 0) {
+      gpu_timer_begin_frame(&ctx, &gpu_timer, command_buffer, ctx.current_frame);
+
+      if (ctx.statistics_pool) {
+        vkCmdResetQueryPool(command_buffer, ctx.statistics_pool, ctx.current_frame, 1);
+      }
+    }
+
+    result = render_graph_execute_segment(&ctx, &render_graph, s, command_buffer);
+
+    vkEndCommandBuffer(command_buffer);
+  }
+
+  return result;
+}
+
+// Submits the segments of the frame in order, each waiting for the previous one. The last
+// segment is on the graphics queue, it waits for the swapchain image and signals the fence.
+// Without a window there is no swapchain image to wait for.
+b8 submit_segments() {
+  u32 last = render_graph.segment_count - 1;
+  for (u32 s = 0; s <= last; s++)
+  {
+    RgSegment *segment = &render_graph.segments[s];
+
+    VkSemaphoreSubmitInfo waits[2] = {0};
+    u32 wait_count = 0;
+    if (s > 0) {
+      waits[wait_count] = (VkSemaphoreSubmitInfo){VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO};
+      waits[wait_count].semaphore = segment_semaphores[ctx.current_frame][s - 1];
+      waits[wait_count++].stageMask = segment->wait_stage;
+    }
+    if (s == last && !settings.headless) {
+      waits[wait_count] = (VkSemaphoreSubmitInfo){VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO};
+      waits[wait_count].semaphore = ctx.image_available_semaphores[ctx.current_frame];
+      waits[wait_count++].stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    }
+
+    VkSemaphoreSubmitInfo signal = {VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO};
+    signal.semaphore = s == last ? ctx.render_finished_semaphores[ctx.current_frame] : segment_semaphores[ctx.current_frame][s];
+    signal.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+    VkCommandBufferSubmitInfo command_buffer_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO};
+    command_buffer_info.commandBuffer = segment_command_buffers[ctx.current_frame][s];
+
+    VkSubmitInfo2 submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO_2};
+    submit_info.waitSemaphoreInfoCount = wait_count;
+    submit_info.pWaitSemaphoreInfos = waits;
+    submit_info.commandBufferInfoCount = 1;
+    submit_info.pCommandBufferInfos = &command_buffer_info;
+    // Nothing presents the offscreen images, so nothing would wait for the last semaphore
+    submit_info.signalSemaphoreInfoCount = s == last && settings.headless ? 0 : 1;
+    submit_info.pSignalSemaphoreInfos = &signal;
+
+    VkQueue queue = segment->queue == RG_QUEUE_ASYNC_COMPUTE ? ctx.compute_queue : ctx.graphics_queue;
+    VkFence fence = s == last ? ctx.in_flight_fences[ctx.current_frame] : VK_NULL_HANDLE;
+    if (vkQueueSubmit2(queue, 1, &submit_info, fence) != VK_SUCCESS) {
+      printf("Submit fail on segment %u\n", s);
+      return false;
+    }
+  }
+  return true;
+}
+
+b8 handle_resize() {
   printf("Resizing ...");
 
   vkDeviceWaitIdle(ctx.device);
@@ -642,65 +1731,241 @@ void handle_resize() {
   for (u32 i = 0; i < ctx.swapchain_image_count; i++)
   {
     vkDestroyImageView(ctx.device, ctx.swapchain_image_views[i], NULL);
-    vkDestroyFramebuffer(ctx.device, ctx.framebuffers[i], NULL);
   }
 
-  create_swapchain();
-  create_framebuffers();
+  if (!create_swapchain()) {
+    return false;
+  }
+  if (!render_graph_resize(&ctx, &render_graph, (VkExtent2D){ctx.image_width, ctx.image_height})) {
+    printf("Render graph resize FAIL\n");
+    return false;
+  }
+  // Same image indices, new images and framebuffers
+  command_version++;
+  return true;
+}
+
+void update_lights(f32 time);
+void update_shadows();
+void light_sweep_step();
+
+// Writes the reference with VKG_GOLDEN_UPDATE, otherwise compares the capture against it. A
+// failed comparison writes the capture next to the reference and makes the process exit with 1.
+void check_golden_image(const ReadbackImage *image) {
+  if (!settings.golden_path || settings.golden_update) {
+    const char *path = settings.golden_path ? settings.golden_path : "capture.ppm";
+    if (golden_image_write(path, image, true)) {
+      printf("Golden image: frame %llu written to %s\n", (unsigned long long)image->frame, path);
+    } else {
+      exit_code = 1;
+    }
+    return;
+  }
+
+  GoldenDiff diff;
+  b8 compared = golden_image_compare(settings.golden_path, image, true, settings.golden_tolerance, &diff);
+  b8 passed = compared && diff.differing_pixels <= (u64)(settings.golden_max_differing * (f64)diff.pixel_count);
+  if (compared) {
+    printf("Golden image %s: %s, frame %llu, %llu of %llu pixels differ by more than %u, max difference %u, mean %.4f\n",
+      settings.golden_path, passed ? "PASS" : "FAIL", (unsigned long long)image->frame,
+      (unsigned long long)diff.differing_pixels, (unsigned long long)diff.pixel_count, settings.golden_tolerance,
+      diff.max_difference, diff.mean_difference);
+  }
+  if (!passed) {
+    char actual_path[512];
+    snprintf(actual_path, sizeof(actual_path), "%s.actual.ppm", settings.golden_path);
+    if (golden_image_write(actual_path, image, true)) printf("Golden image: frame written to %s\n", actual_path);
+    exit_code = 1;
+  }
+}
+
+// Takes the copy of the previous use of the frame slot, the capture ends the run
+void collect_readback() {
+  ReadbackImage image = readback_collect(&ctx, &readback, ctx.current_frame);
+  if (!image.data || !capture_requested || image.frame != capture_frame_number) {
+    return;
+  }
+  check_golden_image(&image);
+  running = false;
+}
+
+// Every frame with VKG_READBACK. The capture waits for the shadow tiles held back by the update
+// budgets, so it does not depend on how many frames they took.
+void request_readback() {
+  b8 capture = settings.capture_frame && !capture_requested && frame_count >= settings.capture_frame &&
+    !shadow_atlas_pending(&shadow_atlas);
+  if (!capture && !settings.readback) {
+    return;
+  }
+  if (readback_request(&ctx, &readback, ctx.current_frame, frame_count, ctx.image_width, ctx.image_height) && capture) {
+    capture_requested = true;
+    capture_frame_number = frame_count;
+  }
+}
+
+// Keeps the frame times of the first STATS_MAX_FRAMES frames after the warm-up
+void record_frame_time(f64 frame_seconds, f64 cpu_seconds) {
+  if (frame_count < settings.warmup_frames) {
+    return;
+  }
+  if (frame_count == settings.warmup_frames) {
+    gpu_timer_reset(&gpu_timer);
+  }
+  if (stats_sample_count < STATS_MAX_FRAMES) {
+    frame_ms_samples[stats_sample_count] = (f32)(frame_seconds * 1000.0);
+    cpu_ms_samples[stats_sample_count] = (f32)(cpu_seconds * 1000.0);
+    stats_sample_count++;
+  }
 }
 
 b8 frame() {
+  TRACE_SCOPE("frame", TRACE_COLOR_DEFAULT);
+  f64 frame_start = platform_get_absolute_time();
+  TraceZone zone = trace_begin("wait_fence", TRACE_COLOR_BAD);
   vkWaitForFences(ctx.device, 1, &ctx.in_flight_fences[ctx.current_frame], VK_TRUE, UINT64_MAX);
-  vkResetFences(ctx.device, 1, &ctx.in_flight_fences[ctx.current_frame]);
+  trace_end(zone);
+  read_statistics_queries();
+  collect_readback();
+  pipeline_cache_begin_frame(&ctx, &pipelines);
+  residency_begin_frame(&ctx, &residency, frame_count);
 
   if(ctx.next_width != ctx.image_width || ctx.next_height != ctx.image_height) {
-    handle_resize();
+    if (!handle_resize()) {
+      return false;
+    }
   }
 
-  VkResult result = vkAcquireNextImageKHR(ctx.device, ctx.swapchain, UINT64_MAX, ctx.image_available_semaphores[ctx.current_frame], 0, &ctx.image_index);
+  VkResult result = VK_SUCCESS;
+  if (settings.headless) {
+    ctx.image_index = ctx.current_frame;
+  } else {
+    zone = trace_begin("acquire", TRACE_COLOR_BAD);
+    result = vkAcquireNextImageKHR(ctx.device, ctx.swapchain, UINT64_MAX, ctx.image_available_semaphores[ctx.current_frame], 0, &ctx.image_index);
+    trace_end(zone);
+  }
   if(result == VK_ERROR_OUT_OF_DATE_KHR) {
     printf("Swapchain out of date! Recriacao necessaria.\n");
-    handle_resize();
+    if (!handle_resize()) {
+      return false;
+    }
   } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
     printf("Falha ao adquirir imagem! Error code %i\n", result);
     return false; 
   }
-  
-
-  vkResetCommandBuffer(ctx.command_buffers[ctx.current_frame], 0);
 
-  record_command_buffer();
+  f64 cpu_start = platform_get_absolute_time();
+  zone = trace_begin("update", TRACE_COLOR_DEFAULT);
+  f32 time = settings.static_scene ? 0.0f : (f32)cpu_start;
+  scene_set_rotation(&scene, scene_root, quat_from_axis_angle(vec3_create(0.3f, 1.0f, 0.2f), time));
+  scene_update(&scene, (Mat4 *)((u8 *)ctx.instance_buffer.mapped + ctx.current_frame * INSTANCE_PARTITION_SIZE),
+    MAX_INSTANCES);
+  update_lights(time);
+  update_shadows();
+  request_readback();
+
+  uniform_ring_begin_frame(&ctx.uniform_ring, ctx.current_frame);
+  Mat4 projection;
+  b8 uniforms_written = write_frame_uniforms(time, &projection);
+  if (!residency_use(&ctx, &residency, mesh_resource)) {
+    return false;
+  }
+  u64 command_key = frame_command_key();
+  b8 reuse = uniforms_written && settings.reuse_commands && command_valid[ctx.current_frame] &&
+    command_keys[ctx.current_frame] == command_key;
+  trace_end(zone);
+  zone = trace_begin(reuse ? "reuse_commands" : "record_commands", TRACE_COLOR_DEFAULT);
+  if (reuse) {
+    // The queries are reset and written by the same commands as last time
+    gpu_timer_collect(&ctx, &gpu_timer, ctx.current_frame);
+    statistics_pending[ctx.current_frame] = ctx.statistics_pool != VK_NULL_HANDLE;
+  } else {
+    // The sets of the previous recording of this slot are released only now
+    vkResetCommandBuffer(ctx.command_buffers[ctx.current_frame], 0);
+    descriptor_allocator_begin_frame(&ctx, &descriptors, ctx.current_frame);
+    command_valid[ctx.current_frame] = uniforms_written && record_command_buffer(&projection);
+    command_keys[ctx.current_frame] = command_key;
+  }
+  uniform_ring_end_frame(&ctx, &ctx.uniform_ring);
+  trace_end(zone);
+  if (!command_valid[ctx.current_frame]) {
+    printf("Recording frame commands FAIL\n");
+    return false;
+  }
 
-  VkSubmitInfo submit_info = {0};
-  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  VkSemaphore wait_semaphores[] = {ctx.image_available_semaphores[ctx.current_frame]};
+  // Reset only right before the submission that signals it, a frame failing earlier leaves the
+  // fence signaled and the next wait on it returns
+  zone = trace_begin("submit", TRACE_COLOR_DEFAULT);
+  vkResetFences(ctx.device, 1, &ctx.in_flight_fences[ctx.current_frame]);
   VkSemaphore signal_semaphores[] = {ctx.render_finished_semaphores[ctx.current_frame]};
-  VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submit_info.waitSemaphoreCount = 1;
-  submit_info.pWaitSemaphores = wait_semaphores;
-  submit_info.pWaitDstStageMask = wait_stages;
-  submit_info.commandBufferCount = 1;
-  submit_info.pCommandBuffers = &ctx.command_buffers[ctx.current_frame];
-  submit_info.signalSemaphoreCount = 1;
-  submit_info.pSignalSemaphores = signal_semaphores;
-
-  if(vkQueueSubmit(ctx.graphics_queue, 1, &submit_info, ctx.in_flight_fences[ctx.current_frame]) != VK_SUCCESS) {
-    printf("Submit fail\n");
-    return false;
+  if (render_graph.segment_count > 1) {
+    if (!submit_segments()) {
+      return false;
+    }
+  } else {
+    VkSubmitInfo submit_info = {0};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    VkSemaphore wait_semaphores[] = {ctx.image_available_semaphores[ctx.current_frame]};
+    VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    submit_info.waitSemaphoreCount = settings.headless ? 0 : 1;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = wait_stages;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &ctx.command_buffers[ctx.current_frame];
+    submit_info.signalSemaphoreCount = settings.headless ? 0 : 1;
+    submit_info.pSignalSemaphores = signal_semaphores;
+
+    if(vkQueueSubmit(ctx.graphics_queue, 1, &submit_info, ctx.in_flight_fences[ctx.current_frame]) != VK_SUCCESS) {
+      printf("Submit fail\n");
+      return false;
+    }
   }
 
-  VkPresentInfoKHR present_info = {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
-  present_info.waitSemaphoreCount = 1;
-  present_info.pWaitSemaphores = signal_semaphores;
-  present_info.swapchainCount = 1;
-  present_info.pSwapchains = &ctx.swapchain;
-  present_info.pImageIndices = &ctx.image_index;
+  trace_end(zone);
 
-  if(vkQueuePresentKHR(ctx.graphics_queue, &present_info) != VK_SUCCESS) {
-    printf("Present FAIL\n");
-    return false;
+  f64 cpu_seconds = platform_get_absolute_time() - cpu_start;
+  if (reuse) {
+    commands_reused++;
+    reused_frame_seconds += cpu_seconds;
+  } else {
+    commands_recorded++;
+    recorded_frame_seconds += cpu_seconds;
+  }
+
+  if (!settings.headless) {
+    VkPresentInfoKHR present_info = {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
+    present_info.waitSemaphoreCount = 1;
+    present_info.pWaitSemaphores = signal_semaphores;
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = &ctx.swapchain;
+    present_info.pImageIndices = &ctx.image_index;
+
+    zone = trace_begin("present", TRACE_COLOR_BAD);
+    VkResult present_result = vkQueuePresentKHR(ctx.graphics_queue, &present_info);
+    trace_end(zone);
+    // An out of date swapchain is recreated by the next acquire, the frame was still submitted
+    if(present_result != VK_SUCCESS && present_result != VK_SUBOPTIMAL_KHR && present_result != VK_ERROR_OUT_OF_DATE_KHR) {
+      printf("Present FAIL\n");
+      return false;
+    }
+  }
+  record_frame_time(platform_get_absolute_time() - frame_start, cpu_seconds);
+  ctx.current_frame = (ctx.current_frame+1) % settings.frames_in_flight;
+  frame_count++;
+  if (frame_count == 1) {
+    first_frame_seconds = platform_get_absolute_time() - process_start;
+    printf("Time to first frame: %.2f ms, %.2f ms of it in the startup\n", first_frame_seconds * 1000.0,
+      startup.seconds * 1000.0);
+  }
+  if (settings.frame_limit && frame_count >= settings.frame_limit) {
+    running = false;
+  }
+  if (settings.light_sweep && frame_count % LIGHT_SWEEP_FRAMES == 0) {
+    light_sweep_step();
+  }
+  if (trace_requested) {
+    trace_requested = 0;
+    trace_write(settings.trace_path);
   }
-  ctx.current_frame = (ctx.current_frame+1) % MAX_FRAMES;
   return true;
 }
 
@@ -708,59 +1973,340 @@ b8 resize_event(u16 code, void* sender, EventContext data) {
   printf("Event code resized received!");
   ctx.next_width = data.data.u32[0];
   ctx.next_height = data.data.u32[1];
+  view_dirty = true;
 
   return false;
 }
 
+b8 window_state_event(u16 code, void* sender, EventContext data) {
+  b8 suspended = data.data.u8[0];
+  if (suspended != window_suspended) {
+    printf("Window %s\n", suspended ? "suspended" : "resumed");
+  }
+  window_suspended = suspended;
+  // Sent on activation changes too, which only need a new frame, not their state
+  view_dirty = true;
+
+  return false;
+}
+
+// Animation, shadow updates held back by the budgets and a pending resize keep the view dirty.
+// Nothing is rendered while suspended, the compositor would not show it.
+b8 view_needs_frame() {
+  if (window_suspended) {
+    return false;
+  }
+  return view_dirty || !settings.static_scene || settings.light_sweep || settings.capture_frame ||
+    shadow_atlas_pending(&shadow_atlas) || ctx.next_width != ctx.image_width || ctx.next_height != ctx.image_height;
+}
+
 b8 quit_event(u16 code, void* sender, EventContext data) {
   running = false;
   return false;
 }
 
-b8 vk_init() {
-  if(!create_instance()) {
-    return false;
+// Light benchmark scene: lights scattered in a fixed volume around the meshes. The radius
+// shrinks as the count grows so the lights cover about the same volume in total, like a scene
+// with many small lights, and the cost of a cluster stays about the same.
+void create_lights() {
+  u32 seed = 1234;
+  f32 radius = 1.5f * cbrtf(64.0f / settings.light_count);
+  for (u32 i = 0; i < settings.light_count; i++)
+  {
+    f32 r[7];
+    for (u32 k = 0; k < 7; k++)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      r[k] = (seed >> 8) / 16777216.0f;
+    }
+
+    GpuLight *light = &scene_lights[i];
+    *light = (GpuLight){
+      {-3.0f + 6.0f * r[0], -2.0f + 4.0f * r[1], -2.0f + 3.0f * r[2], radius},
+      {0.3f + 1.2f * r[3], 0.3f + 1.2f * r[4], 0.3f + 1.2f * r[5], LIGHT_TYPE_POINT},
+      {0.0f, -1.0f, 0.0f, -1.0f},
+      {-1.0f, 0.0f, 0.0f, 0.0f},
+    };
+    // A quarter of them are spot lights aimed at the center
+    if (r[6] < 0.25f) {
+      Vec3 direction = vec3_normalize(vec3_mul_scalar(vec3_create(light->position_radius[0], light->position_radius[1],
+        light->position_radius[2]), -1.0f));
+      light->color_type[3] = LIGHT_TYPE_SPOT;
+      light->direction_cone[0] = direction.x;
+      light->direction_cone[1] = direction.y;
+      light->direction_cone[2] = direction.z;
+      light->direction_cone[3] = cosf(V_PI / 6.0f);
+      light->position_radius[3] *= 2.0f;
+    }
   }
-  if(!setup_debug_messenger()) {
-    return false;
+}
+
+// Point lights wander, spot lights stay fixed so the static part of their shadow stays cached
+void update_lights(f32 time) {
+  GpuLight *lights = clustered_lighting_lights(&lighting, ctx.current_frame);
+  for (u32 i = 0; i < settings.light_count; i++)
+  {
+    lights[i] = scene_lights[i];
+    if (lights[i].color_type[3] == LIGHT_TYPE_POINT) {
+      lights[i].position_radius[0] += 0.3f * sinf(time + i);
+      lights[i].position_radius[1] += 0.3f * cosf(time * 0.7f + i);
+    }
   }
-  if(!choose_physical_device()) {
-    return false;
+}
+
+b8 node_overlaps_light(u32 node, const GpuLight *light) {
+  const Mat4 *world = scene_get_world(&scene, node);
+  f32 scale = vec3_length(vec3_create(world->data[0], world->data[1], world->data[2]));
+  f32 radius = vec3_length(vec3_create(ctx.mesh.extent[0], ctx.mesh.extent[1], ctx.mesh.extent[2])) * scale;
+  Vec3 offset = vec3_sub(vec3_create(world->data[12], world->data[13], world->data[14]),
+    vec3_create(light->position_radius[0], light->position_radius[1], light->position_radius[2]));
+  f32 reach = radius + light->position_radius[3];
+  return vec3_dot(offset, offset) < reach * reach;
+}
+
+Mat4 spot_light_view_proj(const GpuLight *light) {
+  Vec3 position = vec3_create(light->position_radius[0], light->position_radius[1], light->position_radius[2]);
+  Vec3 direction = vec3_create(light->direction_cone[0], light->direction_cone[1], light->direction_cone[2]);
+  Vec3 up = fabsf(direction.y) > 0.99f ? vec3_create(1.0f, 0.0f, 0.0f) : vec3_create(0.0f, 1.0f, 0.0f);
+  Mat4 view = mat4_look_at(position, vec3_add(position, direction), up);
+  // A little wider than the cone so the filter taps at the edge stay inside the tile
+  Mat4 projection = mat4_perspective(2.0f * acosf(light->direction_cone[3]) * 1.1f, 1.0f, 0.05f, light->position_radius[3]);
+  return mat4_mul(&projection, &view);
+}
+
+/**
+ * Requests a shadow tile for the spot lights closest to the camera and schedules the atlas
+ * updates of the frame. Must run after the scene and light updates of the frame.
+ */
+void update_shadows() {
+  GpuLight *lights = clustered_lighting_lights(&lighting, ctx.current_frame);
+  shadow_atlas_begin_frame(&shadow_atlas);
+
+  // Static casters that moved drop the cached tiles they overlap
+  for (u32 node = static_first; node < static_first + static_count; node++)
+  {
+    if (!scene_node_changed(&scene, node)) continue;
+    for (u32 t = 0; t < SHADOW_MAX_TILES; t++)
+    {
+      u32 light = shadow_atlas.tiles[t].light;
+      if (light != SHADOW_NO_LIGHT && light < settings.light_count && node_overlaps_light(node, &lights[light])) {
+        shadow_atlas_invalidate(&shadow_atlas, t);
+      }
+    }
   }
-  if(!create_logical_device()) {
-    return false;
+
+  // Closest spot lights first, by insertion into a list as long as the atlas
+  Vec3 eye = vec3_create(0.0f, 0.0f, 3.0f);
+  u32 candidates[SHADOW_MAX_TILES];
+  f32 distances[SHADOW_MAX_TILES];
+  u32 candidate_count = 0;
+  for (u32 i = 0; i < settings.light_count; i++)
+  {
+    if (lights[i].color_type[3] != LIGHT_TYPE_SPOT) continue;
+    Vec3 offset = vec3_sub(vec3_create(lights[i].position_radius[0], lights[i].position_radius[1],
+      lights[i].position_radius[2]), eye);
+    f32 distance = vec3_dot(offset, offset);
+    if (candidate_count == SHADOW_MAX_TILES && distance >= distances[candidate_count - 1]) continue;
+
+    u32 c = candidate_count < SHADOW_MAX_TILES ? candidate_count++ : SHADOW_MAX_TILES - 1;
+    while (c > 0 && distances[c - 1] > distance) {
+      candidates[c] = candidates[c - 1];
+      distances[c] = distances[c - 1];
+      c--;
+    }
+    candidates[c] = i;
+    distances[c] = distance;
   }
-  if(!allocate_command_buffers()) {
-    return false;
+
+  u32 tiles[SHADOW_MAX_TILES];
+  for (u32 c = 0; c < candidate_count; c++)
+  {
+    GpuLight *light = &lights[candidates[c]];
+    Mat4 view_proj = spot_light_view_proj(light);
+    b8 dynamic_casters = false;
+    for (u32 node = 0; node < static_first && !dynamic_casters; node++)
+    {
+      dynamic_casters = node_overlaps_light(node, light);
+    }
+    tiles[c] = shadow_atlas_request(&shadow_atlas, candidates[c], &view_proj, dynamic_casters);
   }
-  if(!create_surface()) {
-    return false;
+  shadow_atlas_schedule(&shadow_atlas);
+
+  for (u32 c = 0; c < candidate_count; c++)
+  {
+    if (shadow_atlas_tile_ready(&shadow_atlas, tiles[c])) {
+      lights[candidates[c]].shadow[0] = (f32)tiles[c];
+    }
   }
-  if(!create_swapchain()) {
-    return false;
+}
+
+void light_sweep_step() {
+  printf("Lights %u:\n", settings.light_count);
+  gpu_timer_report(&gpu_timer);
+  gpu_timer_reset(&gpu_timer);
+
+  if (settings.light_count >= MAX_LIGHTS) {
+    running = false;
+    return;
   }
-  if(!create_render_pass()) {
+  settings.light_count *= 2;
+  create_lights();
+}
+
+b8 create_scene() {
+  printf("Creating scene ... ");
+
+  if (!jobs_initialize(0)) {
+    printf("FAIL 1\n");
     return false;
   }
-  if(!create_graphics_pipeline()) {
+  if (!scene_create(16, MAX_FRAMES, &scene)) {
+    printf("FAIL 2\n");
     return false;
   }
-  if(!create_framebuffers()) {
-    return false;
+
+  // A spinning root with three smaller meshes orbiting around it
+  scene_root = scene_add_node(&scene, SCENE_INVALID_NODE);
+  scene_set_scale(&scene, scene_root, vec3_create(0.6f, 0.6f, 0.6f));
+  for (u32 i = 0; i < 3; i++)
+  {
+    f32 angle = i * 2.0f * V_PI / 3.0f;
+    u32 child = scene_add_node(&scene, scene_root);
+    scene_set_position(&scene, child, vec3_create(1.8f * cosf(angle), 1.8f * sinf(angle), 0.0f));
+    scene_set_scale(&scene, child, vec3_create(0.4f, 0.4f, 0.4f));
+  }
+
+  // A ring of static meshes below them, the spot lights cast the spinning ones onto it
+  static_first = scene.count;
+  static_count = 8;
+  for (u32 i = 0; i < static_count; i++)
+  {
+    f32 angle = i * 2.0f * V_PI / static_count;
+    u32 node = scene_add_node(&scene, SCENE_INVALID_NODE);
+    scene_set_position(&scene, node, vec3_create(2.2f * cosf(angle), -1.4f, -1.0f + 1.0f * sinf(angle)));
+    scene_set_rotation(&scene, node, quat_from_axis_angle(vec3_create(1.0f, 0.0f, 0.0f), V_PI / 2.0f));
+    scene_set_scale(&scene, node, vec3_create(0.35f, 0.35f, 0.35f));
   }
-  if(!create_sync_objects()) {
+
+  // Every node owns a matrix in each partition of the instance buffer
+  if (scene.count > MAX_INSTANCES) {
+    printf("FAIL 3\n");
     return false;
   }
 
+  create_lights();
+
+  printf("SUCCESS\n");
+  return true;
+}
+
+b8 create_gpu_timer() {
+  printf("Creating GPU timer ... ");
+
+  if (!gpu_timer_create(&ctx, &gpu_timer)) {
+    printf("UNSUPPORTED\n");
+    return true;
+  }
+  render_graph_set_timer(&render_graph, &gpu_timer);
 
+  printf("SUCCESS\n");
   return true;
 }
 
+// The startup as steps with the ones they depend on. Connecting to the compositor overlaps with
+// creating the instance, and loading the shaders, compiling the pipelines and uploading the meshes
+// with creating the surface and the swapchain: the render graph is compiled at the requested size,
+// not at the size of the swapchain.
+b8 vk_init() {
+  startup_create(&startup);
+  u32 window_step = settings.headless ? 0 : startup_add(&startup, "window", create_window, 0, 0);
+  startup_add(&startup, "scene", create_scene, 0, 0);
+  u32 instance_step = startup_add(&startup, "instance", create_instance, 0, 0);
+  u32 debug_step = startup_add(&startup, "debug_messenger", setup_debug_messenger, instance_step, 0);
+  u32 physical_device_step = startup_add(&startup, "physical_device", choose_physical_device, instance_step, 0);
+  u32 device_step = startup_add(&startup, "logical_device", create_logical_device, physical_device_step | debug_step, 0);
+  u32 command_step = startup_add(&startup, "command_buffers", allocate_command_buffers, device_step,
+    STARTUP_LOCK_COMMAND_POOL);
+  u32 images_step;
+  if (settings.headless) {
+    images_step = startup_add(&startup, "offscreen_images", create_offscreen_images, device_step, 0);
+  } else {
+    u32 surface_step = startup_add(&startup, "surface", create_surface, instance_step | window_step, 0);
+    images_step = startup_add(&startup, "swapchain", create_swapchain, surface_step | device_step, 0);
+  }
+  u32 atlas_step = startup_add(&startup, "shadow_atlas", create_shadow_atlas, command_step, STARTUP_LOCK_COMMAND_POOL);
+  u32 descriptor_step = startup_add(&startup, "descriptor_allocator", create_descriptor_allocator, device_step,
+    STARTUP_LOCK_BUFFERS);
+  u32 layouts_step = startup_add(&startup, "layouts", create_layouts, descriptor_step, 0);
+  u32 uniforms_step = startup_add(&startup, "uniform_buffers", create_uniform_buffers, layouts_step | atlas_step,
+    STARTUP_LOCK_BUFFERS);
+  u32 post_step = startup_add(&startup, "post_process", create_post_process, layouts_step, 0);
+  u32 graph_step = startup_add(&startup, "render_graph", create_render_graph, uniforms_step | post_step, 0);
+  startup_add(&startup, "segment_resources", create_segment_resources, graph_step | command_step,
+    STARTUP_LOCK_COMMAND_POOL);
+  startup_add(&startup, "meshes", load_meshes, command_step, STARTUP_LOCK_COMMAND_POOL | STARTUP_LOCK_BUFFERS);
+  startup_add(&startup, "graphics_pipeline", create_graphics_pipeline, graph_step | layouts_step, 0);
+  startup_add(&startup, "statistics_queries", create_statistics_queries, device_step, 0);
+  startup_add(&startup, "gpu_timer", create_gpu_timer, graph_step, 0);
+  startup_add(&startup, "sync_objects", create_sync_objects, images_step, 0);
+
+  // Buffers are created on the first request, 4 bytes per pixel of SWAPCHAIN_FORMAT
+  readback_create(&readback, 4);
+
+  b8 result = startup_run(&startup, settings.startup_threads);
+  startup_report(&startup);
+  return result;
+}
+
 void vk_cleanup() {
   printf("\nClean\n");
   vkDeviceWaitIdle(ctx.device);
 
-  vkDestroySwapchainKHR(ctx.device, ctx.swapchain, NULL);
+  uniform_ring_report(&ctx.uniform_ring);
+  report_statistics_queries();
+  report_command_reuse();
+  report_idle();
+  readback_report(&readback);
+  residency_report(&residency);
+  gpu_timer_report(&gpu_timer);
+  if (settings.stats_path) write_stats_json(settings.stats_path);
+  if (settings.trace_path) trace_write(settings.trace_path);
+  shadow_atlas_report(&shadow_atlas);
+  pipeline_cache_report(&pipelines);
+  layout_cache_report(&layouts);
+  descriptor_allocator_report(&descriptors);
+  gpu_timer_destroy(&ctx, &gpu_timer);
+  shadow_atlas_destroy(&ctx, &shadow_atlas);
+  clustered_lighting_destroy(&ctx, &lighting);
+  if (ctx.statistics_pool) vkDestroyQueryPool(ctx.device, ctx.statistics_pool, NULL);
+  uniform_ring_destroy(&ctx, &ctx.uniform_ring);
+  vulkan_buffer_destroy(&ctx, &ctx.instance_buffer);
+  mesh_destroy(&ctx, &ctx.mesh);
+  descriptor_allocator_destroy(&ctx, &descriptors);
+  readback_destroy(&ctx, &readback);
+  post_process_destroy(&ctx, &post);
+  pipeline_cache_destroy(&ctx, &pipelines);
+  layout_cache_destroy(&ctx, &layouts);
+  render_graph_destroy(&ctx, &render_graph);
+  for (u32 f = 0; f < MAX_FRAMES; f++)
+  {
+    for (u32 s = 0; s < render_graph.segment_count; s++)
+    {
+      if (segment_semaphores[f][s]) vkDestroySemaphore(ctx.device, segment_semaphores[f][s], NULL);
+    }
+  }
+  if (ctx.compute_command_pool) vkDestroyCommandPool(ctx.device, ctx.compute_command_pool, NULL);
+
+  if (settings.headless) {
+    for (u32 i = 0; i < MAX_FRAMES; i++)
+    {
+      vkDestroyImageView(ctx.device, ctx.swapchain_image_views[i], NULL);
+      vkDestroyImage(ctx.device, ctx.swapchain_images[i], NULL);
+      vkFreeMemory(ctx.device, offscreen_memory[i], NULL);
+    }
+  } else {
+    vkDestroySwapchainKHR(ctx.device, ctx.swapchain, NULL);
+  }
   vkDestroyCommandPool(ctx.device, ctx.command_pool, NULL);
 
   vkDestroyDevice(ctx.device, NULL);
@@ -770,25 +2316,75 @@ void vk_cleanup() {
     func(ctx.instance, ctx.debug_messenger, 0);
 
   vkDestroyInstance(ctx.instance, NULL);
+
+  scene_destroy(&scene);
+  jobs_shutdown();
+  trace_shutdown();
+}
+
+void request_trace(int signal_number) {
+  trace_requested = 1;
 }
 
 int main() {
+  process_start = platform_get_absolute_time();
+  load_render_settings();
+  vulkan_shader_set_override_dir(settings.shader_dir);
+  if (settings.trace_path) {
+    trace_initialize();
+    trace_set_thread_name("main");
+    signal(SIGUSR1, request_trace);
+  }
+
   event_initialize();
   event_register(EVENT_CODE_RESIZED, NULL, resize_event);
   event_register(EVENT_CODE_APPLICATION_QUIT, NULL, quit_event);
-  platform_create_window("My app", 0, 0, 1280, 720, &window);
-  platform_show_window(&window);
+  event_register(EVENT_CODE_WINDOW_STATE, NULL, window_state_event);
 
-  ctx.next_width = 800;
-  ctx.next_height = 600;
+  ctx.next_width = settings.width;
+  ctx.next_height = settings.height;
 
+  // Creates the window and the scene as well
   if(vk_init()) {
+    // Without a window every frame renders until the capture or the frame limit
+    while (settings.headless && running) {
+      if (!frame()) {
+        exit_code = 1;
+        running = false;
+      }
+      active_frames++;
+      fflush(stdout);
+    }
     while (running) {
-      platform_process_window_messages(&window);
-      frame();
+      // Only blocks for the next compositor event when there is nothing to render. Presenting does
+      // not wake this loop, the swapchain reads its events on a queue of its own.
+      b8 idle = !view_needs_frame();
+      f64 wait_start = platform_get_absolute_time();
+      if (!platform_process_window_messages(&window, idle)) {
+        printf("Window connection FAIL\n");
+        exit_code = 1;
+        running = false;
+        break;
+      }
+      if (idle) idle_seconds += platform_get_absolute_time() - wait_start;
+
+      if (view_needs_frame()) {
+        if (!frame()) {
+          exit_code = 1;
+          running = false;
+        }
+        view_dirty = false;
+        active_frames++;
+      } else {
+        idle_wakeups++;
+        if (window_suspended) suspended_wakeups++;
+      }
       fflush(stdout);
     }
+  } else {
+    exit_code = 1;
   }
 
   vk_cleanup();
+  return exit_code;
 }
\ No newline at end of file
@@ -9,6 +9,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <poll.h>
 #include "xdg-shell-client-protocol.h"
 
 WaylandState *platform_linux_get_wayland_state(Window *window) {
@@ -99,10 +101,32 @@ b8 platform_hide_window(Window* window) {
   xdg_toplevel_set_minimized(state->xdg_toplevel);
   return true;
 }
-b8 platform_process_window_messages(Window* window) {
+b8 platform_process_window_messages(Window* window, b8 block) {
   WaylandState* state = (WaylandState*)window->internal_state;
-  wl_display_dispatch(state->display);
-  return true;
+  if (block) {
+    return wl_display_dispatch(state->display) >= 0;
+  }
+
+  // Reads only what already arrived on the socket, the events queued before go first
+  while (wl_display_prepare_read(state->display) != 0)
+  {
+    if (wl_display_dispatch_pending(state->display) < 0) return false;
+  }
+  wl_display_flush(state->display);
+
+  struct pollfd fd = {wl_display_get_fd(state->display), POLLIN, 0};
+  if (poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN)) {
+    if (wl_display_read_events(state->display) < 0) return false;
+  } else {
+    wl_display_cancel_read(state->display);
+  }
+  return wl_display_dispatch_pending(state->display) >= 0;
+}
+
+f64 platform_get_absolute_time() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 0.000000001;
 }
 
 static void global_registry_handler(void* data, struct wl_registry *registry, u32 id,
@@ -112,7 +136,9 @@ const char *interface, u32 version) {
   if (!strcmp(interface, wl_compositor_interface.name)) {
     state->compositor = wl_registry_bind(registry, id, &wl_compositor_interface, version);
   }else if (!strcmp(interface, xdg_wm_base_interface.name)) {
-    state->xdg_wm_base = wl_registry_bind(registry, id, &xdg_wm_base_interface, version);
+    // The suspended state needs version 6, never bind above what the generated protocol knows
+    u32 supported = (u32)xdg_wm_base_interface.version;
+    state->xdg_wm_base = wl_registry_bind(registry, id, &xdg_wm_base_interface, version < supported ? version : supported);
     xdg_wm_base_add_listener(state->xdg_wm_base, &xdg_wm_base_listener, data);
   }
 }
@@ -123,13 +149,33 @@ static void xdg_wm_base_ping(void *data, struct xdg_wm_base *shell, u32 serial)
   xdg_wm_base_pong(shell, serial);
 }
 
-static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u32 serial) {}
+static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u32 serial) {
+  xdg_surface_ack_configure(xdg_surface, serial);
+}
 
 static void xdg_toplevel_configure (void *data, struct xdg_toplevel *xdg_toplevel, i32 width, 
   i32 height, struct wl_array *states) {
 
   WaylandState* state = (WaylandState*)data;
 
+  b8 suspended = false;
+  b8 activated = false;
+  u32 *toplevel_state;
+  wl_array_for_each(toplevel_state, states)
+  {
+    if (*toplevel_state == XDG_TOPLEVEL_STATE_SUSPENDED) suspended = true;
+    if (*toplevel_state == XDG_TOPLEVEL_STATE_ACTIVATED) activated = true;
+  }
+  if (suspended != state->suspended || activated != state->activated) {
+    state->suspended = suspended;
+    state->activated = activated;
+
+    EventContext ctx = {0};
+    ctx.data.u8[0] = suspended;
+    ctx.data.u8[1] = activated;
+    event_fire(EVENT_CODE_WINDOW_STATE, &state, ctx);
+  }
+
   if (!width || !height) return;
 	if (width == state->width && height == state->height) return;
   
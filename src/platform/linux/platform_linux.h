@@ -14,6 +14,8 @@ typedef struct WaylandState {
   
   u32 width;
   u32 height;
+  b8 suspended; // xdg_toplevel states of the last configure
+  b8 activated;
 } WaylandState;
 
 WaylandState *platform_linux_get_wayland_state(Window *window);
\ No newline at end of file
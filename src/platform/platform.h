@@ -10,4 +10,9 @@ b8 platform_create_window(const char* window_name, u32 pos_x, u32 pos_y, u32 wid
 void platform_destroy_window(Window* window);
 b8 platform_show_window(Window* window);
 b8 platform_hide_window(Window* window);
-b8 platform_process_window_messages(Window* window);
\ No newline at end of file
+// Dispatches the window events that arrived. With block and none pending, waits until the
+// compositor sends something. Returns FALSE if the connection to the compositor failed.
+b8 platform_process_window_messages(Window* window, b8 block);
+
+// Monotonic time in seconds, only meaningful as a difference between two calls.
+f64 platform_get_absolute_time();
\ No newline at end of file
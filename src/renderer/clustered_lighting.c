@@ -0,0 +1,60 @@
+#include "clustered_lighting.h"
+#include "vulkan_buffer.h"
+#include <math.h>
+#include <stdio.h>
+
+b8 clustered_lighting_create(VkContext *context, ClusteredLighting *lighting) {
+  if (!vulkan_buffer_create(context, LIGHT_PARTITION_SIZE * MAX_FRAMES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &lighting->light_buffer)) {
+    printf("Clustered lighting: light buffer FAIL\n");
+    return false;
+  }
+
+  if (!vulkan_buffer_create(context, CLUSTER_COUNT * CLUSTER_STRIDE * sizeof(u32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &lighting->cluster_buffer)) {
+    printf("Clustered lighting: cluster buffer FAIL\n");
+    return false;
+  }
+
+  return true;
+}
+
+b8 clustered_lighting_create_pipeline(VkContext *context, ClusteredLighting *lighting, VkShaderModule shader,
+  VkPipelineLayout layout) {
+  VkComputePipelineCreateInfo pipeline_info = {VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+  pipeline_info.flags = context->descriptor_buffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+  pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = shader;
+  pipeline_info.stage.pName = "main";
+  pipeline_info.layout = layout;
+
+  if (vkCreateComputePipelines(context->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &lighting->pipeline) != VK_SUCCESS) {
+    printf("Clustered lighting: vkCreateComputePipelines FAIL\n");
+    return false;
+  }
+  return true;
+}
+
+void clustered_lighting_destroy(VkContext *context, ClusteredLighting *lighting) {
+  if (lighting->pipeline) vkDestroyPipeline(context->device, lighting->pipeline, NULL);
+  vulkan_buffer_destroy(context, &lighting->light_buffer);
+  vulkan_buffer_destroy(context, &lighting->cluster_buffer);
+}
+
+GpuLight *clustered_lighting_lights(ClusteredLighting *lighting, u32 frame) {
+  return (GpuLight *)((u8 *)lighting->light_buffer.mapped + frame * LIGHT_PARTITION_SIZE);
+}
+
+void clustered_lighting_depth_params(f32 near, f32 far, f32 out_params[4]) {
+  f32 log_ratio = logf(far / near);
+  out_params[0] = near;
+  out_params[1] = far;
+  out_params[2] = CLUSTER_GRID_Z / log_ratio;
+  out_params[3] = -CLUSTER_GRID_Z * logf(near) / log_ratio;
+}
+
+void clustered_lighting_dispatch(ClusteredLighting *lighting, VkCommandBuffer command_buffer) {
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, lighting->pipeline);
+  vkCmdDispatch(command_buffer, (CLUSTER_COUNT + CLUSTER_WORKGROUP_SIZE - 1) / CLUSTER_WORKGROUP_SIZE, 1, 1);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+
+// Must match cluster_lights.comp and basic.frag
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+#define CLUSTER_MAX_LIGHTS 127
+#define CLUSTER_STRIDE (CLUSTER_MAX_LIGHTS + 1) // Light count followed by the light indices
+#define CLUSTER_WORKGROUP_SIZE 64
+
+#define MAX_LIGHTS 4096
+#define LIGHT_PARTITION_SIZE (MAX_LIGHTS * sizeof(GpuLight))
+
+typedef enum LightType {
+  LIGHT_TYPE_POINT,
+  LIGHT_TYPE_SPOT,
+} LightType;
+
+// std430 layout of a light, in world space
+typedef struct GpuLight {
+  f32 position_radius[4];
+  f32 color_type[4];     // Color premultiplied by intensity, LightType in w
+  f32 direction_cone[4]; // Spot direction and cosine of the outer cone angle
+  f32 shadow[4];         // Shadow atlas tile in x, -1 without a shadow
+} GpuLight;
+
+typedef struct ClusteredLighting {
+  VulkanBuffer light_buffer;   // MAX_FRAMES partitions of MAX_LIGHTS lights, written by the host
+  VulkanBuffer cluster_buffer; // CLUSTER_COUNT * CLUSTER_STRIDE indices, written by the binning pass
+  VkPipeline pipeline;
+} ClusteredLighting;
+
+/**
+ * Creates the light and cluster buffers.
+ * @returns TRUE on success.
+ */
+b8 clustered_lighting_create(VkContext *context, ClusteredLighting *lighting);
+
+/**
+ * Creates the binning compute pipeline. It shares the descriptor set of the scene, the layout
+ * must expose the frame uniforms, lights and clusters to the compute stage.
+ * @param shader shaders/cluster_lights.comp.spv, owned by the caller.
+ * @returns TRUE on success.
+ */
+b8 clustered_lighting_create_pipeline(VkContext *context, ClusteredLighting *lighting, VkShaderModule shader,
+  VkPipelineLayout layout);
+void clustered_lighting_destroy(VkContext *context, ClusteredLighting *lighting);
+
+/**
+ * @returns The mapped lights of a frame slot, to be filled before the frame is submitted.
+ */
+GpuLight *clustered_lighting_lights(ClusteredLighting *lighting, u32 frame);
+
+/**
+ * Computes the exponential depth slicing parameters stored in the frame uniforms:
+ * slice = log(view depth) * scale + bias.
+ */
+void clustered_lighting_depth_params(f32 near, f32 far, f32 out_params[4]);
+
+/**
+ * Records the binning dispatch. The descriptor set must already be bound to the compute bind point.
+ */
+void clustered_lighting_dispatch(ClusteredLighting *lighting, VkCommandBuffer command_buffer);
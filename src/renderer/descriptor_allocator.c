@@ -0,0 +1,461 @@
+#include "descriptor_allocator.h"
+#include "vulkan_buffer.h"
+#include "platform/platform.h"
+#include <stdio.h>
+#include <string.h>
+
+// Descriptors of each type a pool holds per set, generous for the few large sets there are
+static const VkDescriptorPoolSize pool_ratios[] = {
+  {VK_DESCRIPTOR_TYPE_SAMPLER, 1},
+  {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4},
+  {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1},
+  {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+  {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2},
+  {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},
+  {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2},
+  {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2},
+};
+
+#define POOL_RATIO_COUNT (sizeof(pool_ratios) / sizeof(pool_ratios[0]))
+
+b8 descriptor_allocator_create(VkContext *context, DescriptorAllocator *allocator) {
+  memset(allocator, 0, sizeof(DescriptorAllocator));
+  if (!context->descriptor_buffer) return true;
+
+  allocator->get_layout_size =
+    (PFN_vkGetDescriptorSetLayoutSizeEXT)vkGetDeviceProcAddr(context->device, "vkGetDescriptorSetLayoutSizeEXT");
+  allocator->get_binding_offset =
+    (PFN_vkGetDescriptorSetLayoutBindingOffsetEXT)vkGetDeviceProcAddr(context->device, "vkGetDescriptorSetLayoutBindingOffsetEXT");
+  allocator->get_descriptor = (PFN_vkGetDescriptorEXT)vkGetDeviceProcAddr(context->device, "vkGetDescriptorEXT");
+  allocator->cmd_bind_buffers =
+    (PFN_vkCmdBindDescriptorBuffersEXT)vkGetDeviceProcAddr(context->device, "vkCmdBindDescriptorBuffersEXT");
+  allocator->cmd_set_offsets =
+    (PFN_vkCmdSetDescriptorBufferOffsetsEXT)vkGetDeviceProcAddr(context->device, "vkCmdSetDescriptorBufferOffsetsEXT");
+  if (!allocator->get_layout_size || !allocator->get_binding_offset || !allocator->get_descriptor ||
+    !allocator->cmd_bind_buffers || !allocator->cmd_set_offsets) {
+    printf("Descriptor allocator: missing VK_EXT_descriptor_buffer entry points, using sets\n");
+    context->descriptor_buffer = false;
+    return true;
+  }
+
+  allocator->buffer_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+  VkPhysicalDeviceProperties2 properties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  properties.pNext = &allocator->buffer_properties;
+  vkGetPhysicalDeviceProperties2(context->physicalDevice, &properties);
+  allocator->buffer_properties.pNext = NULL;
+
+  // Samplers live next to the resources, one buffer serves every set
+  if (!vulkan_buffer_create(context, DESCRIPTOR_BUFFER_FRAME_SIZE * MAX_FRAMES,
+    VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT |
+    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &allocator->ring)) {
+    printf("Descriptor allocator: descriptor buffer FAIL, using sets\n");
+    context->descriptor_buffer = false;
+    return true;
+  }
+  VkBufferDeviceAddressInfo address_info = {VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO};
+  address_info.buffer = allocator->ring.handle;
+  allocator->ring_address = vkGetBufferDeviceAddress(context->device, &address_info);
+  allocator->use_buffer = true;
+  return true;
+}
+
+static void destroy_list(VkContext *context, DescriptorPoolList *list) {
+  for (u32 i = 0; i < list->pool_count; i++)
+  {
+    vkDestroyDescriptorPool(context->device, list->pools[i], NULL);
+  }
+  list->pool_count = 0;
+  list->current = 0;
+}
+
+void descriptor_allocator_destroy(VkContext *context, DescriptorAllocator *allocator) {
+  for (u32 i = 0; i < MAX_FRAMES; i++)
+  {
+    destroy_list(context, &allocator->frames[i]);
+  }
+  destroy_list(context, &allocator->persistent);
+  memset(allocator->cache, 0, sizeof(allocator->cache));
+  allocator->cache_count = 0;
+  if (allocator->ring.handle) vulkan_buffer_destroy(context, &allocator->ring);
+  allocator->use_buffer = false;
+}
+
+void descriptor_allocator_begin_frame(VkContext *context, DescriptorAllocator *allocator, u32 frame) {
+  allocator->last_frame_allocations = allocator->frame_allocations;
+  if (allocator->frame_allocations > allocator->peak_frame_allocations) {
+    allocator->peak_frame_allocations = allocator->frame_allocations;
+  }
+  allocator->frame_allocations = 0;
+  allocator->frame_count++;
+  allocator->frame = frame;
+  if (allocator->ring_head > allocator->peak_ring_usage) allocator->peak_ring_usage = allocator->ring_head;
+  allocator->ring_head = 0;
+  allocator->bound_command_buffer = VK_NULL_HANDLE;
+  // Buffers may have been recreated since, their handles reused
+  allocator->address_count = 0;
+
+  // Only the pools that were allocated from
+  DescriptorPoolList *list = &allocator->frames[frame];
+  for (u32 i = 0; i <= list->current && i < list->pool_count; i++)
+  {
+    vkResetDescriptorPool(context->device, list->pools[i], 0);
+    allocator->resets++;
+  }
+  list->current = 0;
+}
+
+static b8 add_pool(VkContext *context, DescriptorAllocator *allocator, DescriptorPoolList *list) {
+  if (list->pool_count == DESCRIPTOR_MAX_POOLS) {
+    printf("Descriptor allocator: too many pools\n");
+    return false;
+  }
+
+  u32 sets = DESCRIPTOR_POOL_INITIAL_SETS << list->pool_count;
+  if (sets > DESCRIPTOR_POOL_MAX_SETS || sets == 0) sets = DESCRIPTOR_POOL_MAX_SETS;
+
+  VkDescriptorPoolSize pool_sizes[POOL_RATIO_COUNT];
+  for (u32 i = 0; i < POOL_RATIO_COUNT; i++)
+  {
+    pool_sizes[i].type = pool_ratios[i].type;
+    pool_sizes[i].descriptorCount = pool_ratios[i].descriptorCount * sets;
+  }
+  VkDescriptorPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+  pool_info.maxSets = sets;
+  pool_info.poolSizeCount = POOL_RATIO_COUNT;
+  pool_info.pPoolSizes = pool_sizes;
+  if (vkCreateDescriptorPool(context->device, &pool_info, NULL, &list->pools[list->pool_count]) != VK_SUCCESS) {
+    printf("Descriptor allocator: vkCreateDescriptorPool FAIL\n");
+    return false;
+  }
+  list->pool_count++;
+  allocator->pools_created++;
+  return true;
+}
+
+static VkDescriptorSet allocate_from(VkContext *context, DescriptorAllocator *allocator, DescriptorPoolList *list,
+  VkDescriptorSetLayout layout) {
+  while (true)
+  {
+    if (list->current == list->pool_count && !add_pool(context, allocator, list)) {
+      allocator->failures++;
+      return VK_NULL_HANDLE;
+    }
+
+    VkDescriptorSetAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    alloc_info.descriptorPool = list->pools[list->current];
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &layout;
+    VkDescriptorSet set;
+    VkResult result = vkAllocateDescriptorSets(context->device, &alloc_info, &set);
+    if (result == VK_SUCCESS) {
+      allocator->total_allocations++;
+      return set;
+    }
+    if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) {
+      printf("Descriptor allocator: vkAllocateDescriptorSets FAIL\n");
+      allocator->failures++;
+      return VK_NULL_HANDLE;
+    }
+    // Full, the next pool is larger
+    list->current++;
+  }
+}
+
+VkDescriptorSet descriptor_allocator_allocate(VkContext *context, DescriptorAllocator *allocator,
+  VkDescriptorSetLayout layout) {
+  VkDescriptorSet set = allocate_from(context, allocator, &allocator->frames[allocator->frame], layout);
+  if (set) {
+    allocator->frame_allocations++;
+    allocator->transient_allocations++;
+  }
+  return set;
+}
+
+static b8 is_image_descriptor(VkDescriptorType type) {
+  return type == VK_DESCRIPTOR_TYPE_SAMPLER || type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+    type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE || type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+    type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+}
+
+void descriptor_set_write(VkContext *context, VkDescriptorSet set, const DescriptorBinding *bindings, u32 binding_count) {
+  VkWriteDescriptorSet writes[DESCRIPTOR_MAX_SET_BINDINGS] = {0};
+  if (binding_count > DESCRIPTOR_MAX_SET_BINDINGS) binding_count = DESCRIPTOR_MAX_SET_BINDINGS;
+  for (u32 i = 0; i < binding_count; i++)
+  {
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = set;
+    writes[i].dstBinding = bindings[i].binding;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = bindings[i].type;
+    if (is_image_descriptor(bindings[i].type)) {
+      writes[i].pImageInfo = &bindings[i].image;
+    } else {
+      writes[i].pBufferInfo = &bindings[i].buffer;
+    }
+  }
+  vkUpdateDescriptorSets(context->device, binding_count, writes, 0, NULL);
+}
+
+// FNV-1a over the layout handle and the descriptors
+static u64 hash_set(VkDescriptorSetLayout layout, const DescriptorBinding *bindings, u32 binding_count) {
+  u64 hash = 14695981039346656037ull;
+  const u8 *bytes = (const u8 *)&layout;
+  for (u32 i = 0; i < sizeof(layout); i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  bytes = (const u8 *)bindings;
+  for (u32 i = 0; i < sizeof(DescriptorBinding) * binding_count; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+VkDescriptorSet descriptor_allocator_get_immutable(VkContext *context, DescriptorAllocator *allocator,
+  VkDescriptorSetLayout layout, const DescriptorBinding *bindings, u32 binding_count) {
+  if (binding_count > DESCRIPTOR_MAX_SET_BINDINGS) {
+    printf("Descriptor allocator: too many bindings\n");
+    return VK_NULL_HANDLE;
+  }
+
+  u64 hash = hash_set(layout, bindings, binding_count);
+  u32 mask = DESCRIPTOR_CACHE_CAPACITY - 1;
+  DescriptorCacheEntry *entry = NULL;
+  for (u32 i = 0; i < DESCRIPTOR_CACHE_CAPACITY; i++)
+  {
+    DescriptorCacheEntry *candidate = &allocator->cache[(hash + i) & mask];
+    if (!candidate->set) {
+      entry = candidate;
+      break;
+    }
+    if (candidate->hash == hash && candidate->layout == layout && candidate->binding_count == binding_count &&
+      memcmp(candidate->bindings, bindings, sizeof(DescriptorBinding) * binding_count) == 0) {
+      allocator->cache_hits++;
+      return candidate->set;
+    }
+  }
+
+  allocator->cache_misses++;
+  // Keep a free slot so lookups of missing sets always terminate
+  if (!entry || allocator->cache_count + 1 >= DESCRIPTOR_CACHE_CAPACITY) {
+    printf("Descriptor allocator: set cache full\n");
+    allocator->failures++;
+    return VK_NULL_HANDLE;
+  }
+
+  VkDescriptorSet set = allocate_from(context, allocator, &allocator->persistent, layout);
+  if (!set) return VK_NULL_HANDLE;
+  descriptor_set_write(context, set, bindings, binding_count);
+
+  entry->hash = hash;
+  entry->layout = layout;
+  memcpy(entry->bindings, bindings, sizeof(DescriptorBinding) * binding_count);
+  entry->binding_count = binding_count;
+  entry->set = set;
+  allocator->cache_count++;
+  return set;
+}
+
+static b8 is_dynamic_descriptor(VkDescriptorType type) {
+  return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+}
+
+static void bind_set(VkContext *context, DescriptorAllocator *allocator, VkCommandBuffer command_buffer,
+  VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, u32 set_index, VkDescriptorSetLayout layout,
+  const DescriptorBinding *bindings, u32 binding_count, b8 immutable) {
+  DescriptorBinding set_bindings[DESCRIPTOR_MAX_SET_BINDINGS];
+  u32 dynamic_offsets[DESCRIPTOR_MAX_SET_BINDINGS];
+  u32 dynamic_count = 0;
+  memcpy(set_bindings, bindings, sizeof(DescriptorBinding) * binding_count);
+  for (u32 i = 0; i < binding_count; i++)
+  {
+    if (!is_dynamic_descriptor(bindings[i].type)) continue;
+    dynamic_offsets[dynamic_count++] = (u32)bindings[i].buffer.offset;
+    set_bindings[i].buffer.offset = 0;
+  }
+
+  VkDescriptorSet set;
+  if (immutable) {
+    set = descriptor_allocator_get_immutable(context, allocator, layout, set_bindings, binding_count);
+  } else {
+    set = descriptor_allocator_allocate(context, allocator, layout);
+    if (set) descriptor_set_write(context, set, set_bindings, binding_count);
+  }
+  if (!set) return;
+  vkCmdBindDescriptorSets(command_buffer, bind_point, pipeline_layout, set_index, 1, &set, dynamic_count, dynamic_offsets);
+}
+
+static DescriptorBufferLayout *get_buffer_layout(VkContext *context, DescriptorAllocator *allocator,
+  VkDescriptorSetLayout layout) {
+  for (u32 i = 0; i < allocator->buffer_layout_count; i++)
+  {
+    if (allocator->buffer_layouts[i].layout == layout) return &allocator->buffer_layouts[i];
+  }
+  if (allocator->buffer_layout_count == DESCRIPTOR_BUFFER_MAX_LAYOUTS) {
+    printf("Descriptor allocator: too many descriptor buffer layouts\n");
+    return NULL;
+  }
+
+  DescriptorBufferLayout *buffer_layout = &allocator->buffer_layouts[allocator->buffer_layout_count++];
+  memset(buffer_layout, 0, sizeof(DescriptorBufferLayout));
+  buffer_layout->layout = layout;
+  allocator->get_layout_size(context->device, layout, &buffer_layout->size);
+  return buffer_layout;
+}
+
+static VkDeviceAddress get_buffer_address(VkContext *context, DescriptorAllocator *allocator, VkBuffer buffer) {
+  for (u32 i = 0; i < allocator->address_count; i++)
+  {
+    if (allocator->addresses[i].buffer == buffer) return allocator->addresses[i].address;
+  }
+
+  VkBufferDeviceAddressInfo address_info = {VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO};
+  address_info.buffer = buffer;
+  VkDeviceAddress address = vkGetBufferDeviceAddress(context->device, &address_info);
+  if (allocator->address_count < DESCRIPTOR_BUFFER_MAX_ADDRESSES) {
+    allocator->addresses[allocator->address_count++] = (DescriptorBufferAddress){buffer, address};
+  }
+  return address;
+}
+
+// Writes one descriptor, returns FALSE for types the ring does not handle
+static b8 write_descriptor(VkContext *context, DescriptorAllocator *allocator, const DescriptorBinding *binding,
+  void *destination) {
+  VkPhysicalDeviceDescriptorBufferPropertiesEXT *properties = &allocator->buffer_properties;
+  VkDescriptorGetInfoEXT get_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT};
+  VkDescriptorAddressInfoEXT address_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT};
+  if (!is_image_descriptor(binding->type)) {
+    address_info.address = get_buffer_address(context, allocator, binding->buffer.buffer) + binding->buffer.offset;
+    address_info.range = binding->buffer.range;
+  }
+  u64 size;
+
+  // Descriptor buffers have no dynamic descriptors, the offset is baked into the address
+  switch (binding->type) {
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+      get_info.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      get_info.data.pUniformBuffer = &address_info;
+      size = properties->uniformBufferDescriptorSize;
+      break;
+    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+      get_info.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      get_info.data.pStorageBuffer = &address_info;
+      size = properties->storageBufferDescriptorSize;
+      break;
+    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+      get_info.type = binding->type;
+      get_info.data.pCombinedImageSampler = &binding->image;
+      size = properties->combinedImageSamplerDescriptorSize;
+      break;
+    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+      get_info.type = binding->type;
+      get_info.data.pSampledImage = &binding->image;
+      size = properties->sampledImageDescriptorSize;
+      break;
+    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+      get_info.type = binding->type;
+      get_info.data.pStorageImage = &binding->image;
+      size = properties->storageImageDescriptorSize;
+      break;
+    default:
+      return false;
+  }
+
+  allocator->get_descriptor(context->device, &get_info, size, destination);
+  allocator->buffer_bytes += size;
+  return true;
+}
+
+static void bind_buffer(VkContext *context, DescriptorAllocator *allocator, VkCommandBuffer command_buffer,
+  VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, u32 set_index, VkDescriptorSetLayout layout,
+  const DescriptorBinding *bindings, u32 binding_count) {
+  DescriptorBufferLayout *buffer_layout = get_buffer_layout(context, allocator, layout);
+  if (!buffer_layout) {
+    allocator->failures++;
+    return;
+  }
+
+  u64 alignment = allocator->buffer_properties.descriptorBufferOffsetAlignment;
+  u64 offset = (allocator->ring_head + alignment - 1) & ~(alignment - 1);
+  if (offset + buffer_layout->size > DESCRIPTOR_BUFFER_FRAME_SIZE) {
+    printf("Descriptor allocator: descriptor buffer partition full\n");
+    allocator->failures++;
+    return;
+  }
+  VkDeviceSize set_offset = (VkDeviceSize)allocator->frame * DESCRIPTOR_BUFFER_FRAME_SIZE + offset;
+  u8 *set_data = (u8 *)allocator->ring.mapped + set_offset;
+
+  for (u32 i = 0; i < binding_count; i++)
+  {
+    u32 binding = bindings[i].binding;
+    if (!(buffer_layout->known_offsets & (1u << binding))) {
+      allocator->get_binding_offset(context->device, layout, binding, &buffer_layout->offsets[binding]);
+      buffer_layout->known_offsets |= 1u << binding;
+    }
+    if (!write_descriptor(context, allocator, &bindings[i], set_data + buffer_layout->offsets[binding])) {
+      printf("Descriptor allocator: unsupported descriptor type for the descriptor buffer\n");
+      allocator->failures++;
+      return;
+    }
+  }
+  allocator->ring_head = offset + buffer_layout->size;
+
+  if (allocator->bound_command_buffer != command_buffer) {
+    VkDescriptorBufferBindingInfoEXT binding_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT};
+    binding_info.address = allocator->ring_address;
+    binding_info.usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT;
+    allocator->cmd_bind_buffers(command_buffer, 1, &binding_info);
+    allocator->bound_command_buffer = command_buffer;
+  }
+  u32 buffer_index = 0;
+  allocator->cmd_set_offsets(command_buffer, bind_point, pipeline_layout, set_index, 1, &buffer_index, &set_offset);
+}
+
+void descriptor_allocator_bind(VkContext *context, DescriptorAllocator *allocator, VkCommandBuffer command_buffer,
+  VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, u32 set_index, VkDescriptorSetLayout layout,
+  const DescriptorBinding *bindings, u32 binding_count, b8 immutable) {
+  if (binding_count > DESCRIPTOR_MAX_SET_BINDINGS) {
+    printf("Descriptor allocator: too many bindings\n");
+    allocator->failures++;
+    return;
+  }
+
+  f64 start = platform_get_absolute_time();
+  if (allocator->use_buffer) {
+    bind_buffer(context, allocator, command_buffer, bind_point, pipeline_layout, set_index, layout, bindings, binding_count);
+  } else {
+    bind_set(context, allocator, command_buffer, bind_point, pipeline_layout, set_index, layout, bindings, binding_count,
+      immutable);
+  }
+  allocator->bind_seconds += platform_get_absolute_time() - start;
+  allocator->binds++;
+}
+
+void descriptor_allocator_report(DescriptorAllocator *allocator) {
+  u32 pools = allocator->persistent.pool_count;
+  for (u32 i = 0; i < MAX_FRAMES; i++)
+  {
+    pools += allocator->frames[i].pool_count;
+  }
+  u64 lookups = allocator->cache_hits + allocator->cache_misses;
+  printf("Descriptor allocator: %u pools (%llu created), %llu sets allocated, %.1f sets per frame avg, %u peak, "
+    "%llu pool resets, %u failures\n", pools, (unsigned long long)allocator->pools_created,
+    (unsigned long long)allocator->total_allocations,
+    allocator->frame_count ? (f64)allocator->transient_allocations / (f64)allocator->frame_count : 0.0,
+    allocator->peak_frame_allocations, (unsigned long long)allocator->resets, allocator->failures);
+  printf("  immutable sets %u, %llu lookups, %.2f%% hit rate\n", allocator->cache_count, (unsigned long long)lookups,
+    lookups ? 100.0 * (f64)allocator->cache_hits / (f64)lookups : 0.0);
+  printf("  %s: %llu binds, %.3f us per bind\n", allocator->use_buffer ? "descriptor buffer" : "descriptor sets",
+    (unsigned long long)allocator->binds, allocator->binds ? allocator->bind_seconds * 1e6 / (f64)allocator->binds : 0.0);
+  if (allocator->use_buffer) {
+    printf("  descriptor buffer: %.1f bytes per frame avg, %llu peak of %u per frame\n",
+      allocator->frame_count ? (f64)allocator->buffer_bytes / (f64)allocator->frame_count : 0.0,
+      (unsigned long long)allocator->peak_ring_usage, DESCRIPTOR_BUFFER_FRAME_SIZE);
+  }
+}
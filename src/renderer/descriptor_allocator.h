@@ -0,0 +1,154 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+
+#define DESCRIPTOR_MAX_POOLS 16          // Per frame in flight
+#define DESCRIPTOR_POOL_INITIAL_SETS 64  // Each new pool of a list holds twice as many sets as the last
+#define DESCRIPTOR_POOL_MAX_SETS 4096
+#define DESCRIPTOR_CACHE_CAPACITY 256    // Power of two
+#define DESCRIPTOR_MAX_SET_BINDINGS 8    // Binding numbers must be below it as well
+#define DESCRIPTOR_BUFFER_FRAME_SIZE (256 * 1024) // Descriptor bytes per frame in flight
+#define DESCRIPTOR_BUFFER_MAX_LAYOUTS 16
+#define DESCRIPTOR_BUFFER_MAX_ADDRESSES 32
+
+// One descriptor of a set, the buffer or the image part is used depending on the type
+typedef struct DescriptorBinding {
+  u32 binding;
+  VkDescriptorType type;
+  VkDescriptorBufferInfo buffer;
+  VkDescriptorImageInfo image;
+} DescriptorBinding;
+
+// Pools that sets are allocated from linearly, reset all at once
+typedef struct DescriptorPoolList {
+  VkDescriptorPool pools[DESCRIPTOR_MAX_POOLS];
+  u32 pool_count;
+  u32 current; // Pools before it are full
+} DescriptorPoolList;
+
+typedef struct DescriptorCacheEntry {
+  u64 hash;
+  VkDescriptorSetLayout layout;
+  DescriptorBinding bindings[DESCRIPTOR_MAX_SET_BINDINGS];
+  u32 binding_count;
+  VkDescriptorSet set; // VK_NULL_HANDLE when the slot is free
+} DescriptorCacheEntry;
+
+// Size and binding offsets of a set layout inside a descriptor buffer
+typedef struct DescriptorBufferLayout {
+  VkDescriptorSetLayout layout;
+  VkDeviceSize size;
+  VkDeviceSize offsets[DESCRIPTOR_MAX_SET_BINDINGS];
+  u32 known_offsets; // Bit per binding number
+} DescriptorBufferLayout;
+
+typedef struct DescriptorBufferAddress {
+  VkBuffer buffer;
+  VkDeviceAddress address;
+} DescriptorBufferAddress;
+
+/**
+ * Descriptor sets without vkFreeDescriptorSets. Transient sets come from the pools of the frame
+ * in flight, which are reset with vkResetDescriptorPool once its fence signaled. Sets whose
+ * contents never change are looked up by a hash of the layout and descriptors, and allocated
+ * once from pools that live as long as the allocator. Not thread safe, sets are allocated
+ * while recording.
+ *
+ * When the context enabled VK_EXT_descriptor_buffer, descriptor_allocator_bind skips sets
+ * altogether: the descriptors are written with vkGetDescriptorEXT into a mapped ring with one
+ * partition per frame in flight and bound by offset.
+ */
+typedef struct DescriptorAllocator {
+  DescriptorPoolList frames[MAX_FRAMES];
+  DescriptorPoolList persistent;
+  u32 frame;
+  DescriptorCacheEntry cache[DESCRIPTOR_CACHE_CAPACITY];
+  u32 cache_count;
+
+  // Descriptor buffer path
+  b8 use_buffer;
+  VkPhysicalDeviceDescriptorBufferPropertiesEXT buffer_properties;
+  VulkanBuffer ring;           // MAX_FRAMES partitions of DESCRIPTOR_BUFFER_FRAME_SIZE
+  VkDeviceAddress ring_address;
+  u64 ring_head;               // Next free byte inside the current frame partition
+  VkCommandBuffer bound_command_buffer; // The ring is bound once per command buffer
+  DescriptorBufferLayout buffer_layouts[DESCRIPTOR_BUFFER_MAX_LAYOUTS];
+  u32 buffer_layout_count;
+  DescriptorBufferAddress addresses[DESCRIPTOR_BUFFER_MAX_ADDRESSES]; // Cleared every frame
+  u32 address_count;
+  PFN_vkGetDescriptorSetLayoutSizeEXT get_layout_size;
+  PFN_vkGetDescriptorSetLayoutBindingOffsetEXT get_binding_offset;
+  PFN_vkGetDescriptorEXT get_descriptor;
+  PFN_vkCmdBindDescriptorBuffersEXT cmd_bind_buffers;
+  PFN_vkCmdSetDescriptorBufferOffsetsEXT cmd_set_offsets;
+
+  // Statistics
+  u32 frame_allocations;      // Current frame
+  u32 last_frame_allocations; // Previous frame
+  u32 peak_frame_allocations;
+  u64 transient_allocations;
+  u64 total_allocations;      // Including the immutable sets
+  u64 frame_count;
+  u64 resets;                 // vkResetDescriptorPool calls
+  u64 pools_created;
+  u64 cache_hits;
+  u64 cache_misses;
+  u64 binds;
+  f64 bind_seconds;
+  u64 buffer_bytes;           // Descriptor bytes written to the ring
+  u64 peak_ring_usage;
+  u32 failures;
+} DescriptorAllocator;
+
+/**
+ * Creates the descriptor ring when the context enabled VK_EXT_descriptor_buffer. Classic sets
+ * need nothing, their pools are created on first use. Call before any set layout or pipeline
+ * is created: if the ring fails the context falls back to sets.
+ * @returns TRUE on success.
+ */
+b8 descriptor_allocator_create(VkContext *context, DescriptorAllocator *allocator);
+
+void descriptor_allocator_destroy(VkContext *context, DescriptorAllocator *allocator);
+
+/**
+ * Resets the pools of a frame slot, its sets must not be in use anymore. Call before recording
+ * the frame slot, after its fence was waited. A slot that submits its previous command buffers
+ * again skips the call so their sets stay valid.
+ */
+void descriptor_allocator_begin_frame(VkContext *context, DescriptorAllocator *allocator, u32 frame);
+
+/**
+ * Allocates a set valid until the frame slot comes around again, adding a pool when the
+ * current ones are full.
+ * @returns The set, or VK_NULL_HANDLE on failure.
+ */
+VkDescriptorSet descriptor_allocator_allocate(VkContext *context, DescriptorAllocator *allocator,
+  VkDescriptorSetLayout layout);
+
+/**
+ * Finds the set of a layout holding the given descriptors, allocating and writing it on a miss.
+ * Bindings are hashed as raw bytes, they must start zeroed so unused fields and padding match.
+ * @returns The set, or VK_NULL_HANDLE on failure.
+ */
+VkDescriptorSet descriptor_allocator_get_immutable(VkContext *context, DescriptorAllocator *allocator,
+  VkDescriptorSetLayout layout, const DescriptorBinding *bindings, u32 binding_count);
+
+/**
+ * Binds descriptors to a set index, the one binding call of both paths. With sets the dynamic
+ * buffer bindings are bound with their offset as the dynamic offset and the set is looked up with
+ * offsets zeroed, so a set whose contents are immutable is written once. Other sets are allocated
+ * and written per call. With a descriptor buffer the descriptors are written to the ring, dynamic
+ * bindings at their offset, and bound by offset.
+ * @param bindings Sorted by binding, zeroed before being filled like for the immutable cache. Buffer
+ * ranges must be explicit, not VK_WHOLE_SIZE.
+ * @param immutable TRUE if the contents ignoring dynamic offsets never change.
+ */
+void descriptor_allocator_bind(VkContext *context, DescriptorAllocator *allocator, VkCommandBuffer command_buffer,
+  VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, u32 set_index, VkDescriptorSetLayout layout,
+  const DescriptorBinding *bindings, u32 binding_count, b8 immutable);
+
+/**
+ * Writes descriptors into a set, one vkUpdateDescriptorSets call.
+ */
+void descriptor_set_write(VkContext *context, VkDescriptorSet set, const DescriptorBinding *bindings, u32 binding_count);
+
+void descriptor_allocator_report(DescriptorAllocator *allocator);
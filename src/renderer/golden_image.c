@@ -0,0 +1,99 @@
+#include "golden_image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+b8 golden_image_write(const char *path, const ReadbackImage *image, b8 bgra) {
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    printf("Failed to open %s for writing\n", path);
+    return false;
+  }
+
+  fprintf(file, "P6\n%u %u\n255\n", image->width, image->height);
+  u8 *row = malloc((u64)image->width * 3);
+  b8 result = true;
+  for (u32 y = 0; y < image->height && result; y++)
+  {
+    const u8 *pixels = image->data + (u64)y * image->row_pitch;
+    for (u32 x = 0; x < image->width; x++)
+    {
+      row[x * 3 + 0] = pixels[x * 4 + (bgra ? 2 : 0)];
+      row[x * 3 + 1] = pixels[x * 4 + 1];
+      row[x * 3 + 2] = pixels[x * 4 + (bgra ? 0 : 2)];
+    }
+    result = fwrite(row, 3, image->width, file) == image->width;
+  }
+  free(row);
+  fclose(file);
+
+  if (!result) {
+    printf("Failed to write %s\n", path);
+  }
+  return result;
+}
+
+// Reads the header of a binary PPM written by golden_image_write
+static b8 read_ppm_header(FILE *file, u32 *out_width, u32 *out_height) {
+  u32 max_value;
+  if (fscanf(file, "P6 %u %u %u", out_width, out_height, &max_value) != 3 || max_value != 255) {
+    return false;
+  }
+  // Exactly one whitespace character separates the header from the pixels
+  return fgetc(file) != EOF;
+}
+
+b8 golden_image_compare(const char *path, const ReadbackImage *image, b8 bgra, u32 tolerance, GoldenDiff *out_diff) {
+  memset(out_diff, 0, sizeof(GoldenDiff));
+
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    printf("Missing reference image %s\n", path);
+    return false;
+  }
+
+  u32 width, height;
+  if (!read_ppm_header(file, &width, &height)) {
+    printf("Invalid reference image %s\n", path);
+    fclose(file);
+    return false;
+  }
+  if (width != image->width || height != image->height) {
+    printf("Reference image %s is %ux%u, the frame %ux%u\n", path, width, height, image->width, image->height);
+    fclose(file);
+    return false;
+  }
+
+  u8 *reference = malloc((u64)width * 3);
+  u64 difference_sum = 0;
+  b8 result = true;
+  for (u32 y = 0; y < height && result; y++)
+  {
+    if (fread(reference, 3, width, file) != width) {
+      printf("Truncated reference image %s\n", path);
+      result = false;
+      break;
+    }
+
+    const u8 *pixels = image->data + (u64)y * image->row_pitch;
+    for (u32 x = 0; x < width; x++)
+    {
+      u8 actual[3] = {pixels[x * 4 + (bgra ? 2 : 0)], pixels[x * 4 + 1], pixels[x * 4 + (bgra ? 0 : 2)]};
+      b8 differs = false;
+      for (u32 c = 0; c < 3; c++)
+      {
+        u32 difference = (u32)abs((i32)actual[c] - (i32)reference[x * 3 + c]);
+        if (difference > out_diff->max_difference) out_diff->max_difference = difference;
+        if (difference > tolerance) differs = true;
+        difference_sum += difference;
+      }
+      out_diff->differing_pixels += differs;
+    }
+  }
+  free(reference);
+  fclose(file);
+
+  out_diff->pixel_count = (u64)width * height;
+  out_diff->mean_difference = (f64)difference_sum / (f64)(out_diff->pixel_count * 3);
+  return result;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "renderer/readback.h"
+
+typedef struct GoldenDiff {
+  u32 max_difference;    // Largest difference of a channel, 0 to 255
+  u64 differing_pixels;  // Pixels with a channel differing by more than the tolerance
+  u64 pixel_count;
+  f64 mean_difference;   // Per channel
+} GoldenDiff;
+
+/**
+ * Writes a collected image as a binary PPM, the format of the reference images.
+ * @param bgra TRUE if the pixels are stored blue first, like the swapchain format.
+ * @returns TRUE on success.
+ */
+b8 golden_image_write(const char *path, const ReadbackImage *image, b8 bgra);
+
+/**
+ * Compares a collected image against a reference PPM of the same size. Alpha is ignored.
+ * @param tolerance Channel difference still counted as equal, to absorb rounding differences
+ * between drivers.
+ * @param out_diff Receives the differences, when the reference could be read.
+ * @returns FALSE if the reference is missing, unreadable or of another size.
+ */
+b8 golden_image_compare(const char *path, const ReadbackImage *image, b8 bgra, u32 tolerance, GoldenDiff *out_diff);
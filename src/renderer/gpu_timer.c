@@ -0,0 +1,184 @@
+#include "gpu_timer.h"
+#include "core/trace.h"
+#include "platform/platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUERY_INDEX(frame, zone) (((frame) * GPU_TIMER_MAX_ZONES + (zone)) * 2)
+
+// Both the device and the clock of platform_get_absolute_time must be calibrateable
+static b8 calibration_supported(VkContext *context) {
+  PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT get_time_domains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
+    vkGetInstanceProcAddr(context->instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+  if (!get_time_domains) return false;
+
+  VkTimeDomainEXT domains[8];
+  u32 domain_count = sizeof(domains) / sizeof(domains[0]);
+  if (get_time_domains(context->physicalDevice, &domain_count, domains) < VK_SUCCESS) return false;
+
+  b8 device = false, monotonic = false;
+  for (u32 i = 0; i < domain_count; i++)
+  {
+    device |= domains[i] == VK_TIME_DOMAIN_DEVICE_EXT;
+    monotonic |= domains[i] == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+  }
+  return device && monotonic;
+}
+
+static void calibrate(VkContext *context, GpuTimer *timer) {
+  VkCalibratedTimestampInfoEXT infos[2] = {{VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT},
+    {VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT}};
+  infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+  infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+  u64 timestamps[2];
+  u64 max_deviation;
+  if (timer->get_calibrated_timestamps(context->device, 2, infos, timestamps, &max_deviation) != VK_SUCCESS) {
+    return;
+  }
+
+  timer->gpu_base = timestamps[0];
+  timer->cpu_base = timestamps[1] * 0.000000001;
+  timer->has_base = true;
+  timer->calibration_age = 0;
+}
+
+// Timestamps before the base wrap around to differences above half the valid range
+static f64 cpu_time(GpuTimer *timer, u64 ticks) {
+  u64 after = (ticks - timer->gpu_base) & timer->valid_mask;
+  f64 difference = after <= timer->valid_mask / 2 ? (f64)after : -(f64)((timer->gpu_base - ticks) & timer->valid_mask);
+  return timer->cpu_base + difference * timer->period_ns * 0.000000001;
+}
+
+b8 gpu_timer_create(VkContext *context, GpuTimer *timer) {
+  memset(timer, 0, sizeof(GpuTimer));
+
+  u32 family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &family_count, NULL);
+  VkQueueFamilyProperties *families = malloc(sizeof(VkQueueFamilyProperties) * family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &family_count, families);
+  u32 valid_bits = families[context->graphics_queue_index.familyIndex].timestampValidBits;
+  free(families);
+
+  if (valid_bits == 0 || context->device_properties.limits.timestampPeriod == 0.0f) {
+    return false;
+  }
+
+  timer->period_ns = context->device_properties.limits.timestampPeriod;
+  timer->valid_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+  VkQueryPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  pool_info.queryCount = MAX_FRAMES * GPU_TIMER_MAX_ZONES * 2;
+
+  if (vkCreateQueryPool(context->device, &pool_info, NULL, &timer->pool) != VK_SUCCESS) {
+    return false;
+  }
+
+  timer->trace_track = trace_track("GPU");
+  if (timer->trace_track && context->calibrated_timestamps) {
+    timer->calibrated = calibration_supported(context);
+    timer->get_calibrated_timestamps =
+      (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(context->device, "vkGetCalibratedTimestampsEXT");
+    timer->calibrated = timer->calibrated && timer->get_calibrated_timestamps;
+  }
+  return true;
+}
+
+void gpu_timer_destroy(VkContext *context, GpuTimer *timer) {
+  if (timer->pool) vkDestroyQueryPool(context->device, timer->pool, NULL);
+  timer->pool = VK_NULL_HANDLE;
+}
+
+u32 gpu_timer_zone(GpuTimer *timer, const char *name) {
+  for (u32 i = 0; i < timer->zone_count; i++)
+  {
+    if (strcmp(timer->zones[i].name, name) == 0) return i;
+  }
+  if (timer->zone_count == GPU_TIMER_MAX_ZONES) return GPU_TIMER_MAX_ZONES;
+
+  GpuTimerZone *zone = &timer->zones[timer->zone_count];
+  memset(zone, 0, sizeof(GpuTimerZone));
+  strncpy(zone->name, name, sizeof(zone->name) - 1);
+  return timer->zone_count++;
+}
+
+void gpu_timer_collect(VkContext *context, GpuTimer *timer, u32 frame) {
+  if (!timer->pool) return;
+
+  for (u32 z = 0; z < timer->zone_count; z++)
+  {
+    if (!(timer->written[frame] & (1u << z))) continue;
+
+    u64 timestamps[2];
+    if (vkGetQueryPoolResults(context->device, timer->pool, QUERY_INDEX(frame, z), 2, sizeof(timestamps), timestamps,
+      sizeof(u64), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+      continue;
+    }
+
+    u64 ticks = (timestamps[1] - timestamps[0]) & timer->valid_mask;
+    GpuTimerZone *zone = &timer->zones[z];
+    zone->last_ms = ticks * timer->period_ns / 1e6;
+    zone->total_ms += zone->last_ms;
+    zone->samples++;
+
+    // Uncalibrated, the first zone is assumed to start when its queries were reset
+    if (timer->trace_track && !timer->calibrated && !timer->has_base) {
+      timer->gpu_base = timestamps[0];
+      timer->cpu_base = timer->frame_start[frame];
+      timer->has_base = true;
+    }
+    if (timer->trace_track && timer->has_base) {
+      trace_record(timer->trace_track, zone->name, TRACE_COLOR_OLIVE, cpu_time(timer, timestamps[0]),
+        cpu_time(timer, timestamps[1]));
+    }
+  }
+}
+
+void gpu_timer_begin_frame(VkContext *context, GpuTimer *timer, VkCommandBuffer command_buffer, u32 frame) {
+  if (!timer->pool) return;
+
+  gpu_timer_collect(context, timer, frame);
+  timer->written[frame] = 0;
+  timer->frame = frame;
+  timer->frame_start[frame] = platform_get_absolute_time();
+  if (timer->calibrated && (!timer->has_base || ++timer->calibration_age >= GPU_TIMER_CALIBRATION_FRAMES)) {
+    calibrate(context, timer);
+  }
+  vkCmdResetQueryPool(command_buffer, timer->pool, QUERY_INDEX(frame, 0), GPU_TIMER_MAX_ZONES * 2);
+}
+
+// Timestamps at ALL_COMMANDS wait for the preceding work, so a zone measures its own commands
+void gpu_timer_begin(GpuTimer *timer, VkCommandBuffer command_buffer, u32 zone) {
+  if (!timer->pool || zone >= GPU_TIMER_MAX_ZONES) return;
+  vkCmdWriteTimestamp2(command_buffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timer->pool, QUERY_INDEX(timer->frame, zone));
+}
+
+void gpu_timer_end(GpuTimer *timer, VkCommandBuffer command_buffer, u32 zone) {
+  if (!timer->pool || zone >= GPU_TIMER_MAX_ZONES) return;
+  vkCmdWriteTimestamp2(command_buffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timer->pool, QUERY_INDEX(timer->frame, zone) + 1);
+  timer->written[timer->frame] |= 1u << zone;
+}
+
+f64 gpu_timer_last_ms(GpuTimer *timer, u32 zone) {
+  if (zone >= timer->zone_count) return 0.0;
+  return timer->zones[zone].last_ms;
+}
+
+void gpu_timer_report(GpuTimer *timer) {
+  for (u32 i = 0; i < timer->zone_count; i++)
+  {
+    GpuTimerZone *zone = &timer->zones[i];
+    if (zone->samples == 0) continue;
+    printf("  GPU %-20s %8.3f ms avg over %llu frames\n", zone->name, zone->total_ms / zone->samples,
+      (unsigned long long)zone->samples);
+  }
+}
+
+void gpu_timer_reset(GpuTimer *timer) {
+  for (u32 i = 0; i < timer->zone_count; i++)
+  {
+    timer->zones[i].total_ms = 0.0;
+    timer->zones[i].samples = 0;
+  }
+}
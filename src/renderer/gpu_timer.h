@@ -0,0 +1,78 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+
+#define GPU_TIMER_MAX_ZONES 32
+#define GPU_TIMER_CALIBRATION_FRAMES 120 // The clocks drift apart, calibrate again after this many frames
+
+typedef struct GpuTimerZone {
+  char name[32];
+  f64 last_ms;
+  f64 total_ms;
+  u64 samples;
+} GpuTimerZone;
+
+/**
+ * Timestamp queries around named zones of a frame. Every frame in flight owns its own range of
+ * queries, results are read when the frame slot comes around again so nothing ever stalls.
+ */
+typedef struct GpuTimer {
+  VkQueryPool pool;
+  f64 period_ns;
+  u64 valid_mask;
+  u32 frame;
+
+  GpuTimerZone zones[GPU_TIMER_MAX_ZONES];
+  u32 zone_count;
+  u32 written[MAX_FRAMES]; // Bit mask of the zones recorded in each frame slot
+
+  // With tracing the zones are recorded on their own track, on the CPU clock
+  u32 trace_track;
+  b8 calibrated;        // With VK_EXT_calibrated_timestamps, otherwise estimated once from the first frame
+  b8 has_base;
+  u64 gpu_base;         // A GPU timestamp
+  f64 cpu_base;         // The time of platform_get_absolute_time at gpu_base
+  u32 calibration_age;  // Frames since the last calibration
+  f64 frame_start[MAX_FRAMES]; // When the queries of each slot were reset
+  PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps;
+} GpuTimer;
+
+/**
+ * Creates the query pool for MAX_FRAMES frames. With tracing on, collected zones are recorded
+ * into the trace as well.
+ * @returns FALSE if the graphics queue does not support timestamps.
+ */
+b8 gpu_timer_create(VkContext *context, GpuTimer *timer);
+void gpu_timer_destroy(VkContext *context, GpuTimer *timer);
+
+/**
+ * Finds or registers a zone.
+ * @returns The zone id, or GPU_TIMER_MAX_ZONES when there is no room left.
+ */
+u32 gpu_timer_zone(GpuTimer *timer, const char *name);
+
+/**
+ * Collects the results previously recorded in this frame slot. Only needed on its own when the
+ * slot submits its previous command buffer again, which still resets the queries and writes the
+ * same zones. Must be called after the fence of the frame slot was waited.
+ */
+void gpu_timer_collect(VkContext *context, GpuTimer *timer, u32 frame);
+
+/**
+ * Collects the results previously recorded in this frame slot and resets its queries. Must be
+ * recorded outside of a render pass, after the fence of the frame slot was waited.
+ */
+void gpu_timer_begin_frame(VkContext *context, GpuTimer *timer, VkCommandBuffer command_buffer, u32 frame);
+
+void gpu_timer_begin(GpuTimer *timer, VkCommandBuffer command_buffer, u32 zone);
+void gpu_timer_end(GpuTimer *timer, VkCommandBuffer command_buffer, u32 zone);
+
+/**
+ * @returns The duration of the zone in the most recently collected frame, in milliseconds.
+ */
+f64 gpu_timer_last_ms(GpuTimer *timer, u32 zone);
+
+/**
+ * Prints the average duration of every zone since creation or the last reset.
+ */
+void gpu_timer_report(GpuTimer *timer);
+void gpu_timer_reset(GpuTimer *timer);
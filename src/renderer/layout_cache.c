@@ -0,0 +1,223 @@
+#include "layout_cache.h"
+#include <stdio.h>
+#include <string.h>
+
+// FNV-1a
+static u64 hash_bytes(const void *data, u64 size, u64 hash) {
+  const u8 *bytes = (const u8 *)data;
+  for (u64 i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+void layout_cache_destroy(VkContext *context, LayoutCache *cache) {
+  for (u32 i = 0; i < cache->pipeline_layout_count; i++)
+  {
+    vkDestroyPipelineLayout(context->device, cache->pipeline_layouts[i].layout, NULL);
+  }
+  for (u32 i = 0; i < cache->set_layout_count; i++)
+  {
+    vkDestroyDescriptorSetLayout(context->device, cache->set_layouts[i].layout, NULL);
+  }
+  cache->pipeline_layout_count = 0;
+  cache->set_layout_count = 0;
+}
+
+VkDescriptorSetLayout layout_cache_set_layout(VkContext *context, LayoutCache *cache,
+  const VkDescriptorSetLayoutBinding *bindings, u32 binding_count) {
+  if (binding_count > REFLECT_MAX_BINDINGS) {
+    printf("Layout cache: too many bindings\n");
+    return VK_NULL_HANDLE;
+  }
+
+  // Insertion sort into a zeroed array, so equal sets hash and compare equal
+  VkDescriptorSetLayoutBinding sorted[REFLECT_MAX_BINDINGS];
+  memset(sorted, 0, sizeof(sorted));
+  for (u32 i = 0; i < binding_count; i++)
+  {
+    u32 j = i;
+    while (j > 0 && sorted[j - 1].binding > bindings[i].binding)
+    {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = bindings[i];
+  }
+  u64 size = sizeof(VkDescriptorSetLayoutBinding) * binding_count;
+  u64 hash = hash_bytes(sorted, size, 14695981039346656037ull);
+
+  for (u32 i = 0; i < cache->set_layout_count; i++)
+  {
+    LayoutCacheSetLayout *entry = &cache->set_layouts[i];
+    if (entry->hash == hash && entry->binding_count == binding_count && memcmp(entry->bindings, sorted, size) == 0) {
+      cache->hits++;
+      return entry->layout;
+    }
+  }
+
+  cache->misses++;
+  if (cache->set_layout_count == LAYOUT_CACHE_MAX_SET_LAYOUTS) {
+    printf("Layout cache: too many set layouts\n");
+    return VK_NULL_HANDLE;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layout_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+  layout_info.flags = context->descriptor_buffer ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+  layout_info.bindingCount = binding_count;
+  layout_info.pBindings = sorted;
+  VkDescriptorSetLayout layout;
+  if (vkCreateDescriptorSetLayout(context->device, &layout_info, NULL, &layout) != VK_SUCCESS) {
+    printf("Layout cache: vkCreateDescriptorSetLayout FAIL\n");
+    return VK_NULL_HANDLE;
+  }
+
+  LayoutCacheSetLayout *entry = &cache->set_layouts[cache->set_layout_count++];
+  entry->hash = hash;
+  memcpy(entry->bindings, sorted, sizeof(sorted));
+  entry->binding_count = binding_count;
+  entry->layout = layout;
+  return layout;
+}
+
+// Index of the push constant range of a stage, vertex, fragment and compute in that order
+static b8 stage_index(VkShaderStageFlagBits stage, u32 *out_index) {
+  switch (stage) {
+    case VK_SHADER_STAGE_VERTEX_BIT: *out_index = 0; return true;
+    case VK_SHADER_STAGE_FRAGMENT_BIT: *out_index = 1; return true;
+    case VK_SHADER_STAGE_COMPUTE_BIT: *out_index = 2; return true;
+    default: return false;
+  }
+}
+
+// Adds the bindings of a shader to the sets being merged
+static b8 merge_bindings(const ShaderReflection *shader, const u32 *dynamic_masks,
+  VkDescriptorSetLayoutBinding bindings[REFLECT_MAX_SETS][REFLECT_MAX_BINDINGS], u32 *binding_counts, u32 *set_count) {
+  for (u32 i = 0; i < shader->binding_count; i++)
+  {
+    const ReflectBinding *reflected = &shader->bindings[i];
+    VkDescriptorType type = reflected->type;
+    if (dynamic_masks && (dynamic_masks[reflected->set] & (1u << reflected->binding))) {
+      if (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+      if (type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    }
+
+    VkDescriptorSetLayoutBinding *set = bindings[reflected->set];
+    u32 *count = &binding_counts[reflected->set];
+    VkDescriptorSetLayoutBinding *binding = NULL;
+    for (u32 b = 0; b < *count && !binding; b++)
+    {
+      if (set[b].binding == reflected->binding) binding = &set[b];
+    }
+
+    if (binding) {
+      if (binding->descriptorType != type || binding->descriptorCount != reflected->count) {
+        printf("Layout cache: stages disagree on binding %u of set %u\n", reflected->binding, reflected->set);
+        return false;
+      }
+      binding->stageFlags |= shader->stage;
+      continue;
+    }
+
+    binding = &set[(*count)++];
+    binding->binding = reflected->binding;
+    binding->descriptorType = type;
+    binding->descriptorCount = reflected->count;
+    binding->stageFlags = shader->stage;
+    if (reflected->set + 1 > *set_count) *set_count = reflected->set + 1;
+  }
+  return true;
+}
+
+VkPipelineLayout layout_cache_pipeline_layout(VkContext *context, LayoutCache *cache,
+  const ShaderReflection *const *shaders, u32 shader_count, const u32 *dynamic_masks,
+  VkDescriptorSetLayout *out_set_layouts) {
+  VkDescriptorSetLayoutBinding bindings[REFLECT_MAX_SETS][REFLECT_MAX_BINDINGS];
+  u32 binding_counts[REFLECT_MAX_SETS] = {0};
+  u32 set_count = 0;
+  VkPushConstantRange ranges[LAYOUT_MAX_PUSH_RANGES] = {0};
+  memset(bindings, 0, sizeof(bindings));
+
+  for (u32 i = 0; i < shader_count; i++)
+  {
+    const ShaderReflection *shader = shaders[i];
+    u32 index;
+    if (!stage_index(shader->stage, &index)) {
+      printf("Layout cache: unsupported shader stage\n");
+      return VK_NULL_HANDLE;
+    }
+    // Descriptor buffers have no dynamic descriptors, the offset goes into the written address
+    if (!merge_bindings(shader, context->descriptor_buffer ? NULL : dynamic_masks, bindings, binding_counts, &set_count)) {
+      return VK_NULL_HANDLE;
+    }
+
+    if (shader->push_constant_size) {
+      VkPushConstantRange *range = &ranges[index];
+      u32 end = shader->push_constant_offset + shader->push_constant_size;
+      if (range->size) {
+        u32 range_end = range->offset + range->size;
+        if (shader->push_constant_offset < range->offset) range->offset = shader->push_constant_offset;
+        if (end > range_end) range_end = end;
+        range->size = range_end - range->offset;
+      } else {
+        range->stageFlags = shader->stage;
+        range->offset = shader->push_constant_offset;
+        range->size = shader->push_constant_size;
+      }
+    }
+  }
+
+  LayoutCachePipelineLayout candidate;
+  memset(&candidate, 0, sizeof(candidate));
+  for (u32 s = 0; s < set_count; s++)
+  {
+    candidate.set_layouts[s] = layout_cache_set_layout(context, cache, bindings[s], binding_counts[s]);
+    if (!candidate.set_layouts[s]) return VK_NULL_HANDLE;
+  }
+  candidate.set_count = set_count;
+  for (u32 i = 0; i < LAYOUT_MAX_PUSH_RANGES; i++)
+  {
+    if (ranges[i].size) candidate.push_ranges[candidate.push_range_count++] = ranges[i];
+  }
+  candidate.hash = hash_bytes(candidate.set_layouts, sizeof(candidate.set_layouts), 14695981039346656037ull);
+  candidate.hash = hash_bytes(candidate.push_ranges, sizeof(candidate.push_ranges), candidate.hash);
+  memcpy(out_set_layouts, candidate.set_layouts, sizeof(candidate.set_layouts));
+
+  for (u32 i = 0; i < cache->pipeline_layout_count; i++)
+  {
+    LayoutCachePipelineLayout *entry = &cache->pipeline_layouts[i];
+    if (entry->hash == candidate.hash && entry->set_count == candidate.set_count &&
+      entry->push_range_count == candidate.push_range_count &&
+      memcmp(entry->set_layouts, candidate.set_layouts, sizeof(candidate.set_layouts)) == 0 &&
+      memcmp(entry->push_ranges, candidate.push_ranges, sizeof(candidate.push_ranges)) == 0) {
+      cache->hits++;
+      return entry->layout;
+    }
+  }
+
+  cache->misses++;
+  if (cache->pipeline_layout_count == LAYOUT_CACHE_MAX_PIPELINE_LAYOUTS) {
+    printf("Layout cache: too many pipeline layouts\n");
+    return VK_NULL_HANDLE;
+  }
+
+  VkPipelineLayoutCreateInfo pipeline_layout_info = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  pipeline_layout_info.setLayoutCount = candidate.set_count;
+  pipeline_layout_info.pSetLayouts = candidate.set_layouts;
+  pipeline_layout_info.pushConstantRangeCount = candidate.push_range_count;
+  pipeline_layout_info.pPushConstantRanges = candidate.push_ranges;
+  if (vkCreatePipelineLayout(context->device, &pipeline_layout_info, NULL, &candidate.layout) != VK_SUCCESS) {
+    printf("Layout cache: vkCreatePipelineLayout FAIL\n");
+    return VK_NULL_HANDLE;
+  }
+
+  cache->pipeline_layouts[cache->pipeline_layout_count++] = candidate;
+  return candidate.layout;
+}
+
+void layout_cache_report(LayoutCache *cache) {
+  printf("Layout cache: %u set layouts, %u pipeline layouts, %llu hits, %llu misses\n", cache->set_layout_count,
+    cache->pipeline_layout_count, (unsigned long long)cache->hits, (unsigned long long)cache->misses);
+}
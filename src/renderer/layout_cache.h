@@ -0,0 +1,66 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+#include "renderer/shader_reflect.h"
+
+#define LAYOUT_CACHE_MAX_SET_LAYOUTS 32
+#define LAYOUT_CACHE_MAX_PIPELINE_LAYOUTS 16
+#define LAYOUT_MAX_PUSH_RANGES 3 // One per stage: vertex, fragment, compute
+
+typedef struct LayoutCacheSetLayout {
+  u64 hash;
+  VkDescriptorSetLayoutBinding bindings[REFLECT_MAX_BINDINGS]; // Sorted by binding
+  u32 binding_count;
+  VkDescriptorSetLayout layout;
+} LayoutCacheSetLayout;
+
+typedef struct LayoutCachePipelineLayout {
+  u64 hash;
+  VkDescriptorSetLayout set_layouts[REFLECT_MAX_SETS];
+  u32 set_count;
+  VkPushConstantRange push_ranges[LAYOUT_MAX_PUSH_RANGES];
+  u32 push_range_count;
+  VkPipelineLayout layout;
+} LayoutCachePipelineLayout;
+
+/**
+ * Descriptor set layouts and pipeline layouts built from the reflection of the shaders that use
+ * them. Identical layouts are created once and returned as the same handle, so pipelines built
+ * from the same set of stages share a layout and descriptor sets stay bound across them.
+ */
+typedef struct LayoutCache {
+  LayoutCacheSetLayout set_layouts[LAYOUT_CACHE_MAX_SET_LAYOUTS];
+  u32 set_layout_count;
+  LayoutCachePipelineLayout pipeline_layouts[LAYOUT_CACHE_MAX_PIPELINE_LAYOUTS];
+  u32 pipeline_layout_count;
+
+  // Statistics
+  u64 hits;
+  u64 misses;
+} LayoutCache;
+
+void layout_cache_destroy(VkContext *context, LayoutCache *cache);
+
+/**
+ * Finds or creates a set layout. The bindings are sorted and hashed, their order does not matter.
+ * @returns The set layout, or VK_NULL_HANDLE on failure.
+ */
+VkDescriptorSetLayout layout_cache_set_layout(VkContext *context, LayoutCache *cache,
+  const VkDescriptorSetLayoutBinding *bindings, u32 binding_count);
+
+/**
+ * Merges the reflection of shaders into one pipeline layout: a binding used by several stages
+ * gets all of their stage flags and push constant ranges of the same stage are joined. Passing
+ * every shader that binds the same sets, not only the stages of one pipeline, gives all of them
+ * a compatible layout.
+ * @param dynamic_masks Per set, bit N turns binding N into a dynamic uniform or storage buffer.
+ * May be NULL. Ignored when the context uses descriptor buffers.
+ * @param out_set_layouts Receives the REFLECT_MAX_SETS set layouts, VK_NULL_HANDLE past the last
+ * used set. Sets below it that no shader uses get an empty layout.
+ * @returns The pipeline layout, or VK_NULL_HANDLE if the shaders disagree on a binding or the
+ * cache is full.
+ */
+VkPipelineLayout layout_cache_pipeline_layout(VkContext *context, LayoutCache *cache,
+  const ShaderReflection *const *shaders, u32 shader_count, const u32 *dynamic_masks,
+  VkDescriptorSetLayout *out_set_layouts);
+
+void layout_cache_report(LayoutCache *cache);
@@ -0,0 +1,86 @@
+#include "mesh.h"
+#include "mesh_format.h"
+#include "vulkan_buffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+b8 mesh_load(VkContext *context, const char *path, Mesh *out_mesh) {
+  memset(out_mesh, 0, sizeof(Mesh));
+
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    printf("Failed to open mesh %s\n", path);
+    return false;
+  }
+
+  MeshFileHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != MESH_FILE_MAGIC ||
+    header.version != MESH_FILE_VERSION || header.vertex_stride != sizeof(PackedVertex) ||
+    (header.index_size != 2 && header.index_size != 4)) {
+    printf("Invalid mesh file %s\n", path);
+    fclose(file);
+    return false;
+  }
+
+  u64 vertex_bytes = (u64)header.vertex_count * header.vertex_stride;
+  u64 index_bytes = (u64)header.index_count * header.index_size;
+  u8 *data = malloc(vertex_bytes + index_bytes);
+  b8 read_ok = fread(data, 1, vertex_bytes + index_bytes, file) == vertex_bytes + index_bytes;
+  fclose(file);
+  if (!read_ok) {
+    printf("Truncated mesh file %s\n", path);
+    free(data);
+    return false;
+  }
+
+  b8 result =
+    vulkan_buffer_create(context, vertex_bytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &out_mesh->vertex_buffer) &&
+    vulkan_buffer_create(context, index_bytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &out_mesh->index_buffer) &&
+    vulkan_buffer_upload(context, &out_mesh->vertex_buffer, data, vertex_bytes) &&
+    vulkan_buffer_upload(context, &out_mesh->index_buffer, data + vertex_bytes, index_bytes);
+  free(data);
+
+  if (!result) {
+    printf("Failed to upload mesh %s\n", path);
+    return false;
+  }
+
+  out_mesh->vertex_count = header.vertex_count;
+  out_mesh->index_count = header.index_count;
+  out_mesh->index_type = header.index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+  memcpy(out_mesh->center, header.center, sizeof(header.center));
+  memcpy(out_mesh->extent, header.extent, sizeof(header.extent));
+  return true;
+}
+
+void mesh_destroy(VkContext *context, Mesh *mesh) {
+  vulkan_buffer_destroy(context, &mesh->vertex_buffer);
+  vulkan_buffer_destroy(context, &mesh->index_buffer);
+}
+
+u32 mesh_vertex_input_description(VkVertexInputBindingDescription *out_binding, VkVertexInputAttributeDescription out_attributes[3]) {
+  out_binding->binding = 0;
+  out_binding->stride = sizeof(PackedVertex);
+  out_binding->inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+  out_attributes[0].location = 0;
+  out_attributes[0].binding = 0;
+  out_attributes[0].format = VK_FORMAT_R16G16B16A16_SNORM;
+  out_attributes[0].offset = offsetof(PackedVertex, position);
+
+  out_attributes[1].location = 1;
+  out_attributes[1].binding = 0;
+  out_attributes[1].format = VK_FORMAT_R8G8B8A8_SNORM;
+  out_attributes[1].offset = offsetof(PackedVertex, normal);
+
+  out_attributes[2].location = 2;
+  out_attributes[2].binding = 0;
+  out_attributes[2].format = VK_FORMAT_R16G16_SFLOAT;
+  out_attributes[2].offset = offsetof(PackedVertex, uv);
+
+  return 3;
+}
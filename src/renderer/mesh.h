@@ -0,0 +1,22 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+
+/**
+ * Loads a mesh cooked by tools/mesh_cooker into device local vertex and index buffers.
+ * The file is already in the GPU layout, so loading is a read followed by a copy.
+ * @param context The vulkan context.
+ * @param path The path of the .mesh file.
+ * @param out_mesh A pointer to hold the loaded mesh.
+ * @returns TRUE on success.
+ */
+b8 mesh_load(VkContext *context, const char *path, Mesh *out_mesh);
+
+void mesh_destroy(VkContext *context, Mesh *mesh);
+
+/**
+ * Describes the PackedVertex layout of cooked meshes for VkPipelineVertexInputStateCreateInfo.
+ * @param out_binding Receives the single vertex binding.
+ * @param out_attributes Receives position, normal and uv, in locations 0, 1 and 2.
+ * @returns The number of attributes written.
+ */
+u32 mesh_vertex_input_description(VkVertexInputBindingDescription *out_binding, VkVertexInputAttributeDescription out_attributes[3]);
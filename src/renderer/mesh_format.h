@@ -0,0 +1,26 @@
+#pragma once
+#include "defines.h"
+
+// Binary layout written by tools/mesh_cooker and read by mesh_load:
+// MeshFileHeader, vertex_count PackedVertex, index_count indices of index_size bytes.
+
+#define MESH_FILE_MAGIC 0x4853454D // "MESH"
+#define MESH_FILE_VERSION 1
+
+typedef struct MeshFileHeader {
+  u32 magic;
+  u32 version;
+  u32 vertex_count;
+  u32 index_count;
+  u32 index_size;     // 2 or 4 bytes
+  u32 vertex_stride;  // sizeof(PackedVertex)
+  // Positions are stored normalized to the bounding box: position = packed * extent + center
+  f32 center[3];
+  f32 extent[3];
+} MeshFileHeader;
+
+typedef struct PackedVertex {
+  i16 position[4];  // VK_FORMAT_R16G16B16A16_SNORM, w unused
+  i8 normal[4];     // VK_FORMAT_R8G8B8A8_SNORM, w unused
+  u16 uv[2];        // VK_FORMAT_R16G16_SFLOAT
+} PackedVertex;
@@ -0,0 +1,730 @@
+#include "pipeline_cache.h"
+#include "mesh.h"
+#include "vulkan_shader.h"
+#include "platform/platform.h"
+#include "core/trace.h"
+#include <stdio.h>
+#include <string.h>
+
+static void *compile_thread_main(void *arg);
+
+b8 pipeline_cache_create(VkContext *context, PipelineCacheSettings settings, b8 library_support, PipelineCache *cache) {
+  memset(cache, 0, sizeof(PipelineCache));
+  cache->settings = settings;
+  cache->device = context->device;
+  cache->create_flags = context->descriptor_buffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+  cache->use_libraries = settings.libraries && library_support;
+
+  pthread_mutex_init(&cache->mutex, 0);
+  pthread_cond_init(&cache->wake, 0);
+  if ((cache->use_libraries && settings.optimize_links) || settings.async_compile) {
+    if (pthread_create(&cache->thread, 0, compile_thread_main, cache) != 0) {
+      printf("Pipeline cache: failed to create the compile thread\n");
+      return false;
+    }
+    cache->thread_running = true;
+  }
+  return true;
+}
+
+void pipeline_cache_destroy(VkContext *context, PipelineCache *cache) {
+  if (cache->thread_running) {
+    pthread_mutex_lock(&cache->mutex);
+    cache->quit = true;
+    pthread_cond_signal(&cache->wake);
+    pthread_mutex_unlock(&cache->mutex);
+    pthread_join(cache->thread, 0);
+    cache->thread_running = false;
+  }
+  pthread_cond_destroy(&cache->wake);
+  pthread_mutex_destroy(&cache->mutex);
+
+  for (u32 i = 0; i < PIPELINE_CACHE_MAX_JOBS; i++)
+  {
+    if (cache->jobs[i].state == PIPELINE_JOB_DONE && cache->jobs[i].pipeline) {
+      vkDestroyPipeline(context->device, cache->jobs[i].pipeline, NULL);
+    }
+  }
+  for (u32 i = 0; i < cache->retired_count; i++)
+  {
+    vkDestroyPipeline(context->device, cache->retired[i].pipeline, NULL);
+  }
+  for (u32 i = 0; i < PIPELINE_CACHE_CAPACITY; i++)
+  {
+    if (cache->entries[i].pipeline) vkDestroyPipeline(context->device, cache->entries[i].pipeline, NULL);
+  }
+  for (u32 p = 0; p < PIPELINE_LIBRARY_PART_COUNT; p++)
+  {
+    for (u32 i = 0; i < cache->library_counts[p]; i++)
+    {
+      vkDestroyPipeline(context->device, cache->libraries[p][i].pipeline, NULL);
+    }
+    cache->library_counts[p] = 0;
+  }
+  for (u32 i = 0; i < cache->shader_count; i++)
+  {
+    vkDestroyShaderModule(context->device, cache->shaders[i].module, NULL);
+  }
+  cache->count = 0;
+  cache->shader_count = 0;
+}
+
+VkShaderModule pipeline_cache_shader(VkContext *context, PipelineCache *cache, const char *path) {
+  for (u32 i = 0; i < cache->shader_count; i++)
+  {
+    if (strcmp(cache->shaders[i].path, path) == 0) return cache->shaders[i].module;
+  }
+  if (cache->shader_count == PIPELINE_CACHE_MAX_SHADERS) {
+    printf("Pipeline cache: too many shaders, %s not loaded\n", path);
+    return VK_NULL_HANDLE;
+  }
+
+  PipelineCacheShader *shader = &cache->shaders[cache->shader_count];
+  VkShaderModule module = vulkan_shader_module_create_reflected(context, path, &shader->reflection);
+  if (module == VK_NULL_HANDLE) {
+    return VK_NULL_HANDLE;
+  }
+  cache->shader_count++;
+  strncpy(shader->path, path, sizeof(shader->path) - 1);
+  shader->module = module;
+  return module;
+}
+
+const ShaderReflection *pipeline_cache_shader_reflection(PipelineCache *cache, VkShaderModule module) {
+  for (u32 i = 0; i < cache->shader_count; i++)
+  {
+    if (cache->shaders[i].module == module) return &cache->shaders[i].reflection;
+  }
+  return NULL;
+}
+
+void pipeline_key_init(PipelineKey *key) {
+  memset(key, 0, sizeof(PipelineKey));
+  key->topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  key->polygon_mode = VK_POLYGON_MODE_FILL;
+  key->cull_mode = VK_CULL_MODE_BACK_BIT;
+  key->front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  key->samples = VK_SAMPLE_COUNT_1_BIT;
+  key->depth_test = true;
+  key->depth_write = true;
+  key->depth_compare = VK_COMPARE_OP_LESS;
+  key->blend = PIPELINE_BLEND_NONE;
+  key->color_attachment_count = 1;
+  key->vertex_layout = PIPELINE_VERTEX_MESH;
+}
+
+void pipeline_key_specialize(PipelineKey *key, PipelineShaderStage stage, u32 constant_id, u32 value) {
+  if (constant_id >= PIPELINE_MAX_CONSTANTS) {
+    printf("Pipeline cache: constant_id %u out of range\n", constant_id);
+    return;
+  }
+  key->constants[stage][constant_id] = value;
+  key->constant_masks[stage] |= 1 << constant_id;
+}
+
+// FNV-1a over the bytes of the key
+u64 pipeline_key_hash(const PipelineKey *key) {
+  const u8 *bytes = (const u8 *)key;
+  u64 hash = 14695981039346656037ull;
+  for (u32 i = 0; i < sizeof(PipelineKey); i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// Create infos of a whole pipeline, the library parts use subsets of it
+typedef struct PipelineState {
+  VkPipelineShaderStageCreateInfo stages[2]; // Vertex, then fragment if any
+  u32 stage_count;
+  VkSpecializationMapEntry constant_entries[PIPELINE_STAGE_COUNT][PIPELINE_MAX_CONSTANTS];
+  VkSpecializationInfo specialization[PIPELINE_STAGE_COUNT]; // The data is read from the key
+  VkVertexInputBindingDescription vertex_binding;
+  VkVertexInputAttributeDescription vertex_attributes[3];
+  VkPipelineVertexInputStateCreateInfo vertex_input;
+  VkPipelineInputAssemblyStateCreateInfo input_assembly;
+  VkPipelineViewportStateCreateInfo viewport_state;
+  VkPipelineRasterizationStateCreateInfo rasterization_state;
+  VkPipelineMultisampleStateCreateInfo multisample_info;
+  VkPipelineColorBlendAttachmentState color_blend_attachments[PIPELINE_MAX_COLOR_ATTACHMENTS];
+  VkPipelineColorBlendStateCreateInfo color_blend;
+  VkPipelineDepthStencilStateCreateInfo depth_stencil;
+  VkDynamicState dynamic_states[3];
+  VkPipelineDynamicStateCreateInfo dynamic_state;
+} PipelineState;
+
+// Map entries of the specialized constant ids, the key holds the values at offset 4 * id
+static void build_specialization(const PipelineKey *key, PipelineShaderStage stage, PipelineState *state,
+  VkPipelineShaderStageCreateInfo *stage_info) {
+  if (!key->constant_masks[stage]) return;
+
+  VkSpecializationInfo *specialization = &state->specialization[stage];
+  for (u32 id = 0; id < PIPELINE_MAX_CONSTANTS; id++)
+  {
+    if (!(key->constant_masks[stage] & (1 << id))) continue;
+    VkSpecializationMapEntry *entry = &state->constant_entries[stage][specialization->mapEntryCount++];
+    entry->constantID = id;
+    entry->offset = id * sizeof(u32);
+    entry->size = sizeof(u32);
+  }
+  specialization->pMapEntries = state->constant_entries[stage];
+  specialization->dataSize = sizeof(key->constants[stage]);
+  specialization->pData = key->constants[stage];
+  stage_info->pSpecializationInfo = specialization;
+}
+
+static void build_state(const PipelineKey *key, PipelineState *state, VkGraphicsPipelineCreateInfo *pipeline_info) {
+  memset(state, 0, sizeof(PipelineState));
+  state->stages[state->stage_count].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  state->stages[state->stage_count].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  state->stages[state->stage_count].module = key->vertex_shader;
+  state->stages[state->stage_count].pName = "main";
+  build_specialization(key, PIPELINE_STAGE_VERTEX, state, &state->stages[state->stage_count++]);
+  if (key->fragment_shader) {
+    state->stages[state->stage_count].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    state->stages[state->stage_count].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    state->stages[state->stage_count].module = key->fragment_shader;
+    state->stages[state->stage_count].pName = "main";
+    build_specialization(key, PIPELINE_STAGE_FRAGMENT, state, &state->stages[state->stage_count++]);
+  }
+
+  state->vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  if (key->vertex_layout == PIPELINE_VERTEX_MESH) {
+    state->vertex_input.vertexBindingDescriptionCount = 1;
+    state->vertex_input.pVertexBindingDescriptions = &state->vertex_binding;
+    state->vertex_input.vertexAttributeDescriptionCount = mesh_vertex_input_description(&state->vertex_binding,
+      state->vertex_attributes);
+    state->vertex_input.pVertexAttributeDescriptions = state->vertex_attributes;
+  }
+
+  state->input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  state->input_assembly.topology = (VkPrimitiveTopology)key->topology;
+
+  state->viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  state->viewport_state.viewportCount = 1;
+  state->viewport_state.scissorCount = 1;
+
+  state->rasterization_state.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  state->rasterization_state.polygonMode = (VkPolygonMode)key->polygon_mode;
+  state->rasterization_state.lineWidth = 1.f;
+  state->rasterization_state.cullMode = key->cull_mode;
+  state->rasterization_state.frontFace = (VkFrontFace)key->front_face;
+  state->rasterization_state.depthBiasEnable = key->depth_bias ? VK_TRUE : VK_FALSE;
+
+  state->multisample_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  state->multisample_info.rasterizationSamples = (VkSampleCountFlagBits)key->samples;
+
+  VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
+  color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  if (key->blend != PIPELINE_BLEND_NONE) {
+    color_blend_attachment.blendEnable = VK_TRUE;
+    color_blend_attachment.srcColorBlendFactor = key->blend == PIPELINE_BLEND_ALPHA ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.dstColorBlendFactor = key->blend == PIPELINE_BLEND_ALPHA ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+  }
+  for (u32 i = 0; i < PIPELINE_MAX_COLOR_ATTACHMENTS; i++)
+  {
+    state->color_blend_attachments[i] = color_blend_attachment;
+  }
+  state->color_blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  state->color_blend.attachmentCount = key->color_attachment_count;
+  state->color_blend.pAttachments = state->color_blend_attachments;
+
+  state->depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  state->depth_stencil.depthTestEnable = key->depth_test ? VK_TRUE : VK_FALSE;
+  state->depth_stencil.depthWriteEnable = key->depth_write ? VK_TRUE : VK_FALSE;
+  state->depth_stencil.depthCompareOp = (VkCompareOp)key->depth_compare;
+
+  state->dynamic_states[0] = VK_DYNAMIC_STATE_VIEWPORT;
+  state->dynamic_states[1] = VK_DYNAMIC_STATE_SCISSOR;
+  state->dynamic_states[2] = VK_DYNAMIC_STATE_DEPTH_BIAS;
+  state->dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  state->dynamic_state.dynamicStateCount = key->depth_bias ? 3 : 2;
+  state->dynamic_state.pDynamicStates = state->dynamic_states;
+
+  memset(pipeline_info, 0, sizeof(VkGraphicsPipelineCreateInfo));
+  pipeline_info->sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipeline_info->stageCount = state->stage_count;
+  pipeline_info->pStages = state->stages;
+  pipeline_info->pVertexInputState = &state->vertex_input;
+  pipeline_info->pInputAssemblyState = &state->input_assembly;
+  pipeline_info->pViewportState = &state->viewport_state;
+  pipeline_info->pRasterizationState = &state->rasterization_state;
+  pipeline_info->pMultisampleState = &state->multisample_info;
+  pipeline_info->pColorBlendState = &state->color_blend;
+  pipeline_info->pDepthStencilState = &state->depth_stencil;
+  pipeline_info->pDynamicState = &state->dynamic_state;
+  pipeline_info->layout = key->layout;
+  pipeline_info->renderPass = key->render_pass;
+}
+
+static VkPipeline create_monolithic(const PipelineCache *cache, const PipelineKey *key) {
+  PipelineState state;
+  VkGraphicsPipelineCreateInfo pipeline_info;
+  build_state(key, &state, &pipeline_info);
+  pipeline_info.flags = cache->create_flags;
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  if (vkCreateGraphicsPipelines(cache->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline) != VK_SUCCESS) {
+    return VK_NULL_HANDLE;
+  }
+  return pipeline;
+}
+
+// The fields of the key a library part is compiled from, everything else zeroed
+static void library_key(const PipelineKey *key, PipelineLibraryPart part, PipelineKey *out_key) {
+  memset(out_key, 0, sizeof(PipelineKey));
+  switch (part) {
+    case PIPELINE_LIBRARY_VERTEX_INPUT:
+      out_key->topology = key->topology;
+      out_key->vertex_layout = key->vertex_layout;
+      break;
+    case PIPELINE_LIBRARY_PRE_RASTERIZATION:
+      out_key->vertex_shader = key->vertex_shader;
+      memcpy(out_key->constants[PIPELINE_STAGE_VERTEX], key->constants[PIPELINE_STAGE_VERTEX],
+        sizeof(key->constants[PIPELINE_STAGE_VERTEX]));
+      out_key->constant_masks[PIPELINE_STAGE_VERTEX] = key->constant_masks[PIPELINE_STAGE_VERTEX];
+      out_key->layout = key->layout;
+      out_key->render_pass = key->render_pass;
+      out_key->polygon_mode = key->polygon_mode;
+      out_key->cull_mode = key->cull_mode;
+      out_key->front_face = key->front_face;
+      out_key->depth_bias = key->depth_bias;
+      break;
+    case PIPELINE_LIBRARY_FRAGMENT_SHADER:
+      out_key->fragment_shader = key->fragment_shader;
+      memcpy(out_key->constants[PIPELINE_STAGE_FRAGMENT], key->constants[PIPELINE_STAGE_FRAGMENT],
+        sizeof(key->constants[PIPELINE_STAGE_FRAGMENT]));
+      out_key->constant_masks[PIPELINE_STAGE_FRAGMENT] = key->constant_masks[PIPELINE_STAGE_FRAGMENT];
+      out_key->layout = key->layout;
+      out_key->render_pass = key->render_pass;
+      out_key->samples = key->samples;
+      out_key->depth_test = key->depth_test;
+      out_key->depth_write = key->depth_write;
+      out_key->depth_compare = key->depth_compare;
+      break;
+    default:
+      out_key->render_pass = key->render_pass;
+      out_key->samples = key->samples;
+      out_key->blend = key->blend;
+      out_key->color_attachment_count = key->color_attachment_count;
+      break;
+  }
+}
+
+static const VkGraphicsPipelineLibraryFlagsEXT library_flags[PIPELINE_LIBRARY_PART_COUNT] = {
+  [PIPELINE_LIBRARY_VERTEX_INPUT] = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+  [PIPELINE_LIBRARY_PRE_RASTERIZATION] = VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+  [PIPELINE_LIBRARY_FRAGMENT_SHADER] = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+  [PIPELINE_LIBRARY_FRAGMENT_OUTPUT] = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+};
+
+// Keeps the state of the part only. Libraries retain what the optimized link needs.
+static VkPipeline create_library(const PipelineCache *cache, const PipelineKey *key, PipelineLibraryPart part) {
+  PipelineState state;
+  VkGraphicsPipelineCreateInfo pipeline_info;
+  build_state(key, &state, &pipeline_info);
+
+  VkGraphicsPipelineLibraryCreateInfoEXT library_info = {VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT};
+  library_info.flags = library_flags[part];
+  pipeline_info.pNext = &library_info;
+  pipeline_info.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT |
+    cache->create_flags;
+
+  if (part != PIPELINE_LIBRARY_VERTEX_INPUT) {
+    pipeline_info.pVertexInputState = NULL;
+    pipeline_info.pInputAssemblyState = NULL;
+  }
+  if (part != PIPELINE_LIBRARY_PRE_RASTERIZATION) {
+    pipeline_info.pViewportState = NULL;
+    pipeline_info.pRasterizationState = NULL;
+    pipeline_info.pDynamicState = NULL;
+  }
+  if (part != PIPELINE_LIBRARY_FRAGMENT_SHADER) {
+    pipeline_info.pDepthStencilState = NULL;
+  }
+  if (part != PIPELINE_LIBRARY_FRAGMENT_OUTPUT) {
+    pipeline_info.pColorBlendState = NULL;
+  }
+  if (part != PIPELINE_LIBRARY_FRAGMENT_SHADER && part != PIPELINE_LIBRARY_FRAGMENT_OUTPUT) {
+    pipeline_info.pMultisampleState = NULL;
+  }
+
+  switch (part) {
+    case PIPELINE_LIBRARY_VERTEX_INPUT:
+    case PIPELINE_LIBRARY_FRAGMENT_OUTPUT:
+      pipeline_info.stageCount = 0;
+      pipeline_info.pStages = NULL;
+      pipeline_info.layout = VK_NULL_HANDLE;
+      if (part == PIPELINE_LIBRARY_VERTEX_INPUT) pipeline_info.renderPass = VK_NULL_HANDLE;
+      break;
+    case PIPELINE_LIBRARY_PRE_RASTERIZATION:
+      pipeline_info.stageCount = 1;
+      break;
+    default:
+      pipeline_info.stageCount = state.stage_count - 1;
+      pipeline_info.pStages = state.stage_count > 1 ? &state.stages[1] : NULL;
+      break;
+  }
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  if (vkCreateGraphicsPipelines(cache->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline) != VK_SUCCESS) {
+    return VK_NULL_HANDLE;
+  }
+  return pipeline;
+}
+
+static VkPipeline link_libraries(const PipelineCache *cache, const VkPipeline libraries[PIPELINE_LIBRARY_PART_COUNT],
+  VkPipelineLayout layout, b8 optimize) {
+  VkPipelineLibraryCreateInfoKHR link_info = {VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR};
+  link_info.libraryCount = PIPELINE_LIBRARY_PART_COUNT;
+  link_info.pLibraries = libraries;
+
+  VkGraphicsPipelineCreateInfo pipeline_info = {VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
+  pipeline_info.pNext = &link_info;
+  pipeline_info.flags = (optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0) | cache->create_flags;
+  pipeline_info.layout = layout;
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  if (vkCreateGraphicsPipelines(cache->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline) != VK_SUCCESS) {
+    return VK_NULL_HANDLE;
+  }
+  return pipeline;
+}
+
+// Library parts are shared by every pipeline with the same state for that part
+static VkPipeline get_library(PipelineCache *cache, const PipelineKey *key, PipelineLibraryPart part) {
+  PipelineKey part_key;
+  library_key(key, part, &part_key);
+  u64 hash = pipeline_key_hash(&part_key);
+
+  PipelineLibrary *libraries = cache->libraries[part];
+  for (u32 i = 0; i < cache->library_counts[part]; i++)
+  {
+    if (libraries[i].hash == hash && memcmp(&libraries[i].key, &part_key, sizeof(PipelineKey)) == 0) {
+      return libraries[i].pipeline;
+    }
+  }
+  if (cache->library_counts[part] == PIPELINE_CACHE_MAX_LIBRARIES) {
+    return VK_NULL_HANDLE;
+  }
+
+  f64 start = platform_get_absolute_time();
+  VkPipeline pipeline = create_library(cache, key, part);
+  cache->library_seconds += platform_get_absolute_time() - start;
+  if (!pipeline) {
+    return VK_NULL_HANDLE;
+  }
+  cache->library_count++;
+
+  PipelineLibrary *library = &libraries[cache->library_counts[part]++];
+  library->hash = hash;
+  library->key = part_key;
+  library->pipeline = pipeline;
+  return pipeline;
+}
+
+// @returns FALSE when every job is taken
+static b8 queue_job(PipelineCache *cache, PipelineJobType type, const PipelineKey *key, const VkPipeline *libraries) {
+  b8 queued = false;
+  pthread_mutex_lock(&cache->mutex);
+  for (u32 i = 0; i < PIPELINE_CACHE_MAX_JOBS && !queued; i++)
+  {
+    PipelineCompileJob *job = &cache->jobs[i];
+    if (job->state != PIPELINE_JOB_FREE) continue;
+
+    job->type = type;
+    job->key = *key;
+    if (libraries) memcpy(job->libraries, libraries, sizeof(job->libraries));
+    job->pipeline = VK_NULL_HANDLE;
+    job->state = PIPELINE_JOB_QUEUED;
+    pthread_cond_signal(&cache->wake);
+    queued = true;
+  }
+  pthread_mutex_unlock(&cache->mutex);
+  return queued;
+}
+
+static void *compile_thread_main(void *arg) {
+  PipelineCache *cache = arg;
+  trace_set_thread_name("pipeline compiler");
+
+  pthread_mutex_lock(&cache->mutex);
+  for (;;)
+  {
+    PipelineCompileJob *job = NULL;
+    for (u32 i = 0; i < PIPELINE_CACHE_MAX_JOBS && !job; i++)
+    {
+      if (cache->jobs[i].state == PIPELINE_JOB_QUEUED) job = &cache->jobs[i];
+    }
+    if (cache->quit) break;
+    if (!job) {
+      pthread_cond_wait(&cache->wake, &cache->mutex);
+      continue;
+    }
+
+    job->state = PIPELINE_JOB_RUNNING;
+    pthread_mutex_unlock(&cache->mutex);
+
+    // Libraries are only created on the main thread, async compiles are monolithic
+    TraceZone zone = trace_begin(job->type == PIPELINE_JOB_OPTIMIZED_LINK ? "optimized_link" : "compile_pipeline",
+      TRACE_COLOR_DEFAULT);
+    f64 start = platform_get_absolute_time();
+    VkPipeline pipeline = job->type == PIPELINE_JOB_OPTIMIZED_LINK ?
+      link_libraries(cache, job->libraries, job->key.layout, true) : create_monolithic(cache, &job->key);
+    f64 seconds = platform_get_absolute_time() - start;
+    trace_end(zone);
+
+    pthread_mutex_lock(&cache->mutex);
+    job->pipeline = pipeline;
+    job->seconds = seconds;
+    job->state = PIPELINE_JOB_DONE;
+  }
+  pthread_mutex_unlock(&cache->mutex);
+  return 0;
+}
+
+// Fast link of the library parts, monolithic compile without libraries or when a part fails
+static VkPipeline create_pipeline(PipelineCache *cache, const PipelineKey *key, b8 *out_linked) {
+  *out_linked = false;
+  if (cache->use_libraries) {
+    VkPipeline libraries[PIPELINE_LIBRARY_PART_COUNT];
+    b8 complete = true;
+    for (u32 p = 0; p < PIPELINE_LIBRARY_PART_COUNT; p++)
+    {
+      libraries[p] = get_library(cache, key, (PipelineLibraryPart)p);
+      if (!libraries[p]) complete = false;
+    }
+
+    if (complete) {
+      f64 start = platform_get_absolute_time();
+      VkPipeline pipeline = link_libraries(cache, libraries, key->layout, false);
+      cache->link_seconds += platform_get_absolute_time() - start;
+      if (pipeline) {
+        cache->link_count++;
+        *out_linked = true;
+        // Without a free job the fast link simply stays
+        if (cache->thread_running && cache->settings.optimize_links) {
+          queue_job(cache, PIPELINE_JOB_OPTIMIZED_LINK, key, libraries);
+        }
+        return pipeline;
+      }
+    }
+  }
+
+  f64 start = platform_get_absolute_time();
+  VkPipeline pipeline = create_monolithic(cache, key);
+  cache->monolithic_seconds += platform_get_absolute_time() - start;
+  if (pipeline) cache->monolithic_count++;
+  return pipeline;
+}
+
+static b8 is_specialized(const PipelineKey *key) {
+  return key->constant_masks[PIPELINE_STAGE_VERTEX] || key->constant_masks[PIPELINE_STAGE_FRAGMENT];
+}
+
+// Linear probing, the slot of the key or the free slot where it belongs
+static PipelineCacheEntry *find_entry(PipelineCache *cache, const PipelineKey *key, u64 hash) {
+  u32 mask = PIPELINE_CACHE_CAPACITY - 1;
+  for (u32 i = 0; i < PIPELINE_CACHE_CAPACITY; i++)
+  {
+    PipelineCacheEntry *entry = &cache->entries[(hash + i) & mask];
+    if (!entry->pipeline && !entry->pending) return entry;
+    if (entry->hash == hash && memcmp(&entry->key, key, sizeof(PipelineKey)) == 0) return entry;
+  }
+  return NULL;
+}
+
+static VkPipeline insert(VkContext *context, PipelineCache *cache, PipelineCacheEntry *entry, const PipelineKey *key,
+  u64 hash) {
+  // Keep a free slot so lookups of missing keys always terminate
+  if (!entry->pending && cache->count + 1 >= PIPELINE_CACHE_CAPACITY) {
+    printf("Pipeline cache: full\n");
+    cache->failures++;
+    return VK_NULL_HANDLE;
+  }
+
+  b8 linked;
+  VkPipeline pipeline = create_pipeline(cache, key, &linked);
+  if (!pipeline) {
+    printf("Pipeline cache: vkCreateGraphicsPipelines FAIL for key %016llx\n", (unsigned long long)hash);
+    cache->failures++;
+    return VK_NULL_HANDLE;
+  }
+
+  if (!entry->pending) cache->count++;
+  if (is_specialized(key)) cache->specialized++;
+  entry->hash = hash;
+  entry->key = *key;
+  entry->pipeline = pipeline;
+  entry->linked = linked;
+  entry->pending = false;
+  entry->failed = false;
+  return pipeline;
+}
+
+void pipeline_cache_begin_frame(VkContext *context, PipelineCache *cache) {
+  cache->frame++;
+  cache->last_fallback_draws = cache->fallback_draws;
+  if (cache->fallback_draws > cache->max_fallback_draws) cache->max_fallback_draws = cache->fallback_draws;
+  if (cache->fallback_draws) cache->fallback_frames++;
+  cache->total_fallback_draws += cache->fallback_draws;
+  cache->fallback_draws = 0;
+
+  if (cache->thread_running) {
+    pthread_mutex_lock(&cache->mutex);
+    for (u32 i = 0; i < PIPELINE_CACHE_MAX_JOBS; i++)
+    {
+      PipelineCompileJob *job = &cache->jobs[i];
+      if (job->state != PIPELINE_JOB_DONE) continue;
+      job->state = PIPELINE_JOB_FREE;
+      PipelineCacheEntry *entry = find_entry(cache, &job->key, pipeline_key_hash(&job->key));
+
+      if (job->type == PIPELINE_JOB_COMPILE) {
+        // The entry may have been compiled by a blocking lookup in the meantime
+        if (!entry || !entry->pending) {
+          if (job->pipeline) vkDestroyPipeline(context->device, job->pipeline, NULL);
+          continue;
+        }
+        if (!job->pipeline) {
+          // Stays pending, draws keep the fallback
+          printf("Pipeline cache: async compile FAIL for key %016llx\n", (unsigned long long)entry->hash);
+          entry->failed = true;
+          cache->failures++;
+          continue;
+        }
+        entry->pipeline = job->pipeline;
+        entry->pending = false;
+        cache->version++;
+        if (is_specialized(&entry->key)) cache->specialized++;
+        cache->async_count++;
+        cache->async_seconds += job->seconds;
+        continue;
+      }
+
+      if (!job->pipeline) {
+        cache->failures++;
+        continue;
+      }
+      if (!entry || !entry->linked || cache->retired_count == PIPELINE_CACHE_MAX_RETIRED) {
+        vkDestroyPipeline(context->device, job->pipeline, NULL);
+        continue;
+      }
+
+      // Command buffers of the frames in flight may still reference the fast link
+      cache->retired[cache->retired_count++] = (PipelineRetired){entry->pipeline, cache->frame};
+      entry->pipeline = job->pipeline;
+      entry->linked = false;
+      cache->version++;
+      cache->optimized_count++;
+      cache->optimized_seconds += job->seconds;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+  }
+
+  u32 kept = 0;
+  for (u32 i = 0; i < cache->retired_count; i++)
+  {
+    if (cache->retired[i].frame + MAX_FRAMES <= cache->frame) {
+      vkDestroyPipeline(context->device, cache->retired[i].pipeline, NULL);
+    } else {
+      cache->retired[kept++] = cache->retired[i];
+    }
+  }
+  cache->retired_count = kept;
+}
+
+VkPipeline pipeline_cache_get(VkContext *context, PipelineCache *cache, const PipelineKey *key) {
+  u64 hash = pipeline_key_hash(key);
+  PipelineCacheEntry *entry = find_entry(cache, key, hash);
+  if (entry && entry->pipeline) {
+    cache->hits++;
+    return entry->pipeline;
+  }
+
+  // Includes pending entries, the result of the compile thread is dropped
+  cache->misses++;
+  return entry ? insert(context, cache, entry, key, hash) : VK_NULL_HANDLE;
+}
+
+VkPipeline pipeline_cache_get_async(VkContext *context, PipelineCache *cache, const PipelineKey *key,
+  const PipelineKey *fallback, b8 *out_fallback) {
+  *out_fallback = false;
+  if (!cache->settings.async_compile || !cache->thread_running) {
+    return pipeline_cache_get(context, cache, key);
+  }
+
+  u64 hash = pipeline_key_hash(key);
+  PipelineCacheEntry *entry = find_entry(cache, key, hash);
+  if (entry && entry->pipeline) {
+    cache->hits++;
+    return entry->pipeline;
+  }
+
+  if (entry && !entry->pending) {
+    cache->misses++;
+    if (cache->count + 1 < PIPELINE_CACHE_CAPACITY && queue_job(cache, PIPELINE_JOB_COMPILE, key, NULL)) {
+      entry->hash = hash;
+      entry->key = *key;
+      entry->pending = true;
+      entry->failed = false;
+      cache->count++;
+    }
+    // Otherwise queued again by a later lookup
+  }
+
+  *out_fallback = true;
+  cache->fallback_draws++;
+  return pipeline_cache_get(context, cache, fallback);
+}
+
+b8 pipeline_cache_prewarm(VkContext *context, PipelineCache *cache, const PipelineKey *keys, u32 count) {
+  b8 result = true;
+  for (u32 i = 0; i < count; i++)
+  {
+    u64 hash = pipeline_key_hash(&keys[i]);
+    PipelineCacheEntry *entry = find_entry(cache, &keys[i], hash);
+    if (entry && entry->pipeline) continue;
+
+    if (entry && insert(context, cache, entry, &keys[i], hash)) {
+      cache->prewarmed++;
+    } else {
+      result = false;
+    }
+  }
+  return result;
+}
+
+static f64 average_ms(f64 seconds, u64 count) {
+  return count ? seconds * 1000.0 / (f64)count : 0.0;
+}
+
+void pipeline_cache_report(PipelineCache *cache) {
+  u64 lookups = cache->hits + cache->misses;
+  printf("Pipeline cache: %u pipelines (%llu prewarmed), %llu lookups, %llu hits, %llu misses (%.2f%% hit rate), "
+    "%llu failures\n", cache->count, (unsigned long long)cache->prewarmed,
+    (unsigned long long)lookups, (unsigned long long)cache->hits, (unsigned long long)cache->misses,
+    lookups ? 100.0 * (f64)cache->hits / (f64)lookups : 0.0, (unsigned long long)cache->failures);
+  printf("  specialized variants %llu\n", (unsigned long long)cache->specialized);
+  printf("  monolithic compiles %llu, %.3f ms avg\n", (unsigned long long)cache->monolithic_count,
+    average_ms(cache->monolithic_seconds, cache->monolithic_count));
+  if (cache->use_libraries) {
+    printf("  library parts %llu, %.3f ms avg\n", (unsigned long long)cache->library_count,
+      average_ms(cache->library_seconds, cache->library_count));
+    printf("  fast links %llu, %.3f ms avg\n", (unsigned long long)cache->link_count,
+      average_ms(cache->link_seconds, cache->link_count));
+    printf("  optimized links %llu, %.3f ms avg in the background\n", (unsigned long long)cache->optimized_count,
+      average_ms(cache->optimized_seconds, cache->optimized_count));
+  }
+  if (cache->settings.async_compile) {
+    printf("  async compiles %llu, %.3f ms avg in the background\n", (unsigned long long)cache->async_count,
+      average_ms(cache->async_seconds, cache->async_count));
+    printf("  fallback draws %llu over %llu frames, at most %u in a frame\n",
+      (unsigned long long)cache->total_fallback_draws, (unsigned long long)cache->fallback_frames,
+      cache->max_fallback_draws);
+  }
+}
@@ -0,0 +1,258 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+#include "renderer/shader_reflect.h"
+#include <pthread.h>
+
+#define PIPELINE_CACHE_CAPACITY 256 // Power of two
+#define PIPELINE_CACHE_MAX_SHADERS 32
+#define PIPELINE_CACHE_MAX_LIBRARIES 64 // Per library part
+#define PIPELINE_CACHE_MAX_JOBS 32
+#define PIPELINE_CACHE_MAX_RETIRED 64
+#define PIPELINE_MAX_COLOR_ATTACHMENTS 4
+#define PIPELINE_MAX_CONSTANTS 8 // Specialization constant ids per stage
+
+typedef enum PipelineBlend {
+  PIPELINE_BLEND_NONE,
+  PIPELINE_BLEND_ALPHA,
+  PIPELINE_BLEND_ADDITIVE,
+} PipelineBlend;
+
+typedef enum PipelineVertexLayout {
+  PIPELINE_VERTEX_MESH, // See mesh_vertex_input_description
+  PIPELINE_VERTEX_NONE, // Vertices generated in the shader
+} PipelineVertexLayout;
+
+typedef enum PipelineShaderStage {
+  PIPELINE_STAGE_VERTEX,
+  PIPELINE_STAGE_FRAGMENT,
+  PIPELINE_STAGE_COUNT
+} PipelineShaderStage;
+
+// The four independently compiled parts of VK_EXT_graphics_pipeline_library
+typedef enum PipelineLibraryPart {
+  PIPELINE_LIBRARY_VERTEX_INPUT,
+  PIPELINE_LIBRARY_PRE_RASTERIZATION,
+  PIPELINE_LIBRARY_FRAGMENT_SHADER,
+  PIPELINE_LIBRARY_FRAGMENT_OUTPUT,
+  PIPELINE_LIBRARY_PART_COUNT
+} PipelineLibraryPart;
+
+/**
+ * Everything a graphics pipeline is built from. Keys are hashed and compared as raw bytes, so
+ * they must start from pipeline_key_init. The struct has no implicit padding, struct assignment
+ * would not have to copy it.
+ *
+ * Shader variants are specialization constants rather than separate sources: a shader declares
+ * its options with layout(constant_id = N) and the key supplies values for some of them, the
+ * others keep the default of the shader. Each combination of values is its own cache entry, so
+ * a variant is compiled once however many passes use it.
+ */
+typedef struct PipelineKey {
+  VkShaderModule vertex_shader;
+  VkShaderModule fragment_shader; // VK_NULL_HANDLE for depth only pipelines
+  VkPipelineLayout layout;
+  VkRenderPass render_pass;       // Any render pass compatible with the ones it is used in
+  u32 constants[PIPELINE_STAGE_COUNT][PIPELINE_MAX_CONSTANTS]; // Indexed by constant_id
+  u8 topology;                    // VkPrimitiveTopology
+  u8 polygon_mode;                // VkPolygonMode
+  u8 cull_mode;                   // VkCullModeFlags
+  u8 front_face;                  // VkFrontFace
+  u8 samples;                     // VkSampleCountFlagBits
+  u8 depth_test;
+  u8 depth_write;
+  u8 depth_compare;               // VkCompareOp
+  u8 depth_bias;                  // Dynamic depth bias
+  u8 blend;                       // PipelineBlend
+  u8 color_attachment_count;      // At most PIPELINE_MAX_COLOR_ATTACHMENTS
+  u8 vertex_layout;               // PipelineVertexLayout
+  u8 constant_masks[PIPELINE_STAGE_COUNT]; // Bit N set when constant_id N is specialized
+  u8 reserved[2];                 // Explicit padding to the alignment of the handles, zero
+} PipelineKey;
+
+_Static_assert(sizeof(PipelineKey) == 4 * sizeof(VkShaderModule) +
+  sizeof(u32) * PIPELINE_STAGE_COUNT * PIPELINE_MAX_CONSTANTS + 12 + PIPELINE_STAGE_COUNT +
+  sizeof(((PipelineKey *)0)->reserved),
+  "PipelineKey must not have implicit padding, adjust reserved");
+
+typedef struct PipelineCacheEntry {
+  u64 hash;
+  PipelineKey key;
+  VkPipeline pipeline; // VK_NULL_HANDLE when the slot is free
+  b8 linked;           // Fast linked from libraries, an optimized link may replace it
+  b8 pending;          // Compiling on the compile thread, or failed to
+  b8 failed;
+} PipelineCacheEntry;
+
+typedef struct PipelineCacheShader {
+  char path[64];
+  VkShaderModule module;
+  ShaderReflection reflection;
+} PipelineCacheShader;
+
+// One compiled library part, keyed by the fields of the pipeline key that part depends on
+typedef struct PipelineLibrary {
+  u64 hash;
+  PipelineKey key;
+  VkPipeline pipeline;
+} PipelineLibrary;
+
+typedef enum PipelineJobType {
+  PIPELINE_JOB_OPTIMIZED_LINK, // Link time optimized link of a fast linked pipeline
+  PIPELINE_JOB_COMPILE,        // Full compile of a pipeline requested with pipeline_cache_get_async
+} PipelineJobType;
+
+typedef enum PipelineJobState {
+  PIPELINE_JOB_FREE,
+  PIPELINE_JOB_QUEUED,
+  PIPELINE_JOB_RUNNING,
+  PIPELINE_JOB_DONE,
+} PipelineJobState;
+
+// Work of the compile thread
+typedef struct PipelineCompileJob {
+  PipelineJobType type;
+  PipelineKey key;
+  VkPipeline libraries[PIPELINE_LIBRARY_PART_COUNT];
+  VkPipeline pipeline; // Result, VK_NULL_HANDLE on failure
+  f64 seconds;
+  PipelineJobState state;
+} PipelineCompileJob;
+
+// Replaced pipeline destroyed once the frames in flight that may use it completed
+typedef struct PipelineRetired {
+  VkPipeline pipeline;
+  u64 frame;
+} PipelineRetired;
+
+typedef struct PipelineCacheSettings {
+  b8 libraries;      // Fast link pipeline libraries when VK_EXT_graphics_pipeline_library is enabled
+  b8 optimize_links; // Replace fast links with link time optimized pipelines in the background
+  b8 async_compile;  // pipeline_cache_get_async compiles on the compile thread, otherwise it blocks
+} PipelineCacheSettings;
+
+/**
+ * Graphics pipelines created on demand from their key and kept for the lifetime of the cache.
+ * A lookup is a hash and a few probes, cheap enough for the recording hot path. Shader modules
+ * are loaded through the cache as well, they must outlive every pipeline built from them.
+ *
+ * With graphics pipeline libraries a miss compiles only the parts no other pipeline shares yet
+ * and links them, which is much faster than a monolithic compile. A compile thread then links
+ * the same parts with link time optimization and the result replaces the fast link.
+ *
+ * Pipelines that may be compiled late are looked up with pipeline_cache_get_async, which never
+ * blocks: until the compile thread is done the draw uses a generic fallback pipeline.
+ */
+typedef struct PipelineCache {
+  PipelineCacheSettings settings;
+  VkDevice device;
+  VkPipelineCreateFlags create_flags; // Added to every pipeline and library part
+  b8 use_libraries;
+
+  PipelineCacheEntry entries[PIPELINE_CACHE_CAPACITY];
+  u32 count;
+  PipelineCacheShader shaders[PIPELINE_CACHE_MAX_SHADERS];
+  u32 shader_count;
+  PipelineLibrary libraries[PIPELINE_LIBRARY_PART_COUNT][PIPELINE_CACHE_MAX_LIBRARIES];
+  u32 library_counts[PIPELINE_LIBRARY_PART_COUNT];
+
+  // Compile thread, jobs are guarded by the mutex
+  pthread_t thread;
+  b8 thread_running;
+  b8 quit;
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  PipelineCompileJob jobs[PIPELINE_CACHE_MAX_JOBS];
+
+  PipelineRetired retired[PIPELINE_CACHE_MAX_RETIRED];
+  u32 retired_count;
+  u64 frame;
+  u64 version; // Bumped when a pipeline replaces the one of an entry, command buffers using it are stale
+
+  // Statistics
+  u64 hits;
+  u64 misses;
+  u64 prewarmed;
+  u64 failures;
+  u64 specialized;         // Pipelines with specialization constants
+  u64 monolithic_count;
+  f64 monolithic_seconds;
+  u64 library_count;
+  f64 library_seconds;
+  u64 link_count;
+  f64 link_seconds;
+  u64 optimized_count;
+  f64 optimized_seconds;
+  u64 async_count;
+  f64 async_seconds;
+  u32 fallback_draws;      // Current frame
+  u32 last_fallback_draws; // Previous frame
+  u32 max_fallback_draws;
+  u64 total_fallback_draws;
+  u64 fallback_frames;     // Frames with at least one fallback draw
+} PipelineCache;
+
+/**
+ * Starts the compile thread for background optimized links and async compiles.
+ * @param library_support TRUE if VK_EXT_graphics_pipeline_library is enabled on the device.
+ * @returns TRUE on success.
+ */
+b8 pipeline_cache_create(VkContext *context, PipelineCacheSettings settings, b8 library_support, PipelineCache *cache);
+void pipeline_cache_destroy(VkContext *context, PipelineCache *cache);
+
+/**
+ * Swaps in the optimized and async pipelines the compile thread finished and destroys the pipelines
+ * they replaced once no frame in flight can use them. Call once per frame, after the fence of
+ * the frame slot was waited.
+ */
+void pipeline_cache_begin_frame(VkContext *context, PipelineCache *cache);
+
+/**
+ * Creates the module of a shader once, later calls with the same name return the same module.
+ * @param path The file name of the shader, see vulkan_shader_module_create.
+ * @returns The shader module or VK_NULL_HANDLE on failure.
+ */
+VkShaderModule pipeline_cache_shader(VkContext *context, PipelineCache *cache, const char *path);
+
+/**
+ * @returns The resources of a module loaded with pipeline_cache_shader, NULL for other modules.
+ */
+const ShaderReflection *pipeline_cache_shader_reflection(PipelineCache *cache, VkShaderModule module);
+
+/**
+ * Opaque, back face culled triangle lists with a depth test, one color attachment, single
+ * sampled and the mesh vertex layout.
+ */
+void pipeline_key_init(PipelineKey *key);
+
+/**
+ * Specializes a constant of a stage. Values are 32 bits: the bits of a uint, int or float, or a
+ * VkBool32. Ids the shader does not declare are ignored by the driver.
+ */
+void pipeline_key_specialize(PipelineKey *key, PipelineShaderStage stage, u32 constant_id, u32 value);
+
+u64 pipeline_key_hash(const PipelineKey *key);
+
+/**
+ * Finds the pipeline of a key, creating it on a miss.
+ * @returns The pipeline, or VK_NULL_HANDLE if it could not be created or the cache is full.
+ */
+VkPipeline pipeline_cache_get(VkContext *context, PipelineCache *cache, const PipelineKey *key);
+
+/**
+ * Finds the pipeline of a key without compiling on the calling thread. On a miss the compile
+ * thread builds it and the fallback pipeline is returned until it is swapped in by
+ * pipeline_cache_begin_frame. Every call that returns the fallback counts as a fallback draw.
+ * @param fallback Generic pipeline for the same pass, compiled here if it is not cached yet.
+ * @param out_fallback Set to TRUE when the fallback is returned.
+ * @returns The pipeline, or VK_NULL_HANDLE if neither pipeline is available.
+ */
+VkPipeline pipeline_cache_get_async(VkContext *context, PipelineCache *cache, const PipelineKey *key,
+  const PipelineKey *fallback, b8 *out_fallback);
+
+/**
+ * Creates the pipelines of keys known ahead of time, so the first frames only hit the cache.
+ * @returns TRUE if every pipeline is in the cache.
+ */
+b8 pipeline_cache_prewarm(VkContext *context, PipelineCache *cache, const PipelineKey *keys, u32 count);
+
+void pipeline_cache_report(PipelineCache *cache);
@@ -0,0 +1,264 @@
+#include "post_process.h"
+#include "vulkan_shader.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *pipeline_shaders[POST_PIPELINE_COUNT] = {
+  [POST_PIPELINE_BLOOM_DOWNSAMPLE] = "bloom_downsample.comp.spv",
+  [POST_PIPELINE_BLOOM_UPSAMPLE] = "bloom_upsample.comp.spv",
+  [POST_PIPELINE_SSAO_DEPTH] = "ssao_depth.comp.spv",
+  [POST_PIPELINE_SSAO] = "ssao.comp.spv",
+  [POST_PIPELINE_SSAO_BLUR] = "ssao_blur.comp.spv",
+  [POST_PIPELINE_TONEMAP] = "tonemap.comp.spv",
+};
+
+static b8 create_sampler(VkContext *context, VkFilter filter, VkSampler *out_sampler) {
+  VkSamplerCreateInfo sampler_info = {VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  sampler_info.magFilter = filter;
+  sampler_info.minFilter = filter;
+  sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.maxLod = 0.0f;
+  return vkCreateSampler(context->device, &sampler_info, NULL, out_sampler) == VK_SUCCESS;
+}
+
+b8 post_process_create(VkContext *context, PostProcessSettings settings, DescriptorAllocator *descriptors,
+  LayoutCache *layouts, PostProcess *post) {
+  memset(post, 0, sizeof(PostProcess));
+  post->settings = settings;
+  post->context = context;
+  post->descriptors = descriptors;
+
+  if (!create_sampler(context, VK_FILTER_LINEAR, &post->linear_sampler) ||
+    !create_sampler(context, VK_FILTER_NEAREST, &post->nearest_sampler)) {
+    printf("Post process: vkCreateSampler FAIL\n");
+    return false;
+  }
+
+  // All steps share one layout, merged from the reflection of every shader: inputs are combined
+  // image samplers below POST_MAX_INPUTS, the output the storage image at it. Post passes take
+  // their parameters as push constants, so they touch no buffer owned by the graphics queue family.
+  VkShaderModule shaders[POST_PIPELINE_COUNT] = {0};
+  ShaderReflection reflections[POST_PIPELINE_COUNT];
+  const ShaderReflection *reflection_pointers[POST_PIPELINE_COUNT];
+  b8 result = true;
+  for (u32 i = 0; i < POST_PIPELINE_COUNT && result; i++)
+  {
+    shaders[i] = vulkan_shader_module_create_reflected(context, pipeline_shaders[i], &reflections[i]);
+    reflection_pointers[i] = &reflections[i];
+    if (shaders[i] == VK_NULL_HANDLE) {
+      result = false;
+    } else if (reflections[i].push_constant_offset + reflections[i].push_constant_size > sizeof(post->steps[0].constants)) {
+      printf("Post process: %s pushes more constants than a step holds\n", pipeline_shaders[i]);
+      result = false;
+    }
+  }
+
+  VkDescriptorSetLayout set_layouts[REFLECT_MAX_SETS];
+  if (result) {
+    post->pipeline_layout = layout_cache_pipeline_layout(context, layouts, reflection_pointers, POST_PIPELINE_COUNT,
+      NULL, set_layouts);
+    post->set_layout = set_layouts[0];
+    if (post->pipeline_layout == VK_NULL_HANDLE || post->set_layout == VK_NULL_HANDLE || set_layouts[1] != VK_NULL_HANDLE) {
+      printf("Post process: layout FAIL\n");
+      result = false;
+    }
+  }
+
+  for (u32 i = 0; i < POST_PIPELINE_COUNT && result; i++)
+  {
+    VkComputePipelineCreateInfo pipeline_info = {VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+    pipeline_info.flags = context->descriptor_buffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shaders[i];
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = post->pipeline_layout;
+
+    if (vkCreateComputePipelines(context->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &post->pipelines[i]) != VK_SUCCESS) {
+      printf("Post process: vkCreateComputePipelines FAIL for %s\n", pipeline_shaders[i]);
+      result = false;
+    }
+  }
+
+  for (u32 i = 0; i < POST_PIPELINE_COUNT; i++)
+  {
+    if (shaders[i]) vkDestroyShaderModule(context->device, shaders[i], NULL);
+  }
+  return result;
+}
+
+void post_process_destroy(VkContext *context, PostProcess *post) {
+  for (u32 i = 0; i < POST_PIPELINE_COUNT; i++)
+  {
+    if (post->pipelines[i]) vkDestroyPipeline(context->device, post->pipelines[i], NULL);
+  }
+  vkDestroySampler(context->device, post->linear_sampler, NULL);
+  vkDestroySampler(context->device, post->nearest_sampler, NULL);
+}
+
+// Graph views change with the swapchain extent, so the descriptors are written again every
+// frame right before the dispatch
+static void step_bindings(PostProcess *post, PostStep *step, DescriptorBinding *bindings) {
+  memset(bindings, 0, sizeof(DescriptorBinding) * (step->input_count + 1));
+  for (u32 i = 0; i <= step->input_count; i++)
+  {
+    b8 output = i == step->input_count;
+    u32 resource = output ? step->output : step->inputs[i];
+    b8 filterable = post->graph->resources[resource].desc.format != VK_FORMAT_R32_SFLOAT;
+
+    bindings[i].binding = output ? POST_MAX_INPUTS : i;
+    bindings[i].type = output ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[i].image.sampler = filterable ? post->linear_sampler : post->nearest_sampler;
+    bindings[i].image.imageView = render_graph_get_view(post->graph, resource);
+    bindings[i].image.imageLayout = output ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  }
+}
+
+static void execute_step(VkCommandBuffer command_buffer, void *user_data) {
+  PostStep *step = user_data;
+  PostProcess *post = step->post;
+  DescriptorBinding bindings[POST_MAX_INPUTS + 1];
+  step_bindings(post, step, bindings);
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, post->pipelines[step->pipeline]);
+  descriptor_allocator_bind(post->context, post->descriptors, command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+    post->pipeline_layout, 0, post->set_layout, bindings, step->input_count + 1, false);
+  vkCmdPushConstants(command_buffer, post->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(step->constants),
+    step->constants);
+
+  VkExtent2D extent = render_graph_get_extent(post->graph, step->output);
+  vkCmdDispatch(command_buffer, (extent.width + POST_WORKGROUP_SIZE - 1) / POST_WORKGROUP_SIZE,
+    (extent.height + POST_WORKGROUP_SIZE - 1) / POST_WORKGROUP_SIZE, 1);
+}
+
+static void copy_to_target(VkCommandBuffer command_buffer, void *user_data) {
+  PostProcess *post = user_data;
+  VkExtent2D extent = render_graph_get_extent(post->graph, post->ldr);
+
+  VkImageCopy region = {0};
+  region.srcSubresource = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.dstSubresource = region.srcSubresource;
+  region.extent = (VkExtent3D){extent.width, extent.height, 1};
+  vkCmdCopyImage(command_buffer, render_graph_get_image(post->graph, post->ldr), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    render_graph_get_image(post->graph, post->target), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+
+static PostStep *add_step(VkContext *context, PostProcess *post, const char *name, PostPipeline pipeline, u32 output) {
+  if (post->step_count == POST_MAX_STEPS) {
+    printf("Post process: too many steps, %s dropped\n", name);
+    return NULL;
+  }
+
+  PostStep *step = &post->steps[post->step_count];
+  memset(step, 0, sizeof(PostStep));
+  step->post = post;
+  step->pipeline = pipeline;
+  step->output = output;
+
+  step->pass = render_graph_add_pass(post->graph, name, RG_PASS_COMPUTE, execute_step, step);
+  if (post->settings.async_compute) render_graph_set_async(post->graph, step->pass);
+  render_graph_use(post->graph, step->pass, output, RG_ACCESS_STORAGE_WRITE_COMPUTE);
+  post->step_count++;
+  return step;
+}
+
+// Inputs are declared to the graph once, a step may bind the same image to several slots
+static void add_input(PostProcess *post, PostStep *step, u32 resource) {
+  b8 declared = false;
+  for (u32 i = 0; i < step->input_count; i++)
+  {
+    if (step->inputs[i] == resource) declared = true;
+  }
+  step->inputs[step->input_count++] = resource;
+  if (!declared) {
+    render_graph_use(post->graph, step->pass, resource, RG_ACCESS_SAMPLED_COMPUTE);
+  }
+}
+
+b8 post_process_add_passes(VkContext *context, PostProcess *post, RenderGraph *graph, u32 hdr, u32 target,
+  VkFormat target_format) {
+  post->graph = graph;
+  post->hdr = hdr;
+  post->target = target;
+  PostProcessSettings *settings = &post->settings;
+  PostStep *step;
+
+  if (settings->ssao) {
+    // Half resolution view depth, then the occlusion and a depth aware blur at that resolution
+    RgImageDesc half = {VK_FORMAT_R32_SFLOAT, VK_SAMPLE_COUNT_1_BIT, {0, 0}, 0.5f};
+    post->ssao_depth = render_graph_create_image(graph, "ssao_depth", half);
+    post->ssao_raw = render_graph_create_image(graph, "ssao_raw", half);
+    post->ssao = render_graph_create_image(graph, "ssao", half);
+
+    if (!(step = add_step(context, post, "ssao_depth", POST_PIPELINE_SSAO_DEPTH, post->ssao_depth))) return false;
+    add_input(post, step, hdr);
+
+    if (!(step = add_step(context, post, "ssao", POST_PIPELINE_SSAO, post->ssao_raw))) return false;
+    add_input(post, step, post->ssao_depth);
+    step->constants[2] = settings->ssao_radius;
+    step->constants[3] = settings->ssao_intensity;
+    step->constants[4] = 0.02f; // Bias against self occlusion on flat surfaces, relative to depth
+    post->ssao_step = post->step_count - 1;
+
+    if (!(step = add_step(context, post, "ssao_blur", POST_PIPELINE_SSAO_BLUR, post->ssao))) return false;
+    add_input(post, step, post->ssao_raw);
+    add_input(post, step, post->ssao_depth);
+  }
+
+  // Bloom pyramid: each level halves the previous one, the first level keeps the bright parts only
+  for (u32 i = 0; i < POST_BLOOM_LEVELS; i++)
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "bloom_%u", i);
+    post->bloom[i] = render_graph_create_image(graph, name,
+      (RgImageDesc){POST_HDR_FORMAT, VK_SAMPLE_COUNT_1_BIT, {0, 0}, 1.0f / (f32)(2u << i)});
+
+    snprintf(name, sizeof(name), "bloom_down_%u", i);
+    if (!(step = add_step(context, post, name, POST_PIPELINE_BLOOM_DOWNSAMPLE, post->bloom[i]))) return false;
+    add_input(post, step, i == 0 ? hdr : post->bloom[i - 1]);
+    step->constants[0] = i == 0 ? 1.0f : 0.0f;
+    step->constants[1] = settings->bloom_threshold;
+    step->constants[2] = settings->bloom_threshold * 0.5f;
+  }
+
+  // Back up the pyramid, each level accumulates the blurred level below it
+  for (i32 i = POST_BLOOM_LEVELS - 2; i >= 0; i--)
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "bloom_up_%d", i);
+    if (!(step = add_step(context, post, name, POST_PIPELINE_BLOOM_UPSAMPLE, post->bloom[i]))) return false;
+    add_input(post, step, post->bloom[i + 1]);
+    step->constants[0] = 1.0f;
+  }
+
+  post->ldr = render_graph_create_image(graph, "ldr", (RgImageDesc){VK_FORMAT_R8G8B8A8_UNORM, VK_SAMPLE_COUNT_1_BIT});
+  if (!(step = add_step(context, post, "tonemap", POST_PIPELINE_TONEMAP, post->ldr))) return false;
+  add_input(post, step, hdr);
+  add_input(post, step, post->bloom[0]);
+  // Without SSAO the slots are bound to the HDR image and never read
+  add_input(post, step, settings->ssao ? post->ssao : hdr);
+  add_input(post, step, settings->ssao ? post->ssao_depth : hdr);
+  step->constants[0] = settings->exposure;
+  step->constants[1] = settings->bloom_intensity;
+  step->constants[2] = settings->ssao ? 1.0f : 0.0f;
+  step->constants[3] = target_format == VK_FORMAT_B8G8R8A8_SRGB || target_format == VK_FORMAT_B8G8R8A8_UNORM ? 1.0f : 0.0f;
+  step->constants[4] = target_format == VK_FORMAT_B8G8R8A8_SRGB || target_format == VK_FORMAT_R8G8B8A8_SRGB ? 1.0f : 0.0f;
+
+  // The texels are final, a copy between the size compatible formats is all that is left. It
+  // stays on the graphics queue, which owns the swapchain image.
+  u32 output = render_graph_add_pass(graph, "post_output", RG_PASS_TRANSFER, copy_to_target, post);
+  render_graph_use(graph, output, post->ldr, RG_ACCESS_TRANSFER_SRC);
+  render_graph_use(graph, output, target, RG_ACCESS_TRANSFER_DST);
+  return true;
+}
+
+void post_process_begin_frame(PostProcess *post, const Mat4 *projection) {
+  if (post->settings.ssao) {
+    PostStep *ssao = &post->steps[post->ssao_step];
+    ssao->constants[0] = 1.0f / projection->data[0];
+    ssao->constants[1] = 1.0f / projection->data[5];
+  }
+}
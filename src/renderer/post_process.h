@@ -0,0 +1,104 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+#include "renderer/render_graph.h"
+#include "renderer/descriptor_allocator.h"
+#include "renderer/layout_cache.h"
+#include "core/math_types.h"
+
+#define POST_BLOOM_LEVELS 5
+#define POST_MAX_STEPS 16
+#define POST_MAX_INPUTS 4
+#define POST_WORKGROUP_SIZE 8
+
+// HDR color of the scene. Alpha carries the linear view depth the SSAO passes start from.
+#define POST_HDR_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+
+typedef enum PostPipeline {
+  POST_PIPELINE_BLOOM_DOWNSAMPLE,
+  POST_PIPELINE_BLOOM_UPSAMPLE,
+  POST_PIPELINE_SSAO_DEPTH,
+  POST_PIPELINE_SSAO,
+  POST_PIPELINE_SSAO_BLUR,
+  POST_PIPELINE_TONEMAP,
+  POST_PIPELINE_COUNT
+} PostPipeline;
+
+struct PostProcess;
+
+// One dispatch of the chain: sampled inputs at bindings 0..3, a storage image at binding 4
+typedef struct PostStep {
+  struct PostProcess *post;
+  PostPipeline pipeline;
+  u32 pass;
+  u32 inputs[POST_MAX_INPUTS];
+  u32 input_count;
+  u32 output;
+  f32 constants[8]; // Push constants, see the shaders
+} PostStep;
+
+typedef struct PostProcessSettings {
+  b8 ssao;
+  b8 async_compute; // Marks the compute passes async, see render_graph_enable_async_compute
+  f32 exposure;
+  f32 bloom_intensity;
+  f32 bloom_threshold;
+  f32 ssao_radius; // World units
+  f32 ssao_intensity;
+} PostProcessSettings;
+
+/**
+ * Compute post-processing of the HDR scene color: bloom through a downsample and upsample
+ * pyramid, optional half resolution SSAO with a bilateral blur and upsample, and tonemapping.
+ * Every step is a render graph pass, so each one is timed and can run on async compute. The
+ * tonemapped result is copied into the swapchain: it is already encoded and swizzled for it.
+ */
+typedef struct PostProcess {
+  PostProcessSettings settings;
+  VkContext *context;
+  DescriptorAllocator *descriptors; // Sets of the steps are allocated every frame
+  VkDescriptorSetLayout set_layout; // The layouts are owned by the layout cache
+  VkPipelineLayout pipeline_layout;
+  VkSampler linear_sampler;
+  VkSampler nearest_sampler; // For the 32 bit float images, which may not support filtering
+  VkPipeline pipelines[POST_PIPELINE_COUNT];
+
+  RenderGraph *graph;
+  PostStep steps[POST_MAX_STEPS];
+  u32 step_count;
+
+  // Graph resources
+  u32 hdr;
+  u32 bloom[POST_BLOOM_LEVELS];
+  u32 ssao_depth;
+  u32 ssao_raw;
+  u32 ssao;
+  u32 ldr;
+  u32 target;
+  u32 ssao_step;
+} PostProcess;
+
+/**
+ * Creates the pipelines.
+ * @param descriptors Allocator of the per frame descriptor sets, must outlive the post-processing.
+ * @param layouts Receives the layouts reflected from the shaders, owns them and must outlive the
+ * post-processing.
+ * @returns TRUE on success.
+ */
+b8 post_process_create(VkContext *context, PostProcessSettings settings, DescriptorAllocator *descriptors,
+  LayoutCache *layouts, PostProcess *post);
+void post_process_destroy(VkContext *context, PostProcess *post);
+
+/**
+ * Adds the passes of the chain, from the HDR image to the target, which must be a
+ * VK_FORMAT_B8G8R8A8 or VK_FORMAT_R8G8B8A8 image of the graph extent. The graph must not be
+ * compiled yet.
+ * @returns TRUE on success.
+ */
+b8 post_process_add_passes(VkContext *context, PostProcess *post, RenderGraph *graph, u32 hdr, u32 target,
+  VkFormat target_format);
+
+/**
+ * Sets the projection the SSAO reconstructs view positions with. Call before the graph executes,
+ * after descriptor_allocator_begin_frame.
+ */
+void post_process_begin_frame(PostProcess *post, const Mat4 *projection);
@@ -0,0 +1,135 @@
+#include "readback.h"
+#include "vulkan_buffer.h"
+#include "platform/platform.h"
+#include <stdio.h>
+#include <string.h>
+
+void readback_create(Readback *readback, u32 pixel_size) {
+  memset(readback, 0, sizeof(Readback));
+  readback->pixel_size = pixel_size;
+}
+
+void readback_destroy(VkContext *context, Readback *readback) {
+  for (u32 i = 0; i < MAX_FRAMES; i++)
+  {
+    if (readback->slots[i].buffer.handle) vulkan_buffer_destroy(context, &readback->slots[i].buffer);
+  }
+}
+
+// The host reads every byte, so cached memory comes first: uncached reads are an order of
+// magnitude slower. Non coherent memory is invalidated before reading.
+static b8 create_slot_buffer(VkContext *context, Readback *readback, u64 size, VulkanBuffer *out_buffer) {
+  VkMemoryPropertyFlags candidates[] = {
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+  };
+
+  for (u32 i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++)
+  {
+    if (!vulkan_buffer_create(context, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, candidates[i], out_buffer)) {
+      if (out_buffer->handle) vulkan_buffer_destroy(context, out_buffer);
+      continue;
+    }
+
+    // The memory type vulkan_buffer_create picked, the same for every slot
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(context->device, out_buffer->handle, &requirements);
+    i32 type_index = vulkan_find_memory_type(context, requirements.memoryTypeBits, candidates[i]);
+    VkMemoryPropertyFlags flags = context->memory_properties.memoryTypes[type_index].propertyFlags;
+    readback->coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    return true;
+  }
+  return false;
+}
+
+b8 readback_request(VkContext *context, Readback *readback, u32 frame, u64 frame_number, u32 width, u32 height) {
+  ReadbackSlot *slot = &readback->slots[frame];
+  u64 size = (u64)width * height * readback->pixel_size;
+
+  if (slot->buffer.size < size) {
+    if (slot->buffer.handle) vulkan_buffer_destroy(context, &slot->buffer);
+    if (!create_slot_buffer(context, readback, size, &slot->buffer)) {
+      printf("Readback: no host visible memory for %llu bytes\n", (unsigned long long)size);
+      readback->failures++;
+      return false;
+    }
+  }
+
+  slot->width = width;
+  slot->height = height;
+  slot->frame = frame_number;
+  slot->pending = true;
+  readback->requests++;
+  return true;
+}
+
+b8 readback_requested(Readback *readback, u32 frame) {
+  return readback->slots[frame].pending;
+}
+
+void readback_record(Readback *readback, VkCommandBuffer command_buffer, u32 frame, VkImage image) {
+  ReadbackSlot *slot = &readback->slots[frame];
+  if (!slot->pending) {
+    return;
+  }
+
+  VkBufferImageCopy region = {0};
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent = (VkExtent3D){slot->width, slot->height, 1};
+  vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer.handle, 1, &region);
+
+  // The fence alone does not make the transfer writes visible to the host
+  VkBufferMemoryBarrier2 barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2};
+  barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+  barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+  barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+  barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = slot->buffer.handle;
+  barrier.size = VK_WHOLE_SIZE;
+
+  VkDependencyInfo dependency = {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+  dependency.bufferMemoryBarrierCount = 1;
+  dependency.pBufferMemoryBarriers = &barrier;
+  vkCmdPipelineBarrier2(command_buffer, &dependency);
+}
+
+ReadbackImage readback_collect(VkContext *context, Readback *readback, u32 frame) {
+  ReadbackImage image = {0};
+  ReadbackSlot *slot = &readback->slots[frame];
+  if (!slot->pending) {
+    return image;
+  }
+  slot->pending = false;
+
+  f64 start = platform_get_absolute_time();
+  if (!readback->coherent) {
+    VkMappedMemoryRange range = {VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE};
+    range.memory = slot->buffer.memory;
+    range.size = VK_WHOLE_SIZE;
+    vkInvalidateMappedMemoryRanges(context->device, 1, &range);
+  }
+  readback->collect_seconds += platform_get_absolute_time() - start;
+
+  image.data = (const u8 *)slot->buffer.mapped;
+  image.width = slot->width;
+  image.height = slot->height;
+  image.row_pitch = slot->width * readback->pixel_size;
+  image.frame = slot->frame;
+  readback->collected++;
+  readback->bytes += (u64)image.row_pitch * image.height;
+  return image;
+}
+
+void readback_report(Readback *readback) {
+  if (readback->requests == 0) {
+    return;
+  }
+  printf("Readback: %llu requests, %llu collected, %.2f MB, %.3f ms avg to collect%s, %u failures\n",
+    (unsigned long long)readback->requests, (unsigned long long)readback->collected,
+    (f64)readback->bytes / (1024.0 * 1024.0),
+    readback->collected ? readback->collect_seconds * 1000.0 / (f64)readback->collected : 0.0,
+    readback->coherent ? " (coherent)" : " (cached)", readback->failures);
+}
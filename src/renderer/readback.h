@@ -0,0 +1,71 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+
+typedef struct ReadbackSlot {
+  VulkanBuffer buffer; // Grown to the largest image requested in this slot
+  u32 width;
+  u32 height;
+  u64 frame;   // Frame number the copy was requested in
+  b8 pending;  // The commands of the slot copy into the buffer, collected once its fence signaled
+} ReadbackSlot;
+
+// Tightly packed pixels of a collected copy, valid until the slot is requested again
+typedef struct ReadbackImage {
+  const u8 *data; // NULL when nothing was collected
+  u32 width;
+  u32 height;
+  u32 row_pitch;
+  u64 frame;
+} ReadbackImage;
+
+/**
+ * Copies of rendered images into host visible buffers, one per frame in flight. The copy is
+ * recorded into the frame like any other pass and the buffer is only read once the fence of the
+ * frame slot signaled, when the slot comes around again, so frame() never waits for the GPU.
+ */
+typedef struct Readback {
+  ReadbackSlot slots[MAX_FRAMES];
+  u32 pixel_size;
+  b8 coherent;
+
+  // Statistics
+  u64 requests;
+  u64 collected;
+  u64 bytes;
+  f64 collect_seconds; // Invalidating the mapped range, reading is up to the caller
+  u32 failures;
+} Readback;
+
+/**
+ * Prepares the ring, buffers are created on the first request of each slot.
+ * @param pixel_size Bytes per pixel of the images that are copied.
+ */
+void readback_create(Readback *readback, u32 pixel_size);
+
+void readback_destroy(VkContext *context, Readback *readback);
+
+/**
+ * Asks for a copy of the image rendered in a frame slot, readback_record then records it. The
+ * buffer of the slot must not be read anymore, call after readback_collect.
+ * @returns FALSE if the buffer could not be grown to the size of the image.
+ */
+b8 readback_request(VkContext *context, Readback *readback, u32 frame, u64 frame_number, u32 width, u32 height);
+
+/**
+ * @returns TRUE if the commands recorded for the frame slot must copy into its buffer.
+ */
+b8 readback_requested(Readback *readback, u32 frame);
+
+/**
+ * Records the copy requested for the frame slot, nothing if there is none. The image must be in
+ * VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, with its writes made visible to transfers.
+ */
+void readback_record(Readback *readback, VkCommandBuffer command_buffer, u32 frame, VkImage image);
+
+/**
+ * Takes the copy of the previous use of the frame slot. Must be called after its fence was waited.
+ * @returns The pixels, data is NULL if the slot copied nothing.
+ */
+ReadbackImage readback_collect(VkContext *context, Readback *readback, u32 frame);
+
+void readback_report(Readback *readback);
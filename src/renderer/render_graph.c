@@ -0,0 +1,1150 @@
+#include "render_graph.h"
+#include "vulkan_buffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct AccessInfo {
+  VkPipelineStageFlags2 stage;
+  VkAccessFlags2 access;
+  VkImageLayout layout;
+  b8 write;
+  b8 attachment;
+  VkImageUsageFlags usage;
+  const char *name;
+} AccessInfo;
+
+#define FRAGMENT_TESTS (VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT)
+#define WRITE_ACCESS (VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | \
+  VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT)
+
+static const AccessInfo access_infos[RG_ACCESS_COUNT] = {
+  [RG_ACCESS_NONE] = {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED,
+    false, false, 0, "none"},
+  [RG_ACCESS_ACQUIRE] = {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED,
+    false, false, 0, "acquire"},
+  [RG_ACCESS_COLOR_ATTACHMENT] = {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+    VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    true, true, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, "color"},
+  [RG_ACCESS_DEPTH_ATTACHMENT] = {FRAGMENT_TESTS,
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+    true, true, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, "depth"},
+  [RG_ACCESS_DEPTH_ATTACHMENT_READ_ONLY] = {FRAGMENT_TESTS,
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+    false, true, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, "depth-read"},
+  [RG_ACCESS_SAMPLED_FRAGMENT] = {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+    VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    false, false, VK_IMAGE_USAGE_SAMPLED_BIT, "sampled-fragment"},
+  [RG_ACCESS_SAMPLED_COMPUTE] = {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+    VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    false, false, VK_IMAGE_USAGE_SAMPLED_BIT, "sampled-compute"},
+  [RG_ACCESS_STORAGE_READ_FRAGMENT] = {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+    VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+    false, false, VK_IMAGE_USAGE_STORAGE_BIT, "storage-read-fragment"},
+  [RG_ACCESS_STORAGE_READ_COMPUTE] = {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+    VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+    false, false, VK_IMAGE_USAGE_STORAGE_BIT, "storage-read-compute"},
+  [RG_ACCESS_STORAGE_WRITE_COMPUTE] = {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+    VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+    true, false, VK_IMAGE_USAGE_STORAGE_BIT, "storage-write-compute"},
+  [RG_ACCESS_TRANSFER_SRC] = {VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+    VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    false, false, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, "transfer-src"},
+  [RG_ACCESS_TRANSFER_DST] = {VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+    VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    true, false, VK_IMAGE_USAGE_TRANSFER_DST_BIT, "transfer-dst"},
+  // Presentation waits on the render finished semaphore, which already covers all commands
+  [RG_ACCESS_PRESENT] = {VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+    false, false, 0, "present"},
+};
+
+static const char *layout_name(VkImageLayout layout) {
+  switch (layout) {
+    case VK_IMAGE_LAYOUT_UNDEFINED: return "UNDEFINED";
+    case VK_IMAGE_LAYOUT_GENERAL: return "GENERAL";
+    case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "COLOR_ATTACHMENT";
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: return "DEPTH_ATTACHMENT";
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL: return "DEPTH_READ_ONLY";
+    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "SHADER_READ_ONLY";
+    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "TRANSFER_SRC";
+    case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "TRANSFER_DST";
+    case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "PRESENT_SRC";
+    default: return "?";
+  }
+}
+
+static VkImageAspectFlags aspect_from_format(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+      return VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
+
+void render_graph_create(RenderGraph *graph) {
+  memset(graph, 0, sizeof(RenderGraph));
+}
+
+static u32 add_resource(RenderGraph *graph, const char *name, RgResourceType type) {
+  if (graph->resource_count == RG_MAX_RESOURCES) {
+    printf("Render graph: too many resources, %s dropped\n", name);
+    return RG_INVALID;
+  }
+
+  u32 index = graph->resource_count++;
+  RgResource *resource = &graph->resources[index];
+  memset(resource, 0, sizeof(RgResource));
+  strncpy(resource->name, name, sizeof(resource->name) - 1);
+  resource->type = type;
+  resource->first_pass = RG_INVALID;
+  resource->last_pass = RG_INVALID;
+  return index;
+}
+
+u32 render_graph_create_image(RenderGraph *graph, const char *name, RgImageDesc desc) {
+  u32 index = add_resource(graph, name, RG_RESOURCE_IMAGE);
+  if (index == RG_INVALID) return index;
+
+  RgResource *resource = &graph->resources[index];
+  resource->desc = desc;
+  if (resource->desc.samples == 0) resource->desc.samples = VK_SAMPLE_COUNT_1_BIT;
+  if (resource->desc.scale == 0.0f) resource->desc.scale = 1.0f;
+  resource->aspect = aspect_from_format(desc.format);
+  return index;
+}
+
+u32 render_graph_import_image(RenderGraph *graph, const char *name, VkFormat format, VkSampleCountFlagBits samples,
+  RgAccess initial_access, RgAccess final_access) {
+  u32 index = add_resource(graph, name, RG_RESOURCE_IMAGE);
+  if (index == RG_INVALID) return index;
+
+  RgResource *resource = &graph->resources[index];
+  resource->imported = true;
+  resource->desc.format = format;
+  resource->desc.samples = samples;
+  resource->desc.scale = 1.0f;
+  resource->initial_access = initial_access;
+  resource->final_access = final_access;
+  resource->aspect = aspect_from_format(format);
+  return index;
+}
+
+u32 render_graph_import_buffer(RenderGraph *graph, const char *name, RgAccess initial_access, RgAccess final_access) {
+  u32 index = add_resource(graph, name, RG_RESOURCE_BUFFER);
+  if (index == RG_INVALID) return index;
+
+  RgResource *resource = &graph->resources[index];
+  resource->imported = true;
+  resource->initial_access = initial_access;
+  resource->final_access = final_access;
+  return index;
+}
+
+void render_graph_set_image(RenderGraph *graph, u32 resource, VkImage image, VkImageView view, VkExtent2D extent) {
+  graph->resources[resource].image = image;
+  graph->resources[resource].view = view;
+  graph->resources[resource].extent = extent;
+}
+
+void render_graph_set_buffer(RenderGraph *graph, u32 resource, VkBuffer buffer) {
+  graph->resources[resource].buffer = buffer;
+}
+
+void render_graph_set_output(RenderGraph *graph, u32 resource) {
+  graph->resources[resource].output = true;
+}
+
+u32 render_graph_add_pass(RenderGraph *graph, const char *name, RgPassType type, PFN_rg_execute execute, void *user_data) {
+  if (graph->pass_count == RG_MAX_PASSES) {
+    printf("Render graph: too many passes, %s dropped\n", name);
+    return RG_INVALID;
+  }
+
+  u32 index = graph->pass_count++;
+  RgPass *pass = &graph->passes[index];
+  memset(pass, 0, sizeof(RgPass));
+  strncpy(pass->name, name, sizeof(pass->name) - 1);
+  pass->type = type;
+  pass->execute = execute;
+  pass->user_data = user_data;
+  pass->timer_zone = RG_INVALID;
+  return index;
+}
+
+static RgPassAccess *add_access(RenderGraph *graph, u32 pass, u32 resource, RgAccess access) {
+  if (pass == RG_INVALID || resource == RG_INVALID) return 0;
+
+  RgPass *p = &graph->passes[pass];
+  if (p->access_count == RG_MAX_PASS_ACCESSES) {
+    printf("Render graph: too many accesses in pass %s\n", p->name);
+    return 0;
+  }
+
+  RgPassAccess *a = &p->accesses[p->access_count++];
+  memset(a, 0, sizeof(RgPassAccess));
+  a->resource = resource;
+  a->access = access;
+  a->resolve_source = RG_INVALID;
+  return a;
+}
+
+void render_graph_set_async(RenderGraph *graph, u32 pass) {
+  if (pass == RG_INVALID) return;
+  graph->passes[pass].async = true;
+}
+
+void render_graph_set_side_effects(RenderGraph *graph, u32 pass) {
+  if (pass == RG_INVALID) return;
+  graph->passes[pass].side_effects = true;
+}
+
+void render_graph_enable_async_compute(RenderGraph *graph, u32 graphics_family, u32 compute_family) {
+  graph->async_compute = true;
+  graph->queue_families[0] = graphics_family;
+  graph->queue_families[1] = compute_family;
+}
+
+void render_graph_use(RenderGraph *graph, u32 pass, u32 resource, RgAccess access) {
+  add_access(graph, pass, resource, access);
+}
+
+void render_graph_use_clear(RenderGraph *graph, u32 pass, u32 resource, RgAccess access, VkClearValue clear_value) {
+  RgPassAccess *a = add_access(graph, pass, resource, access);
+  if (!a) return;
+  a->clear = true;
+  a->clear_value = clear_value;
+}
+
+void render_graph_resolve(RenderGraph *graph, u32 pass, u32 source, u32 target) {
+  RgPassAccess *a = add_access(graph, pass, target, RG_ACCESS_COLOR_ATTACHMENT);
+  if (!a) return;
+  a->resolve_source = source;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Compilation
+// ---------------------------------------------------------------------------------------------
+
+// Walks the passes backwards keeping the set of resources whose current content is still
+// needed. A pass survives when it writes one of them or has side effects.
+static void cull_passes(RenderGraph *graph) {
+  b8 needed[RG_MAX_RESOURCES] = {0};
+  for (u32 r = 0; r < graph->resource_count; r++)
+  {
+    RgResource *resource = &graph->resources[r];
+    needed[r] = resource->output || (resource->imported && resource->final_access != RG_ACCESS_NONE);
+  }
+
+  for (i32 p = (i32)graph->pass_count - 1; p >= 0; p--)
+  {
+    RgPass *pass = &graph->passes[p];
+    b8 live = pass->side_effects;
+    for (u32 a = 0; a < pass->access_count && !live; a++)
+    {
+      if (access_infos[pass->accesses[a].access].write && needed[pass->accesses[a].resource]) live = true;
+    }
+
+    pass->culled = !live;
+    if (!live) continue;
+
+    // Writes that replace the whole content end the need for earlier writers, attachment
+    // writes that load their previous content do not.
+    for (u32 a = 0; a < pass->access_count; a++)
+    {
+      RgPassAccess *access = &pass->accesses[a];
+      const AccessInfo *info = &access_infos[access->access];
+      b8 replaces = info->write && (!info->attachment || access->clear || access->resolve_source != RG_INVALID);
+      if (replaces) needed[access->resource] = false;
+    }
+    for (u32 a = 0; a < pass->access_count; a++)
+    {
+      RgPassAccess *access = &pass->accesses[a];
+      const AccessInfo *info = &access_infos[access->access];
+      b8 replaces = info->write && (!info->attachment || access->clear || access->resolve_source != RG_INVALID);
+      if (!replaces) needed[access->resource] = true;
+    }
+  }
+}
+
+typedef struct ResourceState {
+  VkPipelineStageFlags2 write_stage;
+  VkAccessFlags2 write_access;
+  VkPipelineStageFlags2 read_stages;    // Readers since the last write, a new write must wait for them
+  VkPipelineStageFlags2 visible_stages; // Stages the last write was already made visible to
+  VkImageLayout layout;
+  RgQueue queue; // Queue of the last access
+} ResourceState;
+
+static void init_state(RgResource *resource, ResourceState *state) {
+  memset(state, 0, sizeof(ResourceState));
+  if (resource->imported) {
+    const AccessInfo *info = &access_infos[resource->initial_access];
+    state->write_stage = info->stage;
+    state->write_access = info->access & WRITE_ACCESS;
+    state->layout = info->layout;
+  } else {
+    state->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  }
+}
+
+// Moves a resource to a new access and returns true with the barrier that is needed, if any.
+static b8 transition(ResourceState *state, RgResource *resource, RgAccess access, RgQueue queue, RgBarrier *out) {
+  const AccessInfo *info = &access_infos[access];
+  b8 image = resource->type == RG_RESOURCE_IMAGE;
+  b8 layout_change = image && state->layout != info->layout;
+  b8 other_queue = state->queue != queue && (state->write_stage | state->read_stages) != 0;
+
+  memset(out, 0, sizeof(RgBarrier));
+  out->dst_stage = info->stage;
+  out->dst_access = info->access;
+  out->old_layout = state->layout;
+  out->new_layout = image ? info->layout : VK_IMAGE_LAYOUT_UNDEFINED;
+
+  b8 needed;
+  if (info->write) {
+    // Write after write and write after read
+    out->src_stage = state->write_stage | state->read_stages;
+    out->src_access = state->write_access;
+    needed = layout_change || out->src_stage != 0;
+
+    state->write_stage = info->stage;
+    state->write_access = info->access & WRITE_ACCESS;
+    state->read_stages = 0;
+    state->visible_stages = 0;
+  } else {
+    // Read after write, skipped when an earlier barrier already covered this stage
+    b8 visible = (state->visible_stages & info->stage) == info->stage || state->write_stage == 0;
+    out->src_stage = state->write_stage;
+    out->src_access = state->write_access;
+    if (layout_change) {
+      // The transition rewrites the image, earlier readers must be done with it
+      out->src_stage |= state->read_stages;
+    }
+    needed = layout_change || !visible;
+
+    state->read_stages |= info->stage;
+    state->visible_stages |= info->stage;
+  }
+
+  // Work of the other queue is ordered by the semaphore between the segments, the barrier only
+  // has to chain with its wait. Stages the compute queue does not have are handled the same way.
+  b8 foreign_stages = queue == RG_QUEUE_ASYNC_COMPUTE && (out->src_stage & ~VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+  if (out->src_stage && (other_queue || foreign_stages)) {
+    out->src_stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    out->src_access = VK_ACCESS_2_NONE;
+    needed = true;
+  }
+  state->queue = queue;
+
+  if (image) state->layout = info->layout;
+  return needed;
+}
+
+static b8 has_content_before(RenderGraph *graph, u32 resource, u32 pass_index) {
+  RgResource *r = &graph->resources[resource];
+  if (r->first_pass != RG_INVALID && r->first_pass < pass_index) return true;
+  return r->imported && access_infos[r->initial_access].layout != VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+static b8 has_use_after(RenderGraph *graph, u32 resource, u32 pass_index) {
+  RgResource *r = &graph->resources[resource];
+  if (r->last_pass != RG_INVALID && r->last_pass > pass_index) return true;
+  return r->output || (r->imported && r->final_access != RG_ACCESS_NONE);
+}
+
+static b8 create_render_pass(VkContext *context, RenderGraph *graph, u32 pass_index) {
+  RgPass *pass = &graph->passes[pass_index];
+
+  VkAttachmentDescription attachments[RG_MAX_PASS_ACCESSES] = {0};
+  VkAttachmentReference color_refs[RG_MAX_PASS_ACCESSES];
+  VkAttachmentReference resolve_refs[RG_MAX_PASS_ACCESSES];
+  u32 color_resources[RG_MAX_PASS_ACCESSES];
+  VkAttachmentReference depth_ref = {0};
+  b8 has_depth = false;
+  b8 has_resolve = false;
+  u32 color_count = 0;
+
+  pass->attachment_count = 0;
+  for (u32 a = 0; a < pass->access_count; a++)
+  {
+    RgPassAccess *access = &pass->accesses[a];
+    const AccessInfo *info = &access_infos[access->access];
+    if (!info->attachment) continue;
+
+    RgResource *resource = &graph->resources[access->resource];
+    u32 index = pass->attachment_count++;
+    pass->attachment_access[index] = a;
+    pass->clear_values[index] = access->clear_value;
+
+    VkAttachmentDescription *attachment = &attachments[index];
+    attachment->format = resource->desc.format;
+    attachment->samples = resource->desc.samples;
+    if (access->clear) {
+      attachment->loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    } else if (access->resolve_source == RG_INVALID && has_content_before(graph, access->resource, pass_index)) {
+      attachment->loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    } else {
+      attachment->loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    }
+    attachment->storeOp = info->write && has_use_after(graph, access->resource, pass_index)
+      ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    if (!info->write) {
+      attachment->storeOp = VK_ATTACHMENT_STORE_OP_NONE;
+    }
+    attachment->stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment->stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment->initialLayout = info->layout;
+    attachment->finalLayout = info->layout;
+
+    if (access->access == RG_ACCESS_COLOR_ATTACHMENT && access->resolve_source == RG_INVALID) {
+      color_refs[color_count] = (VkAttachmentReference){index, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+      resolve_refs[color_count] = (VkAttachmentReference){VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED};
+      color_resources[color_count] = access->resource;
+      color_count++;
+    } else if (access->access != RG_ACCESS_COLOR_ATTACHMENT && !has_depth) {
+      depth_ref = (VkAttachmentReference){index, info->layout};
+      has_depth = true;
+    }
+
+    if (pass->extent.width == 0) {
+      pass->extent = resource->extent;
+    }
+  }
+
+  // Resolve targets pair up with the color attachment they resolve
+  for (u32 i = 0; i < pass->attachment_count; i++)
+  {
+    RgPassAccess *access = &pass->accesses[pass->attachment_access[i]];
+    if (access->resolve_source == RG_INVALID) continue;
+    for (u32 c = 0; c < color_count; c++)
+    {
+      if (color_resources[c] == access->resolve_source) {
+        resolve_refs[c] = (VkAttachmentReference){i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+        has_resolve = true;
+      }
+    }
+  }
+
+  VkSubpassDescription subpass = {0};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = color_count;
+  subpass.pColorAttachments = color_refs;
+  subpass.pResolveAttachments = has_resolve ? resolve_refs : NULL;
+  subpass.pDepthStencilAttachment = has_depth ? &depth_ref : NULL;
+
+  // No subpass dependencies: every attachment already is in its subpass layout when the pass
+  // begins, the graph barriers recorded before vkCmdBeginRenderPass do all the synchronization.
+  VkRenderPassCreateInfo render_pass_info = {VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+  render_pass_info.attachmentCount = pass->attachment_count;
+  render_pass_info.pAttachments = attachments;
+  render_pass_info.subpassCount = 1;
+  render_pass_info.pSubpasses = &subpass;
+
+  if (vkCreateRenderPass(context->device, &render_pass_info, NULL, &pass->render_pass) != VK_SUCCESS) {
+    printf("Render graph: vkCreateRenderPass FAIL for %s\n", pass->name);
+    return false;
+  }
+  return true;
+}
+
+static void destroy_resources(VkContext *context, RenderGraph *graph) {
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    RgPass *pass = &graph->passes[p];
+    for (u32 f = 0; f < pass->framebuffer_count; f++)
+    {
+      vkDestroyFramebuffer(context->device, pass->framebuffers[f].handle, NULL);
+    }
+    pass->framebuffer_count = 0;
+  }
+
+  for (u32 r = 0; r < graph->resource_count; r++)
+  {
+    RgResource *resource = &graph->resources[r];
+    if (resource->imported) continue;
+    if (resource->view) vkDestroyImageView(context->device, resource->view, NULL);
+    if (resource->image) vkDestroyImage(context->device, resource->image, NULL);
+    resource->view = VK_NULL_HANDLE;
+    resource->image = VK_NULL_HANDLE;
+  }
+
+  for (u32 b = 0; b < graph->memory_block_count; b++)
+  {
+    vkFreeMemory(context->device, graph->memory_blocks[b].memory, NULL);
+  }
+  graph->memory_block_count = 0;
+}
+
+// Async resources are in use while the graphics queue runs ahead, pass order says nothing about them
+static b8 lifetimes_overlap(RgResource *a, RgResource *b) {
+  if (a->async || b->async) return true;
+  return a->first_pass <= b->last_pass && b->first_pass <= a->last_pass;
+}
+
+// Creates the transient images and places them in as few bytes as possible: images that are
+// never alive at the same time share memory.
+static b8 allocate_resources(VkContext *context, RenderGraph *graph) {
+  u32 order[RG_MAX_RESOURCES];
+  u32 order_count = 0;
+  graph->unaliased_bytes = 0;
+  graph->allocated_bytes = 0;
+
+  for (u32 r = 0; r < graph->resource_count; r++)
+  {
+    RgResource *resource = &graph->resources[r];
+    if (resource->imported || resource->first_pass == RG_INVALID) continue;
+
+    if (resource->desc.extent.width) {
+      resource->extent = resource->desc.extent;
+    } else {
+      resource->extent.width = (u32)(graph->extent.width * resource->desc.scale);
+      resource->extent.height = (u32)(graph->extent.height * resource->desc.scale);
+      if (resource->extent.width == 0) resource->extent.width = 1;
+      if (resource->extent.height == 0) resource->extent.height = 1;
+    }
+
+    VkImageCreateInfo image_info = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = resource->desc.format;
+    image_info.extent = (VkExtent3D){resource->extent.width, resource->extent.height, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = resource->desc.samples;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = resource->usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Concurrent sharing spares the queue family ownership transfers
+    if (resource->async) {
+      image_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+      image_info.queueFamilyIndexCount = 2;
+      image_info.pQueueFamilyIndices = graph->queue_families;
+    }
+
+    if (vkCreateImage(context->device, &image_info, NULL, &resource->image) != VK_SUCCESS) {
+      printf("Render graph: vkCreateImage FAIL for %s\n", resource->name);
+      return false;
+    }
+    vkGetImageMemoryRequirements(context->device, resource->image, &resource->requirements);
+    graph->unaliased_bytes += resource->requirements.size;
+
+    // Largest first gives the small ones a chance to fill the gaps
+    u32 i = order_count++;
+    while (i > 0 && graph->resources[order[i - 1]].requirements.size < resource->requirements.size) {
+      order[i] = order[i - 1];
+      i--;
+    }
+    order[i] = r;
+  }
+
+  for (u32 o = 0; o < order_count; o++)
+  {
+    RgResource *resource = &graph->resources[order[o]];
+    VkMemoryRequirements *req = &resource->requirements;
+
+    i32 lazy_type = -1;
+    if (resource->transient_attachment) {
+      lazy_type = vulkan_find_memory_type(context, req->memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+    }
+
+    if (lazy_type >= 0) {
+      // Tile memory on tilers, never backed by real memory so there is nothing to alias
+      if (graph->memory_block_count == RG_MAX_MEMORY_BLOCKS) return false;
+      RgMemoryBlock *block = &graph->memory_blocks[graph->memory_block_count];
+      block->memory_type = lazy_type;
+      block->size = req->size;
+      block->lazily_allocated = true;
+      resource->memory_block = graph->memory_block_count++;
+      resource->memory_offset = 0;
+      continue;
+    }
+
+    i32 memory_type = vulkan_find_memory_type(context, req->memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (memory_type < 0) {
+      printf("Render graph: no memory type for %s\n", resource->name);
+      return false;
+    }
+
+    u32 block_index = RG_INVALID;
+    for (u32 b = 0; b < graph->memory_block_count; b++)
+    {
+      if (!graph->memory_blocks[b].lazily_allocated && graph->memory_blocks[b].memory_type == (u32)memory_type) {
+        block_index = b;
+        break;
+      }
+    }
+    if (block_index == RG_INVALID) {
+      if (graph->memory_block_count == RG_MAX_MEMORY_BLOCKS) return false;
+      block_index = graph->memory_block_count++;
+      graph->memory_blocks[block_index] = (RgMemoryBlock){VK_NULL_HANDLE, memory_type, 0, false};
+    }
+
+    // First fit among the offsets right after each resource alive at the same time
+    VkDeviceSize candidates[RG_MAX_RESOURCES + 1];
+    u32 candidate_count = 0;
+    candidates[candidate_count++] = 0;
+    for (u32 p = 0; p < o; p++)
+    {
+      RgResource *placed = &graph->resources[order[p]];
+      if (placed->memory_block != block_index || !lifetimes_overlap(placed, resource)) continue;
+      VkDeviceSize end = placed->memory_offset + placed->requirements.size;
+      candidates[candidate_count++] = (end + req->alignment - 1) & ~(req->alignment - 1);
+    }
+
+    VkDeviceSize best = (VkDeviceSize)-1;
+    for (u32 c = 0; c < candidate_count; c++)
+    {
+      VkDeviceSize offset = candidates[c];
+      b8 fits = true;
+      for (u32 p = 0; p < o && fits; p++)
+      {
+        RgResource *placed = &graph->resources[order[p]];
+        if (placed->memory_block != block_index || !lifetimes_overlap(placed, resource)) continue;
+        if (offset < placed->memory_offset + placed->requirements.size && placed->memory_offset < offset + req->size) {
+          fits = false;
+        }
+      }
+      if (fits && offset < best) best = offset;
+    }
+
+    resource->memory_block = block_index;
+    resource->memory_offset = best;
+    RgMemoryBlock *block = &graph->memory_blocks[block_index];
+    if (best + req->size > block->size) block->size = best + req->size;
+  }
+
+  for (u32 b = 0; b < graph->memory_block_count; b++)
+  {
+    RgMemoryBlock *block = &graph->memory_blocks[b];
+    VkMemoryAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+    alloc_info.allocationSize = block->size;
+    alloc_info.memoryTypeIndex = block->memory_type;
+    if (vkAllocateMemory(context->device, &alloc_info, NULL, &block->memory) != VK_SUCCESS) {
+      printf("Render graph: vkAllocateMemory FAIL for block %u\n", b);
+      return false;
+    }
+    if (!block->lazily_allocated) graph->allocated_bytes += block->size;
+  }
+
+  for (u32 o = 0; o < order_count; o++)
+  {
+    RgResource *resource = &graph->resources[order[o]];
+    RgMemoryBlock *block = &graph->memory_blocks[resource->memory_block];
+    vkBindImageMemory(context->device, resource->image, block->memory, resource->memory_offset);
+
+    VkImageViewCreateInfo view_info = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+    view_info.image = resource->image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = resource->desc.format;
+    view_info.subresourceRange.aspectMask = resource->aspect;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(context->device, &view_info, NULL, &resource->view) != VK_SUCCESS) {
+      printf("Render graph: vkCreateImageView FAIL for %s\n", resource->name);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Memory of two transient images overlaps, an image always overlaps itself
+static b8 memory_overlaps(RgResource *a, RgResource *b) {
+  return a->memory_block == b->memory_block && a->memory_offset < b->memory_offset + b->requirements.size &&
+    b->memory_offset < a->memory_offset + a->requirements.size;
+}
+
+// A transient image starts after the last accesses to its memory: those of the images placed
+// on the same bytes earlier in the frame, and those of the previous frame, its own included.
+// Earlier frames were submitted before on the same queue, so the first barrier covers them.
+static void init_transient_state(RenderGraph *graph, u32 resource, ResourceState *end_states, ResourceState *state) {
+  RgResource *r = &graph->resources[resource];
+  for (u32 i = 0; i < graph->resource_count; i++)
+  {
+    RgResource *other = &graph->resources[i];
+    if (other->imported || other->first_pass == RG_INVALID || !memory_overlaps(r, other)) continue;
+    state->write_stage |= end_states[i].write_stage | end_states[i].read_stages;
+    state->write_access |= end_states[i].write_access;
+    if (end_states[i].queue != RG_QUEUE_GRAPHICS) state->queue = end_states[i].queue;
+  }
+}
+
+static void build_barriers(RenderGraph *graph) {
+  // The states a frame leaves the resources in, the next one starts from them
+  ResourceState end_states[RG_MAX_RESOURCES];
+  for (u32 r = 0; r < graph->resource_count; r++)
+  {
+    init_state(&graph->resources[r], &end_states[r]);
+  }
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    RgPass *pass = &graph->passes[p];
+    if (pass->culled) continue;
+    for (u32 a = 0; a < pass->access_count; a++)
+    {
+      RgBarrier barrier;
+      u32 resource = pass->accesses[a].resource;
+      transition(&end_states[resource], &graph->resources[resource], pass->accesses[a].access, pass->queue, &barrier);
+    }
+  }
+
+  ResourceState states[RG_MAX_RESOURCES];
+  for (u32 r = 0; r < graph->resource_count; r++)
+  {
+    RgResource *resource = &graph->resources[r];
+    init_state(resource, &states[r]);
+    if (!resource->imported && resource->first_pass != RG_INVALID) init_transient_state(graph, r, end_states, &states[r]);
+  }
+
+  graph->barrier_batches = 0;
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    RgPass *pass = &graph->passes[p];
+    free(pass->barriers);
+    pass->barriers = NULL;
+    pass->barrier_count = 0;
+    if (pass->culled) continue;
+
+    pass->barriers = malloc(sizeof(RgBarrier) * pass->access_count);
+    for (u32 a = 0; a < pass->access_count; a++)
+    {
+      RgPassAccess *access = &pass->accesses[a];
+      RgResource *resource = &graph->resources[access->resource];
+      RgBarrier barrier;
+      if (transition(&states[access->resource], resource, access->access, pass->queue, &barrier)) {
+        barrier.resource = access->resource;
+        barrier.aliasing = !resource->imported && resource->first_pass == p && barrier.src_stage != 0;
+        pass->barriers[pass->barrier_count++] = barrier;
+      }
+    }
+    if (pass->barrier_count > 0) graph->barrier_batches++;
+  }
+
+  free(graph->final_barriers);
+  graph->final_barriers = malloc(sizeof(RgBarrier) * (graph->resource_count + 1));
+  graph->final_barrier_count = 0;
+  for (u32 r = 0; r < graph->resource_count; r++)
+  {
+    RgResource *resource = &graph->resources[r];
+    if (!resource->imported || resource->final_access == RG_ACCESS_NONE) continue;
+    RgBarrier barrier;
+    if (transition(&states[r], resource, resource->final_access, RG_QUEUE_GRAPHICS, &barrier)) {
+      barrier.resource = r;
+      graph->final_barriers[graph->final_barrier_count++] = barrier;
+    }
+  }
+  if (graph->final_barrier_count > 0) graph->barrier_batches++;
+}
+
+// Splits the passes into runs on the same queue. The final barriers are recorded on the graphics
+// queue, so a trailing async run is followed by an empty graphics segment.
+static void build_segments(RenderGraph *graph) {
+  graph->segment_count = 0;
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    RgPass *pass = &graph->passes[p];
+    pass->queue = RG_QUEUE_GRAPHICS;
+    if (pass->culled) continue;
+    if (graph->async_compute && pass->async && pass->type == RG_PASS_COMPUTE) pass->queue = RG_QUEUE_ASYNC_COMPUTE;
+
+    RgSegment *last = graph->segment_count ? &graph->segments[graph->segment_count - 1] : NULL;
+    if (last && last->queue != pass->queue && graph->segment_count >= RG_MAX_SEGMENTS - 1) {
+      // Out of segments, the rest runs on the graphics queue
+      pass->queue = RG_QUEUE_GRAPHICS;
+    }
+    if (last && last->queue == pass->queue) {
+      last->end_pass = p + 1;
+      continue;
+    }
+    graph->segments[graph->segment_count++] = (RgSegment){pass->queue, last ? last->end_pass : 0, p + 1, 0};
+  }
+
+  if (graph->segment_count == 0 || graph->segments[graph->segment_count - 1].queue != RG_QUEUE_GRAPHICS) {
+    u32 end = graph->pass_count;
+    graph->segments[graph->segment_count++] = (RgSegment){RG_QUEUE_GRAPHICS, end, end, 0};
+  }
+  graph->segments[0].first_pass = 0;
+  graph->segments[graph->segment_count - 1].end_pass = graph->pass_count;
+
+  // Graphics stages that touch the async resources
+  VkPipelineStageFlags2 async_stages = 0;
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    RgPass *pass = &graph->passes[p];
+    if (pass->culled) continue;
+    for (u32 a = 0; a < pass->access_count; a++)
+    {
+      RgResource *resource = &graph->resources[pass->accesses[a].resource];
+      if (pass->queue == RG_QUEUE_ASYNC_COMPUTE) resource->async = true;
+    }
+  }
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    RgPass *pass = &graph->passes[p];
+    if (pass->culled || pass->queue != RG_QUEUE_GRAPHICS) continue;
+    for (u32 a = 0; a < pass->access_count; a++)
+    {
+      if (graph->resources[pass->accesses[a].resource].async) async_stages |= access_infos[pass->accesses[a].access].stage;
+    }
+  }
+
+  for (u32 s = 1; s < graph->segment_count; s++)
+  {
+    RgSegment *segment = &graph->segments[s];
+    if (segment->queue == RG_QUEUE_ASYNC_COMPUTE || async_stages == 0) {
+      segment->wait_stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    } else {
+      segment->wait_stage = async_stages;
+    }
+  }
+}
+
+b8 render_graph_compile(VkContext *context, RenderGraph *graph, VkExtent2D extent) {
+  graph->extent = extent;
+  cull_passes(graph);
+  build_segments(graph);
+
+  // Lifetimes and usage in execution order
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    RgPass *pass = &graph->passes[p];
+    if (pass->culled) continue;
+    for (u32 a = 0; a < pass->access_count; a++)
+    {
+      RgResource *resource = &graph->resources[pass->accesses[a].resource];
+      if (resource->first_pass == RG_INVALID) resource->first_pass = p;
+      resource->last_pass = p;
+      resource->usage |= access_infos[pass->accesses[a].access].usage;
+    }
+  }
+
+  // Attachments that live and die inside one render pass never need to reach memory
+  for (u32 r = 0; r < graph->resource_count; r++)
+  {
+    RgResource *resource = &graph->resources[r];
+    if (resource->imported || resource->output || resource->first_pass == RG_INVALID) continue;
+    if (resource->first_pass != resource->last_pass) continue;
+
+    b8 attachment_only = true;
+    RgPass *pass = &graph->passes[resource->first_pass];
+    for (u32 a = 0; a < pass->access_count; a++)
+    {
+      if (pass->accesses[a].resource == r && !access_infos[pass->accesses[a].access].attachment) attachment_only = false;
+    }
+    if (attachment_only) {
+      resource->transient_attachment = true;
+      resource->usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+  }
+
+  // Transient extents must be known before render passes pick their extent, and the memory
+  // placement before the barriers
+  if (!allocate_resources(context, graph)) {
+    return false;
+  }
+  build_barriers(graph);
+
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    if (graph->passes[p].culled || graph->passes[p].type != RG_PASS_RASTER) continue;
+    if (!create_render_pass(context, graph, p)) {
+      return false;
+    }
+  }
+
+  graph->compiled = true;
+  return true;
+}
+
+b8 render_graph_resize(VkContext *context, RenderGraph *graph, VkExtent2D extent) {
+  destroy_resources(context, graph);
+  graph->extent = extent;
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    graph->passes[p].extent = (VkExtent2D){0, 0};
+  }
+  if (!allocate_resources(context, graph)) {
+    return false;
+  }
+  build_barriers(graph);
+  return true;
+}
+
+void render_graph_destroy(VkContext *context, RenderGraph *graph) {
+  destroy_resources(context, graph);
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    RgPass *pass = &graph->passes[p];
+    if (pass->render_pass) vkDestroyRenderPass(context->device, pass->render_pass, NULL);
+    free(pass->barriers);
+  }
+  free(graph->final_barriers);
+  memset(graph, 0, sizeof(RenderGraph));
+}
+
+// ---------------------------------------------------------------------------------------------
+// Execution
+// ---------------------------------------------------------------------------------------------
+
+static void record_barriers(RenderGraph *graph, VkCommandBuffer command_buffer, RgBarrier *barriers, u32 count) {
+  if (count == 0) return;
+
+  VkImageMemoryBarrier2 image_barriers[RG_MAX_RESOURCES];
+  u32 image_count = 0;
+  // Every buffer dependency of the batch folds into a single global barrier
+  VkMemoryBarrier2 memory_barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+  b8 has_memory_barrier = false;
+
+  for (u32 i = 0; i < count; i++)
+  {
+    RgBarrier *b = &barriers[i];
+    RgResource *resource = &graph->resources[b->resource];
+
+    if (resource->type == RG_RESOURCE_BUFFER) {
+      memory_barrier.srcStageMask |= b->src_stage;
+      memory_barrier.srcAccessMask |= b->src_access;
+      memory_barrier.dstStageMask |= b->dst_stage;
+      memory_barrier.dstAccessMask |= b->dst_access;
+      has_memory_barrier = true;
+      continue;
+    }
+
+    if (b->aliasing) {
+      memory_barrier.srcStageMask |= b->src_stage;
+      memory_barrier.srcAccessMask |= b->src_access;
+      memory_barrier.dstStageMask |= b->dst_stage;
+      memory_barrier.dstAccessMask |= b->dst_access;
+      has_memory_barrier = true;
+    }
+
+    VkImageMemoryBarrier2 *barrier = &image_barriers[image_count++];
+    memset(barrier, 0, sizeof(VkImageMemoryBarrier2));
+    barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier->srcStageMask = b->src_stage;
+    barrier->srcAccessMask = b->src_access;
+    barrier->dstStageMask = b->dst_stage;
+    barrier->dstAccessMask = b->dst_access;
+    barrier->oldLayout = b->old_layout;
+    barrier->newLayout = b->new_layout;
+    barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->image = resource->image;
+    barrier->subresourceRange.aspectMask = resource->aspect;
+    barrier->subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier->subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+  }
+
+  VkDependencyInfo dependency = {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+  dependency.memoryBarrierCount = has_memory_barrier ? 1 : 0;
+  dependency.pMemoryBarriers = &memory_barrier;
+  dependency.imageMemoryBarrierCount = image_count;
+  dependency.pImageMemoryBarriers = image_barriers;
+  vkCmdPipelineBarrier2(command_buffer, &dependency);
+}
+
+static VkFramebuffer get_framebuffer(VkContext *context, RenderGraph *graph, RgPass *pass) {
+  VkImageView views[RG_MAX_PASS_ACCESSES];
+  for (u32 i = 0; i < pass->attachment_count; i++)
+  {
+    views[i] = graph->resources[pass->accesses[pass->attachment_access[i]].resource].view;
+  }
+
+  for (u32 f = 0; f < pass->framebuffer_count; f++)
+  {
+    if (memcmp(pass->framebuffers[f].views, views, sizeof(VkImageView) * pass->attachment_count) == 0) {
+      return pass->framebuffers[f].handle;
+    }
+  }
+
+  if (pass->framebuffer_count == RG_MAX_FRAMEBUFFERS) {
+    printf("Render graph: framebuffer cache of %s is full\n", pass->name);
+    return VK_NULL_HANDLE;
+  }
+
+  // Imported attachments may only get their size now, e.g. a recreated swapchain
+  RgResource *first = &graph->resources[pass->accesses[pass->attachment_access[0]].resource];
+  pass->extent = first->extent;
+
+  VkFramebufferCreateInfo framebuffer_info = {VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
+  framebuffer_info.renderPass = pass->render_pass;
+  framebuffer_info.attachmentCount = pass->attachment_count;
+  framebuffer_info.pAttachments = views;
+  framebuffer_info.width = pass->extent.width;
+  framebuffer_info.height = pass->extent.height;
+  framebuffer_info.layers = 1;
+
+  RgFramebuffer *framebuffer = &pass->framebuffers[pass->framebuffer_count];
+  if (vkCreateFramebuffer(context->device, &framebuffer_info, NULL, &framebuffer->handle) != VK_SUCCESS) {
+    printf("Render graph: vkCreateFramebuffer FAIL for %s\n", pass->name);
+    return VK_NULL_HANDLE;
+  }
+  memcpy(framebuffer->views, views, sizeof(VkImageView) * pass->attachment_count);
+  pass->framebuffer_count++;
+  return framebuffer->handle;
+}
+
+b8 render_graph_execute(VkContext *context, RenderGraph *graph, VkCommandBuffer command_buffer) {
+  for (u32 s = 0; s < graph->segment_count; s++)
+  {
+    if (!render_graph_execute_segment(context, graph, s, command_buffer)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+b8 render_graph_execute_segment(VkContext *context, RenderGraph *graph, u32 segment, VkCommandBuffer command_buffer) {
+  RgSegment *seg = &graph->segments[segment];
+  for (u32 p = seg->first_pass; p < seg->end_pass; p++)
+  {
+    RgPass *pass = &graph->passes[p];
+    if (pass->culled) continue;
+
+    record_barriers(graph, command_buffer, pass->barriers, pass->barrier_count);
+
+    if (graph->timer) {
+      if (pass->timer_zone == RG_INVALID) pass->timer_zone = gpu_timer_zone(graph->timer, pass->name);
+      gpu_timer_begin(graph->timer, command_buffer, pass->timer_zone);
+    }
+
+    if (pass->type != RG_PASS_RASTER) {
+      pass->execute(command_buffer, pass->user_data);
+      if (graph->timer) gpu_timer_end(graph->timer, command_buffer, pass->timer_zone);
+      continue;
+    }
+
+    VkFramebuffer framebuffer = get_framebuffer(context, graph, pass);
+    if (framebuffer == VK_NULL_HANDLE) {
+      return false;
+    }
+
+    VkRenderPassBeginInfo begin_info = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+    begin_info.renderPass = pass->render_pass;
+    begin_info.framebuffer = framebuffer;
+    begin_info.renderArea.extent = pass->extent;
+    begin_info.clearValueCount = pass->attachment_count;
+    begin_info.pClearValues = pass->clear_values;
+
+    vkCmdBeginRenderPass(command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    pass->execute(command_buffer, pass->user_data);
+    vkCmdEndRenderPass(command_buffer);
+    if (graph->timer) gpu_timer_end(graph->timer, command_buffer, pass->timer_zone);
+  }
+
+  if (segment == graph->segment_count - 1) {
+    record_barriers(graph, command_buffer, graph->final_barriers, graph->final_barrier_count);
+  }
+  return true;
+}
+
+void render_graph_set_timer(RenderGraph *graph, GpuTimer *timer) {
+  graph->timer = timer;
+}
+
+VkRenderPass render_graph_get_render_pass(RenderGraph *graph, u32 pass) {
+  return graph->passes[pass].render_pass;
+}
+
+VkImageView render_graph_get_view(RenderGraph *graph, u32 resource) {
+  return graph->resources[resource].view;
+}
+
+VkImage render_graph_get_image(RenderGraph *graph, u32 resource) {
+  return graph->resources[resource].image;
+}
+
+VkExtent2D render_graph_get_extent(RenderGraph *graph, u32 resource) {
+  return graph->resources[resource].extent;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Inspection
+// ---------------------------------------------------------------------------------------------
+
+static void print_barrier(RenderGraph *graph, RgBarrier *b) {
+  RgResource *resource = &graph->resources[b->resource];
+  if (resource->type == RG_RESOURCE_IMAGE) {
+    printf("      %-16s stages 0x%llx -> 0x%llx  %s -> %s%s\n", resource->name,
+      (unsigned long long)b->src_stage, (unsigned long long)b->dst_stage,
+      layout_name(b->old_layout), layout_name(b->new_layout), b->aliasing ? " (aliasing)" : "");
+  } else {
+    printf("      %-16s stages 0x%llx -> 0x%llx  (memory)\n", resource->name,
+      (unsigned long long)b->src_stage, (unsigned long long)b->dst_stage);
+  }
+}
+
+void render_graph_dump(RenderGraph *graph) {
+  u32 culled = 0;
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    culled += graph->passes[p].culled;
+  }
+
+  printf("Render graph: %u passes (%u culled), %u resources, %u barrier batches, extent %ux%u\n",
+    graph->pass_count, culled, graph->resource_count, graph->barrier_batches, graph->extent.width, graph->extent.height);
+
+  const char *pass_types[] = {"raster", "compute", "transfer"};
+  for (u32 p = 0; p < graph->pass_count; p++)
+  {
+    RgPass *pass = &graph->passes[p];
+    printf("  [%u] %-20s %-8s%s%s\n", p, pass->name, pass_types[pass->type],
+      pass->queue == RG_QUEUE_ASYNC_COMPUTE ? " async" : "", pass->culled ? " CULLED" : "");
+    if (pass->culled) continue;
+
+    for (u32 a = 0; a < pass->access_count; a++)
+    {
+      RgPassAccess *access = &pass->accesses[a];
+      printf("      uses %-16s as %s%s%s\n", graph->resources[access->resource].name, access_infos[access->access].name,
+        access->clear ? " (clear)" : "", access->resolve_source != RG_INVALID ? " (resolve target)" : "");
+    }
+    if (pass->barrier_count) printf("    barriers:\n");
+    for (u32 b = 0; b < pass->barrier_count; b++)
+    {
+      print_barrier(graph, &pass->barriers[b]);
+    }
+  }
+  if (graph->segment_count > 1) {
+    printf("  segments:\n");
+    for (u32 s = 0; s < graph->segment_count; s++)
+    {
+      RgSegment *segment = &graph->segments[s];
+      printf("    %s passes %u..%u, waits at stages 0x%llx\n", segment->queue == RG_QUEUE_ASYNC_COMPUTE ? "compute " : "graphics",
+        segment->first_pass, segment->end_pass, (unsigned long long)segment->wait_stage);
+    }
+  }
+  if (graph->final_barrier_count) printf("  final barriers:\n");
+  for (u32 b = 0; b < graph->final_barrier_count; b++)
+  {
+    print_barrier(graph, &graph->final_barriers[b]);
+  }
+
+  printf("  resources:\n");
+  for (u32 r = 0; r < graph->resource_count; r++)
+  {
+    RgResource *resource = &graph->resources[r];
+    if (resource->first_pass == RG_INVALID) {
+      printf("    %-16s unused\n", resource->name);
+    } else if (resource->imported) {
+      printf("    %-16s imported, passes %u..%u\n", resource->name, resource->first_pass, resource->last_pass);
+    } else {
+      printf("    %-16s %ux%u x%u, passes %u..%u, block %u offset %llu size %llu%s\n", resource->name,
+        resource->extent.width, resource->extent.height, resource->desc.samples,
+        resource->first_pass, resource->last_pass, resource->memory_block,
+        (unsigned long long)resource->memory_offset, (unsigned long long)resource->requirements.size,
+        resource->transient_attachment ? " transient" : "");
+    }
+  }
+
+  VkDeviceSize saved = graph->unaliased_bytes > graph->allocated_bytes ? graph->unaliased_bytes - graph->allocated_bytes : 0;
+  printf("  transient memory: %llu KB without aliasing, %llu KB allocated, %llu KB saved (%.1f%%)\n",
+    (unsigned long long)graph->unaliased_bytes / 1024, (unsigned long long)graph->allocated_bytes / 1024,
+    (unsigned long long)saved / 1024, graph->unaliased_bytes ? 100.0 * saved / graph->unaliased_bytes : 0.0);
+}
@@ -0,0 +1,305 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+#include "renderer/gpu_timer.h"
+
+#define RG_MAX_RESOURCES 48
+#define RG_MAX_PASSES 32
+#define RG_MAX_PASS_ACCESSES 12
+#define RG_MAX_FRAMEBUFFERS 16
+#define RG_MAX_MEMORY_BLOCKS 8
+#define RG_MAX_SEGMENTS 4
+#define RG_INVALID 0xFFFFFFFF
+
+/**
+ * How a pass uses a resource. Each access maps to the pipeline stage, access mask and image
+ * layout the graph synchronizes against.
+ */
+typedef enum RgAccess {
+  RG_ACCESS_NONE,
+  // Swapchain image right after acquire, its semaphore is waited at color attachment output
+  RG_ACCESS_ACQUIRE,
+  RG_ACCESS_COLOR_ATTACHMENT,
+  RG_ACCESS_DEPTH_ATTACHMENT,
+  RG_ACCESS_DEPTH_ATTACHMENT_READ_ONLY,
+  RG_ACCESS_SAMPLED_FRAGMENT,
+  RG_ACCESS_SAMPLED_COMPUTE,
+  RG_ACCESS_STORAGE_READ_FRAGMENT,
+  RG_ACCESS_STORAGE_READ_COMPUTE,
+  RG_ACCESS_STORAGE_WRITE_COMPUTE,
+  RG_ACCESS_TRANSFER_SRC,
+  RG_ACCESS_TRANSFER_DST,
+  RG_ACCESS_PRESENT,
+  RG_ACCESS_COUNT
+} RgAccess;
+
+typedef enum RgPassType {
+  RG_PASS_RASTER,
+  RG_PASS_COMPUTE,
+  RG_PASS_TRANSFER,
+} RgPassType;
+
+typedef enum RgQueue {
+  RG_QUEUE_GRAPHICS,
+  RG_QUEUE_ASYNC_COMPUTE,
+} RgQueue;
+
+typedef enum RgResourceType {
+  RG_RESOURCE_IMAGE,
+  RG_RESOURCE_BUFFER,
+} RgResourceType;
+
+typedef struct RgImageDesc {
+  VkFormat format;
+  VkSampleCountFlagBits samples;
+  // Fixed size, or 0 to follow the graph extent multiplied by scale
+  VkExtent2D extent;
+  f32 scale;
+} RgImageDesc;
+
+typedef void (*PFN_rg_execute)(VkCommandBuffer command_buffer, void *user_data);
+
+typedef struct RgPassAccess {
+  u32 resource;
+  RgAccess access;
+  b8 clear;
+  VkClearValue clear_value;
+  u32 resolve_source; // RG_INVALID unless this attachment is the resolve target of another one
+} RgPassAccess;
+
+typedef struct RgBarrier {
+  u32 resource;
+  VkPipelineStageFlags2 src_stage;
+  VkAccessFlags2 src_access;
+  VkPipelineStageFlags2 dst_stage;
+  VkAccessFlags2 dst_access;
+  VkImageLayout old_layout;
+  VkImageLayout new_layout;
+  // First use of a transient image: its memory was last written through another image, or by the
+  // previous frame, so the writes are also made available with a global memory barrier
+  b8 aliasing;
+} RgBarrier;
+
+typedef struct RgFramebuffer {
+  VkImageView views[RG_MAX_PASS_ACCESSES];
+  VkFramebuffer handle;
+} RgFramebuffer;
+
+typedef struct RgPass {
+  char name[32];
+  RgPassType type;
+  PFN_rg_execute execute;
+  void *user_data;
+  b8 side_effects; // Never culled, e.g. passes that only write to the host
+  b8 async;        // Compute pass allowed to run on the async compute queue
+
+  RgPassAccess accesses[RG_MAX_PASS_ACCESSES];
+  u32 access_count;
+
+  // Compiled
+  b8 culled;
+  RgQueue queue;
+  RgBarrier *barriers;
+  u32 barrier_count;
+  VkRenderPass render_pass;
+  VkExtent2D extent;
+  u32 attachment_count;
+  u32 attachment_access[RG_MAX_PASS_ACCESSES]; // Attachment index -> access index
+  VkClearValue clear_values[RG_MAX_PASS_ACCESSES];
+  RgFramebuffer framebuffers[RG_MAX_FRAMEBUFFERS];
+  u32 framebuffer_count;
+  u32 timer_zone;
+} RgPass;
+
+typedef struct RgResource {
+  char name[32];
+  RgResourceType type;
+  b8 imported;
+  b8 output;
+  RgImageDesc desc;
+  RgAccess initial_access;
+  RgAccess final_access;
+
+  VkImage image;
+  VkImageView view;
+  VkBuffer buffer;
+  VkExtent2D extent;
+  VkImageAspectFlags aspect;
+  VkImageUsageFlags usage;
+
+  // Compiled
+  u32 first_pass; // Execution order of the first and last pass that touch the resource
+  u32 last_pass;
+  b8 transient_attachment;
+  b8 async; // Used on the async compute queue, shared by both queues and never aliased
+  VkMemoryRequirements requirements;
+  u32 memory_block;
+  VkDeviceSize memory_offset;
+} RgResource;
+
+typedef struct RgMemoryBlock {
+  VkDeviceMemory memory;
+  u32 memory_type;
+  VkDeviceSize size;
+  b8 lazily_allocated;
+} RgMemoryBlock;
+
+/**
+ * A run of consecutive passes on the same queue, recorded into its own command buffer. Each
+ * segment must be submitted after the previous one and wait for it with a semaphore.
+ */
+typedef struct RgSegment {
+  RgQueue queue;
+  u32 first_pass;
+  u32 end_pass;
+  // Stages of this segment that wait for the previous one. On the graphics queue it also covers
+  // every graphics use of the async resources, so the next frame cannot overwrite them while
+  // the async work of this one still reads them.
+  VkPipelineStageFlags2 wait_stage;
+} RgSegment;
+
+typedef struct RenderGraph {
+  RgResource resources[RG_MAX_RESOURCES];
+  u32 resource_count;
+  RgPass passes[RG_MAX_PASSES];
+  u32 pass_count;
+
+  VkExtent2D extent;
+  b8 compiled;
+
+  // Transitions of imported resources into their final access, after the last pass
+  RgBarrier *final_barriers;
+  u32 final_barrier_count;
+
+  RgMemoryBlock memory_blocks[RG_MAX_MEMORY_BLOCKS];
+  u32 memory_block_count;
+  VkDeviceSize unaliased_bytes;
+  VkDeviceSize allocated_bytes;
+  u32 barrier_batches;
+
+  GpuTimer *timer; // Optional, times every pass
+
+  b8 async_compute;
+  u32 queue_families[2]; // Graphics and async compute
+  RgSegment segments[RG_MAX_SEGMENTS];
+  u32 segment_count;
+} RenderGraph;
+
+void render_graph_create(RenderGraph *graph);
+void render_graph_destroy(VkContext *context, RenderGraph *graph);
+
+/**
+ * Declares an image owned by the graph. Its memory may be shared with other transient
+ * resources whose lifetimes do not overlap, so its content is undefined at the first use.
+ * @returns The resource handle.
+ */
+u32 render_graph_create_image(RenderGraph *graph, const char *name, RgImageDesc desc);
+
+/**
+ * Declares an image owned by someone else, e.g. the swapchain image.
+ * @param initial_access The state of the image when the frame starts.
+ * @param final_access The state the graph leaves the image in, RG_ACCESS_NONE to leave it as is.
+ * @returns The resource handle.
+ */
+u32 render_graph_import_image(RenderGraph *graph, const char *name, VkFormat format, VkSampleCountFlagBits samples,
+  RgAccess initial_access, RgAccess final_access);
+
+/**
+ * Declares a buffer owned by someone else. Buffers are synchronized with global memory
+ * barriers, which drivers handle as cheaply as per buffer ones.
+ * @returns The resource handle.
+ */
+u32 render_graph_import_buffer(RenderGraph *graph, const char *name, RgAccess initial_access, RgAccess final_access);
+
+/**
+ * Sets the handles of an imported resource. Can change every frame, e.g. with the image index.
+ */
+void render_graph_set_image(RenderGraph *graph, u32 resource, VkImage image, VkImageView view, VkExtent2D extent);
+void render_graph_set_buffer(RenderGraph *graph, u32 resource, VkBuffer buffer);
+
+/**
+ * Marks a resource as a result of the graph. Passes that do not contribute to an output, or
+ * to a pass with side effects, are culled.
+ */
+void render_graph_set_output(RenderGraph *graph, u32 resource);
+
+/**
+ * Adds a pass. Passes execute in the order they are added.
+ * @returns The pass handle.
+ */
+u32 render_graph_add_pass(RenderGraph *graph, const char *name, RgPassType type, PFN_rg_execute execute, void *user_data);
+
+/**
+ * Allows a compute pass to run on the async compute queue once it is enabled. The graph shares
+ * the images it creates with both queues, imported resources must already be.
+ */
+void render_graph_set_async(RenderGraph *graph, u32 pass);
+
+/**
+ * Keeps a pass that writes nothing the graph tracks, e.g. a copy to a buffer the host reads.
+ */
+void render_graph_set_side_effects(RenderGraph *graph, u32 pass);
+
+/**
+ * Moves the async passes to a compute queue of another family. Must be called before
+ * render_graph_compile. The passes are split into segments, see render_graph_execute_segment.
+ */
+void render_graph_enable_async_compute(RenderGraph *graph, u32 graphics_family, u32 compute_family);
+
+/**
+ * Declares that a pass accesses a resource. Attachment accesses on raster passes become the
+ * attachments of the render pass the graph creates for it, in declaration order.
+ */
+void render_graph_use(RenderGraph *graph, u32 pass, u32 resource, RgAccess access);
+
+/**
+ * Declares a color or depth attachment that is cleared when the pass begins.
+ */
+void render_graph_use_clear(RenderGraph *graph, u32 pass, u32 resource, RgAccess access, VkClearValue clear_value);
+
+/**
+ * Declares that the multisampled color attachment source is resolved into target at the end of the pass.
+ */
+void render_graph_resolve(RenderGraph *graph, u32 pass, u32 source, u32 target);
+
+/**
+ * Culls unused passes, computes load/store operations and barriers, creates the render passes
+ * and allocates the transient resources with aliasing.
+ * @returns TRUE on success.
+ */
+b8 render_graph_compile(VkContext *context, RenderGraph *graph, VkExtent2D extent);
+
+/**
+ * Recreates the transient resources and framebuffers for a new extent. Render passes are kept,
+ * so pipelines created against them stay valid, barriers follow the new aliasing. The device must
+ * be idle.
+ * @returns TRUE on success.
+ */
+b8 render_graph_resize(VkContext *context, RenderGraph *graph, VkExtent2D extent);
+
+/**
+ * Records every pass that was not culled with its barriers. Imported resources must have
+ * their handles set for this frame. Everything runs on the graphics queue, async passes included.
+ */
+b8 render_graph_execute(VkContext *context, RenderGraph *graph, VkCommandBuffer command_buffer);
+
+/**
+ * Records the passes of one segment, for a command buffer of the segment queue. The last
+ * segment is always on the graphics queue and ends with the final barriers.
+ */
+b8 render_graph_execute_segment(VkContext *context, RenderGraph *graph, u32 segment, VkCommandBuffer command_buffer);
+
+/**
+ * Wraps every pass in a GPU timer zone named after the pass. gpu_timer_begin_frame must be
+ * recorded before render_graph_execute.
+ */
+void render_graph_set_timer(RenderGraph *graph, GpuTimer *timer);
+
+VkRenderPass render_graph_get_render_pass(RenderGraph *graph, u32 pass);
+VkImageView render_graph_get_view(RenderGraph *graph, u32 resource);
+VkImage render_graph_get_image(RenderGraph *graph, u32 resource);
+VkExtent2D render_graph_get_extent(RenderGraph *graph, u32 resource);
+
+/**
+ * Prints the compiled passes, barriers, resource lifetimes and memory savings.
+ */
+void render_graph_dump(RenderGraph *graph);
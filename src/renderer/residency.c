@@ -0,0 +1,161 @@
+#include "residency.h"
+#include "core/trace.h"
+#include "platform/platform.h"
+#include <stdio.h>
+#include <string.h>
+
+static void query_budgets(VkContext *context, Residency *residency) {
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+  if (residency->budget_extension) {
+    VkPhysicalDeviceMemoryProperties2 properties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2};
+    properties.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(context->physicalDevice, &properties);
+  }
+
+  for (u32 h = 0; h < residency->heap_count; h++)
+  {
+    if (residency->budget_extension) {
+      residency->heap_budget[h] = budget.heapBudget[h];
+      residency->heap_usage[h] = budget.heapUsage[h];
+    } else {
+      residency->heap_budget[h] = (u64)(context->memory_properties.memoryHeaps[h].size * RESIDENCY_FALLBACK_BUDGET);
+      residency->heap_usage[h] = context->heap_buffer_bytes[h];
+    }
+    if (residency->budget_limit && residency->heap_budget[h] > residency->budget_limit) {
+      residency->heap_budget[h] = residency->budget_limit;
+    }
+    if (residency->heap_usage[h] > residency->heap_peak_usage[h]) {
+      residency->heap_peak_usage[h] = residency->heap_usage[h];
+    }
+  }
+}
+
+// The least recently used resident resource of the heap that no frame in flight can still draw,
+// RESIDENCY_MAX_RESOURCES if there is none
+static u32 eviction_candidate(Residency *residency, u32 heap) {
+  u32 candidate = RESIDENCY_MAX_RESOURCES;
+  for (u32 i = 0; i < residency->resource_count; i++)
+  {
+    ResidentResource *resource = &residency->resources[i];
+    if (!resource->resident || resource->heap != heap || resource->last_used + MAX_FRAMES > residency->frame) continue;
+    if (candidate == RESIDENCY_MAX_RESOURCES || resource->last_used < residency->resources[candidate].last_used) {
+      candidate = i;
+    }
+  }
+  return candidate;
+}
+
+static void evict(VkContext *context, Residency *residency, u32 index) {
+  ResidentResource *resource = &residency->resources[index];
+  resource->evict(context, resource->user_data);
+  resource->resident = false;
+  residency->evictions++;
+  residency->evicted_bytes += resource->size;
+  residency->version++;
+}
+
+// Evicts until the heap has room for size more bytes below the low water mark. The usage of the
+// budget query is only refreshed by the next frame, so evicted bytes are taken off it here.
+static b8 make_room(VkContext *context, Residency *residency, u32 heap, u64 size) {
+  u64 low_water = (u64)(residency->heap_budget[heap] * RESIDENCY_LOW_WATER);
+  while (residency->heap_usage[heap] + size > low_water)
+  {
+    u32 candidate = eviction_candidate(residency, heap);
+    if (candidate == RESIDENCY_MAX_RESOURCES) return false;
+    u64 evicted = residency->resources[candidate].size;
+    evict(context, residency, candidate);
+    residency->heap_usage[heap] = residency->heap_usage[heap] > evicted ? residency->heap_usage[heap] - evicted : 0;
+  }
+  return true;
+}
+
+void residency_create(VkContext *context, u64 budget_limit, Residency *residency) {
+  memset(residency, 0, sizeof(Residency));
+  residency->budget_extension = context->memory_budget;
+  residency->heap_count = context->memory_properties.memoryHeapCount;
+  residency->budget_limit = budget_limit;
+  for (u32 h = 0; h < residency->heap_count; h++)
+  {
+    snprintf(residency->counter_names[h][0], sizeof(residency->counter_names[h][0]), "heap %u usage MB", h);
+    snprintf(residency->counter_names[h][1], sizeof(residency->counter_names[h][1]), "heap %u budget MB", h);
+  }
+  query_budgets(context, residency);
+}
+
+u32 residency_register(Residency *residency, const char *name, u64 size, u32 heap, PFN_residency_load load,
+  PFN_residency_evict evict, void *user_data) {
+  if (residency->resource_count == RESIDENCY_MAX_RESOURCES || heap >= residency->heap_count) {
+    printf("Residency: %s can not be registered\n", name);
+    return RESIDENCY_MAX_RESOURCES;
+  }
+
+  ResidentResource *resource = &residency->resources[residency->resource_count];
+  memset(resource, 0, sizeof(ResidentResource));
+  resource->name = name;
+  resource->load = load;
+  resource->evict = evict;
+  resource->user_data = user_data;
+  resource->size = size;
+  resource->heap = heap;
+  resource->last_used = residency->frame;
+  resource->resident = true;
+  return residency->resource_count++;
+}
+
+void residency_begin_frame(VkContext *context, Residency *residency, u64 frame) {
+  residency->frame = frame;
+  query_budgets(context, residency);
+
+  for (u32 h = 0; h < residency->heap_count; h++)
+  {
+    u64 budget = residency->heap_budget[h];
+    if (residency->heap_usage[h] > (u64)(budget * RESIDENCY_HIGH_WATER)) {
+      make_room(context, residency, h, 0);
+      if (residency->heap_usage[h] > budget) residency->over_budget_frames++;
+    }
+
+    trace_counter(residency->counter_names[h][0], residency->heap_usage[h] / (1024.0 * 1024.0));
+    trace_counter(residency->counter_names[h][1], budget / (1024.0 * 1024.0));
+  }
+}
+
+b8 residency_use(VkContext *context, Residency *residency, u32 resource_index) {
+  if (resource_index >= residency->resource_count) return true;
+
+  ResidentResource *resource = &residency->resources[resource_index];
+  resource->last_used = residency->frame;
+  if (resource->resident) return true;
+
+  // Loading over the budget is still tried, the driver may page instead of failing
+  TRACE_SCOPE("reload", TRACE_COLOR_BAD);
+  make_room(context, residency, resource->heap, resource->size);
+  f64 start = platform_get_absolute_time();
+  b8 loaded = resource->load(context, resource->user_data);
+  residency->reload_seconds += platform_get_absolute_time() - start;
+  if (!loaded) {
+    printf("Residency: failed to reload %s\n", resource->name);
+    residency->reload_failures++;
+    return false;
+  }
+
+  resource->resident = true;
+  residency->heap_usage[resource->heap] += resource->size;
+  residency->reloads++;
+  residency->reloaded_bytes += resource->size;
+  residency->version++;
+  return true;
+}
+
+void residency_report(Residency *residency) {
+  printf("Residency: %s budgets, %llu evictions (%.2f MB), %llu reloads (%.2f MB, %.2f ms), %u failures, "
+    "%llu frames over budget\n", residency->budget_extension ? "VK_EXT_memory_budget" : "estimated",
+    (unsigned long long)residency->evictions, residency->evicted_bytes / (1024.0 * 1024.0),
+    (unsigned long long)residency->reloads, residency->reloaded_bytes / (1024.0 * 1024.0),
+    residency->reload_seconds * 1000.0, residency->reload_failures, (unsigned long long)residency->over_budget_frames);
+  for (u32 h = 0; h < residency->heap_count; h++)
+  {
+    printf("  heap %u: %.2f MB used of %.2f MB budget, %.2f MB peak\n", h,
+      residency->heap_usage[h] / (1024.0 * 1024.0), residency->heap_budget[h] / (1024.0 * 1024.0),
+      residency->heap_peak_usage[h] / (1024.0 * 1024.0));
+  }
+}
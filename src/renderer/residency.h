@@ -0,0 +1,88 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+
+#define RESIDENCY_MAX_RESOURCES 64
+#define RESIDENCY_HIGH_WATER 0.9 // Eviction starts above this fraction of a heap budget
+#define RESIDENCY_LOW_WATER 0.8  // and stops below this one
+#define RESIDENCY_FALLBACK_BUDGET 0.8 // Of the heap size, without VK_EXT_memory_budget
+
+/**
+ * Creates the device copy of an evicted resource again, e.g. from its file.
+ */
+typedef b8 (*PFN_residency_load)(VkContext *context, void *user_data);
+
+/**
+ * Frees the device copy of a resource, keeping what it needs to be loaded again.
+ */
+typedef void (*PFN_residency_evict)(VkContext *context, void *user_data);
+
+typedef struct ResidentResource {
+  const char *name;
+  PFN_residency_load load;
+  PFN_residency_evict evict;
+  void *user_data;
+  u64 size;      // Device memory while resident
+  u32 heap;
+  u64 last_used; // Frame of the last residency_use
+  b8 resident;
+} ResidentResource;
+
+/**
+ * Budget and usage of every memory heap, with the resources that can be streamed out when a heap
+ * nears its budget. Several processes share the device, so the budget is what the driver grants
+ * this one, not the heap size. The least recently used resources not drawn by a frame in flight
+ * are evicted first and loaded again on their next use.
+ */
+typedef struct Residency {
+  b8 budget_extension; // VK_EXT_memory_budget, otherwise a share of the heap against our own buffers
+  u32 heap_count;
+  u64 heap_budget[VK_MAX_MEMORY_HEAPS];
+  u64 heap_usage[VK_MAX_MEMORY_HEAPS];  // Of this process
+  u64 heap_peak_usage[VK_MAX_MEMORY_HEAPS];
+  u64 budget_limit;    // Caps every heap budget, 0 for none
+  char counter_names[VK_MAX_MEMORY_HEAPS][2][32]; // Usage and budget counters of the trace
+
+  ResidentResource resources[RESIDENCY_MAX_RESOURCES];
+  u32 resource_count;
+  u64 frame;
+  u64 version;         // Bumped whenever a resource is evicted or loaded, recorded commands are stale
+
+  // Statistics
+  u64 evictions;
+  u64 evicted_bytes;
+  u64 reloads;
+  u64 reloaded_bytes;
+  f64 reload_seconds;
+  u32 reload_failures;
+  u64 over_budget_frames; // Frames a heap stayed above its budget with nothing left to evict
+} Residency;
+
+/**
+ * @param budget_limit Caps the budget of every heap in bytes, to try eviction on a device with
+ * plenty of memory. 0 for no cap.
+ */
+void residency_create(VkContext *context, u64 budget_limit, Residency *residency);
+
+/**
+ * Adds a resource that is resident at the time of the call.
+ * @param name Must outlive the residency, e.g. a string literal.
+ * @param size The device memory it takes while resident.
+ * @param heap The memory heap it lives in.
+ * @returns The id of the resource, RESIDENCY_MAX_RESOURCES when there is no room left.
+ */
+u32 residency_register(Residency *residency, const char *name, u64 size, u32 heap, PFN_residency_load load,
+  PFN_residency_evict evict, void *user_data);
+
+/**
+ * Queries the heap budgets and evicts least recently used resources from heaps above
+ * RESIDENCY_HIGH_WATER. Call once per frame after the fence of the frame slot was waited.
+ */
+void residency_begin_frame(VkContext *context, Residency *residency, u64 frame);
+
+/**
+ * Marks a resource as used by the frame being recorded, loading it first if it was evicted.
+ * @returns FALSE if the resource is not resident and could not be loaded.
+ */
+b8 residency_use(VkContext *context, Residency *residency, u32 resource_index);
+
+void residency_report(Residency *residency);
@@ -0,0 +1,381 @@
+#include "shader_reflect.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPIRV_MAGIC 0x07230203
+#define SPIRV_HEADER_WORDS 5
+
+// Instructions, decorations and enumerants of the SPIR-V specification used here
+#define SPV_OP_ENTRY_POINT 15
+#define SPV_OP_TYPE_INT 21
+#define SPV_OP_TYPE_FLOAT 22
+#define SPV_OP_TYPE_VECTOR 23
+#define SPV_OP_TYPE_MATRIX 24
+#define SPV_OP_TYPE_IMAGE 25
+#define SPV_OP_TYPE_SAMPLER 26
+#define SPV_OP_TYPE_SAMPLED_IMAGE 27
+#define SPV_OP_TYPE_ARRAY 28
+#define SPV_OP_TYPE_RUNTIME_ARRAY 29
+#define SPV_OP_TYPE_STRUCT 30
+#define SPV_OP_TYPE_POINTER 32
+#define SPV_OP_CONSTANT 43
+#define SPV_OP_VARIABLE 59
+#define SPV_OP_DECORATE 71
+#define SPV_OP_MEMBER_DECORATE 72
+
+#define SPV_DECORATION_BUFFER_BLOCK 3
+#define SPV_DECORATION_ARRAY_STRIDE 6
+#define SPV_DECORATION_BUILT_IN 11
+#define SPV_DECORATION_LOCATION 30
+#define SPV_DECORATION_BINDING 33
+#define SPV_DECORATION_DESCRIPTOR_SET 34
+#define SPV_DECORATION_OFFSET 35
+
+#define SPV_STORAGE_UNIFORM_CONSTANT 0
+#define SPV_STORAGE_INPUT 1
+#define SPV_STORAGE_UNIFORM 2
+#define SPV_STORAGE_PUSH_CONSTANT 9
+#define SPV_STORAGE_STORAGE_BUFFER 12
+
+#define SPV_MODEL_VERTEX 0
+#define SPV_MODEL_FRAGMENT 4
+#define SPV_MODEL_GL_COMPUTE 5
+
+#define SPV_DIM_BUFFER 5
+#define SPV_DIM_SUBPASS_DATA 6
+
+#define SPV_UNDECORATED 0xFFFFFFFF
+
+// What the parse needs to know about each result id
+typedef struct SpirvId {
+  u32 opcode;       // Defining instruction, 0 if none
+  u32 word;         // Offset of the defining instruction
+  u32 set;
+  u32 binding;
+  u32 location;
+  u32 array_stride;
+  b8 buffer_block;
+  b8 built_in;
+} SpirvId;
+
+typedef struct SpirvModule {
+  const u32 *code;
+  u32 word_count;
+  u32 bound;
+  SpirvId *ids;
+} SpirvModule;
+
+static const SpirvId *get_id(const SpirvModule *module, u32 id) {
+  return id < module->bound ? &module->ids[id] : NULL;
+}
+
+// Offset decoration of a struct member, decorations are few so they are searched again
+static u32 member_offset(const SpirvModule *module, u32 struct_id, u32 member) {
+  u32 offset = SPIRV_HEADER_WORDS;
+  while (offset < module->word_count)
+  {
+    u32 count = module->code[offset] >> 16;
+    u32 opcode = module->code[offset] & 0xFFFF;
+    if (opcode == SPV_OP_MEMBER_DECORATE && count >= 5 && module->code[offset + 1] == struct_id &&
+      module->code[offset + 2] == member && module->code[offset + 3] == SPV_DECORATION_OFFSET) {
+      return module->code[offset + 4];
+    }
+    offset += count;
+  }
+  return 0;
+}
+
+// Size of a type in a block, 0 if unknown. Only explicitly laid out blocks are sized.
+static u32 type_size(const SpirvModule *module, u32 type_id, u32 depth) {
+  const SpirvId *type = get_id(module, type_id);
+  if (!type || depth > 16) return 0;
+  const u32 *words = &module->code[type->word];
+
+  switch (type->opcode) {
+    case SPV_OP_TYPE_INT:
+    case SPV_OP_TYPE_FLOAT:
+      return words[2] / 8;
+    case SPV_OP_TYPE_VECTOR:
+      return words[3] * type_size(module, words[2], depth + 1);
+    case SPV_OP_TYPE_MATRIX: {
+      // Columns are vec4 aligned in std140 and std430 blocks
+      u32 column = type_size(module, words[2], depth + 1);
+      return words[3] * ((column + 15) & ~15u);
+    }
+    case SPV_OP_TYPE_ARRAY: {
+      const SpirvId *length = get_id(module, words[3]);
+      if (!length || length->opcode != SPV_OP_CONSTANT) return 0;
+      u32 element = type->array_stride != SPV_UNDECORATED ? type->array_stride : type_size(module, words[2], depth + 1);
+      return module->code[length->word + 3] * element;
+    }
+    case SPV_OP_TYPE_STRUCT: {
+      u32 size = 0;
+      u32 member_count = (words[0] >> 16) - 2;
+      for (u32 i = 0; i < member_count; i++)
+      {
+        u32 end = member_offset(module, type_id, i) + type_size(module, words[2 + i], depth + 1);
+        if (end > size) size = end;
+      }
+      return size;
+    }
+    default:
+      return 0;
+  }
+}
+
+static b8 add_binding(ShaderReflection *reflection, const SpirvId *variable, VkDescriptorType type, u32 count) {
+  if (variable->set == SPV_UNDECORATED || variable->binding == SPV_UNDECORATED) return true;
+  if (reflection->binding_count == REFLECT_MAX_BINDINGS || variable->set >= REFLECT_MAX_SETS ||
+    variable->binding >= REFLECT_MAX_BINDINGS) {
+    printf("Shader reflect: binding %u of set %u does not fit\n", variable->binding, variable->set);
+    return false;
+  }
+  ReflectBinding *binding = &reflection->bindings[reflection->binding_count++];
+  binding->set = variable->set;
+  binding->binding = variable->binding;
+  binding->type = type;
+  binding->count = count;
+  return true;
+}
+
+// Descriptor of a uniform, storage buffer or uniform constant variable
+static b8 reflect_resource(const SpirvModule *module, const SpirvId *variable, u32 storage, u32 type_id,
+  ShaderReflection *reflection) {
+  u32 count = 1;
+  const SpirvId *type = get_id(module, type_id);
+  if (type && type->opcode == SPV_OP_TYPE_ARRAY) {
+    const SpirvId *length = get_id(module, module->code[type->word + 3]);
+    if (length && length->opcode == SPV_OP_CONSTANT) count = module->code[length->word + 3];
+    type = get_id(module, module->code[type->word + 2]);
+  } else if (type && type->opcode == SPV_OP_TYPE_RUNTIME_ARRAY) {
+    type = get_id(module, module->code[type->word + 2]);
+  }
+  if (!type) return false;
+
+  if (storage == SPV_STORAGE_STORAGE_BUFFER) {
+    return add_binding(reflection, variable, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, count);
+  }
+  if (storage == SPV_STORAGE_UNIFORM) {
+    VkDescriptorType descriptor_type = type->buffer_block ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    return add_binding(reflection, variable, descriptor_type, count);
+  }
+
+  switch (type->opcode) {
+    case SPV_OP_TYPE_SAMPLED_IMAGE:
+      return add_binding(reflection, variable, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, count);
+    case SPV_OP_TYPE_SAMPLER:
+      return add_binding(reflection, variable, VK_DESCRIPTOR_TYPE_SAMPLER, count);
+    case SPV_OP_TYPE_IMAGE: {
+      u32 dim = module->code[type->word + 3];
+      b8 storage_image = module->code[type->word + 7] == 2;
+      if (dim == SPV_DIM_SUBPASS_DATA) {
+        return add_binding(reflection, variable, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, count);
+      }
+      if (dim == SPV_DIM_BUFFER) {
+        return add_binding(reflection, variable,
+          storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, count);
+      }
+      return add_binding(reflection, variable,
+        storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, count);
+    }
+    default:
+      // Acceleration structures and other extension types are not bound through set layouts here
+      return true;
+  }
+}
+
+static b8 reflect_input(const SpirvModule *module, const SpirvId *variable, u32 type_id, ShaderReflection *reflection) {
+  if (variable->built_in || variable->location == SPV_UNDECORATED) return true;
+  if (reflection->input_count == REFLECT_MAX_INPUTS) {
+    printf("Shader reflect: too many vertex inputs\n");
+    return false;
+  }
+
+  static const VkFormat formats[3][4] = {
+    {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT},
+    {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT},
+    {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT},
+  };
+
+  const SpirvId *type = get_id(module, type_id);
+  u32 components = 1;
+  if (type && type->opcode == SPV_OP_TYPE_VECTOR) {
+    components = module->code[type->word + 3];
+    type = get_id(module, module->code[type->word + 2]);
+  }
+  if (!type || components < 1 || components > 4) return false;
+
+  u32 kind = 0;
+  if (type->opcode == SPV_OP_TYPE_INT) kind = module->code[type->word + 3] ? 1 : 2;
+
+  ReflectInput *input = &reflection->inputs[reflection->input_count++];
+  input->location = variable->location;
+  input->format = formats[kind][components - 1];
+  return true;
+}
+
+static b8 reflect_variable(const SpirvModule *module, u32 offset, ShaderReflection *reflection) {
+  const u32 *words = &module->code[offset];
+  const SpirvId *variable = get_id(module, words[2]);
+  const SpirvId *pointer = get_id(module, words[1]);
+  if (!variable || !pointer || pointer->opcode != SPV_OP_TYPE_POINTER) return false;
+  u32 storage = words[3];
+  u32 type_id = module->code[pointer->word + 3];
+
+  switch (storage) {
+    case SPV_STORAGE_UNIFORM_CONSTANT:
+    case SPV_STORAGE_UNIFORM:
+    case SPV_STORAGE_STORAGE_BUFFER:
+      return reflect_resource(module, variable, storage, type_id, reflection);
+    case SPV_STORAGE_PUSH_CONSTANT: {
+      const SpirvId *type = get_id(module, type_id);
+      if (!type || type->opcode != SPV_OP_TYPE_STRUCT) return false;
+      u32 member_count = (module->code[type->word] >> 16) - 2;
+      u32 start = 0xFFFFFFFF;
+      u32 end = 0;
+      for (u32 i = 0; i < member_count; i++)
+      {
+        u32 member_start = member_offset(module, type_id, i);
+        u32 member_end = member_start + type_size(module, module->code[type->word + 2 + i], 0);
+        if (member_start < start) start = member_start;
+        if (member_end > end) end = member_end;
+      }
+      if (member_count == 0) return true;
+      reflection->push_constant_offset = start;
+      reflection->push_constant_size = end - start;
+      return true;
+    }
+    case SPV_STORAGE_INPUT:
+      if (reflection->stage != VK_SHADER_STAGE_VERTEX_BIT) return true;
+      return reflect_input(module, variable, type_id, reflection);
+    default:
+      return true;
+  }
+}
+
+static void decorate(SpirvId *id, u32 decoration, u32 value) {
+  switch (decoration) {
+    case SPV_DECORATION_BUFFER_BLOCK: id->buffer_block = true; break;
+    case SPV_DECORATION_ARRAY_STRIDE: id->array_stride = value; break;
+    case SPV_DECORATION_BUILT_IN: id->built_in = true; break;
+    case SPV_DECORATION_LOCATION: id->location = value; break;
+    case SPV_DECORATION_BINDING: id->binding = value; break;
+    case SPV_DECORATION_DESCRIPTOR_SET: id->set = value; break;
+    default: break;
+  }
+}
+
+b8 shader_reflect(const u32 *code, u64 size, ShaderReflection *out_reflection) {
+  memset(out_reflection, 0, sizeof(ShaderReflection));
+  if (size < SPIRV_HEADER_WORDS * sizeof(u32) || code[0] != SPIRV_MAGIC) {
+    printf("Shader reflect: not a SPIR-V module\n");
+    return false;
+  }
+
+  SpirvModule module = {code, (u32)(size / sizeof(u32)), code[3]};
+  module.ids = malloc(sizeof(SpirvId) * module.bound);
+  if (!module.ids) return false;
+  for (u32 i = 0; i < module.bound; i++)
+  {
+    SpirvId *id = &module.ids[i];
+    memset(id, 0, sizeof(SpirvId));
+    id->set = id->binding = id->location = id->array_stride = SPV_UNDECORATED;
+  }
+
+  // First pass: definitions and decorations, which may come before the types they decorate
+  b8 result = true;
+  b8 has_entry_point = false;
+  u32 offset = SPIRV_HEADER_WORDS;
+  while (offset < module.word_count && result)
+  {
+    u32 count = code[offset] >> 16;
+    u32 opcode = code[offset] & 0xFFFF;
+    if (count == 0 || offset + count > module.word_count) {
+      result = false;
+      break;
+    }
+
+    u32 result_id = 0;
+    switch (opcode) {
+      case SPV_OP_ENTRY_POINT:
+        if (!has_entry_point) {
+          u32 model = code[offset + 1];
+          out_reflection->stage = model == SPV_MODEL_VERTEX ? VK_SHADER_STAGE_VERTEX_BIT :
+            model == SPV_MODEL_FRAGMENT ? VK_SHADER_STAGE_FRAGMENT_BIT :
+            model == SPV_MODEL_GL_COMPUTE ? VK_SHADER_STAGE_COMPUTE_BIT : VK_SHADER_STAGE_ALL;
+          has_entry_point = true;
+        }
+        break;
+      case SPV_OP_DECORATE:
+        if (count >= 3 && code[offset + 1] < module.bound) {
+          decorate(&module.ids[code[offset + 1]], code[offset + 2], count > 3 ? code[offset + 3] : 0);
+        }
+        break;
+      case SPV_OP_TYPE_INT:
+      case SPV_OP_TYPE_FLOAT:
+      case SPV_OP_TYPE_VECTOR:
+      case SPV_OP_TYPE_MATRIX:
+      case SPV_OP_TYPE_IMAGE:
+      case SPV_OP_TYPE_SAMPLER:
+      case SPV_OP_TYPE_SAMPLED_IMAGE:
+      case SPV_OP_TYPE_ARRAY:
+      case SPV_OP_TYPE_RUNTIME_ARRAY:
+      case SPV_OP_TYPE_STRUCT:
+      case SPV_OP_TYPE_POINTER:
+        result_id = code[offset + 1];
+        break;
+      case SPV_OP_CONSTANT:
+      case SPV_OP_VARIABLE:
+        result_id = count > 2 ? code[offset + 2] : 0;
+        break;
+      default:
+        break;
+    }
+    if (result_id) {
+      if (result_id >= module.bound) {
+        result = false;
+        break;
+      }
+      module.ids[result_id].opcode = opcode;
+      module.ids[result_id].word = offset;
+    }
+    offset += count;
+  }
+
+  // Second pass: the global variables
+  offset = SPIRV_HEADER_WORDS;
+  while (offset < module.word_count && result)
+  {
+    u32 count = code[offset] >> 16;
+    if ((code[offset] & 0xFFFF) == SPV_OP_VARIABLE && count >= 4) {
+      result = reflect_variable(&module, offset, out_reflection);
+    }
+    offset += count;
+  }
+
+  free(module.ids);
+  if (!result || !has_entry_point) {
+    printf("Shader reflect: malformed module\n");
+    return false;
+  }
+  return true;
+}
+
+b8 shader_reflect_check_vertex_inputs(const ShaderReflection *reflection,
+  const VkVertexInputAttributeDescription *attributes, u32 attribute_count) {
+  b8 result = true;
+  for (u32 i = 0; i < reflection->input_count; i++)
+  {
+    b8 found = false;
+    for (u32 a = 0; a < attribute_count && !found; a++)
+    {
+      found = attributes[a].location == reflection->inputs[i].location;
+    }
+    if (!found) {
+      printf("Shader reflect: vertex input location %u has no attribute\n", reflection->inputs[i].location);
+      result = false;
+    }
+  }
+  return result;
+}
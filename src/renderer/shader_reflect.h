@@ -0,0 +1,48 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+
+#define REFLECT_MAX_SETS 4
+#define REFLECT_MAX_BINDINGS 32 // Per shader, binding numbers must be below it too
+#define REFLECT_MAX_INPUTS 16
+
+typedef struct ReflectBinding {
+  u32 set;
+  u32 binding;
+  VkDescriptorType type; // Never dynamic, see layout_cache_pipeline_layout
+  u32 count;             // Array size, 1 for runtime arrays
+} ReflectBinding;
+
+typedef struct ReflectInput {
+  u32 location;
+  VkFormat format; // 32 bit components of the shader type
+} ReflectInput;
+
+/**
+ * Resources a SPIR-V module declares: descriptor bindings, the push constant block and, for
+ * vertex shaders, the input locations. Only the first entry point is considered.
+ */
+typedef struct ShaderReflection {
+  VkShaderStageFlagBits stage;
+  ReflectBinding bindings[REFLECT_MAX_BINDINGS];
+  u32 binding_count;
+  u32 push_constant_offset; // Offset of the first member
+  u32 push_constant_size;   // 0 without a push constant block
+  ReflectInput inputs[REFLECT_MAX_INPUTS];
+  u32 input_count;
+} ShaderReflection;
+
+/**
+ * Parses a SPIR-V module.
+ * @param code The module, in the byte order of the host.
+ * @param size The size in bytes.
+ * @param out_reflection Receives the resources.
+ * @returns TRUE on success, FALSE if the module is malformed or declares more than fits.
+ */
+b8 shader_reflect(const u32 *code, u64 size, ShaderReflection *out_reflection);
+
+/**
+ * Checks that a vertex input description feeds every input location of a vertex shader.
+ * @returns TRUE if no location is missing.
+ */
+b8 shader_reflect_check_vertex_inputs(const ShaderReflection *reflection,
+  const VkVertexInputAttributeDescription *attributes, u32 attribute_count);
@@ -0,0 +1,309 @@
+#include "shadow_atlas.h"
+#include "vulkan_buffer.h"
+#include <stdio.h>
+#include <string.h>
+
+static b8 create_atlas_image(VkContext *context, VkFormat format, VkImageUsageFlags usage, VkImage *out_image,
+  VkDeviceMemory *out_memory, VkImageView *out_view) {
+  VkImageCreateInfo image_info = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = format;
+  image_info.extent = (VkExtent3D){SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE, 1};
+  image_info.mipLevels = 1;
+  image_info.arrayLayers = 1;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage = usage;
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  if (vkCreateImage(context->device, &image_info, NULL, out_image) != VK_SUCCESS) {
+    return false;
+  }
+
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(context->device, *out_image, &requirements);
+  i32 memory_type = vulkan_find_memory_type(context, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  if (memory_type < 0) {
+    return false;
+  }
+
+  VkMemoryAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+  alloc_info.allocationSize = requirements.size;
+  alloc_info.memoryTypeIndex = memory_type;
+  if (vkAllocateMemory(context->device, &alloc_info, NULL, out_memory) != VK_SUCCESS) {
+    return false;
+  }
+  vkBindImageMemory(context->device, *out_image, *out_memory, 0);
+
+  VkImageViewCreateInfo view_info = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+  view_info.image = *out_image;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = format;
+  view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  view_info.subresourceRange.levelCount = 1;
+  view_info.subresourceRange.layerCount = 1;
+  return vkCreateImageView(context->device, &view_info, NULL, out_view) == VK_SUCCESS;
+}
+
+static void image_barrier(VkCommandBuffer command_buffer, VkImage image, VkPipelineStageFlags2 src_stage,
+  VkAccessFlags2 src_access, VkImageLayout old_layout, VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access,
+  VkImageLayout new_layout) {
+  VkImageMemoryBarrier2 barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+  barrier.srcStageMask = src_stage;
+  barrier.srcAccessMask = src_access;
+  barrier.dstStageMask = dst_stage;
+  barrier.dstAccessMask = dst_access;
+  barrier.oldLayout = old_layout;
+  barrier.newLayout = new_layout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.layerCount = 1;
+
+  VkDependencyInfo dependency = {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+  dependency.imageMemoryBarrierCount = 1;
+  dependency.pImageMemoryBarriers = &barrier;
+  vkCmdPipelineBarrier2(command_buffer, &dependency);
+}
+
+b8 shadow_atlas_create(VkContext *context, ShadowAtlas *atlas) {
+  memset(atlas, 0, sizeof(ShadowAtlas));
+  for (u32 i = 0; i < SHADOW_MAX_TILES; i++)
+  {
+    atlas->tiles[i].light = SHADOW_NO_LIGHT;
+  }
+
+  // 16 bit depth is plenty for the short range of a spot light and halves the bandwidth
+  atlas->format = VK_FORMAT_D16_UNORM;
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(context->physicalDevice, atlas->format, &properties);
+  b8 linear = (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+
+  if (!create_atlas_image(context, atlas->format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+    VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+    &atlas->static_image, &atlas->static_memory, &atlas->static_view)) {
+    printf("Shadow atlas: static atlas FAIL\n");
+    return false;
+  }
+  if (!create_atlas_image(context, atlas->format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+    &atlas->image, &atlas->memory, &atlas->view)) {
+    printf("Shadow atlas: sampled atlas FAIL\n");
+    return false;
+  }
+
+  // Hardware 2x2 PCF where the format can be filtered
+  VkSamplerCreateInfo sampler_info = {VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  sampler_info.magFilter = linear ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+  sampler_info.minFilter = sampler_info.magFilter;
+  sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.compareEnable = VK_TRUE;
+  sampler_info.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+  sampler_info.maxLod = 0.0f;
+  if (vkCreateSampler(context->device, &sampler_info, NULL, &atlas->sampler) != VK_SUCCESS) {
+    printf("Shadow atlas: vkCreateSampler FAIL\n");
+    return false;
+  }
+
+  VkCommandBuffer command_buffer = vulkan_command_buffer_begin_single_use(context);
+  if (command_buffer == VK_NULL_HANDLE) {
+    return false;
+  }
+
+  VkClearDepthStencilValue far = {1.0f, 0};
+  VkImageSubresourceRange range = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+  VkImage images[2] = {atlas->static_image, atlas->image};
+  VkImageLayout layouts[2] = {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+  for (u32 i = 0; i < 2; i++)
+  {
+    image_barrier(command_buffer, images[i], VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    vkCmdClearDepthStencilImage(command_buffer, images[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &far, 1, &range);
+    image_barrier(command_buffer, images[i], VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT, layouts[i]);
+  }
+
+  return vulkan_command_buffer_end_single_use(context, command_buffer);
+}
+
+void shadow_atlas_destroy(VkContext *context, ShadowAtlas *atlas) {
+  vkDestroySampler(context->device, atlas->sampler, NULL);
+  vkDestroyImageView(context->device, atlas->static_view, NULL);
+  vkDestroyImageView(context->device, atlas->view, NULL);
+  vkDestroyImage(context->device, atlas->static_image, NULL);
+  vkDestroyImage(context->device, atlas->image, NULL);
+  vkFreeMemory(context->device, atlas->static_memory, NULL);
+  vkFreeMemory(context->device, atlas->memory, NULL);
+}
+
+void shadow_atlas_begin_frame(ShadowAtlas *atlas) {
+  atlas->frame++;
+  atlas->stat_frames++;
+  atlas->requested_count = 0;
+  atlas->static_update_count = 0;
+  atlas->composite_update_count = 0;
+}
+
+u32 shadow_atlas_request(ShadowAtlas *atlas, u32 light, const Mat4 *view_proj, b8 dynamic_casters) {
+  u32 tile = SHADOW_NO_TILE;
+  u32 victim = SHADOW_NO_TILE;
+  for (u32 i = 0; i < SHADOW_MAX_TILES; i++)
+  {
+    ShadowTile *t = &atlas->tiles[i];
+    if (t->light == light) {
+      tile = i;
+      break;
+    }
+    // Free tiles first, then the one that went unused the longest
+    if (t->last_requested < atlas->frame &&
+      (victim == SHADOW_NO_TILE || t->light == SHADOW_NO_LIGHT ||
+      (atlas->tiles[victim].light != SHADOW_NO_LIGHT && t->last_requested < atlas->tiles[victim].last_requested))) {
+      victim = i;
+    }
+  }
+
+  if (tile == SHADOW_NO_TILE) {
+    if (victim == SHADOW_NO_TILE) return SHADOW_NO_TILE;
+    tile = victim;
+    ShadowTile *t = &atlas->tiles[tile];
+    memset(t, 0, sizeof(ShadowTile));
+    t->light = light;
+    t->view_proj = *view_proj;
+  }
+
+  ShadowTile *t = &atlas->tiles[tile];
+  // The sampled tile was rendered with the old matrix and cannot be sampled with the new one
+  if (memcmp(&t->view_proj, view_proj, sizeof(Mat4)) != 0) {
+    t->view_proj = *view_proj;
+    t->static_valid = false;
+    t->composite_valid = false;
+  }
+  t->last_requested = atlas->frame;
+  t->wants_dynamic = dynamic_casters;
+  t->static_updated = false;
+  atlas->requested[atlas->requested_count++] = tile;
+  return tile;
+}
+
+void shadow_atlas_invalidate(ShadowAtlas *atlas, u32 tile) {
+  atlas->tiles[tile].static_valid = false;
+}
+
+void shadow_atlas_schedule(ShadowAtlas *atlas) {
+  // Static casters, in request priority order
+  for (u32 r = 0; r < atlas->requested_count; r++)
+  {
+    ShadowTile *t = &atlas->tiles[atlas->requested[r]];
+    if (t->static_valid) continue;
+    if (atlas->static_update_count == SHADOW_STATIC_BUDGET) {
+      atlas->stat_deferred++;
+      continue;
+    }
+    atlas->static_updates[atlas->static_update_count++] = atlas->requested[r];
+    t->static_valid = true;
+    t->static_updated = true;
+  }
+
+  // Composites: tiles with fresh static casters must be published, the others need one when
+  // dynamic casters are in range or were in the previous composite
+  u32 candidates[SHADOW_MAX_TILES];
+  u32 candidate_count = 0;
+  for (u32 r = 0; r < atlas->requested_count; r++)
+  {
+    u32 tile = atlas->requested[r];
+    ShadowTile *t = &atlas->tiles[tile];
+    if (t->static_updated) {
+      atlas->composite_updates[atlas->composite_update_count++] = tile;
+    } else if (t->static_valid && (t->wants_dynamic || t->has_dynamic || !t->composite_valid)) {
+      // Oldest composite first, so an over budget frame rotates through the tiles
+      u32 i = candidate_count++;
+      while (i > 0 && atlas->tiles[candidates[i - 1]].last_composited > t->last_composited) {
+        candidates[i] = candidates[i - 1];
+        i--;
+      }
+      candidates[i] = tile;
+    }
+  }
+
+  for (u32 c = 0; c < candidate_count; c++)
+  {
+    if (atlas->composite_update_count >= SHADOW_COMPOSITE_BUDGET) {
+      atlas->stat_deferred += candidate_count - c;
+      break;
+    }
+    atlas->composite_updates[atlas->composite_update_count++] = candidates[c];
+  }
+
+  for (u32 c = 0; c < atlas->composite_update_count; c++)
+  {
+    ShadowTile *t = &atlas->tiles[atlas->composite_updates[c]];
+    t->composite_valid = true;
+    t->has_dynamic = t->wants_dynamic;
+    t->last_composited = atlas->frame;
+  }
+
+  atlas->stat_static_renders += atlas->static_update_count;
+  atlas->stat_composites += atlas->composite_update_count;
+}
+
+b8 shadow_atlas_pending(ShadowAtlas *atlas) {
+  for (u32 r = 0; r < atlas->requested_count; r++)
+  {
+    ShadowTile *t = &atlas->tiles[atlas->requested[r]];
+    if (!t->static_valid || !t->composite_valid || t->has_dynamic != t->wants_dynamic) return true;
+  }
+  return false;
+}
+
+b8 shadow_atlas_tile_ready(ShadowAtlas *atlas, u32 tile) {
+  return tile != SHADOW_NO_TILE && atlas->tiles[tile].composite_valid;
+}
+
+VkRect2D shadow_atlas_tile_rect(u32 tile) {
+  VkRect2D rect;
+  rect.offset.x = (tile % SHADOW_TILES_PER_ROW) * SHADOW_TILE_SIZE;
+  rect.offset.y = (tile / SHADOW_TILES_PER_ROW) * SHADOW_TILE_SIZE;
+  rect.extent = (VkExtent2D){SHADOW_TILE_SIZE, SHADOW_TILE_SIZE};
+  return rect;
+}
+
+void shadow_atlas_tile_uv(u32 tile, f32 out_rect[4]) {
+  VkRect2D rect = shadow_atlas_tile_rect(tile);
+  out_rect[0] = (f32)rect.offset.x / SHADOW_ATLAS_SIZE;
+  out_rect[1] = (f32)rect.offset.y / SHADOW_ATLAS_SIZE;
+  out_rect[2] = (f32)SHADOW_TILE_SIZE / SHADOW_ATLAS_SIZE;
+  out_rect[3] = (f32)SHADOW_TILE_SIZE / SHADOW_ATLAS_SIZE;
+}
+
+void shadow_atlas_record_copies(ShadowAtlas *atlas, VkCommandBuffer command_buffer) {
+  if (atlas->composite_update_count == 0) return;
+
+  VkImageCopy regions[SHADOW_MAX_TILES];
+  for (u32 c = 0; c < atlas->composite_update_count; c++)
+  {
+    VkRect2D rect = shadow_atlas_tile_rect(atlas->composite_updates[c]);
+    VkImageCopy *region = &regions[c];
+    memset(region, 0, sizeof(VkImageCopy));
+    region->srcSubresource = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1};
+    region->dstSubresource = region->srcSubresource;
+    region->srcOffset = (VkOffset3D){rect.offset.x, rect.offset.y, 0};
+    region->dstOffset = region->srcOffset;
+    region->extent = (VkExtent3D){rect.extent.width, rect.extent.height, 1};
+  }
+
+  vkCmdCopyImage(command_buffer, atlas->static_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, atlas->image,
+    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, atlas->composite_update_count, regions);
+}
+
+void shadow_atlas_report(ShadowAtlas *atlas) {
+  if (atlas->stat_frames == 0) return;
+  printf("Shadow atlas: %.2f static renders, %.2f composites, %.2f deferred updates per frame over %llu frames\n",
+    (f64)atlas->stat_static_renders / atlas->stat_frames, (f64)atlas->stat_composites / atlas->stat_frames,
+    (f64)atlas->stat_deferred / atlas->stat_frames, (unsigned long long)atlas->stat_frames);
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+#include "core/math_types.h"
+
+#define SHADOW_ATLAS_SIZE 4096
+#define SHADOW_TILE_SIZE 512
+#define SHADOW_TILES_PER_ROW (SHADOW_ATLAS_SIZE / SHADOW_TILE_SIZE)
+#define SHADOW_MAX_TILES (SHADOW_TILES_PER_ROW * SHADOW_TILES_PER_ROW)
+#define SHADOW_NO_TILE 0xFFFFFFFF
+#define SHADOW_NO_LIGHT 0xFFFFFFFF
+
+// Tiles re-rendered per frame: static casters are expensive and rarely change, compositing is
+// a tile copy plus the few dynamic casters
+#define SHADOW_STATIC_BUDGET 2
+#define SHADOW_COMPOSITE_BUDGET 8
+
+typedef struct ShadowTile {
+  u32 light;           // SHADOW_NO_LIGHT when free
+  Mat4 view_proj;
+  b8 static_valid;     // The static atlas holds the static casters for view_proj
+  b8 composite_valid;  // The sampled atlas holds the shadow for view_proj
+  b8 has_dynamic;      // The sampled atlas contains dynamic casters
+  b8 wants_dynamic;    // Dynamic casters overlap the light this frame
+  b8 static_updated;   // Static casters rendered this frame
+  u64 last_requested;
+  u64 last_composited;
+} ShadowTile;
+
+/**
+ * Shadow maps of many lights packed as tiles of two depth atlases. The static atlas caches the
+ * static casters of every tile and is only re-rendered when the light or a static caster
+ * moves. The sampled atlas receives a copy of the static tile with the dynamic casters drawn on
+ * top. Both kinds of updates are limited per frame, the least recently updated tiles first.
+ */
+typedef struct ShadowAtlas {
+  VkFormat format;
+  VkImage static_image;
+  VkImage image;
+  VkDeviceMemory static_memory;
+  VkDeviceMemory memory;
+  VkImageView static_view;
+  VkImageView view;
+  VkSampler sampler; // Depth comparison sampler for the sampled atlas
+
+  ShadowTile tiles[SHADOW_MAX_TILES];
+  u64 frame;
+  u32 requested[SHADOW_MAX_TILES]; // Tiles requested this frame, in priority order
+  u32 requested_count;
+
+  // Work of the current frame, filled by shadow_atlas_schedule
+  u32 static_updates[SHADOW_MAX_TILES];
+  u32 static_update_count;
+  u32 composite_updates[SHADOW_MAX_TILES];
+  u32 composite_update_count;
+
+  // Statistics
+  u64 stat_frames;
+  u64 stat_static_renders;
+  u64 stat_composites;
+  u64 stat_deferred; // Tile updates pushed to a later frame by the budget
+} ShadowAtlas;
+
+/**
+ * Creates both atlases cleared to the far plane, in the layouts the render graph expects at the
+ * start of a frame: the static atlas as a transfer source, the sampled atlas as shader read only.
+ * @returns TRUE on success.
+ */
+b8 shadow_atlas_create(VkContext *context, ShadowAtlas *atlas);
+void shadow_atlas_destroy(VkContext *context, ShadowAtlas *atlas);
+
+void shadow_atlas_begin_frame(ShadowAtlas *atlas);
+
+/**
+ * Requests a shadow for a light this frame. Call in decreasing priority order, a light keeps
+ * its tile while it is requested every frame, the least recently requested tile is evicted.
+ * @param view_proj The light matrix, the cached static casters are dropped when it changes.
+ * @param dynamic_casters TRUE if dynamic casters overlap the light.
+ * @returns The tile, or SHADOW_NO_TILE when every tile is taken by a higher priority light.
+ */
+u32 shadow_atlas_request(ShadowAtlas *atlas, u32 light, const Mat4 *view_proj, b8 dynamic_casters);
+
+/**
+ * Drops the cached static casters of a tile, e.g. when a static caster in range moved.
+ */
+void shadow_atlas_invalidate(ShadowAtlas *atlas, u32 tile);
+
+/**
+ * Picks the static renders and composites of this frame within the budgets.
+ */
+void shadow_atlas_schedule(ShadowAtlas *atlas);
+
+/**
+ * @returns TRUE if updates of requested tiles were pushed to a later frame by the budgets, so
+ * the shadows keep changing even if nothing moves.
+ */
+b8 shadow_atlas_pending(ShadowAtlas *atlas);
+
+/**
+ * @returns TRUE if the sampled atlas holds a shadow map for the tile.
+ */
+b8 shadow_atlas_tile_ready(ShadowAtlas *atlas, u32 tile);
+
+VkRect2D shadow_atlas_tile_rect(u32 tile);
+
+/**
+ * Writes the tile offset and scale in atlas texture coordinates.
+ */
+void shadow_atlas_tile_uv(u32 tile, f32 out_rect[4]);
+
+/**
+ * Records the copies of the static tiles into the sampled atlas for every composite of the
+ * frame. The static atlas must be a transfer source and the sampled atlas a transfer destination.
+ */
+void shadow_atlas_record_copies(ShadowAtlas *atlas, VkCommandBuffer command_buffer);
+
+void shadow_atlas_report(ShadowAtlas *atlas);
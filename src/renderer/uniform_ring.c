@@ -0,0 +1,121 @@
+#include "uniform_ring.h"
+#include "vulkan_buffer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define ALIGN_UP(value, alignment) (((value) + (alignment) - 1) & ~((u64)(alignment) - 1))
+
+b8 uniform_ring_create(VkContext *context, u64 frame_size, u32 frame_count, UniformRing *out_ring) {
+  memset(out_ring, 0, sizeof(UniformRing));
+  if (frame_count == 0 || frame_count > MAX_FRAMES) {
+    printf("Invalid uniform ring frame count %u\n", frame_count);
+    return false;
+  }
+
+  VkPhysicalDeviceLimits *limits = &context->device_properties.limits;
+  u64 alignment = limits->minUniformBufferOffsetAlignment;
+  if (limits->minStorageBufferOffsetAlignment > alignment) {
+    alignment = limits->minStorageBufferOffsetAlignment;
+  }
+  if (limits->nonCoherentAtomSize > alignment) {
+    alignment = limits->nonCoherentAtomSize;
+  }
+
+  out_ring->alignment = alignment;
+  out_ring->frame_size = ALIGN_UP(frame_size, alignment);
+  out_ring->frame_count = frame_count;
+
+  VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  u64 size = out_ring->frame_size * frame_count;
+
+  // Prefer host visible device local memory (resizable BAR), then plain coherent memory,
+  // and as a last resort any host visible memory with explicit flushes.
+  VkMemoryPropertyFlags candidates[] = {
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+  };
+
+  for (u32 i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++)
+  {
+    VkBufferCreateInfo buffer_info = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer probe;
+    if (vkCreateBuffer(context->device, &buffer_info, NULL, &probe) != VK_SUCCESS) {
+      printf("vkCreateBuffer FAIL\n");
+      return false;
+    }
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(context->device, probe, &requirements);
+    vkDestroyBuffer(context->device, probe, NULL);
+
+    if (vulkan_find_memory_type(context, requirements.memoryTypeBits, candidates[i]) < 0) {
+      continue;
+    }
+
+    // A failed buffer frees what it created, the next candidate starts over
+    if (!vulkan_buffer_create(context, size, usage, candidates[i], &out_ring->buffer)) {
+      continue;
+    }
+
+    out_ring->coherent = (candidates[i] & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    return true;
+  }
+
+  printf("No host visible memory for uniform ring\n");
+  return false;
+}
+
+void uniform_ring_destroy(VkContext *context, UniformRing *ring) {
+  vulkan_buffer_destroy(context, &ring->buffer);
+}
+
+void uniform_ring_begin_frame(UniformRing *ring, u32 frame_index) {
+  ring->frame_index = frame_index % ring->frame_count;
+  ring->head = 0;
+}
+
+void *uniform_ring_alloc(UniformRing *ring, u64 size, u32 *out_offset) {
+  u64 offset = ALIGN_UP(ring->head, ring->alignment);
+  if (offset + size > ring->frame_size) {
+    ring->overflow_count++;
+    return 0;
+  }
+
+  ring->head = offset + size;
+  if (ring->head > ring->high_water[ring->frame_index]) {
+    ring->high_water[ring->frame_index] = ring->head;
+    if (ring->head > ring->peak) {
+      ring->peak = ring->head;
+    }
+  }
+
+  u64 absolute = ring->frame_size * ring->frame_index + offset;
+  *out_offset = (u32)absolute;
+  return (u8 *)ring->buffer.mapped + absolute;
+}
+
+void uniform_ring_end_frame(VkContext *context, UniformRing *ring) {
+  if (ring->coherent || ring->head == 0) {
+    return;
+  }
+
+  VkMappedMemoryRange range = {VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE};
+  range.memory = ring->buffer.memory;
+  range.offset = ring->frame_size * ring->frame_index;
+  range.size = ALIGN_UP(ring->head, ring->alignment);
+  vkFlushMappedMemoryRanges(context->device, 1, &range);
+}
+
+void uniform_ring_report(UniformRing *ring) {
+  printf("Uniform ring: %llu bytes per frame, alignment %llu, peak %llu bytes, %u overflows\n",
+    ring->frame_size, ring->alignment, ring->peak, ring->overflow_count);
+  for (u32 i = 0; i < ring->frame_count; i++)
+  {
+    printf("  frame %u high-water: %llu bytes (%.1f%%)\n", i, ring->high_water[i],
+      100.0 * (f64)ring->high_water[i] / (f64)ring->frame_size);
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+
+/**
+ * Creates a persistently mapped, host visible buffer split into one partition per frame in
+ * flight. Sub-allocations are aligned to both minUniformBufferOffsetAlignment and
+ * minStorageBufferOffsetAlignment so they can be bound as dynamic uniform or storage buffers.
+ * @param context The vulkan context.
+ * @param frame_size The number of bytes reserved for each frame.
+ * @param frame_count The number of partitions, at most MAX_FRAMES.
+ * @param out_ring A pointer to hold the created ring.
+ * @returns TRUE on success.
+ */
+b8 uniform_ring_create(VkContext *context, u64 frame_size, u32 frame_count, UniformRing *out_ring);
+
+void uniform_ring_destroy(VkContext *context, UniformRing *ring);
+
+/**
+ * Starts writing into the partition of the given frame. The caller must have waited on
+ * that frame's fence, as everything written there in the previous use is overwritten.
+ * @param ring The ring.
+ * @param frame_index The frame in flight index.
+ */
+void uniform_ring_begin_frame(UniformRing *ring, u32 frame_index);
+
+/**
+ * Sub-allocates size bytes from the current frame partition.
+ * @param ring The ring.
+ * @param size The number of bytes to allocate.
+ * @param out_offset Receives the offset from the start of the buffer, to be used as a dynamic offset.
+ * @returns A pointer to the mapped memory, or 0/NULL if the partition is full.
+ */
+void *uniform_ring_alloc(UniformRing *ring, u64 size, u32 *out_offset);
+
+/**
+ * Makes the writes of the current frame visible to the device. Only does work when the
+ * memory is not host coherent. Must be called before the frame is submitted.
+ */
+void uniform_ring_end_frame(VkContext *context, UniformRing *ring);
+
+/**
+ * Prints the high-water usage of every frame partition.
+ */
+void uniform_ring_report(UniformRing *ring);
@@ -0,0 +1,171 @@
+#include "vulkan_buffer.h"
+#include <stdio.h>
+#include <string.h>
+
+i32 vulkan_find_memory_type(VkContext *context, u32 type_filter, VkMemoryPropertyFlags properties) {
+  for (u32 i = 0; i < context->memory_properties.memoryTypeCount; i++)
+  {
+    if ((type_filter & (1 << i)) &&
+      (context->memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Startup steps running in parallel create buffers, so the statistics are updated atomically
+static void count_buffer(VkContext *context, const VulkanBuffer *buffer, b8 created) {
+  u64 *heap_bytes = &context->heap_buffer_bytes[context->memory_properties.memoryTypes[buffer->memory_type].heapIndex];
+  if (!created) {
+    __atomic_fetch_sub(&context->buffer_bytes, buffer->size, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&context->buffer_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(heap_bytes, buffer->size, __ATOMIC_RELAXED);
+    return;
+  }
+
+  u64 bytes = __atomic_add_fetch(&context->buffer_bytes, buffer->size, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&context->buffer_count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(heap_bytes, buffer->size, __ATOMIC_RELAXED);
+  u64 peak = __atomic_load_n(&context->buffer_peak_bytes, __ATOMIC_RELAXED);
+  while (bytes > peak)
+  {
+    // A failed exchange reloads the peak another thread wrote
+    if (__atomic_compare_exchange_n(&context->buffer_peak_bytes, &peak, bytes, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+  }
+}
+
+b8 vulkan_buffer_create(VkContext *context, u64 size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VulkanBuffer *out_buffer) {
+  memset(out_buffer, 0, sizeof(VulkanBuffer));
+  out_buffer->size = size;
+
+  // Descriptors in descriptor buffers point at buffers by address
+  if (context->descriptor_buffer && (usage & (VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))) {
+    usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+  }
+
+  VkBufferCreateInfo buffer_info = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+  buffer_info.size = size;
+  buffer_info.usage = usage;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  if (vkCreateBuffer(context->device, &buffer_info, NULL, &out_buffer->handle) != VK_SUCCESS) {
+    printf("vkCreateBuffer FAIL\n");
+    return false;
+  }
+
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(context->device, out_buffer->handle, &requirements);
+
+  i32 memory_type = vulkan_find_memory_type(context, requirements.memoryTypeBits, properties);
+  if (memory_type < 0) {
+    printf("No suitable memory type for buffer\n");
+    vulkan_buffer_destroy(context, out_buffer);
+    return false;
+  }
+
+  VkMemoryAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+  alloc_info.allocationSize = requirements.size;
+  alloc_info.memoryTypeIndex = memory_type;
+  VkMemoryAllocateFlagsInfo flags_info = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO};
+  if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+    flags_info.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    alloc_info.pNext = &flags_info;
+  }
+
+  if (vkAllocateMemory(context->device, &alloc_info, NULL, &out_buffer->memory) != VK_SUCCESS) {
+    printf("vkAllocateMemory FAIL\n");
+    out_buffer->memory = VK_NULL_HANDLE;
+    vulkan_buffer_destroy(context, out_buffer);
+    return false;
+  }
+  out_buffer->memory_type = memory_type;
+  count_buffer(context, out_buffer, true);
+
+  if (vkBindBufferMemory(context->device, out_buffer->handle, out_buffer->memory, 0) != VK_SUCCESS) {
+    printf("vkBindBufferMemory FAIL\n");
+    vulkan_buffer_destroy(context, out_buffer);
+    return false;
+  }
+
+  if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    if (vkMapMemory(context->device, out_buffer->memory, 0, VK_WHOLE_SIZE, 0, &out_buffer->mapped) != VK_SUCCESS) {
+      printf("vkMapMemory FAIL\n");
+      out_buffer->mapped = NULL;
+      vulkan_buffer_destroy(context, out_buffer);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void vulkan_buffer_destroy(VkContext *context, VulkanBuffer *buffer) {
+  if (buffer->mapped) {
+    vkUnmapMemory(context->device, buffer->memory);
+  }
+  vkDestroyBuffer(context->device, buffer->handle, NULL);
+  if (buffer->memory) {
+    vkFreeMemory(context->device, buffer->memory, NULL);
+    count_buffer(context, buffer, false);
+  }
+  memset(buffer, 0, sizeof(VulkanBuffer));
+}
+
+VkCommandBuffer vulkan_command_buffer_begin_single_use(VkContext *context) {
+  VkCommandBufferAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandPool = context->command_pool;
+  alloc_info.commandBufferCount = 1;
+
+  VkCommandBuffer command_buffer;
+  if (vkAllocateCommandBuffers(context->device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+    printf("vkAllocateCommandBuffers FAIL\n");
+    return VK_NULL_HANDLE;
+  }
+
+  VkCommandBufferBeginInfo begin_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(command_buffer, &begin_info);
+  return command_buffer;
+}
+
+b8 vulkan_command_buffer_end_single_use(VkContext *context, VkCommandBuffer command_buffer) {
+  vkEndCommandBuffer(command_buffer);
+
+  VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &command_buffer;
+
+  b8 result = vkQueueSubmit(context->graphics_queue, 1, &submit_info, VK_NULL_HANDLE) == VK_SUCCESS;
+  vkQueueWaitIdle(context->graphics_queue);
+
+  vkFreeCommandBuffers(context->device, context->command_pool, 1, &command_buffer);
+  return result;
+}
+
+b8 vulkan_buffer_upload(VkContext *context, VulkanBuffer *buffer, const void *data, u64 size) {
+  VulkanBuffer staging;
+  if (!vulkan_buffer_create(context, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging)) {
+    return false;
+  }
+  memcpy(staging.mapped, data, size);
+
+  VkCommandBuffer command_buffer = vulkan_command_buffer_begin_single_use(context);
+  if (command_buffer == VK_NULL_HANDLE) {
+    vulkan_buffer_destroy(context, &staging);
+    return false;
+  }
+
+  VkBufferCopy region = {0, 0, size};
+  vkCmdCopyBuffer(command_buffer, staging.handle, buffer->handle, 1, &region);
+
+  b8 result = vulkan_command_buffer_end_single_use(context, command_buffer);
+  vulkan_buffer_destroy(context, &staging);
+
+  if (!result) {
+    printf("Upload submit FAIL\n");
+  }
+  return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+
+/**
+ * Finds a memory type index that matches the type filter and has all requested properties.
+ * @param context The vulkan context.
+ * @param type_filter The memoryTypeBits of a VkMemoryRequirements.
+ * @param properties The required memory property flags.
+ * @returns The memory type index or -1 if none is suitable.
+ */
+i32 vulkan_find_memory_type(VkContext *context, u32 type_filter, VkMemoryPropertyFlags properties);
+
+/**
+ * Creates a buffer and binds freshly allocated memory to it. Host visible buffers are
+ * mapped once here and stay mapped until vulkan_buffer_destroy.
+ * @param context The vulkan context.
+ * @param size The size of the buffer in bytes.
+ * @param usage The buffer usage flags.
+ * @param properties The required memory property flags.
+ * @param out_buffer A pointer to hold the created buffer.
+ * @returns TRUE on success.
+ */
+b8 vulkan_buffer_create(VkContext *context, u64 size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VulkanBuffer *out_buffer);
+
+void vulkan_buffer_destroy(VkContext *context, VulkanBuffer *buffer);
+
+/**
+ * Copies data into a device local buffer through a temporary staging buffer. Blocks until the
+ * copy finished, meant for loading time only.
+ * @param context The vulkan context.
+ * @param buffer The destination buffer, created with VK_BUFFER_USAGE_TRANSFER_DST_BIT.
+ * @param data The bytes to copy.
+ * @param size The number of bytes to copy.
+ * @returns TRUE on success.
+ */
+b8 vulkan_buffer_upload(VkContext *context, VulkanBuffer *buffer, const void *data, u64 size);
+
+/**
+ * Allocates and begins a one time command buffer from the context command pool.
+ * @returns The command buffer or VK_NULL_HANDLE on failure.
+ */
+VkCommandBuffer vulkan_command_buffer_begin_single_use(VkContext *context);
+
+/**
+ * Ends, submits and frees a command buffer from vulkan_command_buffer_begin_single_use,
+ * waiting for the graphics queue to be idle.
+ * @returns TRUE if the submission succeeded.
+ */
+b8 vulkan_command_buffer_end_single_use(VkContext *context, VkCommandBuffer command_buffer);
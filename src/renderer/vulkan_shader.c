@@ -0,0 +1,91 @@
+#include "vulkan_shader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* override_dir;
+
+static b8 read_file(const char* filename, char** buffer, u32* length) {
+  FILE* file = fopen(filename, "rb");
+  if (!file) return false;
+
+  fseek(file, 0, SEEK_END);
+  *length = ftell(file);
+  rewind(file);
+
+  *buffer = malloc(*length);
+  size_t read_size = fread(*buffer, 1, *length, file);
+  fclose(file);
+
+  return (read_size == *length);
+}
+
+static const EmbeddedShader* find_embedded(const char* name) {
+  for (u32 i = 0; i < embedded_shader_count; i++)
+  {
+    if (strcmp(embedded_shaders[i].name, name) == 0) return &embedded_shaders[i];
+  }
+  return NULL;
+}
+
+// A file in the override directory comes first, then the table. *file_code is the buffer to free.
+static b8 load_code(const char* name, char** file_code, const u32** code, u32* length) {
+  *file_code = NULL;
+  if (override_dir) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", override_dir, name);
+    if (read_file(path, file_code, length)) {
+      *code = (const u32*)*file_code;
+      return true;
+    }
+    free(*file_code);
+    *file_code = NULL;
+  }
+
+  const EmbeddedShader* shader = find_embedded(name);
+  if (!shader) return false;
+  *code = shader->code;
+  *length = shader->size;
+  return true;
+}
+
+void vulkan_shader_set_override_dir(const char *dir) {
+  override_dir = dir;
+}
+
+VkShaderModule vulkan_shader_module_create(VkContext *context, const char *name) {
+  return vulkan_shader_module_create_reflected(context, name, NULL);
+}
+
+VkShaderModule vulkan_shader_module_create_reflected(VkContext *context, const char *name,
+  ShaderReflection *out_reflection) {
+  char* file_code;
+  const u32* code;
+  u32 length = 0;
+
+  if (!load_code(name, &file_code, &code, &length)) {
+    printf("Falha ao ler shader: %s\n", name);
+    return VK_NULL_HANDLE;
+  }
+
+  if (out_reflection && !shader_reflect(code, length, out_reflection)) {
+    printf("Shader reflect FAIL for %s\n", name);
+    free(file_code);
+    return VK_NULL_HANDLE;
+  }
+
+  VkShaderModuleCreateInfo create_info = {0};
+  create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  create_info.codeSize = length;
+  create_info.pCode = code;
+
+  VkShaderModule module;
+  if (vkCreateShaderModule(context->device, &create_info, NULL, &module) != VK_SUCCESS) {
+    printf("Falha ao criar modulo de shader\n");
+    free(file_code);
+    return VK_NULL_HANDLE;
+  }
+
+  free(file_code);
+  return module;
+}
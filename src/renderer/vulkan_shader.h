@@ -0,0 +1,37 @@
+#pragma once
+#include "renderer/vulkan_types.h"
+#include "renderer/shader_reflect.h"
+
+// SPIR-V linked into the executable
+typedef struct EmbeddedShader {
+  const char *name; // File name, without directory
+  const u32 *code;
+  u32 size;         // In bytes
+} EmbeddedShader;
+
+// Generated at build time from the optimized shaders by tools/spirv_embed.c
+extern const EmbeddedShader embedded_shaders[];
+extern const u32 embedded_shader_count;
+
+/**
+ * Makes shaders load from a directory before the embedded ones, to try shader changes without
+ * relinking. Shaders missing there still come from the executable.
+ * @param dir The directory, NULL to only use the embedded shaders. Must outlive the modules created.
+ */
+void vulkan_shader_set_override_dir(const char *dir);
+
+/**
+ * Creates a shader module from the SPIR-V of a shader, see vulkan_shader_set_override_dir.
+ * @param context The vulkan context.
+ * @param name The file name of the shader, e.g. basic.frag.spv.
+ * @returns The shader module or VK_NULL_HANDLE on failure.
+ */
+VkShaderModule vulkan_shader_module_create(VkContext *context, const char *name);
+
+/**
+ * Same as vulkan_shader_module_create, also reflecting the resources of the module.
+ * @param out_reflection Receives the reflection, may be NULL.
+ * @returns The shader module or VK_NULL_HANDLE on failure, including a failed reflection.
+ */
+VkShaderModule vulkan_shader_module_create_reflected(VkContext *context, const char *name,
+  ShaderReflection *out_reflection);
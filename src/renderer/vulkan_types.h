@@ -0,0 +1,106 @@
+#pragma once
+
+#ifdef PLATFORM_WAYLAND
+  #define VK_USE_PLATFORM_WAYLAND_KHR
+#endif
+#include <vulkan/vulkan.h>
+#include "defines.h"
+
+#define MAX_FRAMES 3
+
+typedef struct VulkanBuffer {
+  VkBuffer handle;
+  VkDeviceMemory memory;
+  u64 size;
+  void *mapped; // Non NULL while persistently mapped
+  u32 memory_type;
+} VulkanBuffer;
+
+typedef struct Mesh {
+  VulkanBuffer vertex_buffer;
+  VulkanBuffer index_buffer;
+  u32 vertex_count;
+  u32 index_count;
+  VkIndexType index_type;
+  // Dequantization of the snorm16 positions: position = packed * extent + center
+  f32 center[3];
+  f32 extent[3];
+} Mesh;
+
+typedef struct UniformRing {
+  VulkanBuffer buffer;
+  u64 alignment;
+  u64 frame_size;  // Bytes reserved for each frame in flight
+  u32 frame_count;
+  u32 frame_index;
+  u64 head;        // Next free byte inside the current frame partition
+  b8 coherent;
+
+  u64 high_water[MAX_FRAMES];
+  u64 peak;
+  u32 overflow_count;
+} UniformRing;
+
+typedef struct QueueIndex {
+  u32 familyIndex;
+  u32 index;
+} QueueIndex;
+
+typedef struct VkContext {
+  VkInstance instance;
+  VkDebugUtilsMessengerEXT debug_messenger;
+
+  VkPhysicalDevice physicalDevice;
+  VkPhysicalDeviceProperties device_properties;
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  VkDevice device;
+  b8 graphics_pipeline_library; // VK_EXT_graphics_pipeline_library enabled
+  b8 calibrated_timestamps;     // VK_EXT_calibrated_timestamps enabled, for the GPU zones of the trace
+  b8 memory_budget;             // VK_EXT_memory_budget enabled
+  b8 descriptor_buffer;         // VK_EXT_descriptor_buffer enabled, descriptors are bound from buffers instead of sets
+
+  QueueIndex graphics_queue_index;
+  VkQueue graphics_queue;
+  // Compute only family for async compute, the graphics family when the device has none
+  QueueIndex compute_queue_index;
+  VkQueue compute_queue;
+
+  VkCommandPool command_pool;
+  VkCommandBuffer *command_buffers; // MAX FRAMES
+  VkCommandPool compute_command_pool; // VK_NULL_HANDLE without async compute
+
+  VkSurfaceKHR surface;
+  VkSwapchainKHR swapchain;
+  u32 swapchain_image_count;
+  VkImage *swapchain_images;
+  VkImageView *swapchain_image_views;
+  u32 image_index;
+
+  VkRenderPass render_pass; // Main pass, owned by the render graph
+  VkDescriptorSetLayout descriptor_set_layout;
+  VkPipelineLayout pipeline_layout;
+  VkFormat depth_format;
+  VkQueryPool statistics_pool; // One fragment invocation query per frame, VK_NULL_HANDLE if unsupported
+
+  UniformRing uniform_ring;
+  Mesh mesh;
+  VulkanBuffer instance_buffer; // MAX FRAMES partitions of MAX_INSTANCES matrices
+
+  VkSemaphore *image_available_semaphores; // MAX FRAMES
+  VkSemaphore *render_finished_semaphores; // MAX FRAMES
+  VkFence *in_flight_fences; // MAX FRAMES
+  VkFence *images_in_flight; //IMAGE_COUNT
+  u32 current_frame;
+
+  u32 image_width;
+  u32 image_height;
+
+  u32 next_width;
+  u32 next_height;
+
+  // Buffers of vulkan_buffer_create that are alive
+  u64 buffer_bytes;
+  u64 buffer_peak_bytes;
+  u32 buffer_count;
+  u64 heap_buffer_bytes[VK_MAX_MEMORY_HEAPS]; // buffer_bytes per memory heap
+} VkContext;
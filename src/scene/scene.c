@@ -0,0 +1,285 @@
+#include "scene.h"
+#include "core/jobs.h"
+#include "core/vmath.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define FLAG_LOCAL_DIRTY 0x1
+#define FLAG_WORLD_CHANGED 0x2
+
+// Levels smaller than this are not worth waking the workers for
+#define PARALLEL_MIN_BATCH 2048
+
+static b8 scene_grow(Scene* scene, u32 capacity) {
+  #define GROW(array, stride) \
+    { void* grown = realloc(scene->array, sizeof(*scene->array) * (stride) * capacity); \
+      if (!grown) return false; \
+      scene->array = grown; }
+
+  GROW(parents, 1);
+  GROW(depths, 1);
+  GROW(positions, 1);
+  GROW(rotations, 1);
+  GROW(scales, 1);
+  GROW(world, 1);
+  GROW(flags, 1);
+  GROW(pending_uploads, 1);
+  GROW(index_to_id, 1);
+  GROW(id_to_index, 1);
+  #undef GROW
+
+  scene->capacity = capacity;
+  return true;
+}
+
+b8 scene_create(u32 capacity, u32 frames_in_flight, Scene* out_scene) {
+  memset(out_scene, 0, sizeof(Scene));
+  out_scene->frames_in_flight = frames_in_flight;
+  if (capacity < 16) capacity = 16;
+
+  if (!scene_grow(out_scene, capacity)) {
+    printf("Failed to allocate scene\n");
+    return false;
+  }
+  return true;
+}
+
+void scene_destroy(Scene* scene) {
+  free(scene->parents);
+  free(scene->depths);
+  free(scene->positions);
+  free(scene->rotations);
+  free(scene->scales);
+  free(scene->world);
+  free(scene->flags);
+  free(scene->pending_uploads);
+  free(scene->index_to_id);
+  free(scene->id_to_index);
+  free(scene->level_offsets);
+  memset(scene, 0, sizeof(Scene));
+}
+
+u32 scene_add_node(Scene* scene, u32 parent) {
+  if (scene->count == scene->capacity && !scene_grow(scene, scene->capacity * 2)) {
+    printf("Failed to grow scene\n");
+    return SCENE_INVALID_NODE;
+  }
+
+  u32 index = scene->count++;
+  u32 id = index;
+
+  if (parent != SCENE_INVALID_NODE) {
+    u32 parent_index = scene->id_to_index[parent];
+    scene->parents[index] = parent_index;
+    scene->depths[index] = scene->depths[parent_index] + 1;
+  } else {
+    scene->parents[index] = SCENE_INVALID_NODE;
+    scene->depths[index] = 0;
+  }
+
+  // Appending keeps parents before children but not necessarily the depth order
+  scene->hierarchy_dirty = true;
+
+  scene->positions[index] = vec3_create(0.0f, 0.0f, 0.0f);
+  scene->rotations[index] = quat_identity();
+  scene->scales[index] = vec3_create(1.0f, 1.0f, 1.0f);
+  scene->world[index] = mat4_identity();
+
+  scene->flags[index] = FLAG_LOCAL_DIRTY;
+  scene->any_dirty = true;
+  scene->pending_uploads[index] = 0;
+  scene->index_to_id[index] = id;
+  scene->id_to_index[id] = index;
+
+  return id;
+}
+
+void scene_set_position(Scene* scene, u32 node, Vec3 position) {
+  u32 index = scene->id_to_index[node];
+  scene->positions[index] = position;
+  scene->flags[index] |= FLAG_LOCAL_DIRTY;
+  scene->any_dirty = true;
+}
+
+void scene_set_rotation(Scene* scene, u32 node, Quat rotation) {
+  u32 index = scene->id_to_index[node];
+  scene->rotations[index] = rotation;
+  scene->flags[index] |= FLAG_LOCAL_DIRTY;
+  scene->any_dirty = true;
+}
+
+void scene_set_scale(Scene* scene, u32 node, Vec3 scale) {
+  u32 index = scene->id_to_index[node];
+  scene->scales[index] = scale;
+  scene->flags[index] |= FLAG_LOCAL_DIRTY;
+  scene->any_dirty = true;
+}
+
+const Mat4* scene_get_world(Scene* scene, u32 node) {
+  return &scene->world[scene->id_to_index[node]];
+}
+
+b8 scene_node_changed(Scene* scene, u32 node) {
+  // Flags are left untouched when the update exits early, nothing changed then
+  return scene->stat_recomputed > 0 && (scene->flags[scene->id_to_index[node]] & FLAG_WORLD_CHANGED);
+}
+
+// Stable counting sort of every array by depth, so each level becomes a contiguous range.
+static b8 scene_sort(Scene* scene) {
+  u32 count = scene->count;
+
+  u32 level_count = 0;
+  for (u32 i = 0; i < count; i++)
+  {
+    if (scene->depths[i] + 1 > level_count) level_count = scene->depths[i] + 1;
+  }
+
+  // Everything is allocated before the first array changes, a failure leaves the scene as it was
+  u32* offsets = realloc(scene->level_offsets, sizeof(u32) * (level_count + 1));
+  if (!offsets) return false;
+  scene->level_offsets = offsets;
+
+  u32* remap = malloc(sizeof(u32) * count);
+  u32* cursor = malloc(sizeof(u32) * level_count);
+  // Each array is permuted into this and copied back, the world matrices are the largest element
+  void* permuted = malloc(sizeof(Mat4) * count);
+  if (!remap || !cursor || !permuted) {
+    free(remap);
+    free(cursor);
+    free(permuted);
+    return false;
+  }
+  scene->level_count = level_count;
+
+  memset(offsets, 0, sizeof(u32) * (level_count + 1));
+  for (u32 i = 0; i < count; i++)
+  {
+    offsets[scene->depths[i] + 1]++;
+  }
+  for (u32 l = 0; l < level_count; l++)
+  {
+    offsets[l + 1] += offsets[l];
+  }
+
+  b8 sorted = true;
+  memcpy(cursor, offsets, sizeof(u32) * level_count);
+  for (u32 i = 0; i < count; i++)
+  {
+    remap[i] = cursor[scene->depths[i]]++;
+    if (remap[i] != i) sorted = false;
+  }
+  free(cursor);
+
+  if (!sorted) {
+    #define PERMUTE(array, stride) \
+      { for (u32 i = 0; i < count; i++) \
+          memcpy((u8*)permuted + sizeof(*scene->array) * (stride) * remap[i], \
+            &scene->array[i * (stride)], sizeof(*scene->array) * (stride)); \
+        memcpy(scene->array, permuted, sizeof(*scene->array) * (stride) * count); }
+
+    PERMUTE(parents, 1);
+    PERMUTE(depths, 1);
+    PERMUTE(positions, 1);
+    PERMUTE(rotations, 1);
+    PERMUTE(scales, 1);
+    PERMUTE(world, 1);
+    PERMUTE(flags, 1);
+    PERMUTE(pending_uploads, 1);
+    PERMUTE(index_to_id, 1);
+    #undef PERMUTE
+
+    for (u32 i = 0; i < count; i++)
+    {
+      if (scene->parents[i] != SCENE_INVALID_NODE) {
+        scene->parents[i] = remap[scene->parents[i]];
+      }
+      scene->id_to_index[scene->index_to_id[i]] = i;
+    }
+  }
+
+  free(permuted);
+  free(remap);
+  scene->hierarchy_dirty = false;
+  return true;
+}
+
+typedef struct update_job {
+  Scene* scene;
+  Mat4* instance_out;
+  u32 instance_capacity;
+  u32 level_begin;
+} update_job;
+
+static void update_range(void* user_data, u32 begin, u32 end) {
+  update_job* job = (update_job*)user_data;
+  Scene* scene = job->scene;
+  u32 recomputed = 0;
+  u32 uploaded = 0;
+
+  for (u32 i = job->level_begin + begin; i < job->level_begin + end; i++)
+  {
+    u32 parent = scene->parents[i];
+    b8 changed = (scene->flags[i] & FLAG_LOCAL_DIRTY) ||
+      (parent != SCENE_INVALID_NODE && (scene->flags[parent] & FLAG_WORLD_CHANGED));
+
+    if (changed) {
+      Mat4 local = mat4_from_trs(scene->positions[i], scene->rotations[i], scene->scales[i]);
+      if (parent == SCENE_INVALID_NODE) {
+        scene->world[i] = local;
+      } else {
+        scene->world[i] = mat4_mul(&scene->world[parent], &local);
+      }
+      scene->flags[i] = FLAG_WORLD_CHANGED;
+      scene->pending_uploads[i] = scene->frames_in_flight;
+      recomputed++;
+    } else {
+      scene->flags[i] = 0;
+    }
+
+    if (job->instance_out && scene->pending_uploads[i]) {
+      // Nodes past the end of the instance buffer have no slot to write
+      u32 id = scene->index_to_id[i];
+      if (id < job->instance_capacity) {
+        job->instance_out[id] = scene->world[i];
+        uploaded++;
+      }
+      scene->pending_uploads[i]--;
+    }
+  }
+
+  __atomic_fetch_add(&scene->stat_recomputed, recomputed, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&scene->stat_uploaded, uploaded, __ATOMIC_RELAXED);
+}
+
+void scene_update(Scene* scene, Mat4* instance_out, u32 instance_capacity) {
+  scene->stat_recomputed = 0;
+  scene->stat_uploaded = 0;
+
+  // Nothing moved and every frame copy of the instance buffer is up to date
+  if (!scene->any_dirty && (!instance_out || scene->upload_frames_left == 0)) {
+    return;
+  }
+
+  if (scene->hierarchy_dirty && !scene_sort(scene)) {
+    printf("Failed to sort scene hierarchy\n");
+    return;
+  }
+
+  update_job job = {scene, instance_out, instance_capacity, 0};
+  for (u32 l = 0; l < scene->level_count; l++)
+  {
+    // Levels run one after another, parents are final before any child reads them
+    job.level_begin = scene->level_offsets[l];
+    u32 level_size = scene->level_offsets[l + 1] - scene->level_offsets[l];
+    jobs_parallel_for(level_size, PARALLEL_MIN_BATCH, update_range, &job);
+  }
+
+  scene->any_dirty = false;
+  if (scene->stat_recomputed > 0) {
+    scene->upload_frames_left = scene->frames_in_flight;
+  }
+  if (instance_out && scene->upload_frames_left > 0) {
+    scene->upload_frames_left--;
+  }
+}
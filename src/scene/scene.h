@@ -0,0 +1,87 @@
+#pragma once
+#include "defines.h"
+#include "core/math_types.h"
+
+#define SCENE_INVALID_NODE 0xFFFFFFFF
+
+/**
+ * Transform hierarchy stored as structure of arrays. Nodes are kept sorted by depth so that
+ * every parent precedes its children, which lets world transforms be computed in one linear
+ * pass, and every depth level forms a contiguous range that can be updated in parallel.
+ * Node ids returned by scene_add_node stay valid across the internal reordering.
+ */
+typedef struct Scene {
+  u32 count;
+  u32 capacity;
+
+  // Indexed by internal (depth sorted) index
+  u32* parents;         // Internal index of the parent or SCENE_INVALID_NODE for roots
+  u32* depths;
+  Vec3* positions;
+  Quat* rotations;
+  Vec3* scales;
+  Mat4* world;
+  u8* flags;
+  u8* pending_uploads;  // Frames in flight that still hold a stale copy of the world matrix
+  u32* index_to_id;
+
+  // Indexed by node id
+  u32* id_to_index;
+
+  // Start of every depth level in the sorted arrays, level_count + 1 entries
+  u32* level_offsets;
+  u32 level_count;
+  b8 hierarchy_dirty;
+  b8 any_dirty;
+  u32 upload_frames_left;
+
+  u32 frames_in_flight;
+
+  // Statistics of the last update
+  u32 stat_recomputed;
+  u32 stat_uploaded;
+} Scene;
+
+/**
+ * Creates an empty scene.
+ * @param capacity The initial number of nodes, the arrays grow as needed.
+ * @param frames_in_flight The number of copies of the instance buffer the update writes into.
+ * @param out_scene A pointer to hold the scene.
+ * @returns TRUE on success.
+ */
+b8 scene_create(u32 capacity, u32 frames_in_flight, Scene* out_scene);
+void scene_destroy(Scene* scene);
+
+/**
+ * Adds a node with an identity local transform.
+ * @param scene The scene.
+ * @param parent The id of the parent node or SCENE_INVALID_NODE for a root.
+ * @returns The id of the new node.
+ */
+u32 scene_add_node(Scene* scene, u32 parent);
+
+void scene_set_position(Scene* scene, u32 node, Vec3 position);
+void scene_set_rotation(Scene* scene, u32 node, Quat rotation);
+void scene_set_scale(Scene* scene, u32 node, Vec3 scale);
+
+/**
+ * @returns A pointer to the world matrix of a node, valid until the next update.
+ */
+const Mat4* scene_get_world(Scene* scene, u32 node);
+
+/**
+ * @returns TRUE if the world matrix of the node changed in the last update.
+ */
+b8 scene_node_changed(Scene* scene, u32 node);
+
+/**
+ * Recomputes the world matrices of every node whose local transform, or the transform of
+ * one of its ancestors, changed since the last update. Levels large enough are spread over
+ * the job system workers.
+ * @param scene The scene.
+ * @param instance_out Optional mapped instance buffer of the current frame, receives one
+ * matrix per node id. Matrices are written only while that copy is stale.
+ * @param instance_capacity The number of matrices instance_out holds, nodes with a larger id
+ * are not written.
+ */
+void scene_update(Scene* scene, Mat4* instance_out, u32 instance_capacity);
@@ -0,0 +1,189 @@
+// Times the vmath batch kernels at every SIMD level against the scalar reference and checks
+// that every level produces the same results. Exits with 1 on a mismatch.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "defines.h"
+#include "core/vmath.h"
+
+#define COUNT 100000
+#define ITERATIONS 50
+#define EPSILON 0.0001f
+#define ALIGNMENT_COUNT 67 // Odd, so the tails after the SIMD loops run too
+
+static f64 now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 0.000000001;
+}
+
+static f32 random_f32(f32 min, f32 max) {
+  return min + (max - min) * ((f32)rand() / (f32)RAND_MAX);
+}
+
+static b8 nearly_equal(const f32* a, const f32* b, u32 count) {
+  for (u32 i = 0; i < count; i++)
+  {
+    f32 scale = fabsf(a[i]) > 1.0f ? fabsf(a[i]) : 1.0f;
+    if (fabsf(a[i] - b[i]) > EPSILON * scale) {
+      printf("  mismatch at float %u: %f vs %f\n", i, a[i], b[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+static u32 failures = 0;
+
+static void report(const char* name, SimdLevel level, f64 seconds, f64 scalar_seconds, b8 correct) {
+  f64 ns = seconds / ITERATIONS / COUNT * 1e9;
+  printf("%-22s %-7s %8.2f ns/item  %5.2fx  %s\n", name, vmath_simd_level_name(level), ns,
+    scalar_seconds / seconds, correct ? "ok" : "MISMATCH");
+  if (!correct) failures++;
+}
+
+// Mat4 and Vec4 only promise 16 byte alignment. Runs every kernel on arrays that start 16 bytes
+// past a 64 byte boundary, where loads and stores that need 32 would fault.
+static b8 check_alignment(const Mat4* a, const Mat4* b, const Vec3* points, const Vec4* spheres, SimdLevel best) {
+  u8* memory = aligned_alloc(64, sizeof(Mat4) * (ALIGNMENT_COUNT * 4 + 1));
+  Mat4* left = (Mat4*)(memory + 16);
+  Mat4* right = left + ALIGNMENT_COUNT;
+  Mat4* reference = right + ALIGNMENT_COUNT;
+  Mat4* out = reference + ALIGNMENT_COUNT;
+  memcpy(left, a, sizeof(Mat4) * ALIGNMENT_COUNT);
+  memcpy(right, b, sizeof(Mat4) * ALIGNMENT_COUNT);
+  Vec4* sphere_copy = (Vec4*)left;
+  u8 visible_reference[ALIGNMENT_COUNT];
+  u8 visible[ALIGNMENT_COUNT];
+
+  b8 correct = true;
+  for (i32 level = SIMD_LEVEL_SSE; level <= (i32)best; level++)
+  {
+    vmath_set_simd_level(level);
+    mat4_mul_batch_scalar(left, right, reference, ALIGNMENT_COUNT);
+    mat4_mul_batch(left, right, out, ALIGNMENT_COUNT);
+    b8 mul = nearly_equal(reference->data, out->data, ALIGNMENT_COUNT * 16);
+    mat4_mul_batch_left_scalar(left, right, reference, ALIGNMENT_COUNT);
+    mat4_mul_batch_left(left, right, out, ALIGNMENT_COUNT);
+    b8 mul_left = nearly_equal(reference->data, out->data, ALIGNMENT_COUNT * 16);
+    mat4_transform_points_scalar(left, points, (Vec4*)reference, ALIGNMENT_COUNT);
+    mat4_transform_points(left, points, (Vec4*)out, ALIGNMENT_COUNT);
+    b8 transform = nearly_equal(reference->data, out->data, ALIGNMENT_COUNT * 4);
+
+    memcpy(sphere_copy, spheres, sizeof(Vec4) * ALIGNMENT_COUNT);
+    Frustum frustum = frustum_from_mat4(&right[0]);
+    u32 reference_count = frustum_cull_spheres_scalar(&frustum, sphere_copy, visible_reference, ALIGNMENT_COUNT);
+    u32 visible_count = frustum_cull_spheres(&frustum, sphere_copy, visible, ALIGNMENT_COUNT);
+    b8 cull = visible_count == reference_count && memcmp(visible, visible_reference, ALIGNMENT_COUNT) == 0;
+    memcpy(left, a, sizeof(Mat4) * ALIGNMENT_COUNT);
+
+    printf("%-22s %-7s %s\n", "16 byte alignment", vmath_simd_level_name(level),
+      mul && mul_left && transform && cull ? "ok" : "MISMATCH");
+    correct = correct && mul && mul_left && transform && cull;
+  }
+  vmath_set_simd_level(best);
+  free(memory);
+  return correct;
+}
+
+int main() {
+  srand(42);
+
+  Mat4* a = aligned_alloc(64, sizeof(Mat4) * COUNT);
+  Mat4* b = aligned_alloc(64, sizeof(Mat4) * COUNT);
+  Mat4* reference = aligned_alloc(64, sizeof(Mat4) * COUNT);
+  Mat4* out = aligned_alloc(64, sizeof(Mat4) * COUNT);
+  Vec3* points = malloc(sizeof(Vec3) * COUNT);
+  Vec4* spheres = aligned_alloc(64, sizeof(Vec4) * COUNT);
+  Aabb* boxes = malloc(sizeof(Aabb) * COUNT);
+  u8* visible_reference = malloc(COUNT);
+  u8* visible = malloc(COUNT);
+
+  for (u32 i = 0; i < COUNT; i++)
+  {
+    for (u32 j = 0; j < 16; j++)
+    {
+      a[i].data[j] = random_f32(-2.0f, 2.0f);
+      b[i].data[j] = random_f32(-2.0f, 2.0f);
+    }
+    points[i] = vec3_create(random_f32(-50, 50), random_f32(-50, 50), random_f32(-50, 50));
+    spheres[i] = vec4_create(random_f32(-50, 50), random_f32(-50, 50), random_f32(-50, 50), random_f32(0.1f, 3.0f));
+    Vec3 half = vec3_create(random_f32(0.1f, 3.0f), random_f32(0.1f, 3.0f), random_f32(0.1f, 3.0f));
+    boxes[i].min = vec3_sub(points[i], half);
+    boxes[i].max = vec3_add(points[i], half);
+  }
+
+  Mat4 view = mat4_look_at(vec3_create(0, 0, 30), vec3_create(0, 0, 0), vec3_create(0, 1, 0));
+  Mat4 projection = mat4_perspective(V_PI / 3.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+  Mat4 view_proj = mat4_mul(&projection, &view);
+  Frustum frustum = frustum_from_mat4(&view_proj);
+
+  SimdLevel best = vmath_simd_level();
+  printf("%u items, %u iterations, best level %s\n", COUNT, ITERATIONS, vmath_simd_level_name(best));
+  if (!check_alignment(a, b, points, spheres, best)) failures++;
+
+  #define BENCH(name, reference_call, call, check) \
+    { \
+      f64 start = now(); \
+      for (u32 it = 0; it < ITERATIONS; it++) { reference_call; } \
+      f64 scalar_seconds = now() - start; \
+      report(name, SIMD_LEVEL_SCALAR, scalar_seconds, scalar_seconds, true); \
+      for (i32 level = SIMD_LEVEL_SSE; level <= (i32)best; level++) \
+      { \
+        vmath_set_simd_level(level); \
+        start = now(); \
+        for (u32 it = 0; it < ITERATIONS; it++) { call; } \
+        report(name, level, now() - start, scalar_seconds, check); \
+      } \
+      vmath_set_simd_level(best); \
+    }
+
+  BENCH("mat4_mul_batch",
+    mat4_mul_batch_scalar(a, b, reference, COUNT),
+    mat4_mul_batch(a, b, out, COUNT),
+    nearly_equal(reference->data, out->data, COUNT * 16));
+
+  BENCH("mat4_mul_batch_left",
+    mat4_mul_batch_left_scalar(&view_proj, b, reference, COUNT),
+    mat4_mul_batch_left(&view_proj, b, out, COUNT),
+    nearly_equal(reference->data, out->data, COUNT * 16));
+
+  Vec4* transformed = (Vec4*)out;
+  Vec4* transformed_reference = (Vec4*)reference;
+  BENCH("mat4_transform_points",
+    mat4_transform_points_scalar(&view_proj, points, transformed_reference, COUNT),
+    mat4_transform_points(&view_proj, points, transformed, COUNT),
+    nearly_equal(transformed_reference->elements, transformed->elements, COUNT * 4));
+
+  u32 visible_count = 0;
+  u32 reference_count = 0;
+  BENCH("frustum_cull_spheres",
+    reference_count = frustum_cull_spheres_scalar(&frustum, spheres, visible_reference, COUNT),
+    visible_count = frustum_cull_spheres(&frustum, spheres, visible, COUNT),
+    visible_count == reference_count && memcmp(visible, visible_reference, COUNT) == 0);
+  printf("  %u of %u spheres visible\n", reference_count, COUNT);
+
+  BENCH("frustum_cull_aabbs",
+    reference_count = frustum_cull_aabbs_scalar(&frustum, boxes, visible_reference, COUNT),
+    visible_count = frustum_cull_aabbs(&frustum, boxes, visible, COUNT),
+    visible_count == reference_count && memcmp(visible, visible_reference, COUNT) == 0);
+  printf("  %u of %u boxes visible\n", reference_count, COUNT);
+  #undef BENCH
+
+  free(a);
+  free(b);
+  free(reference);
+  free(out);
+  free(points);
+  free(spheres);
+  free(boxes);
+  free(visible_reference);
+  free(visible);
+
+  if (failures) {
+    printf("%u kernels disagree with the scalar reference\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,606 @@
+// Converts a Wavefront OBJ into the packed binary mesh format of renderer/mesh_format.h.
+//
+//   mesh_cooker input.obj output.mesh
+//
+// Vertices are deduplicated, triangles are reordered for the post-transform vertex cache and
+// for overdraw (Tipsify, Sander et al. 2007), vertices are reordered by first use for fetch
+// locality and attributes are quantized to snorm16 positions, snorm8 normals and half uvs.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "defines.h"
+#include "renderer/mesh_format.h"
+
+// Common post-transform cache sizes are 16 to 32 entries, optimize for the small end
+#define CACHE_SIZE 16
+
+typedef struct Vertex {
+  f32 position[3];
+  f32 normal[3];
+  f32 uv[2];
+} Vertex;
+
+typedef struct Mesh {
+  Vertex* vertices;
+  u32 vertex_count;
+  u32* indices;
+  u32 index_count;
+} Mesh;
+
+typedef struct FloatArray {
+  f32* data;
+  u32 count;
+  u32 capacity;
+} FloatArray;
+
+static void float_array_push(FloatArray* array, f32 value) {
+  if (array->count == array->capacity) {
+    array->capacity = array->capacity ? array->capacity * 2 : 256;
+    array->data = realloc(array->data, sizeof(f32) * array->capacity);
+  }
+  array->data[array->count++] = value;
+}
+
+// ---------------------------------------------------------------------------------------------
+// OBJ loading with vertex deduplication
+// ---------------------------------------------------------------------------------------------
+
+typedef struct VertexKey {
+  i32 position;
+  i32 uv;
+  i32 normal;
+} VertexKey;
+
+typedef struct VertexMap {
+  VertexKey* keys;
+  u32* values;
+  u32 capacity;  // Power of two
+  u32 count;
+} VertexMap;
+
+static u32 hash_key(VertexKey key) {
+  u32 h = (u32)key.position * 73856093u;
+  h ^= (u32)key.uv * 19349663u;
+  h ^= (u32)key.normal * 83492791u;
+  return h;
+}
+
+static void vertex_map_grow(VertexMap* map);
+
+static u32* vertex_map_find_or_insert(VertexMap* map, VertexKey key, b8* inserted) {
+  if ((map->count + 1) * 2 > map->capacity) vertex_map_grow(map);
+
+  u32 slot = hash_key(key) & (map->capacity - 1);
+  for (;;)
+  {
+    VertexKey* k = &map->keys[slot];
+    if (k->position == 0) {
+      *k = key;
+      map->count++;
+      *inserted = true;
+      return &map->values[slot];
+    }
+    if (k->position == key.position && k->uv == key.uv && k->normal == key.normal) {
+      *inserted = false;
+      return &map->values[slot];
+    }
+    slot = (slot + 1) & (map->capacity - 1);
+  }
+}
+
+static void vertex_map_grow(VertexMap* map) {
+  VertexMap grown = {0};
+  grown.capacity = map->capacity ? map->capacity * 2 : 1024;
+  grown.keys = calloc(grown.capacity, sizeof(VertexKey));
+  grown.values = calloc(grown.capacity, sizeof(u32));
+
+  for (u32 i = 0; i < map->capacity; i++)
+  {
+    if (map->keys[i].position == 0) continue;
+    b8 inserted;
+    *vertex_map_find_or_insert(&grown, map->keys[i], &inserted) = map->values[i];
+  }
+
+  free(map->keys);
+  free(map->values);
+  *map = grown;
+}
+
+// Resolves an OBJ index, 1 based or negative relative to the end, to a 1 based index. 0 means absent.
+static i32 resolve_index(i32 index, u32 count) {
+  if (index < 0) return (i32)count + index + 1;
+  return index;
+}
+
+static b8 parse_face_vertex(const char* token, u32 position_count, u32 uv_count, u32 normal_count, VertexKey* key) {
+  i32 p = 0, t = 0, n = 0;
+  if (sscanf(token, "%d/%d/%d", &p, &t, &n) == 3) {
+  } else if (sscanf(token, "%d//%d", &p, &n) == 2) {
+  } else if (sscanf(token, "%d/%d", &p, &t) == 2) {
+  } else if (sscanf(token, "%d", &p) != 1) {
+    return false;
+  }
+
+  key->position = resolve_index(p, position_count);
+  key->uv = t ? resolve_index(t, uv_count) : 0;
+  key->normal = n ? resolve_index(n, normal_count) : 0;
+  return key->position > 0 && key->position <= (i32)position_count &&
+    key->uv <= (i32)uv_count && key->normal <= (i32)normal_count;
+}
+
+static b8 load_obj(const char* path, Mesh* mesh, u32* face_corner_count) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    printf("Failed to open %s\n", path);
+    return false;
+  }
+
+  FloatArray positions = {0}, normals = {0}, uvs = {0};
+  VertexMap map = {0};
+  u32 vertex_capacity = 0, index_capacity = 0;
+  memset(mesh, 0, sizeof(Mesh));
+  *face_corner_count = 0;
+
+  char line[1024];
+  u32 line_number = 0;
+  while (fgets(line, sizeof(line), file))
+  {
+    line_number++;
+    f32 x, y, z;
+    if (sscanf(line, "v %f %f %f", &x, &y, &z) == 3) {
+      float_array_push(&positions, x);
+      float_array_push(&positions, y);
+      float_array_push(&positions, z);
+    } else if (sscanf(line, "vn %f %f %f", &x, &y, &z) == 3) {
+      float_array_push(&normals, x);
+      float_array_push(&normals, y);
+      float_array_push(&normals, z);
+    } else if (sscanf(line, "vt %f %f", &x, &y) == 2) {
+      float_array_push(&uvs, x);
+      float_array_push(&uvs, y);
+    } else if (line[0] == 'f' && line[1] == ' ') {
+      u32 corners[64];
+      u32 corner_count = 0;
+
+      for (char* token = strtok(line + 2, " \t\r\n"); token && corner_count < 64; token = strtok(0, " \t\r\n"))
+      {
+        VertexKey key;
+        if (!parse_face_vertex(token, positions.count / 3, uvs.count / 2, normals.count / 3, &key)) {
+          printf("%s:%u: invalid face vertex '%s'\n", path, line_number, token);
+          fclose(file);
+          return false;
+        }
+
+        b8 inserted;
+        u32* index = vertex_map_find_or_insert(&map, key, &inserted);
+        if (inserted) {
+          if (mesh->vertex_count == vertex_capacity) {
+            vertex_capacity = vertex_capacity ? vertex_capacity * 2 : 1024;
+            mesh->vertices = realloc(mesh->vertices, sizeof(Vertex) * vertex_capacity);
+          }
+          Vertex* v = &mesh->vertices[mesh->vertex_count];
+          memset(v, 0, sizeof(Vertex));
+          memcpy(v->position, &positions.data[(key.position - 1) * 3], sizeof(f32) * 3);
+          if (key.normal) memcpy(v->normal, &normals.data[(key.normal - 1) * 3], sizeof(f32) * 3);
+          if (key.uv) memcpy(v->uv, &uvs.data[(key.uv - 1) * 2], sizeof(f32) * 2);
+          *index = mesh->vertex_count++;
+        }
+        corners[corner_count++] = *index;
+      }
+
+      // Fan triangulation of convex polygons
+      for (u32 c = 2; c < corner_count; c++)
+      {
+        if (mesh->index_count + 3 > index_capacity) {
+          index_capacity = index_capacity ? index_capacity * 2 : 3072;
+          mesh->indices = realloc(mesh->indices, sizeof(u32) * index_capacity);
+        }
+        mesh->indices[mesh->index_count++] = corners[0];
+        mesh->indices[mesh->index_count++] = corners[c - 1];
+        mesh->indices[mesh->index_count++] = corners[c];
+        *face_corner_count += 3;
+      }
+    }
+  }
+
+  fclose(file);
+  free(positions.data);
+  free(normals.data);
+  free(uvs.data);
+  free(map.keys);
+  free(map.values);
+
+  if (mesh->index_count == 0) {
+    printf("%s has no faces\n", path);
+    return false;
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Analysis
+// ---------------------------------------------------------------------------------------------
+
+// Vertex shader invocations of an index buffer on a FIFO post-transform cache.
+static u32 simulate_fifo_cache(const u32* indices, u32 index_count, u32 vertex_count, u32 cache_size) {
+  u32* timestamps = calloc(vertex_count, sizeof(u32));
+  u32 time = cache_size + 1;
+  u32 misses = 0;
+
+  for (u32 i = 0; i < index_count; i++)
+  {
+    u32 v = indices[i];
+    if (time - timestamps[v] > cache_size) {
+      timestamps[v] = time++;
+      misses++;
+    }
+  }
+
+  free(timestamps);
+  return misses;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Tipsify: vertex cache and overdraw ordering
+// ---------------------------------------------------------------------------------------------
+
+typedef struct Adjacency {
+  u32* offsets;    // vertex_count + 1
+  u32* triangles;  // index_count
+} Adjacency;
+
+static void build_adjacency(const Mesh* mesh, Adjacency* adjacency, u32* live) {
+  adjacency->offsets = calloc(mesh->vertex_count + 1, sizeof(u32));
+  adjacency->triangles = malloc(sizeof(u32) * mesh->index_count);
+
+  for (u32 i = 0; i < mesh->index_count; i++)
+  {
+    live[mesh->indices[i]]++;
+  }
+  for (u32 v = 0; v < mesh->vertex_count; v++)
+  {
+    adjacency->offsets[v + 1] = adjacency->offsets[v] + live[v];
+  }
+
+  u32* cursor = malloc(sizeof(u32) * mesh->vertex_count);
+  memcpy(cursor, adjacency->offsets, sizeof(u32) * mesh->vertex_count);
+  for (u32 i = 0; i < mesh->index_count; i++)
+  {
+    adjacency->triangles[cursor[mesh->indices[i]]++] = i / 3;
+  }
+  free(cursor);
+}
+
+typedef struct Cluster {
+  u32 first_triangle;
+  u32 triangle_count;
+  f32 sort_key;
+} Cluster;
+
+static int compare_clusters(const void* a, const void* b) {
+  f32 ka = ((const Cluster*)a)->sort_key;
+  f32 kb = ((const Cluster*)b)->sort_key;
+  return ka < kb ? 1 : (ka > kb ? -1 : 0);
+}
+
+static void optimize_triangles(Mesh* mesh) {
+  u32 triangle_count = mesh->index_count / 3;
+  u32 vertex_count = mesh->vertex_count;
+
+  u32* live = calloc(vertex_count, sizeof(u32));
+  Adjacency adjacency;
+  build_adjacency(mesh, &adjacency, live);
+
+  u32* cache_time = calloc(vertex_count, sizeof(u32));
+  u8* emitted = calloc(triangle_count, 1);
+  u32* dead_end = malloc(sizeof(u32) * mesh->index_count);
+  u32 dead_end_count = 0;
+  u32* candidates = malloc(sizeof(u32) * mesh->index_count);
+  u32* output = malloc(sizeof(u32) * triangle_count);
+  u32 output_count = 0;
+
+  // A new cluster starts every time the fanning vertex is not found in the cache
+  Cluster* clusters = malloc(sizeof(Cluster) * triangle_count);
+  u32 cluster_count = 0;
+
+  u32 time = CACHE_SIZE + 1;
+  u32 cursor = 0;
+  i32 fanning = 0;
+  b8 cache_flush = true;
+
+  while (fanning >= 0)
+  {
+    if (cache_flush) {
+      clusters[cluster_count].first_triangle = output_count;
+      clusters[cluster_count].triangle_count = 0;
+      cluster_count++;
+    }
+
+    u32 candidate_count = 0;
+    for (u32 a = adjacency.offsets[fanning]; a < adjacency.offsets[fanning + 1]; a++)
+    {
+      u32 t = adjacency.triangles[a];
+      if (emitted[t]) continue;
+
+      for (u32 c = 0; c < 3; c++)
+      {
+        u32 v = mesh->indices[t * 3 + c];
+        dead_end[dead_end_count++] = v;
+        candidates[candidate_count++] = v;
+        live[v]--;
+        if (time - cache_time[v] > CACHE_SIZE) {
+          cache_time[v] = time++;
+        }
+      }
+      emitted[t] = 1;
+      output[output_count++] = t;
+      clusters[cluster_count - 1].triangle_count++;
+    }
+
+    // Pick the candidate that will still be in the cache after its remaining triangles
+    // are emitted, preferring the oldest one.
+    i32 best = -1;
+    i32 best_priority = -1;
+    for (u32 c = 0; c < candidate_count; c++)
+    {
+      u32 v = candidates[c];
+      if (live[v] == 0) continue;
+      i32 priority = 0;
+      if (time - cache_time[v] + 2 * live[v] <= CACHE_SIZE) {
+        priority = time - cache_time[v];
+      }
+      if (priority > best_priority) {
+        best_priority = priority;
+        best = v;
+      }
+    }
+
+    cache_flush = false;
+    if (best < 0) {
+      // Dead end, backtrack through recently used vertices and then scan the input
+      while (dead_end_count > 0 && best < 0) {
+        u32 v = dead_end[--dead_end_count];
+        if (live[v] > 0) best = v;
+      }
+      while (best < 0 && cursor < vertex_count) {
+        if (live[cursor] > 0) best = cursor;
+        cursor++;
+      }
+      cache_flush = best >= 0 && time - cache_time[best] > CACHE_SIZE;
+    }
+    fanning = best;
+  }
+
+  // Overdraw: clusters whose triangles face away from the mesh center are drawn first as
+  // they are the most likely to occlude the rest (Sander et al., linear-speed ordering).
+  f32 mesh_center[3] = {0};
+  for (u32 v = 0; v < vertex_count; v++)
+  {
+    for (u32 k = 0; k < 3; k++) mesh_center[k] += mesh->vertices[v].position[k] / vertex_count;
+  }
+
+  for (u32 c = 0; c < cluster_count; c++)
+  {
+    f32 centroid[3] = {0};
+    f32 normal[3] = {0};
+    f32 area = 0.0f;
+    for (u32 t = clusters[c].first_triangle; t < clusters[c].first_triangle + clusters[c].triangle_count; t++)
+    {
+      const f32* p0 = mesh->vertices[mesh->indices[output[t] * 3 + 0]].position;
+      const f32* p1 = mesh->vertices[mesh->indices[output[t] * 3 + 1]].position;
+      const f32* p2 = mesh->vertices[mesh->indices[output[t] * 3 + 2]].position;
+      f32 e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      f32 e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      f32 n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+      f32 a = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for (u32 k = 0; k < 3; k++)
+      {
+        centroid[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * a;
+        normal[k] += n[k];
+      }
+      area += a;
+    }
+
+    f32 key = 0.0f;
+    if (area > 0.0f) {
+      for (u32 k = 0; k < 3; k++) key += (centroid[k] / area - mesh_center[k]) * normal[k];
+      key /= area;
+    }
+    clusters[c].sort_key = key;
+  }
+
+  // qsort is not stable, break ties with the original cluster order through the key
+  for (u32 c = 0; c < cluster_count; c++)
+  {
+    clusters[c].sort_key -= (f32)c * 1e-9f;
+  }
+  qsort(clusters, cluster_count, sizeof(Cluster), compare_clusters);
+
+  u32* indices = malloc(sizeof(u32) * mesh->index_count);
+  u32 written = 0;
+  for (u32 c = 0; c < cluster_count; c++)
+  {
+    for (u32 t = clusters[c].first_triangle; t < clusters[c].first_triangle + clusters[c].triangle_count; t++)
+    {
+      memcpy(&indices[written], &mesh->indices[output[t] * 3], sizeof(u32) * 3);
+      written += 3;
+    }
+  }
+
+  free(mesh->indices);
+  mesh->indices = indices;
+
+  printf("  %u overdraw clusters\n", cluster_count);
+
+  free(live);
+  free(adjacency.offsets);
+  free(adjacency.triangles);
+  free(cache_time);
+  free(emitted);
+  free(dead_end);
+  free(candidates);
+  free(output);
+  free(clusters);
+}
+
+// Renumbers vertices in the order the index buffer first references them.
+static void optimize_vertex_fetch(Mesh* mesh) {
+  u32* remap = malloc(sizeof(u32) * mesh->vertex_count);
+  memset(remap, 0xFF, sizeof(u32) * mesh->vertex_count);
+  Vertex* vertices = malloc(sizeof(Vertex) * mesh->vertex_count);
+  u32 next = 0;
+
+  for (u32 i = 0; i < mesh->index_count; i++)
+  {
+    u32 v = mesh->indices[i];
+    if (remap[v] == 0xFFFFFFFF) {
+      remap[v] = next;
+      vertices[next++] = mesh->vertices[v];
+    }
+    mesh->indices[i] = remap[v];
+  }
+
+  // Unreferenced vertices are dropped
+  free(mesh->vertices);
+  mesh->vertices = vertices;
+  mesh->vertex_count = next;
+  free(remap);
+}
+
+// ---------------------------------------------------------------------------------------------
+// Quantization
+// ---------------------------------------------------------------------------------------------
+
+static i16 quantize_snorm16(f32 v) {
+  if (v > 1.0f) v = 1.0f;
+  if (v < -1.0f) v = -1.0f;
+  return (i16)lrintf(v * 32767.0f);
+}
+
+static i8 quantize_snorm8(f32 v) {
+  if (v > 1.0f) v = 1.0f;
+  if (v < -1.0f) v = -1.0f;
+  return (i8)lrintf(v * 127.0f);
+}
+
+static u16 quantize_half(f32 v) {
+  union { f32 f; u32 u; } bits = {v};
+  u32 sign = (bits.u >> 16) & 0x8000;
+  i32 exponent = (i32)((bits.u >> 23) & 0xFF) - 127 + 15;
+  u32 mantissa = bits.u & 0x7FFFFF;
+
+  if (exponent >= 31) return sign | 0x7C00;  // Overflow to infinity, uvs never get there
+  if (exponent <= 0) {
+    if (exponent < -10) return sign;
+    mantissa |= 0x800000;
+    u32 shift = 14 - exponent;
+    u32 half = mantissa >> shift;
+    if ((mantissa >> (shift - 1)) & 1) half++;
+    return sign | half;
+  }
+
+  u32 half = sign | (exponent << 10) | (mantissa >> 13);
+  if (mantissa & 0x1000) half++;  // Round, a carry correctly moves into the exponent
+  return half;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    printf("usage: %s input.obj output.mesh\n", argv[0]);
+    return 1;
+  }
+
+  Mesh mesh;
+  u32 face_corners;
+  if (!load_obj(argv[1], &mesh, &face_corners)) {
+    return 1;
+  }
+
+  u32 triangle_count = mesh.index_count / 3;
+  u32 unoptimized = simulate_fifo_cache(mesh.indices, mesh.index_count, mesh.vertex_count, CACHE_SIZE);
+  printf("%s: %u triangles, %u unique vertices\n", argv[1], triangle_count, mesh.vertex_count);
+
+  optimize_triangles(&mesh);
+  optimize_vertex_fetch(&mesh);
+
+  u32 optimized = simulate_fifo_cache(mesh.indices, mesh.index_count, mesh.vertex_count, CACHE_SIZE);
+
+  MeshFileHeader header = {0};
+  header.magic = MESH_FILE_MAGIC;
+  header.version = MESH_FILE_VERSION;
+  header.vertex_count = mesh.vertex_count;
+  header.index_count = mesh.index_count;
+  header.index_size = mesh.vertex_count <= 0xFFFF ? 2 : 4;
+  header.vertex_stride = sizeof(PackedVertex);
+
+  f32 min[3] = {INFINITY, INFINITY, INFINITY};
+  f32 max[3] = {-INFINITY, -INFINITY, -INFINITY};
+  for (u32 v = 0; v < mesh.vertex_count; v++)
+  {
+    for (u32 k = 0; k < 3; k++)
+    {
+      if (mesh.vertices[v].position[k] < min[k]) min[k] = mesh.vertices[v].position[k];
+      if (mesh.vertices[v].position[k] > max[k]) max[k] = mesh.vertices[v].position[k];
+    }
+  }
+  for (u32 k = 0; k < 3; k++)
+  {
+    header.center[k] = (min[k] + max[k]) * 0.5f;
+    header.extent[k] = (max[k] - min[k]) * 0.5f;
+    if (header.extent[k] <= 0.0f) header.extent[k] = 1.0f;
+  }
+
+  PackedVertex* packed = malloc(sizeof(PackedVertex) * mesh.vertex_count);
+  f32 max_error = 0.0f;
+  for (u32 v = 0; v < mesh.vertex_count; v++)
+  {
+    Vertex* src = &mesh.vertices[v];
+    for (u32 k = 0; k < 3; k++)
+    {
+      packed[v].position[k] = quantize_snorm16((src->position[k] - header.center[k]) / header.extent[k]);
+      f32 error = fabsf(packed[v].position[k] / 32767.0f * header.extent[k] + header.center[k] - src->position[k]);
+      if (error > max_error) max_error = error;
+      packed[v].normal[k] = quantize_snorm8(src->normal[k]);
+    }
+    packed[v].position[3] = 0;
+    packed[v].normal[3] = 0;
+    packed[v].uv[0] = quantize_half(src->uv[0]);
+    packed[v].uv[1] = quantize_half(src->uv[1]);
+  }
+
+  FILE* file = fopen(argv[2], "wb");
+  if (!file) {
+    printf("Failed to open %s for writing\n", argv[2]);
+    return 1;
+  }
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(packed, sizeof(PackedVertex), mesh.vertex_count, file);
+  if (header.index_size == 2) {
+    for (u32 i = 0; i < mesh.index_count; i++)
+    {
+      u16 index = (u16)mesh.indices[i];
+      fwrite(&index, sizeof(u16), 1, file);
+    }
+  } else {
+    fwrite(mesh.indices, sizeof(u32), mesh.index_count, file);
+  }
+  fclose(file);
+
+  u64 soup_bytes = (u64)face_corners * sizeof(Vertex);
+  u64 float_bytes = (u64)mesh.vertex_count * sizeof(Vertex) + (u64)mesh.index_count * sizeof(u32);
+  u64 packed_bytes = (u64)mesh.vertex_count * sizeof(PackedVertex) + (u64)mesh.index_count * header.index_size;
+
+  printf("  vertex shader invocations (FIFO %u): unindexed %u, as authored %u (ACMR %.3f), optimized %u (ACMR %.3f, ATVR %.3f)\n",
+    CACHE_SIZE, face_corners, unoptimized, (f32)unoptimized / triangle_count,
+    optimized, (f32)optimized / triangle_count, (f32)optimized / mesh.vertex_count);
+  printf("  memory: unindexed float %llu bytes, indexed float %llu bytes, packed %llu bytes (%.1f%% of indexed)\n",
+    soup_bytes, float_bytes, packed_bytes, 100.0 * packed_bytes / float_bytes);
+  printf("  max position quantization error %f\n", max_error);
+  printf("  wrote %s\n", argv[2]);
+
+  free(packed);
+  free(mesh.vertices);
+  free(mesh.indices);
+  return 0;
+}
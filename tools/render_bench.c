@@ -0,0 +1,220 @@
+// Runs the renderer headless through a list of scenarios and collects the frame statistics each
+// run writes with VKG_STATS_JSON into one JSON file. With a baseline from an earlier run, prints
+// the change of every metric and exits with 1 when one got slower by more than the threshold.
+//
+// render_bench [--app bin/app] [--frames N] [--warmup N] [--out results.json] [--baseline file.json]
+//   [--threshold 0.1] [--scenario name] [--verbose]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "defines.h"
+
+#define MAX_SETTINGS 6
+#define LINE_SIZE 4096
+
+typedef struct Scenario {
+  const char* name;
+  const char* settings[MAX_SETTINGS]; // VKG_ variables on top of the common ones
+} Scenario;
+
+// Every scenario changes one thing from the default scene at 800x600, 3 frames in flight
+static const Scenario scenarios[] = {
+  {"default", {0}},
+  {"draws_1k", {"VKG_DRAWS=1000"}},
+  {"draws_10k", {"VKG_DRAWS=10000"}},
+  {"pipelines_8", {"VKG_DRAWS=1000", "VKG_PIPELINES=8"}},
+  {"res_720p", {"VKG_WIDTH=1280", "VKG_HEIGHT=720"}},
+  {"res_1080p", {"VKG_WIDTH=1920", "VKG_HEIGHT=1080"}},
+  {"frames_in_flight_1", {"VKG_FRAMES_IN_FLIGHT=1"}},
+  {"frames_in_flight_2", {"VKG_FRAMES_IN_FLIGHT=2"}},
+};
+#define SCENARIO_COUNT (sizeof(scenarios) / sizeof(scenarios[0]))
+
+// Metrics compared against the baseline, all of them lower is better
+static const char* metrics[] = {"frame_ms", "frame_ms_p99", "cpu_ms", "cpu_ms_p99", "gpu_ms", "buffer_peak_bytes",
+  "render_graph_bytes", "first_frame_ms", "evictions", "reloads"};
+#define METRIC_COUNT (sizeof(metrics) / sizeof(metrics[0]))
+
+typedef struct Options {
+  const char* app;
+  u32 frames;
+  u32 warmup;
+  const char* out;
+  const char* baseline;
+  f64 threshold;
+  const char* only;
+  b8 verbose;
+} Options;
+
+// Runs the app with the scenario on top of the environment, its output goes to /dev/null
+static b8 run_scenario(const Options* options, const Scenario* scenario, const char* stats_path) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    printf("fork failed\n");
+    return false;
+  }
+
+  if (pid == 0) {
+    char frames[32], warmup[32];
+    snprintf(frames, sizeof(frames), "%u", options->frames + options->warmup);
+    snprintf(warmup, sizeof(warmup), "%u", options->warmup);
+    setenv("VKG_HEADLESS", "1", 1);
+    setenv("VKG_FRAMES", frames, 1);
+    setenv("VKG_WARMUP_FRAMES", warmup, 1);
+    setenv("VKG_STATS_JSON", stats_path, 1);
+    // Background compiles would make the first frames of every run depend on thread timing
+    setenv("VKG_PIPELINE_ASYNC", "0", 0);
+    setenv("VKG_PIPELINE_OPTIMIZE", "0", 0);
+    for (u32 i = 0; i < MAX_SETTINGS && scenario->settings[i]; i++)
+    {
+      putenv((char*)scenario->settings[i]);
+    }
+
+    if (!options->verbose) {
+      int null = open("/dev/null", O_WRONLY);
+      dup2(null, STDOUT_FILENO);
+      close(null);
+    }
+    execl(options->app, options->app, (char*)NULL);
+    _exit(127);
+  }
+
+  int status = 0;
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    printf("%-20s FAILED (status %d)\n", scenario->name, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    return false;
+  }
+  return true;
+}
+
+static b8 read_line(const char* path, char* line) {
+  FILE* file = fopen(path, "r");
+  if (!file) return false;
+  b8 result = fgets(line, LINE_SIZE, file) != NULL;
+  fclose(file);
+  line[strcspn(line, "\n")] = 0;
+  return result;
+}
+
+// Finds "key": number in a line written by this tool or the app, which never nest the keys
+static b8 find_number(const char* line, const char* key, f64* out_value) {
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+  const char* found = strstr(line, pattern);
+  if (!found) return false;
+  *out_value = strtod(found + strlen(pattern), NULL);
+  return true;
+}
+
+// The line of a scenario in a results file
+static b8 find_scenario(FILE* file, const char* name, char* line) {
+  char pattern[96];
+  snprintf(pattern, sizeof(pattern), "{\"scenario\": \"%s\",", name);
+  rewind(file);
+  while (fgets(line, LINE_SIZE, file))
+  {
+    if (strstr(line, pattern)) return true;
+  }
+  return false;
+}
+
+// Prints the change of every metric, returns the number of regressions
+static u32 compare(const Options* options, FILE* baseline, const char* name, const char* line) {
+  char baseline_line[LINE_SIZE];
+  if (!find_scenario(baseline, name, baseline_line)) {
+    printf("  not in the baseline\n");
+    return 0;
+  }
+
+  u32 regressions = 0;
+  for (u32 m = 0; m < METRIC_COUNT; m++)
+  {
+    f64 before, after;
+    if (!find_number(baseline_line, metrics[m], &before) || !find_number(line, metrics[m], &after)) continue;
+    f64 change = before > 0.0 ? (after - before) / before : 0.0;
+    b8 regressed = change > options->threshold;
+    regressions += regressed;
+    printf("  %-20s %14.4f -> %14.4f  %+7.1f%%%s\n", metrics[m], before, after, change * 100.0,
+      regressed ? "  REGRESSION" : "");
+  }
+  return regressions;
+}
+
+static b8 parse_options(int argc, char** argv, Options* options) {
+  *options = (Options){"bin/app", 300, 30, "bench.json", NULL, 0.1, NULL, false};
+  for (int i = 1; i < argc; i++)
+  {
+    b8 has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--verbose") == 0) options->verbose = true;
+    else if (strcmp(argv[i], "--app") == 0 && has_value) options->app = argv[++i];
+    else if (strcmp(argv[i], "--frames") == 0 && has_value) options->frames = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--warmup") == 0 && has_value) options->warmup = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--out") == 0 && has_value) options->out = argv[++i];
+    else if (strcmp(argv[i], "--baseline") == 0 && has_value) options->baseline = argv[++i];
+    else if (strcmp(argv[i], "--threshold") == 0 && has_value) options->threshold = atof(argv[++i]);
+    else if (strcmp(argv[i], "--scenario") == 0 && has_value) options->only = argv[++i];
+    else {
+      printf("Unknown option %s\n", argv[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parse_options(argc, argv, &options)) return 2;
+
+  FILE* baseline = options.baseline ? fopen(options.baseline, "r") : NULL;
+  if (options.baseline && !baseline) {
+    printf("No baseline at %s, nothing to compare against\n", options.baseline);
+  }
+
+  FILE* out = fopen(options.out, "w");
+  if (!out) {
+    printf("Failed to open %s for writing\n", options.out);
+    return 2;
+  }
+  // One scenario per line, so the comparison can find them without a JSON parser
+  fprintf(out, "{\"frames\": %u, \"warmup\": %u, \"scenarios\": [\n", options.frames, options.warmup);
+
+  char stats_path[256];
+  snprintf(stats_path, sizeof(stats_path), "%s.run", options.out);
+  u32 failures = 0;
+  u32 regressions = 0;
+  u32 written = 0;
+  for (u32 s = 0; s < SCENARIO_COUNT; s++)
+  {
+    const Scenario* scenario = &scenarios[s];
+    if (options.only && strcmp(options.only, scenario->name) != 0) continue;
+
+    char line[LINE_SIZE];
+    remove(stats_path);
+    if (!run_scenario(&options, scenario, stats_path) || !read_line(stats_path, line) || line[0] != '{') {
+      failures++;
+      continue;
+    }
+
+    f64 frame_ms = 0.0, cpu_ms = 0.0, gpu_ms = 0.0;
+    find_number(line, "frame_ms", &frame_ms);
+    find_number(line, "cpu_ms", &cpu_ms);
+    find_number(line, "gpu_ms", &gpu_ms);
+    printf("%-20s frame %8.3f ms | cpu %8.3f ms | gpu %8.3f ms\n", scenario->name, frame_ms, cpu_ms, gpu_ms);
+
+    fprintf(out, "%s{\"scenario\": \"%s\", %s", written ? ",\n" : "", scenario->name, line + 1);
+    written++;
+    if (baseline) regressions += compare(&options, baseline, scenario->name, line);
+  }
+  fprintf(out, "\n]}\n");
+  fclose(out);
+  remove(stats_path);
+  if (baseline) fclose(baseline);
+
+  printf("%u scenarios written to %s, %u failed", written, options.out, failures);
+  if (baseline) printf(", %u regressions over %.0f%%", regressions, options.threshold * 100.0);
+  printf("\n");
+  return failures || regressions ? 1 : 0;
+}
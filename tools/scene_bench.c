@@ -0,0 +1,114 @@
+// Measures scene_update on synthetic hierarchies of 10k, 100k and 1M nodes.
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "defines.h"
+#include "core/jobs.h"
+#include "scene/scene.h"
+#include "core/vmath.h"
+
+#define FRAMES_IN_FLIGHT 3
+#define ITERATIONS 20
+
+static f64 now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 0.000000001;
+}
+
+// Random forest of 64 roots, parents are always picked among nodes that already exist.
+static void build_scene(Scene* scene, u32 count, u32* roots, u32* root_count) {
+  *root_count = 0;
+  for (u32 i = 0; i < count; i++)
+  {
+    u32 parent = SCENE_INVALID_NODE;
+    if (i >= 64) {
+      parent = i / 8 + (u32)rand() % (i / 8);
+    }
+    u32 node = scene_add_node(scene, parent);
+    if (parent == SCENE_INVALID_NODE) roots[(*root_count)++] = node;
+
+    scene_set_position(scene, node, vec3_create((f32)(rand() % 100) * 0.01f, 0.0f, 1.0f));
+    f32 angle = (f32)(rand() % 628) * 0.01f;
+    scene_set_rotation(scene, node, quat_from_axis_angle(vec3_create(0.0f, 0.0f, 1.0f), angle));
+  }
+}
+
+static f64 time_updates(Scene* scene, Mat4* instances, u32 dirty_every) {
+  f64 total = 0;
+  for (u32 it = 0; it < ITERATIONS; it++)
+  {
+    // Touch a subset of nodes to mimic moving objects
+    if (dirty_every) {
+      for (u32 n = it % dirty_every; n < scene->count; n += dirty_every)
+      {
+        scene_set_position(scene, n, vec3_create((f32)it, 0.0f, 0.0f));
+      }
+    }
+    f64 start = now();
+    scene_update(scene, instances + (u64)(it % FRAMES_IN_FLIGHT) * scene->count, scene->count);
+    total += now() - start;
+  }
+  return total / ITERATIONS * 1000.0;
+}
+
+static void run(u32 count, b8 parallel) {
+  Scene scene;
+  if (!scene_create(count, FRAMES_IN_FLIGHT, &scene)) return;
+
+  u32* roots = malloc(sizeof(u32) * 64);
+  u32 root_count = 0;
+  build_scene(&scene, count, roots, &root_count);
+
+  Mat4* instances = malloc(sizeof(Mat4) * (u64)count * FRAMES_IN_FLIGHT);
+
+  f64 start = now();
+  scene_update(&scene, instances, count);
+  f64 first = (now() - start) * 1000.0;
+
+  f64 all_dirty = 0;
+  for (u32 it = 0; it < ITERATIONS; it++)
+  {
+    for (u32 r = 0; r < root_count; r++)
+    {
+      scene_set_position(&scene, roots[r], vec3_create((f32)it, 0.0f, 0.0f));
+    }
+    start = now();
+    scene_update(&scene, instances + (u64)(it % FRAMES_IN_FLIGHT) * count, count);
+    all_dirty += now() - start;
+  }
+  all_dirty = all_dirty / ITERATIONS * 1000.0;
+
+  f64 one_percent = time_updates(&scene, instances, 100);
+  // Drain pending uploads so the idle case measures a truly static scene
+  time_updates(&scene, instances, 0);
+  f64 idle = time_updates(&scene, instances, 0);
+
+  printf("%8u nodes %-8s | first %8.3f ms | all dirty %8.3f ms | 1%% dirty %8.3f ms | idle %8.4f ms | levels %u\n",
+    count, parallel ? "parallel" : "serial", first, all_dirty, one_percent, idle, scene.level_count);
+
+  free(instances);
+  free(roots);
+  scene_destroy(&scene);
+}
+
+int main() {
+  u32 counts[] = {10000, 100000, 1000000};
+
+  for (u32 i = 0; i < 3; i++)
+  {
+    srand(1234);
+    run(counts[i], false);
+  }
+
+  jobs_initialize(0);
+  printf("-- %u threads --\n", jobs_thread_count());
+  for (u32 i = 0; i < 3; i++)
+  {
+    srand(1234);
+    run(counts[i], true);
+  }
+  jobs_shutdown();
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+// Turns SPIR-V files into a C source with one u32 array per shader and the table
+// renderer/vulkan_shader.c looks shaders up in, so the app never reads them from disk.
+//
+//   spirv_embed output.c shader.spv...
+//
+// Shaders are named by their file name without directory. The arrays are u32, so the code has
+// the alignment vkCreateShaderModule requires.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defines.h"
+
+#define SPIRV_MAGIC 0x07230203
+#define WORDS_PER_LINE 8
+
+static u32* read_spirv(const char* path, u32* out_word_count) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    printf("Failed to open %s\n", path);
+    return NULL;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  if (size < 20 || size % 4 != 0) {
+    printf("%s is not SPIR-V, %ld bytes\n", path, size);
+    fclose(file);
+    return NULL;
+  }
+
+  u32* words = malloc(size);
+  b8 read = fread(words, 1, size, file) == (size_t)size;
+  fclose(file);
+  if (!read || words[0] != SPIRV_MAGIC) {
+    printf("%s is not SPIR-V\n", path);
+    free(words);
+    return NULL;
+  }
+
+  *out_word_count = (u32)(size / 4);
+  return words;
+}
+
+static const char* file_name(const char* path) {
+  const char* slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("Usage: spirv_embed output.c shader.spv...\n");
+    return 1;
+  }
+
+  FILE* out = fopen(argv[1], "w");
+  if (!out) {
+    printf("Failed to open %s for writing\n", argv[1]);
+    return 1;
+  }
+  fprintf(out, "// Generated by tools/spirv_embed.c, do not edit\n#include \"renderer/vulkan_shader.h\"\n");
+
+  u32 shader_count = argc - 2;
+  u64 total_bytes = 0;
+  for (u32 i = 0; i < shader_count; i++)
+  {
+    u32 word_count;
+    u32* words = read_spirv(argv[i + 2], &word_count);
+    if (!words) {
+      fclose(out);
+      remove(argv[1]);
+      return 1;
+    }
+
+    fprintf(out, "\nstatic const u32 shader_%u[] = {", i);
+    for (u32 w = 0; w < word_count; w++)
+    {
+      fprintf(out, "%s0x%08x,", w % WORDS_PER_LINE == 0 ? "\n  " : " ", words[w]);
+    }
+    fprintf(out, "\n};\n");
+    total_bytes += (u64)word_count * 4;
+    free(words);
+  }
+
+  fprintf(out, "\nconst EmbeddedShader embedded_shaders[] = {\n");
+  for (u32 i = 0; i < shader_count; i++)
+  {
+    fprintf(out, "  {\"%s\", shader_%u, sizeof(shader_%u)},\n", file_name(argv[i + 2]), i, i);
+  }
+  // An empty initializer is not valid C, the count keeps the placeholder out of lookups
+  if (shader_count == 0) fprintf(out, "  {0},\n");
+  fprintf(out, "};\n\nconst u32 embedded_shader_count = %u;\n", shader_count);
+  fclose(out);
+
+  printf("Embedded %u shaders, %llu bytes of SPIR-V\n", shader_count, (unsigned long long)total_bytes);
+  return 0;
+}